@@ -0,0 +1,65 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+// Unbounded multi-producer/multi-consumer queue. Callers bound it by
+// circulating a fixed number of items through it.
+template <typename T>
+class BlockingQueue
+{
+public:
+    // Returns false if the queue has been closed.
+    bool push(T item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (closed)
+                return false;
+            items.push_back(std::move(item));
+        }
+        ready.notify_one();
+        return true;
+    }
+
+    // Blocks until an item is available. Returns nullopt once the queue is
+    // closed and drained.
+    std::optional<T> pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty())
+            return std::nullopt;
+        T item = std::move(items.front());
+        items.pop_front();
+        return item;
+    }
+
+    // Returns nullopt immediately if nothing is queued.
+    std::optional<T> tryPop()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.empty())
+            return std::nullopt;
+        T item = std::move(items.front());
+        items.pop_front();
+        return item;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<T> items;
+    bool closed = false;
+};
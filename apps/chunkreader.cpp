@@ -0,0 +1,52 @@
+#include "chunkreader.h"
+
+#include <cstring>
+
+#include "csv.h"
+
+using namespace std;
+
+bool ChunkReader::next(string & chunk)
+{
+    // Swapping keeps both buffers' capacity in circulation.
+    chunk.swap(carry);
+    carry.clear();
+    size_t boundary = string::npos;
+    while (boundary == string::npos && !eof) {
+        size_t had = chunk.size();
+        chunk.resize(had + chunkSize);
+        size_t got = in.read(chunk.data() + had, chunkSize);
+        chunk.resize(had + got);
+        if (got < chunkSize)
+            eof = true;
+        if (csv) {
+            // The carry was already scanned, so the scan resumes where it left off.
+            if (size_t end = findCsvRecordsEnd(chunk, had, inQuotes))
+                boundary = end - 1;
+        } else {
+            size_t last = string_view(chunk).substr(had).rfind('\n');
+            if (last != string::npos)
+                boundary = had + last;
+        }
+    }
+    if (!eof) {
+        carry.assign(chunk, boundary + 1);
+        chunk.resize(boundary + 1);
+    }
+    return !chunk.empty();
+}
+
+void splitLines(string_view records, vector<string_view> & names)
+{
+    const char * p = records.data();
+    const char * end = p + records.size();
+    while (p < end) {
+        const char * newline = static_cast<const char *>(memchr(p, '\n', end - p));
+        const char * stop = newline ? newline : end;
+        size_t length = stop - p;
+        if (length > 0 && p[length - 1] == '\r')
+            --length;
+        names.emplace_back(p, length);
+        p = stop + 1;
+    }
+}
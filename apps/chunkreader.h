@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "inputstream.h"
+
+// Reads a stream in chunks of about chunkSize bytes that end on a record
+// boundary, so each chunk can be split and processed on its own. A record
+// longer than chunkSize makes the chunk grow to hold it. Records end at
+// newlines; with csv, only at newlines outside quoted fields.
+class ChunkReader
+{
+public:
+    ChunkReader(InputStream & in, size_t chunkSize, bool csv = false) : in(in), chunkSize(chunkSize), csv(csv) {}
+
+    // Replaces chunk with the next run of whole records, reusing its capacity.
+    // Returns false at end of input.
+    bool next(std::string & chunk);
+
+private:
+    InputStream & in;
+    size_t chunkSize;
+    bool csv;
+    bool inQuotes = false;   // csv quote state at the end of the bytes read so far
+    std::string carry;
+    bool eof = false;
+};
+
+// Splits newline-terminated records into names, dropping a trailing "\r".
+// The final record does not need a newline.
+void splitLines(std::string_view records, std::vector<std::string_view> & names);
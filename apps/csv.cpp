@@ -0,0 +1,207 @@
+#include "csv.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HELLO_HAVE_SSE2 1
+#endif
+
+using namespace std;
+
+namespace {
+
+struct BlockMasks
+{
+    uint64_t quote = 0;
+    uint64_t delimiter = 0;
+    uint64_t newline = 0;
+};
+
+// Bit i of each mask is set when p[i] is that character.
+BlockMasks classify(const char * p, char delimiter)
+{
+    BlockMasks masks;
+#ifdef HELLO_HAVE_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i separator = _mm_set1_epi8(delimiter);
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (int i = 0; i < 4; ++i) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+        auto bits = [&](__m128i match) { return uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, match)))); };
+        masks.quote |= bits(quote) << (16 * i);
+        masks.delimiter |= bits(separator) << (16 * i);
+        masks.newline |= bits(newline) << (16 * i);
+    }
+#else
+    for (int i = 0; i < 64; ++i) {
+        masks.quote |= uint64_t(p[i] == '"') << i;
+        masks.delimiter |= uint64_t(p[i] == delimiter) << i;
+        masks.newline |= uint64_t(p[i] == '\n') << i;
+    }
+#endif
+    return masks;
+}
+
+// Bit i of the result is the XOR of bits 0..i: set inside quotes, counting
+// each opening quote as inside and each closing quote as outside.
+uint64_t prefixXor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// Calls visit(base, delimiters, newlines) for each 64-byte block from from,
+// with the masks of the structural characters outside quotes.
+template <typename Visit>
+void forEachBlock(string_view data, size_t from, bool & inQuotes, char delimiter, Visit visit)
+{
+    uint64_t carry = inQuotes ? ~uint64_t(0) : 0;
+    char tail[64];
+    for (size_t base = from; base < data.size(); base += 64) {
+        const char * p = data.data() + base;
+        if (data.size() - base < 64) {
+            // Zero padding never matches: the delimiter cannot be NUL.
+            memset(tail, 0, sizeof tail);
+            memcpy(tail, p, data.size() - base);
+            p = tail;
+        }
+        BlockMasks masks = classify(p, delimiter);
+        uint64_t quoted = prefixXor(masks.quote) ^ carry;
+        carry = uint64_t(int64_t(quoted) >> 63);
+        visit(base, masks.delimiter & ~quoted, masks.newline & ~quoted);
+    }
+    inQuotes = carry != 0;
+}
+
+// The field's value: CR of a CRLF dropped, surrounding quotes removed and ""
+// unescaped into storage, whose capacity must already cover it.
+string_view fieldValue(string_view field, bool endsRecord, string & storage)
+{
+    if (endsRecord && !field.empty() && field.back() == '\r')
+        field.remove_suffix(1);
+    if (field.empty() || field.front() != '"')
+        return field;
+    field.remove_prefix(1);
+    if (!field.empty() && field.back() == '"')
+        field.remove_suffix(1);
+    if (field.find('"') == string_view::npos)
+        return field;
+    size_t begin = storage.size();
+    for (size_t i = 0; i < field.size(); ++i) {
+        storage += field[i];
+        if (field[i] == '"' && i + 1 < field.size() && field[i + 1] == '"')
+            ++i;
+    }
+    return string_view(storage).substr(begin);
+}
+
+bool isColumnNumber(const string & text)
+{
+    return !text.empty() && text.size() < 10 && text.find_first_not_of("0123456789") == string::npos && stoul(text) > 0;
+}
+
+} // namespace
+
+size_t findCsvRecordsEnd(string_view data, size_t from, bool & inQuotes)
+{
+    size_t end = 0;
+    forEachBlock(data, from, inQuotes, ',', [&](size_t base, uint64_t, uint64_t newlines) {
+        if (newlines)
+            end = base + 64 - countl_zero(newlines);
+    });
+    return end;
+}
+
+CsvColumn::CsvColumn(string column, char delimiter, bool header)
+    : column(move(column)), delimiter(delimiter), header(header)
+{
+    if (delimiter == '\0' || delimiter == '"' || delimiter == '\n' || delimiter == '\r')
+        throw invalid_argument("--csv-delimiter: cannot be NUL, a quote or a line break");
+    if (isColumnNumber(this->column))
+        index = stoul(this->column) - 1;
+    else if (!header)
+        throw invalid_argument("--csv: without a header the column must be a number from 1");
+}
+
+void CsvColumn::takeHeader(string & firstChunk)
+{
+    if (!header)
+        return;
+    // Only the header's fields are collected, but the scan runs on to the
+    // end of the chunk; it happens once per stream.
+    vector<string_view> fields;
+    string storage;
+    storage.reserve(firstChunk.size());
+    string_view chunk = firstChunk;
+    size_t start = 0;
+    size_t end = 0;
+    bool inQuotes = false;
+    forEachBlock(chunk, 0, inQuotes, delimiter, [&](size_t base, uint64_t delimiters, uint64_t newlines) {
+        for (uint64_t m = delimiters | newlines; m && end == 0; m &= m - 1) {
+            unsigned bit = countr_zero(m);
+            bool endsRecord = (newlines >> bit) & 1;
+            fields.push_back(fieldValue(chunk.substr(start, base + bit - start), endsRecord, storage));
+            start = base + bit + 1;
+            if (endsRecord)
+                end = start;
+        }
+    });
+    if (end == 0) {
+        fields.push_back(fieldValue(chunk.substr(start), true, storage));
+        end = chunk.size();
+    }
+
+    size_t i = 0;
+    while (i < fields.size() && fields[i] != column)
+        ++i;
+    if (i < fields.size())
+        index = i;
+    else if (!isColumnNumber(column))
+        throw runtime_error("--csv: no column named '" + column + "' in the header");
+    firstChunk.erase(0, end);
+}
+
+size_t CsvColumn::split(string_view records, vector<string_view> & names, string & storage) const
+{
+    // Unescaped fields are never longer than the records, so storage does
+    // not reallocate under the views.
+    storage.clear();
+    storage.reserve(records.size());
+    size_t field = 0;
+    size_t start = 0;
+    size_t skipped = 0;
+    auto endField = [&](size_t end, bool endsRecord) {
+        string_view text = records.substr(start, end - start);
+        if (endsRecord && field == 0 && (text.empty() || text == "\r"))
+            ++skipped;   // a blank line
+        else if (field == index)
+            names.push_back(fieldValue(text, endsRecord, storage));
+        else if (endsRecord && field < index)
+            ++skipped;   // a record too short to have the column
+        if (endsRecord) {
+            field = 0;
+        } else {
+            ++field;
+        }
+        start = end + 1;
+    };
+    bool inQuotes = false;
+    forEachBlock(records, 0, inQuotes, delimiter, [&](size_t base, uint64_t delimiters, uint64_t newlines) {
+        for (uint64_t m = delimiters | newlines; m; m &= m - 1) {
+            unsigned bit = countr_zero(m);
+            endField(base + bit, (newlines >> bit) & 1);
+        }
+    });
+    if (start < records.size() || field > 0)
+        endField(records.size(), true);
+    return skipped;
+}
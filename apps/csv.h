@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// RFC 4180 CSV: fields separated by a delimiter, records by newlines
+// (CRLF or LF), and fields optionally in double quotes, inside which
+// delimiters and newlines are data and "" is a literal quote. The scanners
+// classify 64 bytes at a time into quote, delimiter and newline bitmasks and
+// find the quoted regions with a prefix XOR over the quote mask, so only the
+// structural characters are visited one by one.
+
+// Scans data from from, continuing with inQuotes as the quote state there,
+// and leaves inQuotes as the state at the end. Returns one past the last
+// newline outside quotes, or 0 if there is none.
+size_t findCsvRecordsEnd(std::string_view data, size_t from, bool & inQuotes);
+
+// The column of a CSV stream that holds the names.
+class CsvColumn
+{
+public:
+    // column is a header name or, failing that, a 1-based column number.
+    // Without a header it must be a number. Throws std::invalid_argument.
+    CsvColumn(std::string column, char delimiter, bool header);
+
+    // Call with the stream's first chunk: strips the header record and
+    // resolves a named column. Throws std::runtime_error if it is missing.
+    void takeHeader(std::string & firstChunk);
+
+    // Appends the selected field of each record in records, which must hold
+    // whole records, to names. Blank lines and records too short to have
+    // the column are skipped; returns how many. Quoted fields with ""
+    // escapes are unescaped into storage (cleared first); other fields view
+    // records directly.
+    size_t split(std::string_view records, std::vector<std::string_view> & names, std::string & storage) const;
+
+private:
+    std::string column;
+    char delimiter;
+    bool header;
+    size_t index = 0;
+};
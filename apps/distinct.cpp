@@ -0,0 +1,597 @@
+#include "distinct.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "asynclog.h"
+#include "chunkreader.h"
+#include "csv.h"
+#include "escape.h"
+#include "file.h"
+#include "hello.h"
+#include "jsonl.h"
+#include "namehash.h"
+#include "rulesfile.h"
+#include "stats.h"
+#include "transliterate.h"
+
+using namespace std;
+
+namespace {
+
+constexpr unsigned maxTopFanOut = 256;   // partitions when the input first overflows, budget permitting
+constexpr unsigned subFanOut = 16;       // partitions when a partition overflows
+constexpr size_t minTableBytes = 64 << 10;
+constexpr unsigned maxLevels = 6;
+constexpr size_t emitBatch = 4096;
+
+const LogFormat spillFormat("distinct: name table full at level {} ({} bytes), spilling into {} partitions");
+
+// Partitions at different levels must use independent hash bits.
+unsigned partitionOf(uint64_t hash, unsigned level, unsigned fanOut)
+{
+    uint64_t x = hash + (level + 1) * 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return static_cast<unsigned>((x >> 32) % fanOut);
+}
+
+// Open-addressing set of names. Slots and name bytes together never exceed
+// limit; an insert that would go over returns Full and changes nothing.
+class NameTable
+{
+public:
+    enum class Result { Added, Present, Full };
+
+    explicit NameTable(size_t limit) : limit(limit), blockSize(clamp<size_t>(limit / 16, 4096, 1 << 20)) {}
+
+    // On Added, stored views the table's copy of name, valid until release().
+    Result insert(string_view name, uint64_t hash, string_view & stored)
+    {
+        if ((count + 1) * 2 > slots.size() && !grow())
+            return Result::Full;
+        size_t mask = slots.size() - 1;
+        size_t i = hash & mask;
+        for (; slots[i].ref != emptyRef; i = (i + 1) & mask) {
+            if (slots[i].hash == hash && nameAt(slots[i].ref) == name)
+                return Result::Present;
+        }
+        uint64_t ref;
+        if (!store(name, ref))
+            return Result::Full;
+        slots[i] = {hash, ref};
+        ++count;
+        stored = nameAt(ref);
+        return Result::Added;
+    }
+
+    template <typename Visit>
+    void forEach(Visit visit) const
+    {
+        for (const Slot & slot : slots) {
+            if (slot.ref != emptyRef)
+                visit(nameAt(slot.ref), slot.hash);
+        }
+    }
+
+    // Slot and name bytes held; only grows until release().
+    size_t bytes() const { return memory; }
+
+    void release()
+    {
+        vector<Slot>().swap(slots);
+        blocks.clear();
+        count = 0;
+        memory = 0;
+    }
+
+private:
+    struct Slot
+    {
+        uint64_t hash;
+        uint64_t ref;   // block index << 40 | offset of the length-prefixed name
+    };
+    static constexpr uint64_t emptyRef = ~uint64_t(0);
+
+    bool grow()
+    {
+        size_t size = max<size_t>(1024, slots.size() * 2);
+        // Old and new slots are both live while rehashing.
+        if (memory + size * sizeof(Slot) > limit)
+            return false;
+        vector<Slot> grown(size, Slot{0, emptyRef});
+        for (const Slot & slot : slots) {
+            if (slot.ref == emptyRef)
+                continue;
+            size_t i = slot.hash & (size - 1);
+            while (grown[i].ref != emptyRef)
+                i = (i + 1) & (size - 1);
+            grown[i] = slot;
+        }
+        memory += (size - slots.size()) * sizeof(Slot);
+        slots.swap(grown);
+        return true;
+    }
+
+    bool store(string_view name, uint64_t & ref)
+    {
+        uint32_t length = static_cast<uint32_t>(name.size());
+        size_t needed = sizeof length + name.size();
+        if (blocks.empty() || blocks.back().used + needed > blocks.back().size) {
+            size_t size = max(blockSize, needed);
+            if (memory + size > limit)
+                return false;
+            blocks.push_back({make_unique<char[]>(size), size, 0});
+            memory += size;
+        }
+        Block & block = blocks.back();
+        memcpy(block.data.get() + block.used, &length, sizeof length);
+        memcpy(block.data.get() + block.used + sizeof length, name.data(), name.size());
+        ref = uint64_t(blocks.size() - 1) << 40 | block.used;
+        block.used += needed;
+        return true;
+    }
+
+    string_view nameAt(uint64_t ref) const
+    {
+        const char * p = blocks[ref >> 40].data.get() + (ref & ((uint64_t(1) << 40) - 1));
+        uint32_t length;
+        memcpy(&length, p, sizeof length);
+        return string_view(p + sizeof length, length);
+    }
+
+    struct Block
+    {
+        unique_ptr<char[]> data;
+        size_t size;
+        size_t used;
+    };
+
+    size_t limit;
+    size_t blockSize;
+    size_t memory = 0;
+    size_t count = 0;
+    vector<Slot> slots;
+    vector<Block> blocks;
+};
+
+struct FileCloser
+{
+    void operator()(FILE * file) const { fclose(file); }
+};
+using SpillFile = unique_ptr<FILE, FileCloser>;
+
+// An anonymous temporary file: unlinked at once, gone when closed.
+SpillFile createSpillFile(const string & dir)
+{
+    string path = dir + "/hello-distinct-XXXXXX";
+    int fd = mkstemp(path.data());
+    if (fd < 0)
+        throw system_error(errno, generic_category(), path);
+    unlink(path.c_str());
+    FILE * file = fdopen(fd, "w+b");
+    if (!file) {
+        close(fd);
+        throw system_error(errno, generic_category(), path);
+    }
+    setvbuf(file, nullptr, _IONBF, 0);
+    return SpillFile(file);
+}
+
+// Writes (seen, name) records into fanOut spill files through buffers of a
+// fixed size. Record layout: seen flag byte, 4-byte length, name bytes.
+class SpillSet
+{
+public:
+    SpillSet(const string & dir, unsigned fanOut, size_t bufferSize, RunStats & stats)
+        : dir(dir), bufferSize(bufferSize), stats(stats), files(fanOut), buffers(fanOut)
+    {
+        for (string & buffer : buffers)
+            buffer.reserve(bufferSize);
+        stats.noteBuffer(Stage::Spill, fanOut * bufferSize);
+    }
+
+    void add(unsigned partition, bool seen, string_view name)
+    {
+        string & buffer = buffers[partition];
+        uint32_t length = static_cast<uint32_t>(name.size());
+        if (buffer.size() + 1 + sizeof length + name.size() > bufferSize)
+            flush(partition);
+        buffer += seen ? '\1' : '\0';
+        buffer.append(reinterpret_cast<const char *>(&length), sizeof length);
+        buffer += name;
+    }
+
+    // Returns the non-empty files, rewound for reading.
+    vector<SpillFile> finish()
+    {
+        vector<SpillFile> result;
+        for (unsigned p = 0; p < files.size(); ++p) {
+            flush(p);
+            if (files[p]) {
+                rewind(files[p].get());
+                result.push_back(move(files[p]));
+            }
+        }
+        return result;
+    }
+
+private:
+    void flush(unsigned partition)
+    {
+        string & buffer = buffers[partition];
+        if (buffer.empty())
+            return;
+        if (!files[partition]) {
+            files[partition] = createSpillFile(dir);
+            ++stats.spillFiles;
+        }
+        if (fwrite(buffer.data(), 1, buffer.size(), files[partition].get()) != buffer.size())
+            throw system_error(errno, generic_category(), "writing spill file in " + dir);
+        stats.spillBytes += buffer.size();
+        buffer.clear();
+    }
+
+    string dir;
+    size_t bufferSize;
+    RunStats & stats;
+    vector<SpillFile> files;
+    vector<string> buffers;
+};
+
+class InputSource
+{
+public:
+    InputSource(FILE * in, const Options & options, RunStats & stats, size_t decompressLimit)
+        : stream(in, options.inputPath, options.threads, decompressLimit), reader(stream, options.chunkSize, !options.csvColumn.empty()),
+          stats(stats), field(options.jsonlField)
+    {
+        if (!options.csvColumn.empty())
+            csv.emplace(options.csvColumn, options.csvDelimiter, options.csvHeader);
+    }
+
+    ~InputSource() { stats.noteBuffer(Stage::Read, chunk.capacity() + unescaped.capacity()); }
+
+    bool compressed() const { return stream.compressed(); }
+
+    bool next(string_view & name, bool & seen, uint64_t & hash)
+    {
+        while (position == names.size()) {
+            StageScope stage(Stage::Read);
+            if (!reader.next(chunk))
+                return false;
+            stats.inputBytes += chunk.size();
+            if (csv && first)
+                csv->takeHeader(chunk);
+            first = false;
+            names.clear();
+            if (csv)
+                stats.skippedRecords += csv->split(chunk, names, unescaped);
+            else if (!field.empty())
+                stats.skippedRecords += splitJsonl(chunk, field, names, nullptr, unescaped);
+            else
+                splitLines(chunk, names);
+            hashNames(names, hashes);
+            position = 0;
+            stats.records += names.size();
+        }
+        hash = hashes[position];
+        name = names[position++];
+        seen = false;
+        return true;
+    }
+
+private:
+    InputStream stream;
+    ChunkReader reader;
+    RunStats & stats;
+    optional<CsvColumn> csv;
+    string field;   // JSON Lines field, empty for other formats
+    bool first = true;
+    string chunk;
+    string unescaped;
+    vector<string_view> names;
+    vector<uint64_t> hashes;
+    size_t position = 0;
+};
+
+class SpillSource
+{
+public:
+    SpillSource(SpillFile file, size_t bufferSize) : file(move(file)), bufferSize(bufferSize) {}
+
+    bool next(string_view & name, bool & seen, uint64_t & hash)
+    {
+        uint32_t length;
+        if (!fill(1 + sizeof length))
+            return false;
+        seen = buffer[position] != 0;
+        memcpy(&length, buffer.data() + position + 1, sizeof length);
+        if (!fill(1 + sizeof length + length))
+            throw runtime_error("truncated spill file");
+        name = string_view(buffer).substr(position + 1 + sizeof length, length);
+        position += 1 + sizeof length + length;
+        hash = hashName(name);
+        return true;
+    }
+
+private:
+    // Makes at least needed bytes available from position.
+    bool fill(size_t needed)
+    {
+        if (buffer.size() - position >= needed)
+            return true;
+        buffer.erase(0, position);
+        position = 0;
+        while (buffer.size() < needed) {
+            size_t had = buffer.size();
+            size_t want = max(bufferSize, needed) - had;
+            buffer.resize(had + want);
+            size_t got = fread(buffer.data() + had, 1, want, file.get());
+            buffer.resize(had + got);
+            if (got == 0) {
+                if (ferror(file.get()))
+                    throw system_error(errno, generic_category(), "reading spill file");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    SpillFile file;
+    size_t bufferSize;
+    string buffer;
+    size_t position = 0;
+};
+
+class Output
+{
+public:
+    Output(FILE * out, const string & path, RunStats & stats) : out(out), path(path), stats(stats) {}
+
+    void write(const string & bytes)
+    {
+        StageScope stage(Stage::Write);
+        lock_guard<mutex> lock(outMutex);
+        if (fwrite(bytes.data(), 1, bytes.size(), out) != bytes.size())
+            throw system_error(errno, generic_category(), path);
+        stats.outputBytes += bytes.size();
+    }
+
+private:
+    FILE * out;
+    string path;
+    RunStats & stats;
+    mutex outMutex;
+};
+
+// Greets names in batches and hands the text to the output in large writes.
+class Emitter
+{
+public:
+    Emitter(Output & output, size_t flushBytes, bool transliterate, const GreetingRules * rules)
+        : output(output), flushBytes(flushBytes), transliterate(transliterate), rules(rules)
+    {
+    }
+
+    void add(string_view name)
+    {
+        names.push_back(name);
+        if (names.size() == emitBatch)
+            render();
+    }
+
+    // Must run before the names' storage goes away.
+    void render()
+    {
+        StageScope stage(Stage::Greet);
+        if (transliterate)
+            transliterateNames(names, transliterated);
+        if (rules)
+            rules->greet(names, greetings);
+        else
+            generateHelloStrings(names, greetings);
+        escapeGreetings(greetings, text);
+        greetings.clear();
+        names.clear();
+        if (text.size() >= flushBytes)
+            flush();
+    }
+
+    void flush()
+    {
+        output.write(text);
+        text.clear();
+    }
+
+    void noteBuffers(RunStats & stats) const
+    {
+        stats.noteBuffer(Stage::Greet, names.capacity() * sizeof(string_view) + transliterated.capacity() +
+                                           greetings.text.capacity() + greetings.offsets.capacity() * sizeof(size_t));
+        stats.noteBuffer(Stage::Escape, text.capacity());
+    }
+
+private:
+    Output & output;
+    size_t flushBytes;
+    bool transliterate;
+    const GreetingRules * rules;
+    vector<string_view> names;
+    string transliterated;
+    GreetingBatch greetings;
+    string text;
+};
+
+// Deduplicates one stream of (seen, name) records within a memory share.
+// "seen" names were greeted at an earlier level and only suppress repeats.
+class Deduper
+{
+public:
+    Deduper(const Options & options, const GreetingRules * rules, Output & output, RunStats & stats, size_t budget,
+            size_t streamBuffers)
+        : options(options), stats(stats)
+    {
+        // An eighth of the budget goes to spill buffers, of 16K each until
+        // there are maxTopFanOut of them; a small budget spills into fewer
+        // partitions rather than crowd out the table.
+        ioBufferSize = clamp<size_t>(budget / 32, 64 << 10, 1 << 20);
+        topFanOut = clamp<size_t>(budget / 8 / (16 << 10), subFanOut, maxTopFanOut);
+        spillBufferSize = clamp<size_t>(budget / 8 / topFanOut, 4 << 10, 256 << 10);
+        size_t reserved = streamBuffers + 2 * ioBufferSize + topFanOut * spillBufferSize;
+        if (budget < reserved + minTableBytes)
+            throw invalid_argument("--memory-budget too small, need at least " +
+                                   to_string((reserved + minTableBytes + (1 << 10) - 1) >> 10) + "K per worker");
+        tableLimit = budget - reserved;
+        emitter = make_unique<Emitter>(output, ioBufferSize, options.transliterate, rules);
+    }
+
+    size_t readBufferSize() const { return ioBufferSize; }
+
+    // Greets every new name that fits. If the distinct names outgrow the
+    // table, everything from there on is partitioned and returned for
+    // another round, with the names already greeted marked seen.
+    template <typename Source>
+    vector<SpillFile> dedupe(Source & source, unsigned level)
+    {
+        StageScope stage(Stage::Dedupe);
+        NameTable table(tableLimit);
+        string_view name;
+        string_view stored;
+        bool seen;
+        uint64_t hash;
+        while (source.next(name, seen, hash)) {
+            NameTable::Result result = table.insert(name, hash, stored);
+            if (result == NameTable::Result::Added && !seen) {
+                emitter->add(stored);
+                ++stats.distinctNames;
+            } else if (result == NameTable::Result::Full) {
+                emitter->render();
+                if (level >= maxLevels)
+                    throw runtime_error("distinct names in one partition exceed --memory-budget");
+                peakTableBytes = max(peakTableBytes, table.bytes());
+                StageScope spilling(Stage::Spill);
+                unsigned fanOut = level == 0 ? topFanOut : subFanOut;
+                logEvent(spillFormat, level, table.bytes(), fanOut);
+                SpillSet spill(options.spillDir, fanOut, spillBufferSize, stats);
+                table.forEach([&](string_view known, uint64_t knownHash) {
+                    spill.add(partitionOf(knownHash, level, fanOut), true, known);
+                });
+                table.release();
+                do
+                    spill.add(partitionOf(hash, level, fanOut), seen, name);
+                while (source.next(name, seen, hash));
+                return spill.finish();
+            }
+        }
+        emitter->render();
+        peakTableBytes = max(peakTableBytes, table.bytes());
+        return {};
+    }
+
+    void processPartition(SpillFile file, unsigned level)
+    {
+        vector<SpillFile> parts;
+        {
+            SpillSource source(move(file), ioBufferSize);
+            parts = dedupe(source, level);
+        }
+        for (SpillFile & part : parts)
+            processPartition(move(part), level + 1);
+    }
+
+    void flush()
+    {
+        emitter->flush();
+        emitter->noteBuffers(stats);
+        stats.noteBuffer(Stage::Dedupe, peakTableBytes);
+    }
+
+private:
+    const Options & options;
+    RunStats & stats;
+    size_t ioBufferSize;
+    unsigned topFanOut;
+    size_t spillBufferSize;
+    size_t tableLimit;
+    size_t peakTableBytes = 0;
+    unique_ptr<Emitter> emitter;
+};
+
+} // namespace
+
+void runDistinct(const Options & options, RunStats & stats)
+{
+    optional<GreetingRules> rules;
+    if (!options.rulesPath.empty())
+        rules.emplace(loadGreetingRules(options.rulesPath));
+    File in(options.inputPath, false);
+    File out(options.outputPath, true);
+    Output output(out.get(), options.outputPath, stats);
+
+    vector<SpillFile> partitions;
+    {
+        // The input chunk and the carried partial record stay live, and for
+        // CSV and JSON Lines the unescaped fields. Compressed input is
+        // decoded ahead into buffers of its own, within an eighth of the
+        // budget.
+        bool plain = options.csvColumn.empty() && options.jsonlField.empty();
+        size_t streamBuffers = (plain ? 3 : 4) * options.chunkSize;
+        size_t decompressBuffers = options.memoryBudget / 8;
+        InputSource input(in.get(), options, stats, decompressBuffers);
+        if (input.compressed())
+            streamBuffers += decompressBuffers;
+        Deduper first(options, rules ? &*rules : nullptr, output, stats, options.memoryBudget, streamBuffers);
+        partitions = first.dedupe(input, 0);
+        first.flush();
+    }
+
+    if (!partitions.empty()) {
+        unsigned workers = min<size_t>(options.threads, partitions.size());
+        atomic<size_t> next{0};
+        mutex errorMutex;
+        exception_ptr error;
+        vector<thread> threads;
+        for (unsigned w = 0; w < workers; ++w) {
+            threads.emplace_back([&] {
+                try {
+                    Deduper deduper(options, rules ? &*rules : nullptr, output, stats, options.memoryBudget / workers, 0);
+                    for (size_t p; (p = next++) < partitions.size();) {
+                        deduper.processPartition(move(partitions[p]), 1);
+                        lock_guard<mutex> lock(errorMutex);
+                        if (error)
+                            return;
+                    }
+                    deduper.flush();
+                } catch (...) {
+                    lock_guard<mutex> lock(errorMutex);
+                    if (!error)
+                        error = current_exception();
+                    next = partitions.size();
+                }
+            });
+        }
+        for (thread & t : threads)
+            t.join();
+        if (error)
+            rethrow_exception(error);
+    }
+
+    if (fflush(out.get()) != 0)
+        throw system_error(errno, generic_category(), options.outputPath);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "options.h"
+#include "stats.h"
+
+// Greets each distinct input line once, in first-seen order while the names
+// fit in options.memoryBudget. Past that the names are hash-partitioned into
+// spill files which are then deduplicated in parallel, one partition per
+// worker; a partition that is still too big is partitioned again.
+void runDistinct(const Options & options, RunStats & stats);
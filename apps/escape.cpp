@@ -0,0 +1,31 @@
+#include "escape.h"
+
+using namespace std;
+
+namespace {
+
+bool isControl(unsigned char c) { return c < 0x20 || c == 0x7f; }
+
+} // namespace
+
+void escapeGreetings(const GreetingBatch & greetings, string & output)
+{
+    static const char hex[] = "0123456789abcdef";
+    output.reserve(output.size() + greetings.text.size() + greetings.size());
+    for (size_t i = 0; i < greetings.size(); ++i) {
+        string_view greeting = greetings[i];
+        size_t run = 0;
+        for (size_t j = 0; j < greeting.size(); ++j) {
+            unsigned char c = greeting[j];
+            if (isControl(c)) {
+                output.append(greeting.data() + run, j - run);
+                output += "\\x";
+                output += hex[c >> 4];
+                output += hex[c & 15];
+                run = j + 1;
+            }
+        }
+        output.append(greeting.data() + run, greeting.size() - run);
+        output += '\n';
+    }
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+#include "hello.h"
+
+// Writes each greeting on its own line. Control bytes would break the
+// one-greeting-per-line output, so they are written as \xHH; everything
+// else, including UTF-8, passes through. Appends to output.
+void escapeGreetings(const GreetingBatch & greetings, std::string & output);
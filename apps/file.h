@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <system_error>
+
+// Owns a stdio stream; "-" maps to stdin or stdout, which are left open.
+class File
+{
+public:
+    File(const std::string & path, bool forWriting)
+    {
+        if (path == "-") {
+            file = forWriting ? stdout : stdin;
+            return;
+        }
+        file = std::fopen(path.c_str(), forWriting ? "wb" : "rb");
+        if (!file)
+            throw std::system_error(errno, std::generic_category(), path);
+        owned = true;
+    }
+    ~File()
+    {
+        if (owned)
+            std::fclose(file);
+    }
+    File(const File &) = delete;
+    File & operator=(const File &) = delete;
+
+    FILE * get() const { return file; }
+
+private:
+    FILE * file = nullptr;
+    bool owned = false;
+};
@@ -0,0 +1,378 @@
+#include "follow.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "asynclog.h"
+#include "csv.h"
+#include "pipeline.h"
+
+using namespace std;
+
+#ifdef __linux__
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+const LogFormat truncatedFormat("follow: {} truncated, rereading it from the start");
+const LogFormat replacedFormat("follow: {} replaced, switching to the new file");
+
+// Appends less than this far apart belong to one burst, and a burst is cut
+// off after burstLimit even if appends keep coming.
+constexpr int burstWindowMillis = 20;
+constexpr chrono::milliseconds burstLimit(200);
+// Without events the file is still rechecked this often, in case inotify
+// misses changes, as it does for writes from other hosts on network mounts.
+constexpr int recheckMillis = 1000;
+constexpr size_t readSize = 64 << 10;
+
+[[noreturn]] void fail(const string & what) { throw system_error(errno, generic_category(), what); }
+
+struct Position
+{
+    unsigned long long device = 0;
+    unsigned long long inode = 0;
+    unsigned long long offset = 0;
+};
+
+bool loadState(const string & path, Position & position)
+{
+    FILE * file = fopen(path.c_str(), "r");
+    if (!file) {
+        if (errno == ENOENT)
+            return false;
+        fail(path);
+    }
+    bool ok = fscanf(file, "%llu %llu %llu", &position.device, &position.inode, &position.offset) == 3;
+    fclose(file);
+    if (!ok)
+        throw runtime_error(path + ": not a follow state file");
+    return true;
+}
+
+// Written aside and renamed over the old state, so a crash leaves one or
+// the other, never a torn file.
+void saveState(const string & path, const Position & position)
+{
+    string temporary = path + ".tmp";
+    FILE * file = fopen(temporary.c_str(), "w");
+    if (!file)
+        fail(temporary);
+    int written = fprintf(file, "%llu %llu %llu\n", position.device, position.inode, position.offset);
+    if (fclose(file) != 0 || written < 0)
+        fail(temporary);
+    if (rename(temporary.c_str(), path.c_str()) != 0)
+        fail(path);
+}
+
+class Descriptor
+{
+public:
+    explicit Descriptor(int fd = -1) : fd(fd) {}
+    ~Descriptor() { reset(); }
+    Descriptor(const Descriptor &) = delete;
+    Descriptor & operator=(const Descriptor &) = delete;
+
+    int get() const { return fd; }
+    void reset(int next = -1)
+    {
+        if (fd >= 0)
+            close(fd);
+        fd = next;
+    }
+
+private:
+    int fd;
+};
+
+class FollowSource : public ChunkSource
+{
+public:
+    FollowSource(const Options & options)
+        : path(options.inputPath), statePath(options.followState), chunkSize(options.chunkSize),
+          csv(!options.csvColumn.empty())
+    {
+        // Blocked here, before the pipeline starts its threads, so they all
+        // inherit the mask and the signals only arrive through signalFd.
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, &savedMask);
+        signalFd.reset(signalfd(-1, &signals, SFD_CLOEXEC));
+        if (signalFd.get() < 0)
+            fail("signalfd");
+
+        // Watching the directory rather than the file sees the file being
+        // renamed away, deleted and created again, and every event
+        // triggers a full recheck, so no event needs decoding.
+        inotifyFd.reset(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+        if (inotifyFd.get() < 0)
+            fail("inotify");
+        size_t slash = path.rfind('/');
+        string directory = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        if (inotify_add_watch(inotifyFd.get(), directory.c_str(),
+                              IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) < 0)
+            fail(directory);
+
+        if (!open())
+            fail(path);
+        Position saved;
+        if (!statePath.empty() && loadState(statePath, saved) && saved.device == device && saved.inode == inode) {
+            struct stat status;
+            if (fstat(file.get(), &status) != 0)
+                fail(path);
+            if (saved.offset <= uint64_t(status.st_size)) {
+                if (lseek(file.get(), off_t(saved.offset), SEEK_SET) < 0)
+                    fail(path);
+                readOffset = saved.offset;
+            }
+        }
+    }
+
+    ~FollowSource() override { pthread_sigmask(SIG_SETMASK, &savedMask, nullptr); }
+
+    bool next(string & chunk) override
+    {
+        for (;;) {
+            if (stopRequested())
+                return false;
+            readAvailable();
+            if (recordsEnd > 0) {
+                if (atEnd)
+                    batch();
+                take(chunk, recordsEnd);
+                return true;
+            }
+            if (truncated())
+                continue;
+            if (replaced()) {
+                // Nothing more will be appended to the old file, so its
+                // unterminated last record is complete.
+                logEvent(replacedFormat, path);
+                bool last = !pending.empty();
+                if (last)
+                    take(chunk, pending.size());
+                // If the new file is already gone again, the old one is
+                // kept until the next appears.
+                if (!open() && errno != ENOENT)
+                    fail(path);
+                if (last)
+                    return true;
+                continue;
+            }
+            waitForEvents(recheckMillis);
+        }
+    }
+
+    void written(int64_t sequence) override
+    {
+        lock_guard<mutex> lock(positionsMutex);
+        while (!positions.empty() && positions.front().first < sequence)
+            positions.pop_front();
+        if (positions.empty() || positions.front().first != sequence)
+            return;
+        if (!statePath.empty())
+            saveState(statePath, positions.front().second);
+        positions.pop_front();
+    }
+
+private:
+    // Opens the file at the path from its start. Returns false with errno
+    // set if it cannot.
+    bool open()
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        file.reset(fd);
+        struct stat status;
+        if (fstat(fd, &status) != 0)
+            fail(path);
+        device = status.st_dev;
+        inode = status.st_ino;
+        readOffset = 0;
+        restart();
+        return true;
+    }
+
+    void restart()
+    {
+        pending.clear();
+        scanned = 0;
+        recordsEnd = 0;
+        inQuotes = false;
+    }
+
+    // Reads what the file has past the read position into pending, stopping
+    // at its end or once pending holds a chunk's worth of whole records.
+    void readAvailable()
+    {
+        atEnd = false;
+        while (!atEnd && (pending.size() < chunkSize || recordsEnd == 0)) {
+            size_t had = pending.size();
+            pending.resize(had + readSize);
+            ssize_t got = read(file.get(), pending.data() + had, readSize);
+            pending.resize(had + max<ssize_t>(got, 0));
+            if (got < 0 && errno != EINTR)
+                fail(path);
+            if (got == 0)
+                atEnd = true;
+            readOffset += max<ssize_t>(got, 0);
+            scan();
+        }
+    }
+
+    // Advances recordsEnd over the bytes of pending not scanned yet.
+    void scan()
+    {
+        if (csv) {
+            if (size_t end = findCsvRecordsEnd(pending, scanned, inQuotes))
+                recordsEnd = end;
+        } else if (size_t last = string_view(pending).substr(scanned).rfind('\n'); last != string::npos) {
+            recordsEnd = scanned + last + 1;
+        }
+        scanned = pending.size();
+    }
+
+    // Moves the first end bytes of pending to chunk.
+    void take(string & chunk, size_t end)
+    {
+        // Swapping keeps both buffers' capacity in circulation.
+        chunk.swap(pending);
+        pending.assign(chunk, end);
+        chunk.resize(end);
+        scanned = pending.size();
+        recordsEnd = 0;
+        lock_guard<mutex> lock(positionsMutex);
+        positions.emplace_back(sequence++, Position{device, inode, readOffset - pending.size()});
+    }
+
+    // Waits for the rest of a burst of appends, so that many small writes
+    // become one chunk instead of many tiny ones.
+    void batch()
+    {
+        Clock::time_point deadline = Clock::now() + burstLimit;
+        while (pending.size() < chunkSize && Clock::now() < deadline && waitForEvents(burstWindowMillis))
+            readAvailable();
+    }
+
+    // Whether the file shrank under us, copytruncate style. It is then
+    // reread from the start.
+    bool truncated()
+    {
+        struct stat status;
+        if (fstat(file.get(), &status) != 0)
+            fail(path);
+        if (uint64_t(status.st_size) >= readOffset)
+            return false;
+        if (lseek(file.get(), 0, SEEK_SET) < 0)
+            fail(path);
+        logEvent(truncatedFormat, path);
+        readOffset = 0;
+        restart();
+        return true;
+    }
+
+    // Whether the path now names another file. Until a new file appears
+    // at a path that was renamed away or deleted, the old one is kept.
+    bool replaced()
+    {
+        struct stat status;
+        if (stat(path.c_str(), &status) != 0) {
+            if (errno == ENOENT)
+                return false;
+            fail(path);
+        }
+        return status.st_dev != device || status.st_ino != inode;
+    }
+
+    bool stopRequested()
+    {
+        pollfd signal = {signalFd.get(), POLLIN, 0};
+        if (!stopping && poll(&signal, 1, 0) > 0)
+            readSignal();
+        return stopping;
+    }
+
+    void readSignal()
+    {
+        signalfd_siginfo info;
+        if (read(signalFd.get(), &info, sizeof info) > 0)
+            stopping = true;
+    }
+
+    // Returns true if the file may have changed, false on a timeout or a
+    // stop signal.
+    bool waitForEvents(int timeoutMillis)
+    {
+        pollfd fds[2] = {{inotifyFd.get(), POLLIN, 0}, {signalFd.get(), POLLIN, 0}};
+        int ready = poll(fds, 2, timeoutMillis);
+        if (ready < 0 && errno != EINTR)
+            fail("poll");
+        if (ready <= 0)
+            return false;
+        if (fds[1].revents) {
+            readSignal();
+            return false;
+        }
+        char events[4096];
+        while (read(inotifyFd.get(), events, sizeof events) > 0) {
+        }
+        return true;
+    }
+
+    string path;
+    string statePath;
+    size_t chunkSize;
+    bool csv;
+    sigset_t savedMask;
+    Descriptor signalFd;
+    Descriptor inotifyFd;
+    Descriptor file;
+    unsigned long long device = 0;
+    unsigned long long inode = 0;
+    uint64_t readOffset = 0;   // file offset of the end of pending
+    string pending;            // read but not yet handed to the pipeline
+    size_t scanned = 0;        // bytes of pending scanned for record ends
+    size_t recordsEnd = 0;     // one past the last whole record in pending, or 0
+    bool inQuotes = false;     // csv quote state at the end of pending
+    bool atEnd = false;        // the last read reached the end of the file
+    bool stopping = false;
+    int64_t sequence = 0;
+
+    // (chunk sequence, position after it), from the reader to the writer.
+    mutex positionsMutex;
+    deque<pair<int64_t, Position>> positions;
+};
+
+} // namespace
+
+void runFollow(const Options & options, RunStats & stats)
+{
+    FollowSource source(options);
+    runPipeline(options, stats, source);
+}
+
+#else
+
+void runFollow(const Options &, RunStats &) { throw runtime_error("--follow needs inotify, which only Linux has"); }
+
+#endif
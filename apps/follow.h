@@ -0,0 +1,18 @@
+#pragma once
+
+#include "options.h"
+#include "stats.h"
+
+// Follows options.inputPath like tail -F, greeting records as they are
+// appended. inotify wakes the reader on appends, truncation and rotation;
+// appends that arrive in a burst are batched into one chunk. Only complete
+// records are greeted: a partial last line waits for its newline, unless the
+// file is rotated away, which ends it.
+//
+// With options.followState, the offset just past the last record whose
+// greeting was written is saved there after every chunk, with the file's
+// identity, and a later run resumes from it. If the file was rotated or
+// truncated in between, the run starts at the beginning of the current one.
+//
+// Runs until SIGINT or SIGTERM, then finishes the chunks in flight.
+void runFollow(const Options & options, RunStats & stats);
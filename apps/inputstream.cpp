@@ -0,0 +1,433 @@
+#include "inputstream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef HELLO_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "blockingqueue.h"
+#include "lz4.h"
+#include "stats.h"
+#include "trace.h"
+
+using namespace std;
+
+namespace {
+
+enum class Format { Plain, Gzip, Lz4 };
+
+constexpr size_t gzipPieceSize = 1 << 20;   // inflated bytes per piece, at most
+constexpr size_t gzipReadSize = 256 << 10;
+constexpr size_t lz4HistorySize = 64 << 10; // how far back a dependent block's matches reach
+
+uint32_t readLe32(const char * p)
+{
+    const unsigned char * b = reinterpret_cast<const unsigned char *>(p);
+    return uint32_t(b[0]) | uint32_t(b[1]) << 8 | uint32_t(b[2]) << 16 | uint32_t(b[3]) << 24;
+}
+
+Format detect(string_view head)
+{
+    if (head.size() >= 2 && uint8_t(head[0]) == 0x1f && uint8_t(head[1]) == 0x8b)
+        return Format::Gzip;
+    if (head.size() >= 4 && (readLe32(head.data()) == lz4FrameMagic || lz4IsSkippableMagic(readLe32(head.data()))))
+        return Format::Lz4;
+    return Format::Plain;
+}
+
+// A run of decompressed input, in sequence order. An LZ4 block travels in
+// raw to a decoder thread, which fills data.
+struct Piece
+{
+    int64_t sequence = 0;
+    string raw;                // an LZ4 block and its checksum
+    uint32_t sizeField = 0;    // the LZ4 block's size field
+    Lz4FrameDescriptor frame;
+    string data;
+    size_t begin = 0;          // data before begin is a dependent block's history
+    bool frameStart = false;   // the first piece of an LZ4 frame with a content checksum
+    optional<uint32_t> contentChecksum;   // set on the last piece of such a frame
+};
+
+struct BySequence
+{
+    bool operator()(const Piece * a, const Piece * b) const { return a->sequence > b->sequence; }
+};
+
+} // namespace
+
+class Decompressor
+{
+public:
+    Decompressor(Format format, FILE * in, const string & path, string head, unsigned threads, size_t memoryLimit)
+        : format(format), in(in), path(path), head(move(head)), memoryLimit(memoryLimit)
+    {
+        unsigned workers = format == Format::Lz4 ? max(1u, threads) : 0;
+        for (size_t i = 0; i < 2 * workers + 2; ++i) {
+            pieces.push_back(make_unique<Piece>());
+            freePieces.push(pieces.back().get());
+        }
+        circulating = pieces.size();
+        running = 1 + workers;
+        stageThreads.emplace_back([this] {
+            guarded("decompress", [this] {
+                if (this->format == Format::Gzip)
+                    inflateStage();
+                else
+                    namingInput([this] { parseLz4Stage(); });
+            });
+        });
+        for (unsigned i = 0; i < workers; ++i)
+            stageThreads.emplace_back(
+                [this, i] { guarded("decompress-" + to_string(i + 1), [this] { namingInput([this] { decodeStage(); }); }); });
+    }
+
+    ~Decompressor()
+    {
+        freePieces.close();
+        workQueue.close();
+        doneQueue.close();
+        for (thread & t : stageThreads)
+            t.join();
+    }
+
+    size_t read(char * buffer, size_t size)
+    {
+        size_t copied = 0;
+        while (copied < size) {
+            if (!current || position == current->data.size()) {
+                if (current)
+                    freePieces.push(current);
+                current = nextPiece();
+                if (!current)
+                    break;
+                position = current->begin;
+                if (current->frameStart) {
+                    content.reset();
+                    checkingContent = true;
+                }
+                if (checkingContent)
+                    content.update(string_view(current->data).substr(position));
+                if (current->contentChecksum) {
+                    if (*current->contentChecksum != content.digest())
+                        throw runtime_error(path + ": LZ4 content checksum mismatch");
+                    checkingContent = false;
+                }
+                continue;
+            }
+            size_t take = min(size - copied, current->data.size() - position);
+            memcpy(buffer + copied, current->data.data() + position, take);
+            copied += take;
+            position += take;
+        }
+        return copied;
+    }
+
+    const Format format;
+
+private:
+    template <typename Body>
+    void guarded(const string & name, Body body)
+    {
+        setTraceThreadName(name);
+        try {
+            StageScope stage(Stage::Decompress);
+            body();
+        } catch (...) {
+            {
+                lock_guard<mutex> lock(errorMutex);
+                if (!error)
+                    error = current_exception();
+            }
+            freePieces.close();
+            workQueue.close();
+            doneQueue.close();
+        }
+        if (--running == 0)
+            doneQueue.close();
+    }
+
+    // Prefixes the LZ4 stages' errors with the file.
+    template <typename Body>
+    void namingInput(Body body)
+    {
+        try {
+            body();
+        } catch (const system_error &) {
+            throw;
+        } catch (const runtime_error & e) {
+            throw runtime_error(path + ": " + e.what());
+        }
+    }
+
+    // The next piece in sequence, or null at the end of the input.
+    Piece * nextPiece()
+    {
+        while (pending.empty() || pending.top()->sequence != nextSequence) {
+            optional<Piece *> piece = doneQueue.pop();
+            if (!piece) {
+                lock_guard<mutex> lock(errorMutex);
+                if (error)
+                    rethrow_exception(error);
+                return nullptr;
+            }
+            pending.push(*piece);
+        }
+        Piece * piece = pending.top();
+        pending.pop();
+        ++nextSequence;
+        return piece;
+    }
+
+    // Reads up to size bytes of the compressed input, fewer only at its end.
+    size_t readRaw(char * buffer, size_t size)
+    {
+        size_t fromHead = min(size, head.size() - headPosition);
+        memcpy(buffer, head.data() + headPosition, fromHead);
+        headPosition += fromHead;
+        size_t got = fromHead + fread(buffer + fromHead, 1, size - fromHead, in);
+        if (got < size && ferror(in))
+            throw system_error(errno, generic_category(), path);
+        return got;
+    }
+
+    void readExact(char * buffer, size_t size)
+    {
+        if (readRaw(buffer, size) != size)
+            throw runtime_error("truncated LZ4 input");
+    }
+
+    // A free piece, once no more than circulating pieces are in use; the
+    // rest are parked, their buffers released.
+    Piece * takePiece()
+    {
+        while (optional<Piece *> piece = freePieces.pop()) {
+            if (pieces.size() - parked.size() <= circulating)
+                return *piece;
+            string().swap((*piece)->raw);
+            string().swap((*piece)->data);
+            parked.push_back(*piece);
+        }
+        return nullptr;
+    }
+
+    // Lets as many pieces circulate as fit the memory limit, each holding
+    // pieceBytes, but always one.
+    void fitPieces(size_t pieceBytes)
+    {
+        circulating = clamp<size_t>(memoryLimit / pieceBytes, 1, pieces.size());
+        for (; !parked.empty() && pieces.size() - parked.size() < circulating; parked.pop_back())
+            freePieces.push(parked.back());
+    }
+
+    void inflateStage()
+    {
+#ifdef HELLO_HAVE_ZLIB
+        z_stream stream{};
+        if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+            throw runtime_error("cannot initialize zlib");
+        struct End
+        {
+            z_stream & stream;
+            ~End() { inflateEnd(&stream); }
+        } end{stream};
+
+        // Two pieces and the read buffer, within the memory limit.
+        size_t pieceSize = clamp<size_t>(memoryLimit / 3, 16 << 10, gzipPieceSize);
+        string input(min(gzipReadSize, pieceSize / 4), '\0');
+        bool memberEnded = false;
+        int64_t sequence = 0;
+        for (bool inputEnded = false; !inputEnded;) {
+            Piece * piece = takePiece();
+            if (!piece)
+                return;
+            TraceSpan span("inflate", sequence);
+            piece->data.resize(pieceSize);
+            stream.next_out = reinterpret_cast<Bytef *>(piece->data.data());
+            stream.avail_out = uInt(piece->data.size());
+            while (stream.avail_out > 0) {
+                if (stream.avail_in == 0) {
+                    size_t got = readRaw(input.data(), input.size());
+                    if (got == 0) {
+                        inputEnded = true;
+                        break;
+                    }
+                    stream.next_in = reinterpret_cast<Bytef *>(input.data());
+                    stream.avail_in = uInt(got);
+                }
+                int result = inflate(&stream, Z_NO_FLUSH);
+                if (result == Z_STREAM_END) {
+                    // Concatenated members make one stream, as with zcat.
+                    memberEnded = true;
+                    inflateReset(&stream);
+                } else if (result == Z_OK) {
+                    memberEnded = false;
+                } else {
+                    throw runtime_error(path + ": malformed gzip input" +
+                                        (stream.msg ? string(": ") + stream.msg : string()));
+                }
+            }
+            if (inputEnded && !memberEnded)
+                throw runtime_error(path + ": truncated gzip input");
+            piece->data.resize(piece->data.size() - stream.avail_out);
+            piece->begin = 0;
+            piece->sequence = sequence++;
+            doneQueue.push(piece);
+        }
+#endif
+    }
+
+    void parseLz4Stage()
+    {
+        int64_t sequence = 0;
+        string skipped;
+        char word[4];
+        while (size_t got = readRaw(word, 4)) {
+            if (got < 4)
+                throw runtime_error("truncated LZ4 input");
+            uint32_t magic = readLe32(word);
+            if (lz4IsSkippableMagic(magic)) {
+                readExact(word, 4);
+                skipped.resize(readLe32(word));
+                readExact(skipped.data(), skipped.size());
+                continue;
+            }
+            if (magic != lz4FrameMagic)
+                throw runtime_error("unexpected data after an LZ4 frame");
+            char descriptor[16];
+            readExact(descriptor, 1);
+            size_t descriptorSize = lz4DescriptorSize(descriptor[0]);
+            readExact(descriptor + 1, descriptorSize - 1);
+            Lz4FrameDescriptor frame = lz4ParseDescriptor(string_view(descriptor, descriptorSize));
+            // A block is decoded into room for the largest, after the history.
+            fitPieces(2 * frame.blockMaxSize + lz4HistorySize);
+
+            // Dependent blocks are decoded here, in order, after the last
+            // lz4HistorySize bytes of the block before.
+            string history;
+            for (bool first = true;; first = false) {
+                readExact(word, 4);
+                uint32_t sizeField = readLe32(word);
+                size_t size = lz4FrameBlockSize(frame, sizeField);
+                Piece * piece = takePiece();
+                if (!piece)
+                    return;
+                piece->sequence = sequence++;
+                piece->frame = frame;
+                piece->sizeField = sizeField;
+                piece->data.clear();
+                piece->begin = 0;
+                piece->frameStart = first && frame.contentChecksum;
+                piece->contentChecksum.reset();
+                if (size == 0) {
+                    if (frame.contentChecksum) {
+                        readExact(word, 4);
+                        piece->contentChecksum = readLe32(word);
+                    }
+                    doneQueue.push(piece);
+                    break;
+                }
+                piece->raw.resize(size);
+                readExact(piece->raw.data(), size);
+                if (frame.independentBlocks) {
+                    workQueue.push(piece);
+                    continue;
+                }
+                TraceSpan span("decode", piece->sequence);
+                piece->data = history;
+                piece->begin = history.size();
+                lz4DecompressFrameBlock(frame, sizeField, piece->raw, piece->data, history.size());
+                history.assign(piece->data, piece->data.size() - min(lz4HistorySize, piece->data.size()));
+                doneQueue.push(piece);
+            }
+        }
+        workQueue.close();
+    }
+
+    void decodeStage()
+    {
+        while (optional<Piece *> next = workQueue.pop()) {
+            Piece & piece = **next;
+            TraceSpan span("decode", piece.sequence);
+            lz4DecompressFrameBlock(piece.frame, piece.sizeField, piece.raw, piece.data);
+            doneQueue.push(&piece);
+        }
+    }
+
+    FILE * in;
+    string path;
+    string head;   // the bytes already read to detect the format
+    size_t headPosition = 0;
+
+    size_t memoryLimit;
+
+    vector<unique_ptr<Piece>> pieces;
+    size_t circulating;         // pieces that may be in use; the parsing stage's
+    vector<Piece *> parked;     // the others, held back by it
+    BlockingQueue<Piece *> freePieces;
+    BlockingQueue<Piece *> workQueue;   // LZ4 blocks to decode
+    BlockingQueue<Piece *> doneQueue;
+    atomic<unsigned> running{0};
+    vector<thread> stageThreads;
+    mutex errorMutex;
+    exception_ptr error;
+
+    // The reading side.
+    priority_queue<Piece *, vector<Piece *>, BySequence> pending;
+    int64_t nextSequence = 0;
+    Piece * current = nullptr;
+    size_t position = 0;
+    Xxh32 content;
+    bool checkingContent = false;
+};
+
+InputStream::InputStream(FILE * in, string path, unsigned threads, size_t memoryLimit) : in(in), path(move(path))
+{
+    peeked.resize(4);
+    peeked.resize(fread(peeked.data(), 1, peeked.size(), in));
+    if (peeked.size() < 4 && ferror(in))
+        throw system_error(errno, generic_category(), this->path);
+    Format format = detect(peeked);
+#ifndef HELLO_HAVE_ZLIB
+    if (format == Format::Gzip)
+        throw runtime_error(this->path + ": gzip input needs zlib, which this build lacks");
+#endif
+    if (format != Format::Plain)
+        decompressor = make_unique<Decompressor>(format, in, this->path, move(peeked), threads, memoryLimit);
+}
+
+InputStream::~InputStream() = default;
+
+size_t InputStream::read(char * buffer, size_t size)
+{
+    if (decompressor)
+        return decompressor->read(buffer, size);
+    size_t fromPeeked = min(size, peeked.size() - peekedPosition);
+    memcpy(buffer, peeked.data() + peekedPosition, fromPeeked);
+    peekedPosition += fromPeeked;
+    size_t got = fromPeeked + fread(buffer + fromPeeked, 1, size - fromPeeked, in);
+    if (got < size && ferror(in))
+        throw system_error(errno, generic_category(), path);
+    return got;
+}
+
+const char * InputStream::format() const
+{
+    if (!decompressor)
+        return "plain";
+    return decompressor->format == Format::Gzip ? "gzip" : "lz4";
+}
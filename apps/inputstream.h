@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+class Decompressor;
+
+// The input as a byte stream, decompressed when it starts with the magic
+// number of a gzip member or an LZ4 frame, so that compressed name dumps
+// need no zcat in front.
+//
+// Compressed input is decoded ahead of the reader on its own threads: one
+// thread reads the file and, for gzip, inflates it; for LZ4 frames with
+// independent blocks, which lz4 writes by default, it hands the blocks to
+// a pool of decoder threads instead. Decoded pieces circulate through a
+// fixed pool of buffers, and read() copies them out in order. gzip needs
+// zlib at build time (HELLO_HAVE_ZLIB).
+//
+// The buffers stay within memoryLimit bytes: fewer circulate, and gzip
+// pieces are smaller, under a tighter limit. An LZ4 block is decoded
+// whole, though, so a frame's largest block size (4M as lz4 writes by
+// default) times two is needed whatever the limit.
+class InputStream
+{
+public:
+    InputStream(FILE * in, std::string path, unsigned threads, size_t memoryLimit = SIZE_MAX);
+    ~InputStream();
+    InputStream(const InputStream &) = delete;
+    InputStream & operator=(const InputStream &) = delete;
+
+    // Like fread: fills buffer, returning fewer bytes only at the end of the
+    // input. Throws std::system_error on read errors and std::runtime_error
+    // on malformed compressed data.
+    size_t read(char * buffer, size_t size);
+
+    // "plain", "gzip" or "lz4".
+    const char * format() const;
+
+    // Whether the input is decompressed, through buffers of its own.
+    bool compressed() const { return decompressor != nullptr; }
+
+private:
+    FILE * in;
+    std::string path;
+    std::string peeked;   // the bytes read to detect the format, for plain input
+    size_t peekedPosition = 0;
+    std::unique_ptr<Decompressor> decompressor;   // null for plain input
+};
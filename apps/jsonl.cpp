@@ -0,0 +1,476 @@
+#include "jsonl.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HELLO_HAVE_SSE2 1
+#endif
+
+using namespace std;
+
+namespace {
+
+constexpr size_t maxDepth = 256;
+
+struct BlockMasks
+{
+    uint64_t quote = 0;
+    uint64_t backslash = 0;
+    uint64_t structural = 0;   // { } [ ] :
+    uint64_t control = 0;      // bytes below 0x20, newlines among them
+};
+
+BlockMasks classify(const char * p)
+{
+    BlockMasks masks;
+#ifdef HELLO_HAVE_SSE2
+    for (int i = 0; i < 4; ++i) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+        auto is = [&](char c) { return _mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)); };
+        auto bits = [](__m128i match) { return uint64_t(uint32_t(_mm_movemask_epi8(match))); };
+        __m128i structural =
+            _mm_or_si128(_mm_or_si128(_mm_or_si128(is('{'), is('}')), _mm_or_si128(is('['), is(']'))), is(':'));
+        __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(bytes, _mm_set1_epi8(0x1f)), _mm_set1_epi8(0x1f));
+        masks.quote |= bits(is('"')) << (16 * i);
+        masks.backslash |= bits(is('\\')) << (16 * i);
+        masks.structural |= bits(structural) << (16 * i);
+        masks.control |= bits(control) << (16 * i);
+    }
+#else
+    for (int i = 0; i < 64; ++i) {
+        char c = p[i];
+        masks.quote |= uint64_t(c == '"') << i;
+        masks.backslash |= uint64_t(c == '\\') << i;
+        masks.structural |= uint64_t(c == '{' || c == '}' || c == '[' || c == ']' || c == ':') << i;
+        masks.control |= uint64_t(static_cast<unsigned char>(c) < 0x20) << i;
+    }
+#endif
+    return masks;
+}
+
+uint64_t prefixXor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// The bytes escaped by a backslash. Backslashes are rare, so they are walked
+// one by one; carry says the block's first byte is escaped and is set if
+// its last byte escapes the next block's first.
+uint64_t escapedBytes(uint64_t backslashes, bool & carry)
+{
+    uint64_t escaped = carry ? 1 : 0;
+    carry = false;
+    for (uint64_t m = backslashes; m; m &= m - 1) {
+        unsigned bit = countr_zero(m);
+        if ((escaped >> bit) & 1)
+            continue;
+        if (bit == 63)
+            carry = true;
+        else
+            escaped |= uint64_t(2) << bit;
+    }
+    return escaped;
+}
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool readHex4(string_view text, size_t at, uint32_t & value)
+{
+    if (at + 4 > text.size())
+        return false;
+    value = 0;
+    for (size_t i = at; i < at + 4; ++i) {
+        int digit = hexValue(text[i]);
+        if (digit < 0)
+            return false;
+        value = value << 4 | digit;
+    }
+    return true;
+}
+
+void appendUtf8(uint32_t c, string & out)
+{
+    if (c < 0x80) {
+        out += char(c);
+    } else if (c < 0x800) {
+        out += char(0xc0 | c >> 6);
+        out += char(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+        out += char(0xe0 | c >> 12);
+        out += char(0x80 | (c >> 6 & 0x3f));
+        out += char(0x80 | (c & 0x3f));
+    } else {
+        out += char(0xf0 | c >> 18);
+        out += char(0x80 | (c >> 12 & 0x3f));
+        out += char(0x80 | (c >> 6 & 0x3f));
+        out += char(0x80 | (c & 0x3f));
+    }
+}
+
+// Appends the unescaped contents of a JSON string (without its quotes).
+// The result is never longer than raw.
+bool appendUnescaped(string_view raw, string & out)
+{
+    for (size_t i = 0; i < raw.size(); ++i) {
+        if (raw[i] != '\\') {
+            out += raw[i];
+            continue;
+        }
+        if (++i == raw.size())
+            return false;
+        switch (raw[i]) {
+        case '"': case '\\': case '/': out += raw[i]; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            uint32_t c;
+            if (!readHex4(raw, i + 1, c))
+                return false;
+            i += 4;
+            if (c >= 0xdc00 && c <= 0xdfff)
+                return false;
+            if (c >= 0xd800 && c <= 0xdbff) {
+                uint32_t low;
+                if (i + 2 >= raw.size() || raw[i + 1] != '\\' || raw[i + 2] != 'u' || !readHex4(raw, i + 3, low) ||
+                    low < 0xdc00 || low > 0xdfff)
+                    return false;
+                i += 6;
+                c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+            }
+            appendUtf8(c, out);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+void appendJsonEscaped(string_view text, string & out)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t run = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = text[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        out.append(text.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        }
+    }
+    out.append(text.data() + run, text.size() - run);
+}
+
+// The walk over one record. Only brackets, colons and newlines outside
+// strings are visited: brackets track the nesting, and a colon at depth 1
+// looks back at its key and, if it is the field, forward at the value,
+// both short scalar scans. Errors only mark the record bad; the scan goes
+// on to its newline either way.
+class RecordParser
+{
+public:
+    // A record with a top-level member named reserved, if not empty, is
+    // skipped.
+    RecordParser(string_view text, string_view field, string_view reserved, string & storage)
+        : text(text), field(field), reserved(reserved), storage(storage)
+    {
+    }
+
+    void start(size_t at)
+    {
+        begin = at;
+        depth = 0;
+        closed = false;
+        found = false;
+        bad = false;
+    }
+
+    void fail() { bad = true; }
+
+    void token(size_t at, char c)
+    {
+        if (bad)
+            return;
+        if (closed) {
+            bad = true;
+        } else if (c == ':') {
+            if (depth == 1 && (!found || !reserved.empty()))
+                member(at);
+        } else if (c == '{' || c == '[') {
+            if ((depth == 0 && (c != '{' || !blank(begin, at))) || depth == maxDepth)
+                bad = true;
+            else
+                isObject[++depth] = c == '{';
+        } else if (depth == 0 || isObject[depth] != (c == '}')) {
+            bad = true;
+        } else if (--depth == 0) {
+            closed = true;
+            closedAt = at;
+        }
+    }
+
+    enum class Result { Blank, Skipped, Found };
+
+    // Ends the record at end; on Found, record is trimmed to its closing
+    // brace and name is the field's value.
+    Result finish(size_t end, string_view & record, string_view & name)
+    {
+        if (!closed && depth == 0 && !bad && blank(begin, end))
+            return Result::Blank;
+        if (bad || !found || !closed || !blank(closedAt + 1, end))
+            return Result::Skipped;
+        record = text.substr(begin, closedAt + 1 - begin);
+        name = value;
+        return Result::Found;
+    }
+
+private:
+    bool blank(size_t from, size_t to) const
+    {
+        for (size_t i = from; i < to; ++i) {
+            if (!isBlank(text[i]))
+                return false;
+        }
+        return true;
+    }
+
+    // A quote not escaped by an odd run of backslashes.
+    bool unescapedQuote(size_t at) const
+    {
+        if (text[at] != '"')
+            return false;
+        size_t backslashes = 0;
+        while (at - backslashes > begin && text[at - backslashes - 1] == '\\')
+            ++backslashes;
+        return backslashes % 2 == 0;
+    }
+
+    static bool keyIs(string_view key, string_view name)
+    {
+        if (key.find('\\') == string_view::npos)
+            return key == name;
+        string unescaped;
+        return appendUnescaped(key, unescaped) && unescaped == name;
+    }
+
+    // After the field is found, members are only looked at for the
+    // reserved key, and a colon without a key before it is let pass, as
+    // when nothing was looked for.
+    void member(size_t colon)
+    {
+        size_t close = colon;
+        while (close > begin && isBlank(text[close - 1]))
+            --close;
+        if (close == begin || text[--close] != '"') {
+            bad |= !found;
+            return;
+        }
+        size_t open = close;
+        do {
+            if (open == begin) {
+                bad |= !found;
+                return;
+            }
+            --open;
+        } while (!unescapedQuote(open));
+        string_view key = text.substr(open + 1, close - open - 1);
+        if (!reserved.empty() && keyIs(key, reserved)) {
+            bad = true;
+            return;
+        }
+        if (found || !keyIs(key, field))
+            return;
+
+        size_t start = colon + 1;
+        while (start < text.size() && isBlank(text[start]))
+            ++start;
+        if (start == text.size() || text[start] != '"') {
+            bad = true;   // the field's value is not a string
+            return;
+        }
+        bool escapes = false;
+        size_t end = ++start;
+        for (; end < text.size() && text[end] != '"'; ++end) {
+            if (text[end] == '\n')
+                break;
+            if (text[end] == '\\') {
+                escapes = true;
+                ++end;
+            }
+        }
+        if (end >= text.size() || text[end] != '"') {
+            bad = true;
+            return;
+        }
+        string_view content = text.substr(start, end - start);
+        found = true;
+        if (!escapes) {
+            value = content;
+        } else {
+            size_t first = storage.size();
+            bad = !appendUnescaped(content, storage);
+            value = string_view(storage).substr(first);
+        }
+    }
+
+    string_view text;
+    string_view field;
+    string_view reserved;
+    string & storage;
+
+    size_t begin = 0;
+    bool isObject[maxDepth + 1];
+    size_t depth = 0;
+    bool closed = false;          // the top-level object has ended
+    size_t closedAt = 0;
+    bool found = false;
+    string_view value;
+    bool bad = false;
+};
+
+// Scans text as newline-separated records in one pass of 64-byte blocks,
+// calling visit(result, record, name) for each. Strings cannot contain raw
+// newlines, so a newline inside one ends a malformed record and the quote
+// state after it is reset.
+template <typename Visit>
+void scanRecords(string_view text, string_view field, string_view reserved, string & storage, Visit visit)
+{
+    RecordParser parser(text, field, reserved, storage);
+    parser.start(0);
+    auto finish = [&](size_t end) {
+        string_view record, name;
+        visit(parser.finish(end, record, name), record, name);
+    };
+
+    bool stringCarry = false;
+    bool escapeCarry = false;
+    char tail[64];
+    for (size_t base = 0; base < text.size(); base += 64) {
+        const char * p = text.data() + base;
+        if (text.size() - base < 64) {
+            memset(tail, ' ', sizeof tail);
+            memcpy(tail, p, text.size() - base);
+            p = tail;
+        }
+        BlockMasks masks = classify(p);
+        uint64_t quotes = masks.quote & ~escapedBytes(masks.backslash, escapeCarry);
+        uint64_t inString = prefixXor(quotes) ^ (stringCarry ? ~uint64_t(0) : 0);
+        // Newlines always, other control bytes only inside strings, where
+        // they are not allowed.
+        auto tokens = [&] { return (masks.structural & ~inString) | masks.control; };
+        for (uint64_t m = tokens(); m; m &= m - 1) {
+            unsigned bit = countr_zero(m);
+            size_t at = base + bit;
+            char c = p[bit];
+            if (c == '\n') {
+                if ((inString >> bit) & 1) {
+                    parser.fail();
+                    // Flipping the parity from the newline on closes the string.
+                    uint64_t from = ~((uint64_t(1) << bit) - 1);
+                    inString ^= from;
+                    m = tokens() & from;
+                }
+                finish(at);
+                parser.start(at + 1);
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                if ((inString >> bit) & 1)
+                    parser.fail();
+            } else {
+                parser.token(at, c);
+            }
+        }
+        stringCarry = int64_t(inString) < 0;
+    }
+    if (stringCarry)
+        parser.fail();
+    finish(text.size());
+}
+
+} // namespace
+
+bool extractJsonField(string_view record, string_view field, string_view & value, string & storage)
+{
+    size_t found = 0;
+    size_t records = 0;
+    scanRecords(record, field, {}, storage, [&](RecordParser::Result result, string_view, string_view name) {
+        ++records;
+        if (result == RecordParser::Result::Found) {
+            ++found;
+            value = name;
+        }
+    });
+    return found == 1 && records == 1;
+}
+
+size_t splitJsonl(string_view chunk, string_view field, vector<string_view> & names, vector<string_view> * records,
+                  string & storage)
+{
+    storage.clear();
+    storage.reserve(chunk.size());
+    size_t skipped = 0;
+    scanRecords(chunk, field, records ? greetingMember : string_view(), storage, [&](RecordParser::Result result, string_view record, string_view name) {
+        if (result == RecordParser::Result::Skipped) {
+            ++skipped;
+        } else if (result == RecordParser::Result::Found) {
+            names.push_back(name);
+            if (records)
+                records->push_back(record);
+        }
+    });
+    return skipped;
+}
+
+void writeJsonlGreetings(const vector<string_view> & records, const GreetingBatch & greetings, string & output)
+{
+    static constexpr string_view member = "\"greeting\":\"";   // greetingMember, quoted
+    size_t bytes = greetings.text.size() + records.size() * (member.size() + 4);
+    for (string_view record : records)
+        bytes += record.size();
+    output.reserve(output.size() + bytes);
+    for (size_t i = 0; i < records.size(); ++i) {
+        // Records come from splitJsonl: trimmed, ending in the closing brace.
+        string_view record = records[i];
+        size_t close = record.size() - 1;
+        size_t last = record.find_last_not_of(" \t\r\n", close - 1);
+        output.append(record.data(), close);
+        if (record[last] != '{')
+            output += ',';
+        output += member;
+        appendJsonEscaped(greetings[i], output);
+        output += "\"}\n";
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "hello.h"
+
+// JSON Lines: one JSON object per line. Chunks are scanned 64 bytes at a
+// time into bitmasks of quotes, backslashes, brackets and colons, strings
+// are found with a prefix XOR over the unescaped quotes, and only brackets,
+// colons and newlines outside strings are walked, so a field is extracted
+// without building a document. Records are checked for balanced nesting,
+// terminated strings, valid escapes in the field and no raw control
+// characters inside strings; they are not fully validated.
+
+// Finds the string value of the top-level field of the object in record.
+// Returns false if the record is malformed, has no such field, or its value
+// is not a string. Values with escapes are unescaped and appended to
+// storage, whose capacity must already cover them; others view record.
+bool extractJsonField(std::string_view record, std::string_view field, std::string_view & value, std::string & storage);
+
+// The member writeJsonlGreetings adds.
+constexpr std::string_view greetingMember = "greeting";
+
+// Splits newline-separated records and appends the field of each to names,
+// and the record itself to records if not null. Blank lines are ignored;
+// records without a usable field are skipped and counted. storage is
+// cleared first and must outlive the views. Returns the number skipped.
+// With records, those that already have a top-level greetingMember are
+// skipped and counted too, rather than given a second one.
+size_t splitJsonl(std::string_view chunk, std::string_view field, std::vector<std::string_view> & names,
+                  std::vector<std::string_view> * records, std::string & storage);
+
+// Writes each record followed by greetings[i] as a "greeting" member,
+// copying the record's bytes up to its closing brace verbatim. Appends to
+// output, one record per line.
+void writeJsonlGreetings(const std::vector<std::string_view> & records, const GreetingBatch & greetings,
+                         std::string & output);
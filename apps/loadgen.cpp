@@ -0,0 +1,361 @@
+// Open-loop load generator for greetings. Requests go out on a fixed
+// schedule (constant or Poisson arrivals) whether or not earlier ones have
+// been answered, and latency is measured from each request's intended send
+// time, so time a request spends waiting behind a stalled system is counted
+// instead of silently omitted. Sweeping the rate shows where the latency
+// curve leaves the floor: the saturation knee.
+//
+//   loadgen --target inproc --sweep 10000:200000:10000
+//   loadgen --target localhost:7070 --rate 50000 --duration 10 --histogram out.hgrm
+//
+// The inproc target calls generateHelloString on --senders threads; the
+// HOST:PORT target drives the greeting server over --senders connections,
+// pipelining "G <name>" requests and matching responses in order. Requests
+// a server sheds ("ERR overloaded") are counted apart and left out of the
+// latency and the achieved rate.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blockingqueue.h"
+#include "hdrhistogram.h"
+#include "hello.h"
+#include "tcp.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+namespace {
+
+struct LoadOptions
+{
+    string target = "inproc";
+    vector<double> rates{10000};
+    bool poisson = false;
+    double duration = 5;
+    unsigned senders = 4;
+    string name = "Jim";
+    string histogramPath;
+    double kneeFactor = 10;
+};
+
+struct RunResult
+{
+    double targetRate;
+    double achievedRate;
+    uint64_t sent;
+    uint64_t shed;
+    HdrHistogram latency;
+};
+
+double parseDouble(const string & option, const string & value)
+{
+    try {
+        size_t used = 0;
+        double number = stod(value, &used);
+        if (used == value.size() && number >= 0)
+            return number;
+    } catch (const exception &) {
+    }
+    throw invalid_argument(option + ": expected a non-negative number, got '" + value + "'");
+}
+
+LoadOptions parseLoadOptions(int argc, char ** argv)
+{
+    LoadOptions options;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        auto value = [&] {
+            if (i + 1 >= argc)
+                throw invalid_argument(arg + ": missing value");
+            return string(argv[++i]);
+        };
+        if (arg == "--target") {
+            options.target = value();
+        } else if (arg == "--rate") {
+            options.rates = {parseDouble(arg, value())};
+        } else if (arg == "--sweep") {
+            string spec = value();
+            size_t a = spec.find(':');
+            size_t b = spec.find(':', a + 1);
+            if (a == string::npos || b == string::npos)
+                throw invalid_argument("--sweep: expected START:END:STEP");
+            double start = parseDouble(arg, spec.substr(0, a));
+            double end = parseDouble(arg, spec.substr(a + 1, b - a - 1));
+            double step = parseDouble(arg, spec.substr(b + 1));
+            if (step <= 0 || end < start)
+                throw invalid_argument("--sweep: need START <= END and STEP > 0");
+            options.rates.clear();
+            for (double rate = start; rate <= end + step / 2; rate += step)
+                options.rates.push_back(rate);
+        } else if (arg == "--distribution") {
+            string kind = value();
+            if (kind != "constant" && kind != "poisson")
+                throw invalid_argument("--distribution: expected constant or poisson");
+            options.poisson = kind == "poisson";
+        } else if (arg == "--duration") {
+            options.duration = parseDouble(arg, value());
+        } else if (arg == "--senders") {
+            options.senders = max(1u, static_cast<unsigned>(parseDouble(arg, value())));
+        } else if (arg == "--name") {
+            options.name = value();
+        } else if (arg == "--histogram") {
+            options.histogramPath = value();
+        } else if (arg == "--knee-factor") {
+            options.kneeFactor = parseDouble(arg, value());
+        } else {
+            throw invalid_argument("unknown option '" + arg + "'");
+        }
+    }
+    if (find(options.rates.begin(), options.rates.end(), 0.0) != options.rates.end())
+        throw invalid_argument("rates must be positive");
+    return options;
+}
+
+void printLoadUsage(ostream & out)
+{
+    out << "usage: loadgen [options]\n"
+           "  --target inproc|HOST:PORT   call generateHelloString in process, or a greeting server\n"
+           "  --rate N                    requests per second (default 10000)\n"
+           "  --sweep START:END:STEP      run each rate in turn and report the saturation knee\n"
+           "  --distribution constant|poisson  inter-arrival times (default constant)\n"
+           "  --duration SECONDS          per rate (default 5)\n"
+           "  --senders N                 sender threads or connections (default 4)\n"
+           "  --name NAME                 name to greet (default Jim)\n"
+           "  --histogram PATH            write the last run's latency distribution (.hgrm, us)\n"
+           "  --knee-factor X             knee = first rate whose p99 exceeds X times the\n"
+           "                              first rate's p99, or that falls 5% short of its rate\n";
+}
+
+// Intended send times for one sender. Senders split the total rate evenly,
+// so together they produce the requested arrival process.
+class Schedule
+{
+public:
+    Schedule(Clock::time_point start, double rate, unsigned sender, unsigned senders, bool poisson)
+        : poisson(poisson), meanGapNanos(1e9 * senders / rate), random(sender * 7919 + 1)
+    {
+        // Constant senders are staggered so their sends interleave.
+        next = double(start.time_since_epoch().count()) + (poisson ? draw() : meanGapNanos * sender / senders);
+    }
+
+    Clock::time_point peek() const
+    {
+        return Clock::time_point(Clock::duration(static_cast<Clock::rep>(next)));
+    }
+
+    void advance() { next += poisson ? draw() : meanGapNanos; }
+
+private:
+    double draw() { return exponential(random) * meanGapNanos; }
+
+    bool poisson;
+    double meanGapNanos;
+    double next;
+    mt19937_64 random;
+    exponential_distribution<double> exponential{1.0};
+};
+
+void waitUntil(Clock::time_point when)
+{
+    for (;;) {
+        Clock::duration left = when - Clock::now();
+        if (left <= Clock::duration::zero())
+            return;
+        if (left > chrono::microseconds(200))
+            this_thread::sleep_for(left - chrono::microseconds(100));
+        else
+            this_thread::yield();
+    }
+}
+
+uint64_t nanosSince(Clock::time_point intended)
+{
+    return static_cast<uint64_t>(max<int64_t>(0, chrono::duration_cast<chrono::nanoseconds>(Clock::now() - intended).count()));
+}
+
+// Keeps the in-process greetings from being optimized away.
+atomic<size_t> greetedBytes{0};
+
+void runInProcessSender(const LoadOptions & options, Schedule schedule, Clock::time_point end, HdrHistogram & latency,
+                        atomic<uint64_t> & sent)
+{
+    size_t sink = 0;
+    for (; schedule.peek() < end; schedule.advance()) {
+        Clock::time_point intended = schedule.peek();
+        waitUntil(intended);
+        sink += generateHelloString(options.name).size();
+        latency.record(nanosSince(intended));
+        ++sent;
+    }
+    greetedBytes.fetch_add(sink, memory_order_relaxed);
+}
+
+void runTcpSender(const LoadOptions & options, const string & host, unsigned short port, Schedule schedule,
+                  Clock::time_point end, HdrHistogram & latency, atomic<uint64_t> & sent, atomic<uint64_t> & shed)
+{
+    TcpSocket socket = connectTcp(host, port);
+    BlockingQueue<Clock::time_point> inFlight;
+    string request = "G " + options.name + "\n";
+
+    exception_ptr receiveError;
+    thread receiver([&] {
+        try {
+            LineReader reader(socket);
+            string_view line;
+            while (optional<Clock::time_point> intended = inFlight.pop()) {
+                if (!reader.next(line))
+                    throw runtime_error("server closed the connection");
+                if (line == "ERR overloaded")
+                    ++shed;
+                else
+                    latency.record(nanosSince(*intended));
+            }
+        } catch (...) {
+            receiveError = current_exception();
+            inFlight.close();
+        }
+    });
+
+    try {
+        string burst;
+        while (schedule.peek() < end) {
+            waitUntil(schedule.peek());
+            // Everything already due goes out in one write, each request
+            // still timed from its own intended send time.
+            Clock::time_point now = Clock::now();
+            burst.clear();
+            while (schedule.peek() <= now && schedule.peek() < end) {
+                if (!inFlight.push(schedule.peek()))
+                    break;
+                burst += request;
+                schedule.advance();
+                ++sent;
+            }
+            if (burst.empty())
+                break;
+            socket.sendAll(burst);
+        }
+    } catch (...) {
+        socket.shutdown();
+        inFlight.close();
+        receiver.join();
+        throw;
+    }
+    inFlight.close();
+    receiver.join();
+    if (receiveError)
+        rethrow_exception(receiveError);
+}
+
+RunResult runRate(const LoadOptions & options, double rate)
+{
+    string host;
+    unsigned short port = 0;
+    if (options.target != "inproc") {
+        size_t colon = options.target.rfind(':');
+        if (colon == string::npos)
+            throw invalid_argument("--target: expected inproc or HOST:PORT");
+        host = options.target.substr(0, colon);
+        port = static_cast<unsigned short>(parseDouble("--target", options.target.substr(colon + 1)));
+    }
+
+    Clock::time_point start = Clock::now() + chrono::milliseconds(50);
+    Clock::time_point end = start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(options.duration));
+    vector<HdrHistogram> latencies(options.senders);
+    atomic<uint64_t> sent{0};
+    atomic<uint64_t> shed{0};
+    vector<thread> senders;
+    mutex errorMutex;
+    exception_ptr error;
+    for (unsigned s = 0; s < options.senders; ++s) {
+        senders.emplace_back([&, s] {
+            try {
+                Schedule schedule(start, rate, s, options.senders, options.poisson);
+                if (host.empty())
+                    runInProcessSender(options, schedule, end, latencies[s], sent);
+                else
+                    runTcpSender(options, host, port, schedule, end, latencies[s], sent, shed);
+            } catch (...) {
+                lock_guard<mutex> lock(errorMutex);
+                error = current_exception();
+            }
+        });
+    }
+    for (thread & sender : senders)
+        sender.join();
+    if (error)
+        rethrow_exception(error);
+    double elapsed = chrono::duration<double>(Clock::now() - start).count();
+
+    RunResult result{rate, 0, sent, shed, HdrHistogram()};
+    for (const HdrHistogram & latency : latencies)
+        result.latency.add(latency);
+    result.achievedRate = result.latency.count() / elapsed;
+    return result;
+}
+
+void printResult(const RunResult & result)
+{
+    auto us = [&](double p) { return result.latency.valueAtPercentile(p) / 1000.0; };
+    printf("%12.0f %12.0f %10.1f %10.1f %10.1f %10.1f %12.1f %10llu\n", result.targetRate, result.achievedRate, us(50),
+           us(90), us(99), us(99.9), result.latency.max() / 1000.0, (unsigned long long)result.shed);
+    fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    LoadOptions options;
+    try {
+        options = parseLoadOptions(argc, argv);
+    } catch (const invalid_argument & e) {
+        cerr << "loadgen: " << e.what() << "\n";
+        printLoadUsage(cerr);
+        return 2;
+    }
+
+    try {
+        printf("target=%s distribution=%s senders=%u duration=%.1fs\n", options.target.c_str(),
+               options.poisson ? "poisson" : "constant", options.senders, options.duration);
+        printf("%12s %12s %10s %10s %10s %10s %12s %10s\n", "target/s", "achieved/s", "p50 us", "p90 us", "p99 us",
+               "p99.9 us", "max us", "shed");
+        double baselineP99 = 0;
+        double knee = 0;
+        for (double rate : options.rates) {
+            RunResult result = runRate(options, rate);
+            printResult(result);
+            double p99 = double(result.latency.valueAtPercentile(99));
+            if (baselineP99 == 0)
+                baselineP99 = max(p99, 1.0);
+            bool saturated = result.achievedRate < 0.95 * rate || p99 > options.kneeFactor * baselineP99;
+            if (saturated && knee == 0 && options.rates.size() > 1)
+                knee = rate;
+            if (!options.histogramPath.empty()) {
+                ofstream histogram(options.histogramPath);
+                result.latency.writePercentileDistribution(histogram, 1000);
+            }
+        }
+        if (options.rates.size() > 1) {
+            if (knee > 0)
+                printf("saturation knee at about %.0f requests/s\n", knee);
+            else
+                printf("no saturation up to %.0f requests/s\n", options.rates.back());
+        }
+    } catch (const exception & e) {
+        cerr << "loadgen: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,9 +1,90 @@
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include "asynclog.h"
+#include "distinct.h"
+#include "follow.h"
 #include "hello.h"
+#include "merge.h"
+#include "options.h"
+#include "pipeline.h"
+#include "sort.h"
+#include "stats.h"
+#include "trace.h"
 
-int main(int, char**) {
-    std::string helloJim = generateHelloString("Jim");
-    std::cout << helloJim << std::endl;
+namespace {
+
+const LogFormat startFormat("main: started, {} to {}");
+const LogFormat doneFormat("main: done, {} records in {} s");
+const LogFormat failedFormat("main: failed: {}");
+
+}
+
+int main(int argc, char** argv) {
+    if (argc <= 1) {
+        std::string helloJim = generateHelloString("Jim");
+        std::cout << helloJim << std::endl;
+        return 0;
+    }
+
+    // Declared out here so that failures are logged too; destroyed last,
+    // after writing what was logged.
+    std::unique_ptr<AsyncLog> log;
+    try {
+        Options options = parseOptions(argc, argv);
+        if (options.help) {
+            printUsage(std::cout);
+            return 0;
+        }
+        if (!options.logPath.empty()) {
+            log = std::make_unique<AsyncLog>(AsyncLogConfig{options.logPath});
+            log->flushOnCrash();
+            processLog = log.get();
+            logEvent(startFormat, options.inputPath, options.outputPath);
+        }
+        if (!options.tracePath.empty())
+            enableTracing();
+        if (!options.stats.empty())
+            enableStats();
+
+        auto start = std::chrono::steady_clock::now();
+        RunStats stats;
+        if (options.merge)
+            runMerge(options, stats);
+        else if (options.distinct)
+            runDistinct(options, stats);
+        else if (!options.sort.empty())
+            runSorted(options, stats);
+        else if (options.follow)
+            runFollow(options, stats);
+        else
+            runPipeline(options, stats);
+        logEvent(doneFormat, stats.records.load(),
+                 std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        if (stats.skippedRecords > 0)
+            std::cerr << "main: skipped " << stats.skippedRecords << " malformed records\n";
+        if (!options.stats.empty()) {
+            std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+            writeStatsReport(std::cerr, stats, wall.count(), options.stats == "json");
+        }
+
+        if (!options.tracePath.empty()) {
+            std::ofstream trace(options.tracePath);
+            writeChromeTrace(trace);
+            if (!trace)
+                throw std::runtime_error(options.tracePath + ": cannot write trace");
+        }
+    } catch (const std::invalid_argument & e) {
+        std::cerr << "main: " << e.what() << "\n";
+        printUsage(std::cerr);
+        return 2;
+    } catch (const std::exception & e) {
+        logEvent(failedFormat, e.what());
+        std::cerr << "main: " << e.what() << std::endl;
+        return 1;
+    }
 
     return 0;
-}
\ No newline at end of file
+}
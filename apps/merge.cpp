@@ -0,0 +1,253 @@
+#include "merge.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blockingqueue.h"
+#include "file.h"
+#include "namesort.h"
+
+using namespace std;
+
+namespace {
+
+// Each input is read ahead, and released behind, this much at a time.
+constexpr size_t readAhead = 4 << 20;
+constexpr size_t outputBufferSize = 8 << 20;
+constexpr size_t outputBuffers = 3;
+
+// One mapped input, consumed a record at a time.
+class MappedInput
+{
+public:
+    explicit MappedInput(const string & path) : path(path)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw system_error(errno, generic_category(), path);
+        struct stat status;
+        if (fstat(fd, &status) != 0) {
+            int error = errno;
+            close(fd);
+            throw system_error(error, generic_category(), path);
+        }
+        size = size_t(status.st_size);
+        if (size > 0) {
+            void * mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                int error = errno;
+                close(fd);
+                throw system_error(error, generic_category(), path);
+            }
+            data = static_cast<const char *>(mapping);
+            madvise(const_cast<char *>(data), size, MADV_SEQUENTIAL);
+        }
+        close(fd);
+    }
+
+    ~MappedInput()
+    {
+        if (data)
+            munmap(const_cast<char *>(data), size);
+    }
+
+    MappedInput(const MappedInput &) = delete;
+    MappedInput & operator=(const MappedInput &) = delete;
+
+    // The next record, without its newline, or nullopt at the end.
+    optional<string_view> next()
+    {
+        if (position >= size)
+            return nullopt;
+        if (position >= prefetched)
+            prefetch();
+        const char * start = data + position;
+        const char * newline = static_cast<const char *>(memchr(start, '\n', size - position));
+        size_t length = newline ? size_t(newline - start) : size - position;
+        position += length + 1;
+        string_view record(start, length);
+        ++records;
+        if (records > 1 && record < previous)
+            throw runtime_error(path + ": record " + to_string(records) + " is out of order; inputs must be sorted");
+        previous = record;
+        return record;
+    }
+
+    size_t bytes() const { return size; }
+
+private:
+    // Asks for the next window to be read in the background, so the merge
+    // rarely waits on a page fault, and drops the pages of the window before
+    // the last, which the merge has finished with, so that with many inputs
+    // only a few windows of each stay resident. A dropped page is read in
+    // again if touched, so views into it stay valid.
+    void prefetch()
+    {
+        size_t page = size_t(sysconf(_SC_PAGESIZE));
+        size_t from = position / page * page;
+        size_t length = min(2 * readAhead, size - from);
+        madvise(const_cast<char *>(data) + from, length, MADV_WILLNEED);
+        prefetched = from + readAhead;
+        if (from >= 2 * readAhead)
+            madvise(const_cast<char *>(data) + from - 2 * readAhead, readAhead, MADV_DONTNEED);
+    }
+
+    string path;
+    const char * data = nullptr;
+    size_t size = 0;
+    size_t position = 0;
+    size_t prefetched = 0;
+    uint64_t records = 0;
+    string_view previous;
+};
+
+// Writes full buffers on its own thread while the merge fills the next.
+class BufferedOutput
+{
+public:
+    BufferedOutput(FILE * out, const string & path, RunStats & stats) : out(out), path(path), stats(stats)
+    {
+        buffers.resize(outputBuffers);
+        for (string & buffer : buffers) {
+            buffer.reserve(outputBufferSize);
+            freeBuffers.push(&buffer);
+        }
+        current = *freeBuffers.pop();
+        writer = thread([this] { writeBuffers(); });
+    }
+
+    ~BufferedOutput()
+    {
+        if (writer.joinable()) {
+            fullBuffers.close();
+            writer.join();
+        }
+    }
+
+    void append(string_view record)
+    {
+        if (current->size() + record.size() + 1 > outputBufferSize && !current->empty())
+            swapBuffer();
+        current->append(record);
+        *current += '\n';
+    }
+
+    void finish()
+    {
+        if (!current->empty())
+            swapBuffer();
+        fullBuffers.close();
+        writer.join();
+        if (error)
+            rethrow_exception(error);
+        if (fflush(out) != 0)
+            throw system_error(errno, generic_category(), path);
+    }
+
+private:
+    void swapBuffer()
+    {
+        fullBuffers.push(current);
+        optional<string *> next = freeBuffers.pop();
+        if (!next)
+            rethrow_exception(error);   // the writer failed and closed the queue
+        current = *next;
+    }
+
+    void writeBuffers()
+    {
+        StageScope stage(Stage::Write);
+        while (optional<string *> next = fullBuffers.pop()) {
+            string & buffer = **next;
+            if (!error) {
+                if (fwrite(buffer.data(), 1, buffer.size(), out) == buffer.size()) {
+                    stats.outputBytes += buffer.size();
+                } else {
+                    error = make_exception_ptr(system_error(errno, generic_category(), path));
+                    freeBuffers.close();
+                }
+            }
+            buffer.clear();
+            freeBuffers.push(&buffer);
+        }
+    }
+
+    FILE * out;
+    string path;
+    RunStats & stats;
+    vector<string> buffers;
+    BlockingQueue<string *> freeBuffers;
+    BlockingQueue<string *> fullBuffers;
+    string * current = nullptr;
+    exception_ptr error;   // set by the writer before it closes freeBuffers
+    thread writer;
+};
+
+} // namespace
+
+void runMerge(const Options & options, RunStats & stats)
+{
+    // Opening the output truncates it, which would pull an input out from
+    // under its mapping.
+    struct stat output;
+    if (options.outputPath != "-" && stat(options.outputPath.c_str(), &output) == 0) {
+        for (const string & path : options.mergeInputs) {
+            struct stat input;
+            if (stat(path.c_str(), &input) == 0 && input.st_dev == output.st_dev && input.st_ino == output.st_ino)
+                throw invalid_argument("--merge: the output " + options.outputPath + " is also an input");
+        }
+    }
+
+    vector<unique_ptr<MappedInput>> inputs;
+    vector<optional<string_view>> heads;
+    for (const string & path : options.mergeInputs) {
+        inputs.push_back(make_unique<MappedInput>(path));
+        stats.inputBytes += inputs.back()->bytes();
+        heads.push_back(inputs.back()->next());
+    }
+
+    File out(options.outputPath, true);
+    BufferedOutput buffered(out.get(), options.outputPath, stats);
+    {
+        StageScope stage(Stage::Merge);
+        LoserTree tree(heads);
+        optional<string_view> last;
+        uint64_t records = 0;
+        uint64_t written = 0;
+        while (!tree.empty()) {
+            string_view record = tree.top();
+            ++records;
+            // Equal records come out together, so comparing with the last
+            // one written is enough to drop repeats.
+            if (!options.distinct || !last || record != *last) {
+                buffered.append(record);
+                ++written;
+                last = record;
+            }
+            if (optional<string_view> next = inputs[tree.winner()]->next())
+                tree.replace(*next);
+            else
+                tree.exhaust();
+        }
+        stats.records += records;
+        if (options.distinct)
+            stats.distinctNames += written;
+    }
+    buffered.finish();
+    stats.noteBuffer(Stage::Write, outputBuffers * outputBufferSize);
+}
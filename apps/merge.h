@@ -0,0 +1,12 @@
+#pragma once
+
+#include "options.h"
+#include "stats.h"
+
+// Merges options.mergeInputs, files of newline-separated records each
+// sorted bytewise (as --sort name writes them, or LC_ALL=C sort), into one
+// sorted output; with options.distinct, records equal to the one before are
+// dropped. The inputs are memory-mapped and read ahead, the records merged
+// with a loser tree, and the output handed in large buffers to a writer
+// thread. Throws std::runtime_error if an input turns out not to be sorted.
+void runMerge(const Options & options, RunStats & stats);
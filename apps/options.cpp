@@ -0,0 +1,293 @@
+#include "options.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+size_t parseSize(const string & option, const string & value)
+{
+    size_t used = 0;
+    unsigned long long number = 0;
+    try {
+        number = stoull(value, &used);
+    } catch (const exception &) {
+        throw invalid_argument(option + ": expected a number, got '" + value + "'");
+    }
+    string suffix = value.substr(used);
+    if (suffix == "k" || suffix == "K")
+        number <<= 10;
+    else if (suffix == "m" || suffix == "M")
+        number <<= 20;
+    else if (suffix == "g" || suffix == "G")
+        number <<= 30;
+    else if (!suffix.empty())
+        throw invalid_argument(option + ": unknown size suffix '" + suffix + "'");
+    return static_cast<size_t>(number);
+}
+
+// A thread count: digits only, since size suffixes would make -j 2k start
+// 2048 workers, and at most maxThreads.
+unsigned parseThreads(const string & option, const string & value)
+{
+    constexpr unsigned maxThreads = 1024;
+    if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != string::npos)
+        throw invalid_argument(option + ": expected a number of threads, got '" + value + "'");
+    unsigned long threads = stoul(value);
+    if (threads > maxThreads)
+        throw invalid_argument(option + ": at most " + to_string(maxThreads) + " threads, got " + value);
+    return unsigned(threads);
+}
+
+char parseDelimiter(const string & option, const string & value)
+{
+    if (value == "\\t" || value == "tab")
+        return '\t';
+    if (value.size() != 1)
+        throw invalid_argument(option + ": expected a single character, got '" + value + "'");
+    return value[0];
+}
+
+} // namespace
+
+Options parseOptions(int argc, char ** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        string value;
+        bool hasValue = false;
+        if (size_t eq = arg.find('='); arg.rfind("--", 0) == 0 && eq != string::npos) {
+            value = arg.substr(eq + 1);
+            arg.resize(eq);
+            hasValue = true;
+        }
+        auto next = [&]() -> const string & {
+            if (!hasValue) {
+                if (i + 1 >= argc)
+                    throw invalid_argument(arg + ": missing value");
+                value = argv[++i];
+                hasValue = true;
+            }
+            return value;
+        };
+
+        if (arg == "-h" || arg == "--help")
+            options.help = true;
+        else if (arg == "-i" || arg == "--input")
+            options.inputPath = next();
+        else if (arg == "-o" || arg == "--output")
+            options.outputPath = next();
+        else if (arg == "-j" || arg == "--threads")
+            options.threads = parseThreads(arg, next());
+        else if (arg == "--chunk-size")
+            options.chunkSize = parseSize(arg, next());
+        else if (arg == "--trace")
+            options.tracePath = next();
+        else if (arg == "--transliterate")
+            options.transliterate = true;
+        else if (arg == "--distinct")
+            options.distinct = true;
+        else if (arg == "--memory-budget")
+            options.memoryBudget = parseSize(arg, next());
+        else if (arg == "--spill-dir")
+            options.spillDir = next();
+        else if (arg == "--csv")
+            options.csvColumn = next();
+        else if (arg == "--csv-delimiter")
+            options.csvDelimiter = parseDelimiter(arg, next());
+        else if (arg == "--csv-no-header")
+            options.csvHeader = false;
+        else if (arg == "--jsonl")
+            options.jsonlField = next();
+        else if (arg == "--jsonl-output")
+            options.jsonlOutput = true;
+        else if (arg == "--sort") {
+            options.sort = next();
+            if (options.sort != "name" && options.sort != "first-letter")
+                throw invalid_argument("--sort: expected name or first-letter, got '" + options.sort + "'");
+        } else if (arg == "--merge") {
+            options.merge = true;
+        } else if (arg == "-" || arg[0] != '-') {
+            options.mergeInputs.push_back(arg);
+        } else if (arg == "--output-format") {
+            options.outputFormat = next();
+            if (options.outputFormat != "text" && options.outputFormat != "blocks" &&
+                options.outputFormat != "parquet")
+                throw invalid_argument("--output-format: expected text, blocks or parquet, got '" +
+                                       options.outputFormat + "'");
+        } else if (arg == "--block-size") {
+            options.blockSize = parseSize(arg, next());
+        } else if (arg == "--compress") {
+            options.compress = next();
+            if (options.compress != "lz4")
+                throw invalid_argument("--compress: expected lz4, got '" + options.compress + "'");
+        } else if (arg == "--tee") {
+            TeeTarget target{next()};
+            size_t comma = target.target.rfind(',');
+            if (comma != string::npos) {
+                string policy = target.target.substr(comma + 1);
+                if (policy == "block" || policy == "drop" || policy == "spill") {
+                    target.policy = policy;
+                    target.target.resize(comma);
+                }
+            }
+            if (target.target.empty() || target.target == "|")
+                throw invalid_argument("--tee: expected a target");
+            if (target.target.compare(0, 4, "tcp:") == 0) {
+                size_t colon = target.target.rfind(':');
+                string port = target.target.substr(colon + 1);
+                bool valid = colon >= 5 && !port.empty() && port.size() <= 5 &&
+                             port.find_first_not_of("0123456789") == string::npos && stoul(port) > 0 &&
+                             stoul(port) <= 65535;
+                if (!valid)
+                    throw invalid_argument("--tee: expected tcp:HOST:PORT, got '" + target.target + "'");
+            }
+            options.tee.push_back(target);
+        } else if (arg == "--tee-buffer") {
+            options.teeBuffer = parseSize(arg, next());
+        } else if (arg == "--follow") {
+            options.follow = true;
+        } else if (arg == "--follow-state") {
+            options.followState = next();
+        } else if (arg == "--rules") {
+            options.rulesPath = next();
+        } else if (arg == "--stats") {
+            options.stats = hasValue ? value : "text";
+            if (options.stats != "text" && options.stats != "json")
+                throw invalid_argument("--stats: expected text or json, got '" + options.stats + "'");
+        } else if (arg == "--log") {
+            options.logPath = next();
+        } else {
+            throw invalid_argument("unknown option '" + arg + "'");
+        }
+    }
+
+    if (options.threads == 0)
+        options.threads = max(1u, thread::hardware_concurrency());
+    if (options.chunkSize == 0)
+        throw invalid_argument("--chunk-size must be positive");
+    if (!options.csvColumn.empty() && !options.jsonlField.empty())
+        throw invalid_argument("--csv and --jsonl cannot be combined");
+    if (options.jsonlOutput && options.jsonlField.empty())
+        throw invalid_argument("--jsonl-output needs --jsonl");
+    if (options.jsonlOutput && options.distinct)
+        throw invalid_argument("--jsonl-output cannot be combined with --distinct");
+    if (options.jsonlOutput && options.jsonlField == "greeting")
+        throw invalid_argument("--jsonl-output adds the greeting member, so it cannot be --jsonl's FIELD");
+    if (options.blockSize == 0 || options.blockSize > (size_t(1) << 30))
+        throw invalid_argument("--block-size must be between 1 and 1G");
+    if (options.outputFormat != "text" && (options.distinct || options.follow || options.jsonlOutput))
+        throw invalid_argument("--output-format " + options.outputFormat +
+                               " cannot be combined with --distinct, --follow or --jsonl-output");
+    if (!options.compress.empty() && (options.distinct || options.outputFormat == "blocks"))
+        throw invalid_argument("--compress cannot be combined with --distinct or --output-format blocks");
+    if (!options.tee.empty() && (options.distinct || options.merge))
+        throw invalid_argument("--tee cannot be combined with --distinct or --merge");
+    for (const TeeTarget & target : options.tee) {
+        if (target.policy == "drop" && (options.outputFormat != "text" || !options.compress.empty()))
+            throw invalid_argument("--tee " + target.target + ",drop needs uncompressed text output");
+        if (target.target == "-" && options.outputPath == "-")
+            throw invalid_argument("--tee -: the output already goes to stdout");
+    }
+    if (options.teeBuffer == 0)
+        throw invalid_argument("--tee-buffer must be positive");
+    if (!options.mergeInputs.empty() && !options.merge)
+        throw invalid_argument("unexpected argument '" + options.mergeInputs[0] + "'; input files are for --merge");
+    if (options.merge) {
+        if (options.mergeInputs.empty())
+            throw invalid_argument("--merge needs input files");
+        if (options.inputPath != "-" || !options.csvColumn.empty() || !options.jsonlField.empty() ||
+            options.transliterate || !options.rulesPath.empty() || !options.sort.empty() || options.follow ||
+            options.outputFormat != "text" || !options.compress.empty())
+            throw invalid_argument("--merge only takes --distinct, -o and --stats besides its input files");
+        if (find(options.mergeInputs.begin(), options.mergeInputs.end(), "-") != options.mergeInputs.end())
+            throw invalid_argument("--merge inputs must be files, not '-'");
+    }
+    if (!options.sort.empty() && (options.distinct || options.follow || options.jsonlOutput))
+        throw invalid_argument("--sort cannot be combined with --distinct, --follow or --jsonl-output");
+    if (!options.followState.empty() && !options.follow)
+        throw invalid_argument("--follow-state needs --follow");
+    if (options.follow && options.inputPath == "-")
+        throw invalid_argument("--follow needs an input file");
+    if (options.follow && options.distinct)
+        throw invalid_argument("--follow cannot be combined with --distinct");
+    if (options.follow && !options.csvColumn.empty() && options.csvHeader)
+        throw invalid_argument("--follow with --csv needs --csv-no-header");
+    if (options.spillDir.empty()) {
+        const char * tmp = getenv("TMPDIR");
+        options.spillDir = tmp && *tmp ? tmp : "/tmp";
+    }
+    return options;
+}
+
+void printUsage(ostream & out)
+{
+    out << "usage: main [options]\n"
+           "       main --merge [--distinct] [-o PATH] FILE...\n"
+           "Greets every line of the input. Without options prints a single greeting.\n"
+           "\n"
+           "  -i, --input PATH      names, one per line ('-' = stdin, default); gzip or LZ4\n"
+           "                        compressed input is decompressed\n"
+           "  -o, --output PATH     greetings ('-' = stdout, default)\n"
+           "  -j, --threads N       greeting worker threads, at most 1024 (default: one per core)\n"
+           "      --chunk-size N    bytes per pipeline chunk, k/M/G suffixes (default 1M)\n"
+           "      --trace PATH      write per-thread stage spans as Chrome trace JSON\n"
+           "      --transliterate   transliterate names to ASCII before greeting\n"
+           "      --distinct        greet each distinct name once\n"
+           "      --memory-budget N memory cap for --distinct, spills to disk past it (default 1G);\n"
+           "                        parquet row groups are a quarter of it, at most 128M, and compressed\n"
+           "                        input is decoded within an eighth of it\n"
+           "      --spill-dir DIR   directory for --distinct and --tee spill files (default $TMPDIR or /tmp)\n"
+           "      --sort KEY        greet in order: name sorts by name, first-letter groups by first\n"
+           "                        character keeping input order within each group; reads the\n"
+           "                        whole input into memory first\n"
+           "      --merge           merge FILEs, each sorted bytewise, into one sorted output;\n"
+           "                        with --distinct, repeated records are written once\n"
+           "      --csv COLUMN      input is RFC 4180 CSV; greet COLUMN, a header name or 1-based number\n"
+           "      --csv-delimiter C field separator for --csv, 'tab' for tabs (default ',')\n"
+           "      --csv-no-header   the first CSV record is data; COLUMN must be a number\n"
+           "      --jsonl FIELD     input is JSON Lines; greet each object's FIELD string, skipping\n"
+           "                        and counting lines that are malformed or lack it\n"
+           "      --jsonl-output    write each record back with a \"greeting\" member added; records\n"
+           "                        that already have one are skipped and counted\n"
+           "      --output-format F text, one greeting per line (default); blocks, a binary file\n"
+           "                        of checksummed blocks with a row index for random access; or\n"
+           "                        parquet, a Parquet file of name and greeting string columns,\n"
+           "                        dictionary encoded where that is smaller\n"
+           "      --block-size N    target block size for --output-format blocks (default 64k)\n"
+           "      --compress lz4    write the output as an LZ4 frame, compressed on the worker threads;\n"
+           "                        lz4 -d and lz4cat read it. With parquet, compresses its pages\n"
+           "                        as LZ4_RAW\n"
+           "      --tee TARGET[,POLICY]\n"
+           "                        also write the output to TARGET, a file or named pipe, '-' for\n"
+           "                        stdout, |COMMAND or tcp:HOST:PORT; repeatable. POLICY is for a\n"
+           "                        slow TARGET: block waits for it (default), drop skips output it\n"
+           "                        cannot take (text output only), spill queues it in --spill-dir\n"
+           "      --tee-buffer N    output queued per --tee target before its POLICY applies (default 64M)\n"
+           "      --follow          keep greeting records as they are appended to the input file,\n"
+           "                        across truncation and rotation, until SIGINT or SIGTERM\n"
+           "      --follow-state PATH\n"
+           "                        save the offset greeted up to in PATH and resume from it\n"
+           "      --rules PATH      greet by rules, one per line as kind<TAB>pattern<TAB>template;\n"
+           "                        kind is prefix, suffix or exact, template may use {name}\n"
+           "                        and {rest}, the name without the matched prefix or suffix\n"
+           "      --stats[=json]    report peak RSS, page faults, heap allocations and per-stage\n"
+           "                        buffer high-water marks on stderr, as text or one JSON line\n"
+           "      --log PATH        append an event log to PATH, '-' for stderr: a line per chunk\n"
+           "                        greeted, spill, input rotation and failure, written off the\n"
+           "                        worker threads\n"
+           "  -h, --help            show this help\n";
+}
+
+ParquetWriterConfig parquetWriterConfig(const Options & options)
+{
+    ParquetWriterConfig config;
+    config.rowGroupBytes = clamp(options.memoryBudget / 4, size_t(1) << 20, size_t(128) << 20);
+    config.lz4 = options.compress == "lz4";
+    return config;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "parquet.h"
+
+// A --tee sink.
+struct TeeTarget
+{
+    std::string target;            // a path, "-" for stdout, "|command" or "tcp:host:port"
+    std::string policy = "block";  // for a slow sink: "block", "drop" or "spill"
+};
+
+struct Options
+{
+    std::string inputPath = "-";   // "-" is stdin
+    std::string outputPath = "-";  // "-" is stdout
+    unsigned threads = 0;          // greeting workers, 0 = one per core
+    size_t chunkSize = 1 << 20;    // bytes read per pipeline chunk
+    std::string tracePath;         // Chrome trace-event JSON, empty = off
+    bool transliterate = false;    // greet ASCII transliterations of the names
+    bool distinct = false;         // greet each distinct name once
+    std::string sort;              // "name", "first-letter" or empty = input order
+    bool merge = false;            // merge the sorted files in mergeInputs instead of greeting
+    std::vector<std::string> mergeInputs;
+    size_t memoryBudget = size_t(1) << 30;  // cap for --distinct, spills past it; sizes parquet row groups
+    std::string spillDir;          // where --distinct spills, default $TMPDIR or /tmp
+    std::string csvColumn;         // CSV input, greeting this column (header name or 1-based number)
+    char csvDelimiter = ',';
+    bool csvHeader = true;         // first CSV record names the columns
+    std::string jsonlField;        // JSON Lines input, greeting this top-level string field
+    bool jsonlOutput = false;      // write the input records back with a "greeting" member
+    std::string outputFormat = "text";  // "text" lines, "blocks", a seekable block file, or "parquet"
+    size_t blockSize = 64 << 10;   // target block size for --output-format blocks
+    std::string compress;          // "lz4" frames (pages for parquet) or empty = uncompressed output
+    std::vector<TeeTarget> tee;    // more copies of the output
+    size_t teeBuffer = 64 << 20;   // bytes queued per --tee sink before its policy applies
+    bool follow = false;           // keep greeting records appended to the input, like tail -F
+    std::string followState;       // where --follow saves its offset, empty = nowhere
+    std::string rulesPath;         // personalized greeting rules, empty = plain greetings
+    std::string stats;             // resource report on stderr: "text", "json" or empty = off
+    std::string logPath;           // event log appended to, "-" is stderr, empty = off
+    bool help = false;
+};
+
+// Throws std::invalid_argument on unknown or malformed options.
+Options parseOptions(int argc, char ** argv);
+
+void printUsage(std::ostream & out);
+
+// The writer settings for --output-format parquet: row groups of a quarter
+// of the memory budget, between 1M and 128M, as the writer holds about twice
+// that while it encodes one.
+ParquetWriterConfig parquetWriterConfig(const Options & options);
@@ -0,0 +1,332 @@
+#include "pipeline.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "asynclog.h"
+#include "blockfile.h"
+#include "blockingqueue.h"
+#include "chunkreader.h"
+#include "csv.h"
+#include "escape.h"
+#include "file.h"
+#include "hello.h"
+#include "jsonl.h"
+#include "lz4.h"
+#include "parquet.h"
+#include "rulesfile.h"
+#include "stats.h"
+#include "tee.h"
+#include "trace.h"
+#include "transliterate.h"
+
+using namespace std;
+
+namespace {
+
+const LogFormat chunkFormat("chunk {}: {} records, {} bytes in, {} skipped");
+
+struct Chunk
+{
+    int64_t sequence = 0;
+    string input;                 // whole records
+    vector<string_view> names;    // views into input, unescaped or transliterated
+    vector<string_view> records;  // JSON Lines records behind names, for --jsonl-output
+    string unescaped;             // CSV or JSON fields that had escapes
+    string transliterated;
+    GreetingBatch greetings;
+    string output;
+    vector<GreetingBlock> blocks;  // of output, for --output-format blocks
+    string compressed;            // output as LZ4 frame blocks, for --compress
+};
+
+class StreamSource : public ChunkSource
+{
+public:
+    StreamSource(FILE * in, const Options & options)
+        : stream(in, options.inputPath, options.threads), reader(stream, options.chunkSize, !options.csvColumn.empty())
+    {
+    }
+
+    bool next(string & chunk) override { return reader.next(chunk); }
+
+private:
+    InputStream stream;
+    ChunkReader reader;
+};
+
+struct BySequence
+{
+    bool operator()(const Chunk * a, const Chunk * b) const { return a->sequence > b->sequence; }
+};
+
+class Pipeline
+{
+public:
+    Pipeline(const Options & options, RunStats & stats)
+        : options(options), stats(stats), lz4Frame(!options.compress.empty() && options.outputFormat != "parquet")
+    {
+        if (!options.csvColumn.empty())
+            csv.emplace(options.csvColumn, options.csvDelimiter, options.csvHeader);
+        if (!options.rulesPath.empty())
+            rules.emplace(loadGreetingRules(options.rulesPath));
+        if (options.outputFormat == "blocks")
+            blockIndex.emplace(uint32_t(options.blockSize));
+        if (options.outputFormat == "parquet")
+            parquet.emplace(parquetWriterConfig(options));
+        if (!options.tee.empty())
+            tee.emplace(options, stats);
+        size_t poolSize = 2 * options.threads + 2;
+        for (size_t i = 0; i < poolSize; ++i) {
+            chunks.push_back(make_unique<Chunk>());
+            freeChunks.push(chunks.back().get());
+        }
+    }
+
+    void run(ChunkSource & source)
+    {
+        File out(options.outputPath, true);
+
+        vector<thread> threads;
+        threads.emplace_back([&] { guarded("reader", [&] { readStage(source); }); });
+        for (unsigned i = 0; i < options.threads; ++i)
+            threads.emplace_back([this, i] { guarded("worker-" + to_string(i + 1), [this] { workStage(); }); });
+        threads.emplace_back([&] { guarded("writer", [&] { writeStage(out.get(), source); }); });
+        for (thread & t : threads)
+            t.join();
+
+        if (error)
+            rethrow_exception(error);
+        // Chunk buffers are cleared but never shrunk, so their capacities
+        // now are the high-water marks.
+        for (const unique_ptr<Chunk> & chunk : chunks) {
+            stats.noteBuffer(Stage::Read, chunk->input.capacity());
+            stats.noteBuffer(Stage::Split, chunk->names.capacity() * sizeof(string_view) + chunk->unescaped.capacity());
+            if (options.transliterate)
+                stats.noteBuffer(Stage::Transliterate, chunk->transliterated.capacity());
+            stats.noteBuffer(Stage::Greet, chunk->greetings.text.capacity() +
+                                               chunk->greetings.offsets.capacity() * sizeof(size_t));
+            stats.noteBuffer(Stage::Escape, chunk->output.capacity());
+            if (lz4Frame)
+                stats.noteBuffer(Stage::Compress, chunk->compressed.capacity());
+        }
+    }
+
+private:
+    template <typename Body>
+    void guarded(const string & name, Body body)
+    {
+        setTraceThreadName(name);
+        try {
+            body();
+        } catch (...) {
+            fail(current_exception());
+        }
+    }
+
+    void fail(exception_ptr e)
+    {
+        {
+            lock_guard<mutex> lock(errorMutex);
+            if (!error)
+                error = e;
+        }
+        freeChunks.close();
+        workQueue.close();
+        doneQueue.close();
+    }
+
+    bool failed()
+    {
+        lock_guard<mutex> lock(errorMutex);
+        return bool(error);
+    }
+
+    void readStage(ChunkSource & source)
+    {
+        int64_t sequence = 0;
+        for (;;) {
+            Chunk * chunk;
+            {
+                TraceSpan span("wait-buffer");
+                optional<Chunk *> next = freeChunks.pop();
+                if (!next)
+                    return;
+                chunk = *next;
+            }
+            TraceSpan span("read", sequence);
+            StageScope stage(Stage::Read);
+            if (!source.next(chunk->input)) {
+                freeChunks.push(chunk);
+                break;
+            }
+            stats.inputBytes += chunk->input.size();
+            if (csv && sequence == 0)
+                csv->takeHeader(chunk->input);
+            chunk->sequence = sequence++;
+            workQueue.push(chunk);
+        }
+        workQueue.close();
+    }
+
+    void workStage()
+    {
+        while (optional<Chunk *> next = workQueue.pop()) {
+            Chunk & chunk = **next;
+            size_t skipped = 0;
+            {
+                TraceSpan span("split", chunk.sequence);
+                StageScope stage(Stage::Split);
+                chunk.names.clear();
+                chunk.records.clear();
+                if (csv)
+                    skipped = csv->split(chunk.input, chunk.names, chunk.unescaped);
+                else if (!options.jsonlField.empty())
+                    skipped = splitJsonl(chunk.input, options.jsonlField, chunk.names,
+                                         options.jsonlOutput ? &chunk.records : nullptr, chunk.unescaped);
+                else
+                    splitLines(chunk.input, chunk.names);
+                stats.records += chunk.names.size();
+                stats.skippedRecords += skipped;
+            }
+            logEvent(chunkFormat, chunk.sequence, chunk.names.size(), chunk.input.size(), skipped);
+            if (options.transliterate) {
+                TraceSpan span("transliterate", chunk.sequence);
+                StageScope stage(Stage::Transliterate);
+                transliterateNames(chunk.names, chunk.transliterated);
+            }
+            {
+                TraceSpan span("greet", chunk.sequence);
+                StageScope stage(Stage::Greet);
+                chunk.greetings.clear();
+                if (rules)
+                    rules->greet(chunk.names, chunk.greetings);
+                else
+                    generateHelloStrings(chunk.names, chunk.greetings);
+            }
+            {
+                TraceSpan span("escape", chunk.sequence);
+                StageScope stage(Stage::Escape);
+                chunk.output.clear();
+                if (blockIndex) {
+                    chunk.blocks.clear();
+                    encodeGreetingBlocks(chunk.greetings, uint32_t(options.blockSize), chunk.output, chunk.blocks);
+                } else if (options.jsonlOutput) {
+                    writeJsonlGreetings(chunk.records, chunk.greetings, chunk.output);
+                } else if (!parquet) {
+                    escapeGreetings(chunk.greetings, chunk.output);
+                }
+            }
+            if (lz4Frame) {
+                TraceSpan span("compress", chunk.sequence);
+                StageScope stage(Stage::Compress);
+                chunk.compressed.clear();
+                lz4CompressFrameBlocks(chunk.output, chunk.compressed);
+            }
+            doneQueue.push(&chunk);
+        }
+        if (--runningWorkers == 0)
+            doneQueue.close();
+    }
+
+    void writeStage(FILE * out, ChunkSource & source)
+    {
+        priority_queue<Chunk *, vector<Chunk *>, BySequence> pending;
+        int64_t nextSequence = 0;
+        if (blockIndex)
+            writeFraming(out, blockIndex->header());
+        if (parquet)
+            writeFraming(out, parquet->header());
+        if (lz4Frame)
+            writeFraming(out, lz4FrameHeader());
+        while (optional<Chunk *> next = doneQueue.pop()) {
+            pending.push(*next);
+            while (!pending.empty() && pending.top()->sequence == nextSequence) {
+                Chunk * chunk = pending.top();
+                pending.pop();
+                {
+                    TraceSpan span("write", chunk->sequence);
+                    StageScope stage(Stage::Write);
+                    // Parquet row groups span chunks, so they are encoded here, in order.
+                    if (parquet)
+                        parquet->add(chunk->names, chunk->greetings, chunk->output);
+                    writeOutput(out, lz4Frame ? chunk->compressed : chunk->output);
+                    if (blockIndex)
+                        blockIndex->add(chunk->blocks);
+                }
+                source.written(chunk->sequence);
+                ++nextSequence;
+                freeChunks.push(chunk);
+            }
+        }
+        // A failed stage also closes the queues; the file is then left
+        // without a footer or end mark, so readers reject it.
+        if (failed())
+            return;
+        if (blockIndex)
+            writeFraming(out, blockIndex->trailer());
+        if (parquet)
+            writeFraming(out, parquet->trailer());
+        if (lz4Frame)
+            writeFraming(out, lz4FrameEnd());
+        if (tee)
+            tee->finish();
+    }
+
+    // Writes and flushes bytes, and hands them on to the --tee sinks by
+    // swapping them into a shared buffer; bytes is left with an empty
+    // buffer's capacity.
+    void writeOutput(FILE * out, string & bytes)
+    {
+        if (fwrite(bytes.data(), 1, bytes.size(), out) != bytes.size() || fflush(out) != 0)
+            throw system_error(errno, generic_category(), options.outputPath);
+        stats.outputBytes += bytes.size();
+        if (tee) {
+            shared_ptr<string> shared = tee->buffer();
+            shared->swap(bytes);
+            tee->write(move(shared));
+        }
+    }
+
+    void writeFraming(FILE * out, string bytes) { writeOutput(out, bytes); }
+
+    const Options & options;
+    RunStats & stats;
+    const bool lz4Frame;          // --compress of the whole output; parquet compresses its pages instead
+    optional<CsvColumn> csv;      // set by the reader's first chunk, before any worker sees it
+    optional<GreetingRules> rules;
+    optional<BlockFileIndex> blockIndex;   // set for --output-format blocks
+    optional<ParquetWriter> parquet;       // set for --output-format parquet
+    optional<Tee> tee;                     // set for --tee
+    vector<unique_ptr<Chunk>> chunks;
+    BlockingQueue<Chunk *> freeChunks;
+    BlockingQueue<Chunk *> workQueue;
+    BlockingQueue<Chunk *> doneQueue;
+    atomic<unsigned> runningWorkers{options.threads};
+    mutex errorMutex;
+    exception_ptr error;
+};
+
+} // namespace
+
+void runPipeline(const Options & options, RunStats & stats, ChunkSource & source)
+{
+    Pipeline(options, stats).run(source);
+}
+
+void runPipeline(const Options & options, RunStats & stats)
+{
+    File in(options.inputPath, false);
+    StreamSource source(in.get(), options);
+    runPipeline(options, stats, source);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "options.h"
+#include "stats.h"
+
+// Where the pipeline's input comes from. next is called from the reader
+// thread only; written from the writer thread only.
+class ChunkSource
+{
+public:
+    virtual ~ChunkSource() = default;
+
+    // Replaces chunk with the next run of whole records, reusing its
+    // capacity. Returns false at the end of the input.
+    virtual bool next(std::string & chunk) = 0;
+
+    // Called in order once the greetings of the sequence-th chunk next
+    // returned (counting from 0) are written and flushed.
+    virtual void written(int64_t sequence) { (void)sequence; }
+};
+
+// Streams the input through read -> split -> greet -> escape -> write.
+// One reader thread cuts the input into chunks of whole records, worker
+// threads split, greet and escape chunks independently, and one writer thread
+// emits them in input order. A fixed pool of chunks bounds memory.
+void runPipeline(const Options & options, RunStats & stats);
+
+// The same, reading chunks from source instead of options.inputPath.
+void runPipeline(const Options & options, RunStats & stats, ChunkSource & source);
@@ -0,0 +1,25 @@
+#include "rulesfile.h"
+
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+#include "file.h"
+
+using namespace std;
+
+GreetingRules loadGreetingRules(const string & path)
+{
+    File file(path, false);
+    string text;
+    char buffer[1 << 14];
+    while (size_t n = fread(buffer, 1, sizeof buffer, file.get()))
+        text.append(buffer, n);
+    if (ferror(file.get()))
+        throw system_error(errno, generic_category(), path);
+    try {
+        return GreetingRules(parseGreetingRules(text));
+    } catch (const invalid_argument & e) {
+        throw invalid_argument(path + ": " + e.what());
+    }
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+#include "greetingrules.h"
+
+// Reads and compiles a --rules file (see parseGreetingRules for the format).
+// Throws std::system_error if it cannot be read and std::invalid_argument,
+// prefixed with the path, if a rule is malformed.
+GreetingRules loadGreetingRules(const std::string & path);
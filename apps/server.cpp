@@ -0,0 +1,334 @@
+// Greeting server. Line protocol over TCP, one request per line, answered in
+// request order on each connection:
+//
+//   G <name>      -> Hello <name>
+//   B <count>     followed by <count> name lines -> <count> greeting lines
+//   STATS         -> STATS key=value ...
+//
+// Single greetings and small batches are interactive and are served ahead of
+// large (bulk) batches, which yield to them every --bulk-chunk names. With
+// --coalesce, G requests for a name already in flight share its render. With
+// --shed, requests are shed while the queue delay stays above target, and a
+// shed G or B is answered by the single line "ERR overloaded". --log writes
+// an access log, a line per request, without holding up the connection
+// threads.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <variant>
+
+#include "asynclog.h"
+#include "blockingqueue.h"
+#include "greetingservice.h"
+#include "tcp.h"
+
+using namespace std;
+
+namespace {
+
+const LogFormat openedFormat("conn {}: opened");
+const LogFormat greetFormat("conn {}: G {}");
+const LogFormat batchFormat("conn {}: B {}");
+const LogFormat statsFormat("conn {}: STATS");
+const LogFormat badRequestFormat("conn {}: bad request '{}'");
+const LogFormat overloadedFormat("conn {}: overloaded, request shed");
+const LogFormat closedFormat("conn {}: closed after {} requests");
+
+struct ServerOptions
+{
+    unsigned short port = 7070;
+    GreetingServiceConfig service;
+    string logPath;
+};
+
+unsigned long parseNumber(const string & option, const string & value)
+{
+    try {
+        size_t used = 0;
+        unsigned long number = stoul(value, &used);
+        if (used == value.size())
+            return number;
+    } catch (const exception &) {
+    }
+    throw invalid_argument(option + ": expected a number, got '" + value + "'");
+}
+
+ServerOptions parseServerOptions(int argc, char ** argv)
+{
+    ServerOptions options;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        auto value = [&] {
+            if (i + 1 >= argc)
+                throw invalid_argument(arg + ": missing value");
+            return string(argv[++i]);
+        };
+        if (arg == "--port")
+            options.port = static_cast<unsigned short>(parseNumber(arg, value()));
+        else if (arg == "--workers")
+            options.service.workers = parseNumber(arg, value());
+        else if (arg == "--fifo")
+            options.service.prioritize = false;
+        else if (arg == "--bulk-chunk")
+            options.service.bulkChunkSize = parseNumber(arg, value());
+        else if (arg == "--interactive-max")
+            options.service.interactiveMaxBatch = parseNumber(arg, value());
+        else if (arg == "--interactive-weight")
+            options.service.interactiveWeight = parseNumber(arg, value());
+        else if (arg == "--bulk-weight")
+            options.service.bulkWeight = parseNumber(arg, value());
+        else if (arg == "--coalesce")
+            options.service.coalesce = true;
+        else if (arg == "--shed")
+            options.service.shed = true;
+        else if (arg == "--shed-target-ms")
+            options.service.shedTarget = chrono::milliseconds(parseNumber(arg, value()));
+        else if (arg == "--shed-interval-ms")
+            options.service.shedInterval = chrono::milliseconds(parseNumber(arg, value()));
+        else if (arg == "--log")
+            options.logPath = value();
+        else
+            throw invalid_argument("unknown option '" + arg + "'");
+    }
+    return options;
+}
+
+void printServerUsage(ostream & out)
+{
+    out << "usage: server [options]\n"
+           "  --port N                 listen port (default 7070)\n"
+           "  --workers N              greeting worker threads (default: one per core)\n"
+           "  --fifo                   single FIFO queue, no priority classes\n"
+           "  --bulk-chunk N           names rendered before a bulk batch yields (default 256)\n"
+           "  --interactive-max N      largest batch treated as interactive (default 16)\n"
+           "  --interactive-weight N   scheduling weights while both classes are queued\n"
+           "  --bulk-weight N            (default 8:1)\n"
+           "  --coalesce               answer concurrent G requests for the same name with one render\n"
+           "  --shed                   shed requests while the queue delay stands above target\n"
+           "  --shed-target-ms N       acceptable queue delay (default 5)\n"
+           "  --shed-interval-ms N     how long the delay may stay above target (default 100)\n"
+           "  --log PATH               append an access log to PATH, '-' for stderr\n";
+}
+
+using Response = variant<future<string>, future<GreetingBatch>, string>;
+
+void appendResponse(string & out, Response & response, uint64_t connection)
+{
+    try {
+        if (auto * single = get_if<future<string>>(&response)) {
+            out += single->get();
+            out += '\n';
+        } else if (auto * batch = get_if<future<GreetingBatch>>(&response)) {
+            GreetingBatch greetings = batch->get();
+            for (size_t i = 0; i < greetings.size(); ++i) {
+                out += greetings[i];
+                out += '\n';
+            }
+        } else {
+            out += get<string>(response);
+            out += '\n';
+        }
+    } catch (const GreetingOverloaded &) {
+        logEvent(overloadedFormat, connection);
+        out += "ERR overloaded\n";
+    }
+}
+
+string formatStats(const GreetingService & service)
+{
+    GreetingServiceStats stats = service.stats();
+    ostringstream line;
+    line << "STATS interactive=" << stats.interactiveRequests << " bulk=" << stats.bulkRequests
+         << " bulk_chunks=" << stats.bulkChunks << " preemptions=" << stats.preemptions << " expired=" << stats.expired
+         << " cancelled=" << stats.cancelled << " coalesced=" << stats.coalesced
+         << " shed_interactive=" << stats.shed[0] << " shed_bulk=" << stats.shed[1];
+    // Queue delays in microseconds.
+    for (GreetingPriority priority : {GreetingPriority::Interactive, GreetingPriority::Bulk}) {
+        HdrHistogram delays = service.queueDelays(priority);
+        const char * name = priority == GreetingPriority::Interactive ? "interactive" : "bulk";
+        for (auto [key, percentile] : {pair{"p50", 50.0}, pair{"p99", 99.0}, pair{"p999", 99.9}})
+            line << " delay_" << name << '_' << key << "_us=" << delays.valueAtPercentile(percentile) / 1000;
+    }
+    return line.str();
+}
+
+// Requests are read and submitted on this thread; a responder thread waits
+// for results in order, so clients may pipeline. At most maxPipelined
+// responses wait on a connection: past that this thread stops reading the
+// socket until the responder has sent some, so a client that sends without
+// reading holds a fixed amount of server memory.
+constexpr size_t maxPipelined = 1024;
+
+void serveConnection(const TcpSocket & socket, GreetingService & service)
+{
+    static atomic<uint64_t> connections{0};
+    uint64_t connection = ++connections;
+    uint64_t requests = 0;
+    logEvent(openedFormat, connection);
+    BlockingQueue<Response> responses;
+    BlockingQueue<bool> slots;   // free places in responses
+    for (size_t i = 0; i < maxPipelined; ++i)
+        slots.push(true);
+    thread responder([&] {
+        string out;
+        try {
+            while (optional<Response> response = responses.pop()) {
+                appendResponse(out, *response, connection);
+                size_t sent = 1;
+                while (out.size() < (1 << 20)) {
+                    optional<Response> more = responses.tryPop();
+                    if (!more)
+                        break;
+                    appendResponse(out, *more, connection);
+                    ++sent;
+                }
+                socket.sendAll(out);
+                out.clear();
+                for (; sent > 0; --sent)
+                    slots.push(true);
+            }
+        } catch (const exception &) {
+            responses.close();
+            slots.close();
+        }
+    });
+
+    try {
+        LineReader reader(socket);
+        string_view line;
+        while (slots.pop() && reader.next(line)) {
+            Response response;
+            if (line.rfind("G ", 0) == 0) {
+                logEvent(greetFormat, connection, line.substr(2));
+                response = service.greet(string(line.substr(2)));
+            } else if (line.rfind("B ", 0) == 0) {
+                logEvent(batchFormat, connection, line.substr(2));
+                size_t count = 0;
+                try {
+                    count = stoul(string(line.substr(2)));
+                } catch (const exception &) {
+                    response = string("ERR bad batch count");
+                }
+                vector<string> names;
+                names.reserve(min<size_t>(count, 1 << 16));
+                while (names.size() < count && reader.next(line))
+                    names.emplace_back(line);
+                if (!holds_alternative<string>(response))
+                    response = service.greetBatch(move(names));
+            } else if (line == "STATS") {
+                logEvent(statsFormat, connection);
+                response = formatStats(service);
+            } else if (line.empty()) {
+                slots.push(true);   // nothing to answer
+                continue;
+            } else {
+                logEvent(badRequestFormat, connection, line);
+                response = string("ERR unknown command");
+            }
+            ++requests;
+            if (!responses.push(move(response)))
+                break;
+        }
+    } catch (const exception &) {
+    }
+    responses.close();
+    responder.join();
+    logEvent(closedFormat, connection, requests);
+}
+
+// The connections being served, each on a detached thread of its own.
+// Destruction shuts them all down and waits for their threads, so that the
+// service and the log they use can be destroyed after it.
+class Connections
+{
+public:
+    Connections() = default;
+    Connections(const Connections &) = delete;
+    Connections & operator=(const Connections &) = delete;
+
+    ~Connections()
+    {
+        unique_lock<mutex> guard(lock);
+        for (const TcpSocket * socket : open)
+            socket->shutdown();
+        finished.wait(guard, [&] { return open.empty(); });
+    }
+
+    void serve(TcpSocket connection, GreetingService & service)
+    {
+        auto socket = make_unique<TcpSocket>(move(connection));
+        const TcpSocket * registered = socket.get();
+        {
+            lock_guard<mutex> guard(lock);
+            open.insert(registered);
+        }
+        thread worker;
+        try {
+            worker = thread([this, socket = move(socket), &service]() mutable {
+                serveConnection(*socket, service);
+                {
+                    lock_guard<mutex> guard(lock);
+                    open.erase(socket.get());
+                    finished.notify_all();
+                }
+                // Closed only once out of open, so a shutdown never reaches
+                // a reused descriptor.
+                socket.reset();
+            });
+        } catch (...) {
+            lock_guard<mutex> guard(lock);
+            open.erase(registered);
+            throw;
+        }
+        worker.detach();
+    }
+
+private:
+    mutex lock;
+    condition_variable finished;
+    unordered_set<const TcpSocket *> open;
+};
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    ServerOptions options;
+    try {
+        options = parseServerOptions(argc, argv);
+    } catch (const invalid_argument & e) {
+        cerr << "server: " << e.what() << "\n";
+        printServerUsage(cerr);
+        return 2;
+    }
+
+    // Destroyed in reverse: the connections are ended and their threads
+    // finished before the service goes, and the service before the log.
+    unique_ptr<AsyncLog> log;
+    try {
+        if (!options.logPath.empty()) {
+            log = make_unique<AsyncLog>(AsyncLogConfig{options.logPath});
+            log->flushOnCrash();
+            processLog = log.get();
+        }
+        GreetingService service(options.service);
+        Connections connections;
+        TcpSocket listener = listenTcp(options.port);
+        cerr << "server: listening on port " << options.port << endl;
+        for (;;)
+            connections.serve(acceptTcp(listener), service);
+    } catch (const exception & e) {
+        cerr << "server: " << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,262 @@
+#include "sort.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "blockfile.h"
+#include "chunkreader.h"
+#include "csv.h"
+#include "escape.h"
+#include "file.h"
+#include "hello.h"
+#include "jsonl.h"
+#include "lz4.h"
+#include "namesort.h"
+#include "parquet.h"
+#include "rulesfile.h"
+#include "tee.h"
+#include "transliterate.h"
+
+using namespace std;
+
+namespace {
+
+constexpr size_t renderBatch = 16384;   // names greeted per task
+
+// The whole input split into names, which view the chunks and the unescaped
+// or transliterated storage. Deques keep their strings in place as they
+// grow, so the views stay valid.
+struct Input
+{
+    deque<string> chunks;
+    deque<string> storage;
+    vector<string_view> names;
+};
+
+void readNames(const Options & options, RunStats & stats, Input & input)
+{
+    File in(options.inputPath, false);
+    InputStream stream(in.get(), options.inputPath, options.threads);
+    ChunkReader reader(stream, options.chunkSize, !options.csvColumn.empty());
+    optional<CsvColumn> csv;
+    if (!options.csvColumn.empty())
+        csv.emplace(options.csvColumn, options.csvDelimiter, options.csvHeader);
+    vector<string_view> names;
+    size_t inputBytes = 0;
+    for (bool first = true;; first = false) {
+        string & chunk = input.chunks.emplace_back();
+        {
+            StageScope stage(Stage::Read);
+            if (!reader.next(chunk)) {
+                input.chunks.pop_back();
+                break;
+            }
+        }
+        stats.inputBytes += chunk.size();
+        inputBytes += chunk.capacity();
+        if (csv && first)
+            csv->takeHeader(chunk);
+        {
+            StageScope stage(Stage::Split);
+            names.clear();
+            string & unescaped = input.storage.emplace_back();
+            if (csv)
+                stats.skippedRecords += csv->split(chunk, names, unescaped);
+            else if (!options.jsonlField.empty())
+                stats.skippedRecords += splitJsonl(chunk, options.jsonlField, names, nullptr, unescaped);
+            else
+                splitLines(chunk, names);
+            stats.records += names.size();
+        }
+        if (options.transliterate) {
+            StageScope stage(Stage::Transliterate);
+            transliterateNames(names, input.storage.emplace_back());
+        }
+        StageScope stage(Stage::Split);
+        input.names.insert(input.names.end(), names.begin(), names.end());
+    }
+    stats.noteBuffer(Stage::Read, inputBytes);
+    stats.noteBuffer(Stage::Split, input.names.capacity() * sizeof(string_view));
+}
+
+// Greets batches of the sorted names on several threads and writes them in
+// order: each worker renders the next batch, then waits for its turn to
+// write it.
+class OrderedWriter
+{
+public:
+    OrderedWriter(const Options & options, RunStats & stats, const vector<string_view> & names,
+                  const GreetingRules * rules, FILE * out)
+        : options(options), stats(stats), names(names), rules(rules), out(out),
+          lz4Frame(!options.compress.empty() && options.outputFormat != "parquet")
+    {
+        if (options.outputFormat == "blocks")
+            index.emplace(uint32_t(options.blockSize));
+        if (options.outputFormat == "parquet")
+            parquet.emplace(parquetWriterConfig(options));
+        if (!options.tee.empty())
+            tee.emplace(options, stats);
+    }
+
+    void run()
+    {
+        if (index)
+            writeFraming(index->header());
+        if (parquet)
+            writeFraming(parquet->header());
+        if (lz4Frame)
+            writeFraming(lz4FrameHeader());
+        unsigned workers = unsigned(min<size_t>(options.threads, (names.size() + renderBatch - 1) / renderBatch));
+        vector<thread> threads;
+        for (unsigned w = 0; w < workers; ++w)
+            threads.emplace_back([this] { work(); });
+        for (thread & t : threads)
+            t.join();
+        if (error)
+            rethrow_exception(error);
+        if (index)
+            writeFraming(index->trailer());
+        if (parquet)
+            writeFraming(parquet->trailer());
+        if (lz4Frame)
+            writeFraming(lz4FrameEnd());
+        if (fflush(out) != 0)
+            throw system_error(errno, generic_category(), options.outputPath);
+        if (tee)
+            tee->finish();
+    }
+
+private:
+    void work()
+    {
+        vector<string_view> slice;
+        GreetingBatch greetings;
+        string output;
+        string compressed;
+        vector<GreetingBlock> blocks;
+        try {
+            for (;;) {
+                size_t batch = nextBatch++;
+                size_t first = batch * renderBatch;
+                if (first >= names.size() || failed())
+                    break;
+                slice.assign(names.begin() + first, names.begin() + min(names.size(), first + renderBatch));
+                {
+                    StageScope stage(Stage::Greet);
+                    greetings.clear();
+                    if (rules)
+                        rules->greet(slice, greetings);
+                    else
+                        generateHelloStrings(slice, greetings);
+                }
+                {
+                    StageScope stage(Stage::Escape);
+                    output.clear();
+                    blocks.clear();
+                    if (index)
+                        encodeGreetingBlocks(greetings, uint32_t(options.blockSize), output, blocks);
+                    else if (!parquet)
+                        escapeGreetings(greetings, output);
+                }
+                if (lz4Frame) {
+                    StageScope stage(Stage::Compress);
+                    compressed.clear();
+                    lz4CompressFrameBlocks(output, compressed);
+                }
+                unique_lock<mutex> lock(turnMutex);
+                turn.wait(lock, [&] { return nextToWrite == batch || error; });
+                if (error)
+                    break;
+                if (parquet)
+                    parquet->add(slice, greetings, output);
+                write(lz4Frame ? compressed : output);
+                if (index)
+                    index->add(blocks);
+                ++nextToWrite;
+                turn.notify_all();
+            }
+        } catch (...) {
+            lock_guard<mutex> lock(turnMutex);
+            if (!error)
+                error = current_exception();
+            turn.notify_all();
+        }
+        stats.noteBuffer(Stage::Greet, greetings.text.capacity() + greetings.offsets.capacity() * sizeof(size_t));
+        stats.noteBuffer(Stage::Escape, output.capacity());
+        stats.noteBuffer(Stage::Compress, compressed.capacity());
+    }
+
+    bool failed()
+    {
+        lock_guard<mutex> lock(turnMutex);
+        return bool(error);
+    }
+
+    // Hands bytes on to the --tee sinks as the pipeline's writer does,
+    // leaving it with an empty buffer.
+    void write(string & bytes)
+    {
+        StageScope stage(Stage::Write);
+        if (fwrite(bytes.data(), 1, bytes.size(), out) != bytes.size())
+            throw system_error(errno, generic_category(), options.outputPath);
+        stats.outputBytes += bytes.size();
+        if (tee) {
+            shared_ptr<string> shared = tee->buffer();
+            shared->swap(bytes);
+            tee->write(move(shared));
+        }
+    }
+
+    void writeFraming(string bytes) { write(bytes); }
+
+    const Options & options;
+    RunStats & stats;
+    const vector<string_view> & names;
+    const GreetingRules * rules;
+    FILE * out;
+    const bool lz4Frame;   // --compress of the whole output; parquet compresses its pages instead
+    optional<BlockFileIndex> index;
+    optional<ParquetWriter> parquet;
+    optional<Tee> tee;
+
+    mutex turnMutex;
+    condition_variable turn;
+    atomic<size_t> nextBatch{0};
+    size_t nextToWrite = 0;
+    exception_ptr error;
+};
+
+} // namespace
+
+void runSorted(const Options & options, RunStats & stats)
+{
+    optional<GreetingRules> rules;
+    if (!options.rulesPath.empty())
+        rules.emplace(loadGreetingRules(options.rulesPath));
+    Input input;
+    readNames(options, stats, input);
+    {
+        StageScope stage(Stage::Sort);
+        if (options.sort == "name")
+            sortNames(input.names, options.threads);
+        else
+            groupNamesByFirstCharacter(input.names, options.threads);
+        stats.noteBuffer(Stage::Sort, input.names.size() * (sizeof(string_view) + 2 * sizeof(uint64_t)));
+    }
+    // Opened only now, so that the output may replace the input, as with
+    // sort -o.
+    File out(options.outputPath, true);
+    OrderedWriter(options, stats, input.names, rules ? &*rules : nullptr, out.get()).run();
+}
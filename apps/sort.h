@@ -0,0 +1,12 @@
+#pragma once
+
+#include "options.h"
+#include "stats.h"
+
+// Greets the input in sorted order: by name, or grouped by first character
+// with each group in input order (options.sort). The whole input is read
+// and split first, and the names are sorted as views into it with a
+// parallel radix sort, so memory grows with the input: its bytes plus up to
+// 64 bytes per name while sorting. The sorted names are then greeted in
+// batches on options.threads workers and written in order.
+void runSorted(const Options & options, RunStats & stats);
@@ -0,0 +1,248 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+struct alignas(64) StageCounters
+{
+    atomic<uint64_t> allocations{0};
+    atomic<uint64_t> bytes{0};
+    atomic<uint64_t> minorFaults{0};
+    atomic<uint64_t> majorFaults{0};
+};
+
+StageCounters stageCounters[size_t(Stage::Count)];
+atomic<uint64_t> frees{0};
+atomic<int64_t> liveBytes{0};
+atomic<int64_t> peakLiveBytes{0};
+thread_local Stage currentStage = Stage::Other;
+
+// Live heap bytes need the size of each freed block, which only glibc's
+// malloc_usable_size tells us; elsewhere only counts are kept.
+#ifdef __GLIBC__
+constexpr bool trackLiveBytes = true;
+size_t blockSize(void * p) { return malloc_usable_size(p); }
+#else
+constexpr bool trackLiveBytes = false;
+size_t blockSize(void *) { return 0; }
+#endif
+
+void atomicMax(atomic<uint64_t> & target, uint64_t value)
+{
+    uint64_t seen = target.load(memory_order_relaxed);
+    while (value > seen && !target.compare_exchange_weak(seen, value, memory_order_relaxed)) {
+    }
+}
+
+// Aligned blocks come from aligned_alloc, whose size must be a multiple of
+// the alignment; free releases both kinds.
+void * allocate(size_t size, size_t alignment)
+{
+    if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+        return malloc(size ? size : 1);
+    size_t rounded = (max<size_t>(size, 1) + alignment - 1) / alignment * alignment;
+    return aligned_alloc(alignment, rounded);
+}
+
+void * countedAllocate(size_t size, size_t alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+{
+    void * p;
+    while (!(p = allocate(size, alignment))) {
+        new_handler handler = get_new_handler();
+        if (!handler)
+            throw bad_alloc();
+        handler();
+    }
+    // Without --stats, the replacement costs one relaxed load.
+    if (!statsEnabled())
+        return p;
+    StageCounters & counters = stageCounters[size_t(currentStage)];
+    counters.allocations.fetch_add(1, memory_order_relaxed);
+    counters.bytes.fetch_add(size, memory_order_relaxed);
+    if (trackLiveBytes) {
+        int64_t n = static_cast<int64_t>(blockSize(p));
+        int64_t live = liveBytes.fetch_add(n, memory_order_relaxed) + n;
+        int64_t peak = peakLiveBytes.load(memory_order_relaxed);
+        while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live, memory_order_relaxed)) {
+        }
+    }
+    return p;
+}
+
+void countedFree(void * p)
+{
+    if (!p)
+        return;
+    if (!statsEnabled()) {
+        free(p);
+        return;
+    }
+    frees.fetch_add(1, memory_order_relaxed);
+    if (trackLiveBytes)
+        liveBytes.fetch_sub(static_cast<int64_t>(blockSize(p)), memory_order_relaxed);
+    free(p);
+}
+
+bool threadFaults(int64_t & minor, int64_t & major)
+{
+#ifdef RUSAGE_THREAD
+    rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+        minor = usage.ru_minflt;
+        major = usage.ru_majflt;
+        return true;
+    }
+#endif
+    return false;
+}
+
+double seconds(const timeval & t) { return t.tv_sec + t.tv_usec / 1e6; }
+
+double mebibytes(uint64_t bytes) { return bytes / 1048576.0; }
+
+} // namespace
+
+void * operator new(size_t size) { return countedAllocate(size); }
+void * operator new[](size_t size) { return countedAllocate(size); }
+void operator delete(void * p) noexcept { countedFree(p); }
+void operator delete[](void * p) noexcept { countedFree(p); }
+void operator delete(void * p, size_t) noexcept { countedFree(p); }
+void operator delete[](void * p, size_t) noexcept { countedFree(p); }
+void * operator new(size_t size, align_val_t alignment) { return countedAllocate(size, size_t(alignment)); }
+void * operator new[](size_t size, align_val_t alignment) { return countedAllocate(size, size_t(alignment)); }
+void operator delete(void * p, align_val_t) noexcept { countedFree(p); }
+void operator delete[](void * p, align_val_t) noexcept { countedFree(p); }
+void operator delete(void * p, size_t, align_val_t) noexcept { countedFree(p); }
+void operator delete[](void * p, size_t, align_val_t) noexcept { countedFree(p); }
+
+const char * stageName(Stage stage)
+{
+    static const char * const names[] = {"other", "read",   "split", "transliterate", "greet",
+                                         "escape", "write", "dedupe", "spill", "sort", "merge", "compress",
+                                         "decompress"};
+    return names[size_t(stage)];
+}
+
+StageScope::StageScope(Stage stage) : previous(currentStage), stage(stage)
+{
+    currentStage = stage;
+    if (statsEnabled() && !threadFaults(minorFaults, majorFaults))
+        minorFaults = -1;
+}
+
+StageScope::~StageScope()
+{
+    currentStage = previous;
+    int64_t minor, major;
+    if (minorFaults >= 0 && threadFaults(minor, major)) {
+        StageCounters & counters = stageCounters[size_t(stage)];
+        counters.minorFaults.fetch_add(minor - minorFaults, memory_order_relaxed);
+        counters.majorFaults.fetch_add(major - majorFaults, memory_order_relaxed);
+    }
+}
+
+void RunStats::noteBuffer(Stage stage, uint64_t bytes)
+{
+    atomicMax(buffers[size_t(stage)].largest, bytes);
+    buffers[size_t(stage)].total.fetch_add(bytes, memory_order_relaxed);
+}
+
+void writeStatsReport(ostream & out, const RunStats & stats, double wallSeconds, bool json)
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    uint64_t peakRss = uint64_t(usage.ru_maxrss) * 1024;   // kilobytes on Linux
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    for (const StageCounters & counters : stageCounters) {
+        allocations += counters.allocations.load(memory_order_relaxed);
+        allocatedBytes += counters.bytes.load(memory_order_relaxed);
+    }
+    uint64_t peakLive = static_cast<uint64_t>(peakLiveBytes.load(memory_order_relaxed));
+    auto load = [](const atomic<uint64_t> & value) { return value.load(memory_order_relaxed); };
+
+    char line[256];
+    if (json) {
+        snprintf(line, sizeof line, "{\"wall_seconds\":%.6f,\"user_cpu_seconds\":%.6f,\"system_cpu_seconds\":%.6f,",
+                 wallSeconds, seconds(usage.ru_utime), seconds(usage.ru_stime));
+        out << line << "\"peak_rss_bytes\":" << peakRss << ",\"minor_faults\":" << usage.ru_minflt
+            << ",\"major_faults\":" << usage.ru_majflt << ",\"heap\":{\"allocations\":" << allocations
+            << ",\"allocated_bytes\":" << allocatedBytes << ",\"frees\":" << load(frees) << ",\"peak_live_bytes\":";
+        if (trackLiveBytes)
+            out << peakLive;
+        else
+            out << "null";
+        out << "},\"records\":" << load(stats.records) << ",\"input_bytes\":" << load(stats.inputBytes)
+            << ",\"output_bytes\":" << load(stats.outputBytes) << ",\"skipped_records\":" << load(stats.skippedRecords)
+            << ",\"distinct_names\":" << load(stats.distinctNames)
+            << ",\"spill_files\":" << load(stats.spillFiles) << ",\"spill_bytes\":" << load(stats.spillBytes)
+            << ",\"tee_dropped_bytes\":" << load(stats.teeDroppedBytes)
+            << ",\"tee_spilled_bytes\":" << load(stats.teeSpilledBytes)
+            << ",\"stages\":{";
+        for (size_t s = 0; s < size_t(Stage::Count); ++s) {
+            const StageCounters & counters = stageCounters[s];
+            out << (s ? "," : "") << '"' << stageName(Stage(s)) << "\":{\"allocations\":" << load(counters.allocations)
+                << ",\"allocated_bytes\":" << load(counters.bytes) << ",\"minor_faults\":" << load(counters.minorFaults)
+                << ",\"major_faults\":" << load(counters.majorFaults)
+                << ",\"largest_buffer_bytes\":" << load(stats.buffers[s].largest)
+                << ",\"buffer_high_water_bytes\":" << load(stats.buffers[s].total) << '}';
+        }
+        out << "}}\n";
+        return;
+    }
+
+    snprintf(line, sizeof line, "wall %.3f s, cpu %.3f s user, %.3f s system\n", wallSeconds, seconds(usage.ru_utime),
+             seconds(usage.ru_stime));
+    out << line;
+    snprintf(line, sizeof line, "peak RSS %.1f MiB, page faults %ld minor, %ld major\n", mebibytes(peakRss),
+             usage.ru_minflt, usage.ru_majflt);
+    out << line;
+    snprintf(line, sizeof line, "heap %llu allocations, %.1f MiB allocated, %llu frees", (unsigned long long)allocations,
+             mebibytes(allocatedBytes), (unsigned long long)load(frees));
+    out << line;
+    if (trackLiveBytes) {
+        snprintf(line, sizeof line, ", %.1f MiB peak live", mebibytes(peakLive));
+        out << line;
+    }
+    snprintf(line, sizeof line, "\nrecords %llu, skipped %llu, input %.1f MiB, output %.1f MiB\n",
+             (unsigned long long)load(stats.records), (unsigned long long)load(stats.skippedRecords),
+             mebibytes(load(stats.inputBytes)), mebibytes(load(stats.outputBytes)));
+    out << line;
+    if (load(stats.distinctNames) || load(stats.spillFiles)) {
+        snprintf(line, sizeof line, "distinct names %llu, spill files %llu, spilled %.1f MiB\n",
+                 (unsigned long long)load(stats.distinctNames), (unsigned long long)load(stats.spillFiles),
+                 mebibytes(load(stats.spillBytes)));
+        out << line;
+    }
+    if (load(stats.teeDroppedBytes) || load(stats.teeSpilledBytes)) {
+        snprintf(line, sizeof line, "tee dropped %.1f MiB, spilled %.1f MiB\n", mebibytes(load(stats.teeDroppedBytes)),
+                 mebibytes(load(stats.teeSpilledBytes)));
+        out << line;
+    }
+
+    snprintf(line, sizeof line, "%-14s %10s %12s %10s %10s %14s %14s\n", "stage", "allocs", "alloc MiB", "minflt",
+             "majflt", "largest MiB", "high-water MiB");
+    out << line;
+    for (size_t s = 0; s < size_t(Stage::Count); ++s) {
+        const StageCounters & counters = stageCounters[s];
+        uint64_t total = load(stats.buffers[s].total);
+        if (!load(counters.allocations) && !load(counters.minorFaults) && !total)
+            continue;
+        snprintf(line, sizeof line, "%-14s %10llu %12.1f %10llu %10llu %14.1f %14.1f\n", stageName(Stage(s)),
+                 (unsigned long long)load(counters.allocations), mebibytes(load(counters.bytes)),
+                 (unsigned long long)load(counters.minorFaults), (unsigned long long)load(counters.majorFaults),
+                 mebibytes(load(stats.buffers[s].largest)), mebibytes(total));
+        out << line;
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+// Resource accounting behind --stats: process rusage (peak RSS, page faults,
+// CPU), heap allocations counted by replacement operator new/delete and
+// attributed to the stage the allocating thread is in, and the high-water
+// marks of each stage's buffers. Allocations, over-aligned ones included,
+// are counted once stats are enabled, and so are per-stage page faults,
+// which cost two getrusage calls per StageScope. Blocks allocated before
+// that and freed after make peak live bytes read low by as much.
+
+enum class Stage {
+    Other, Read, Split, Transliterate, Greet, Escape, Write, Dedupe, Spill, Sort, Merge, Compress, Decompress, Count
+};
+
+const char * stageName(Stage stage);
+
+inline std::atomic<bool> statsEnabledFlag{false};
+
+inline void enableStats() { statsEnabledFlag.store(true, std::memory_order_relaxed); }
+inline bool statsEnabled() { return statsEnabledFlag.load(std::memory_order_relaxed); }
+
+// Attributes the calling thread's allocations and page faults to stage
+// until destroyed. Scopes nest; the innermost wins.
+class StageScope
+{
+public:
+    explicit StageScope(Stage stage);
+    ~StageScope();
+    StageScope(const StageScope &) = delete;
+    StageScope & operator=(const StageScope &) = delete;
+
+private:
+    Stage previous;
+    Stage stage;
+    int64_t minorFaults = -1;
+    int64_t majorFaults = 0;
+};
+
+// Filled in by the run; safe to update from several threads.
+struct RunStats
+{
+    std::atomic<uint64_t> records{0};
+    std::atomic<uint64_t> inputBytes{0};
+    std::atomic<uint64_t> outputBytes{0};
+    std::atomic<uint64_t> skippedRecords{0};
+    std::atomic<uint64_t> distinctNames{0};
+    std::atomic<uint64_t> spillFiles{0};
+    std::atomic<uint64_t> spillBytes{0};
+    std::atomic<uint64_t> teeDroppedBytes{0};   // by --tee sinks with the drop policy
+    std::atomic<uint64_t> teeSpilledBytes{0};
+
+    // Records that one buffer of stage peaked at bytes. largest keeps the
+    // biggest single buffer, total sums every buffer's peak: the stage's
+    // high-water mark when its buffers are all live at once, as the
+    // pipeline's chunk pool is, and an upper bound otherwise.
+    void noteBuffer(Stage stage, uint64_t bytes);
+
+    struct Buffers
+    {
+        std::atomic<uint64_t> largest{0};
+        std::atomic<uint64_t> total{0};
+    };
+    Buffers buffers[size_t(Stage::Count)];
+};
+
+// Writes the report, sampling process usage now. wallSeconds covers the run.
+void writeStatsReport(std::ostream & out, const RunStats & stats, double wallSeconds, bool json);
@@ -0,0 +1,163 @@
+#include "tcp.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+[[noreturn]] void throwErrno(const string & what)
+{
+    throw system_error(errno, generic_category(), what);
+}
+
+void setNoDelay(int fd)
+{
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+}
+
+} // namespace
+
+TcpSocket & TcpSocket::operator=(TcpSocket && other) noexcept
+{
+    if (this != &other) {
+        if (fd >= 0)
+            close(fd);
+        fd = other.release();
+    }
+    return *this;
+}
+
+TcpSocket::~TcpSocket()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+int TcpSocket::release()
+{
+    int released = fd;
+    fd = -1;
+    return released;
+}
+
+void TcpSocket::sendAll(string_view data) const
+{
+    while (!data.empty()) {
+        ssize_t sent = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            throwErrno("send");
+        }
+        data.remove_prefix(static_cast<size_t>(sent));
+    }
+}
+
+size_t TcpSocket::receive(char * buffer, size_t capacity) const
+{
+    for (;;) {
+        ssize_t got = recv(fd, buffer, capacity, 0);
+        if (got >= 0)
+            return static_cast<size_t>(got);
+        if (errno != EINTR)
+            throwErrno("recv");
+    }
+}
+
+void TcpSocket::shutdown() const
+{
+    ::shutdown(fd, SHUT_RDWR);
+}
+
+TcpSocket listenTcp(unsigned short port)
+{
+    TcpSocket listener(socket(AF_INET6, SOCK_STREAM, 0));
+    if (!listener.valid())
+        throwErrno("socket");
+    int on = 1;
+    setsockopt(listener.get(), SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    int off = 0;
+    setsockopt(listener.get(), IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof off);
+    sockaddr_in6 address{};
+    address.sin6_family = AF_INET6;
+    address.sin6_addr = in6addr_any;
+    address.sin6_port = htons(port);
+    if (bind(listener.get(), reinterpret_cast<sockaddr *>(&address), sizeof address) != 0)
+        throwErrno("bind port " + to_string(port));
+    if (listen(listener.get(), SOMAXCONN) != 0)
+        throwErrno("listen");
+    return listener;
+}
+
+TcpSocket acceptTcp(const TcpSocket & listener)
+{
+    for (;;) {
+        int fd = accept(listener.get(), nullptr, nullptr);
+        if (fd >= 0) {
+            setNoDelay(fd);
+            return TcpSocket(fd);
+        }
+        if (errno != EINTR && errno != ECONNABORTED)
+            throwErrno("accept");
+    }
+}
+
+TcpSocket connectTcp(const string & host, unsigned short port)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo * addresses = nullptr;
+    if (int rc = getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &addresses); rc != 0)
+        throw runtime_error(host + ": " + gai_strerror(rc));
+    int lastError = 0;
+    for (addrinfo * a = addresses; a; a = a->ai_next) {
+        TcpSocket socket(::socket(a->ai_family, a->ai_socktype, a->ai_protocol));
+        if (socket.valid() && connect(socket.get(), a->ai_addr, a->ai_addrlen) == 0) {
+            freeaddrinfo(addresses);
+            setNoDelay(socket.get());
+            return socket;
+        }
+        lastError = errno;
+    }
+    freeaddrinfo(addresses);
+    throw system_error(lastError, generic_category(), "connect " + host + ":" + to_string(port));
+}
+
+bool LineReader::next(string_view & line)
+{
+    for (;;) {
+        size_t newline = buffer.find('\n', start);
+        if (newline != string::npos) {
+            line = string_view(buffer).substr(start, newline - start);
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            start = newline + 1;
+            return true;
+        }
+        buffer.erase(0, start);
+        start = 0;
+        size_t had = buffer.size();
+        buffer.resize(had + 64 * 1024);
+        size_t got = socket.receive(buffer.data() + had, 64 * 1024);
+        buffer.resize(had + got);
+        if (got == 0) {
+            if (buffer.empty())
+                return false;
+            line = buffer;
+            start = buffer.size();
+            return true;
+        }
+    }
+}
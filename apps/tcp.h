@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Minimal blocking TCP helpers shared by the greeting server and its load
+// generator. Errors are thrown as std::system_error.
+
+class TcpSocket
+{
+public:
+    TcpSocket() = default;
+    explicit TcpSocket(int fd) : fd(fd) {}
+    TcpSocket(TcpSocket && other) noexcept : fd(other.release()) {}
+    TcpSocket & operator=(TcpSocket && other) noexcept;
+    ~TcpSocket();
+
+    int get() const { return fd; }
+    int release();
+    bool valid() const { return fd >= 0; }
+
+    void sendAll(std::string_view data) const;
+    // Returns 0 at end of stream.
+    size_t receive(char * buffer, size_t capacity) const;
+    // Shuts down both directions, waking any thread blocked in receive().
+    void shutdown() const;
+
+private:
+    int fd = -1;
+};
+
+TcpSocket listenTcp(unsigned short port);
+TcpSocket acceptTcp(const TcpSocket & listener);
+TcpSocket connectTcp(const std::string & host, unsigned short port);
+
+// Buffered line reader over a socket. Lines are returned without the
+// trailing "\n" or "\r\n" and stay valid until the next call.
+class LineReader
+{
+public:
+    explicit LineReader(const TcpSocket & socket) : socket(socket) {}
+    bool next(std::string_view & line);
+
+private:
+    const TcpSocket & socket;
+    std::string buffer;
+    size_t start = 0;
+};
@@ -0,0 +1,311 @@
+#include "tee.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "tcp.h"
+
+using namespace std;
+
+namespace {
+
+constexpr size_t pooledBuffers = 64;        // idle buffers kept for reuse
+constexpr size_t spillReadSize = 1 << 20;
+
+void writeAll(int fd, string_view data, const string & target)
+{
+    while (!data.empty()) {
+        ssize_t written = ::write(fd, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throw system_error(errno, generic_category(), target);
+        }
+        data.remove_prefix(size_t(written));
+    }
+}
+
+// An anonymous temporary file: unlinked at once, gone when closed.
+int createSpillFile(const string & dir)
+{
+    string path = dir + "/hello-tee-XXXXXX";
+    int fd = mkstemp(path.data());
+    if (fd < 0)
+        throw system_error(errno, generic_category(), path);
+    unlink(path.c_str());
+    return fd;
+}
+
+} // namespace
+
+class TeeBufferPool : public enable_shared_from_this<TeeBufferPool>
+{
+public:
+    shared_ptr<string> take()
+    {
+        unique_ptr<string> buffer;
+        {
+            lock_guard<mutex> lock(poolMutex);
+            if (!idle.empty()) {
+                buffer = move(idle.back());
+                idle.pop_back();
+            }
+        }
+        if (!buffer)
+            buffer = make_unique<string>();
+        buffer->clear();
+        // The deleter holds the pool, so buffers may outlive the Tee.
+        return shared_ptr<string>(buffer.release(), [pool = shared_from_this()](string * returned) {
+            unique_ptr<string> owned(returned);
+            lock_guard<mutex> lock(pool->poolMutex);
+            if (pool->idle.size() < pooledBuffers)
+                pool->idle.push_back(move(owned));
+        });
+    }
+
+private:
+    mutex poolMutex;
+    vector<unique_ptr<string>> idle;
+};
+
+class TeeSink
+{
+public:
+    TeeSink(const TeeTarget & target, const Options & options, RunStats & stats)
+        : target(target.target), policy(target.policy), limit(options.teeBuffer), spillDir(options.spillDir),
+          stats(stats)
+    {
+        open();
+        writer = thread([this] { run(); });
+    }
+
+    ~TeeSink()
+    {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            abandoned = true;
+        }
+        changed.notify_all();
+        if (socket.valid())
+            socket.shutdown();
+        if (writer.joinable())
+            writer.join();
+        close();
+        if (spillFd >= 0)
+            ::close(spillFd);
+    }
+
+    void push(const shared_ptr<const string> & bytes)
+    {
+        unique_lock<mutex> lock(queueMutex);
+        if (error)
+            rethrow_exception(error);
+        bool over = !queue.empty() && queuedBytes + bytes->size() > limit;
+        if (over && policy == "block") {
+            changed.wait(lock, [&] { return error || queue.empty() || queuedBytes + bytes->size() <= limit; });
+            if (error)
+                rethrow_exception(error);
+        } else if (over && policy == "drop") {
+            stats.teeDroppedBytes += bytes->size();
+            return;
+        } else if (over && policy == "spill") {
+            // Only this thread appends, at an offset reserved under the lock;
+            // the sink reads spilled bytes back when their marker comes up.
+            if (spillFd < 0)
+                spillFd = createSpillFile(spillDir);
+            if (spilledItems == 0)
+                spillEnd = 0;
+            uint64_t offset = spillEnd;
+            spillEnd += bytes->size();
+            ++spilledItems;
+            lock.unlock();
+            for (size_t done = 0; done < bytes->size();) {
+                ssize_t written = pwrite(spillFd, bytes->data() + done, bytes->size() - done, off_t(offset + done));
+                if (written < 0 && errno != EINTR)
+                    throw system_error(errno, generic_category(), "spilling --tee " + target);
+                done += written < 0 ? 0 : size_t(written);
+            }
+            stats.teeSpilledBytes += bytes->size();
+            lock.lock();
+            queue.push_back({nullptr, offset, bytes->size()});
+            changed.notify_all();
+            return;
+        }
+        queuedBytes += bytes->size();
+        queue.push_back({bytes, 0, bytes->size()});
+        changed.notify_all();
+    }
+
+    void finish()
+    {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            closing = true;
+        }
+        changed.notify_all();
+        writer.join();
+        if (error)
+            rethrow_exception(error);
+        close();
+    }
+
+private:
+    struct Item
+    {
+        shared_ptr<const string> bytes;   // null if spilled
+        uint64_t spillOffset;
+        size_t size;
+    };
+
+    void open()
+    {
+        if (target == "-") {
+            fd = STDOUT_FILENO;
+        } else if (target[0] == '|') {
+            command = popen(target.c_str() + 1, "w");
+            if (!command)
+                throw system_error(errno, generic_category(), target);
+            fd = fileno(command);
+        } else if (target.compare(0, 4, "tcp:") == 0) {
+            size_t colon = target.rfind(':');
+            string host = target.substr(4, colon - 4);
+            if (host.size() > 2 && host.front() == '[' && host.back() == ']')
+                host = host.substr(1, host.size() - 2);
+            socket = connectTcp(host, static_cast<unsigned short>(stoul(target.substr(colon + 1))));
+            fd = socket.get();
+        } else {
+            fd = ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+            if (fd < 0)
+                throw system_error(errno, generic_category(), target);
+        }
+    }
+
+    void close()
+    {
+        if (command) {
+            int status = pclose(command);
+            command = nullptr;
+            if (status != 0 && !abandoned)
+                throw runtime_error("--tee " + target + ": command exited with status " +
+                                    to_string(WIFEXITED(status) ? WEXITSTATUS(status) : status));
+        } else if (!socket.valid() && fd > STDOUT_FILENO) {
+            ::close(fd);
+        }
+        fd = -1;
+        socket = TcpSocket();
+    }
+
+    void run()
+    {
+        // A pipe whose reader has gone then fails the write with EPIPE
+        // instead of killing the process.
+        sigset_t pipeSignal;
+        sigemptyset(&pipeSignal);
+        sigaddset(&pipeSignal, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &pipeSignal, nullptr);
+
+        StageScope stage(Stage::Write);
+        string spilled;
+        try {
+            for (;;) {
+                Item item;
+                {
+                    unique_lock<mutex> lock(queueMutex);
+                    changed.wait(lock, [&] { return abandoned || closing || !queue.empty(); });
+                    if (abandoned || queue.empty())
+                        return;
+                    item = move(queue.front());
+                    queue.pop_front();
+                }
+                if (item.bytes) {
+                    writeAll(fd, *item.bytes, target);
+                } else {
+                    for (size_t done = 0; done < item.size;) {
+                        spilled.resize(min(spillReadSize, item.size - done));
+                        ssize_t got = pread(spillFd, spilled.data(), spilled.size(), off_t(item.spillOffset + done));
+                        if (got <= 0) {
+                            if (got < 0 && errno == EINTR)
+                                continue;
+                            throw system_error(got < 0 ? errno : EIO, generic_category(), "reading --tee spill");
+                        }
+                        writeAll(fd, string_view(spilled.data(), size_t(got)), target);
+                        done += size_t(got);
+                    }
+                }
+                {
+                    lock_guard<mutex> lock(queueMutex);
+                    if (item.bytes)
+                        queuedBytes -= item.size;
+                    else
+                        --spilledItems;
+                }
+                item.bytes.reset();   // before waking the writer, so the buffer is back in the pool
+                changed.notify_all();
+            }
+        } catch (...) {
+            lock_guard<mutex> lock(queueMutex);
+            error = current_exception();
+            queue.clear();
+            changed.notify_all();
+        }
+    }
+
+    string target;
+    string policy;
+    size_t limit;
+    string spillDir;
+    RunStats & stats;
+
+    int fd = -1;
+    FILE * command = nullptr;
+    TcpSocket socket;
+    int spillFd = -1;
+    uint64_t spillEnd = 0;      // where the next spilled buffer goes
+    size_t spilledItems = 0;    // queued; when none, the spill file is reused from the start
+
+    mutex queueMutex;
+    condition_variable changed;
+    deque<Item> queue;
+    size_t queuedBytes = 0;     // of buffers queued in memory
+    bool closing = false;
+    bool abandoned = false;
+    exception_ptr error;
+    thread writer;
+};
+
+Tee::Tee(const Options & options, RunStats & stats) : pool(make_shared<TeeBufferPool>())
+{
+    for (const TeeTarget & target : options.tee)
+        sinks.push_back(make_unique<TeeSink>(target, options, stats));
+}
+
+Tee::~Tee() = default;
+
+shared_ptr<string> Tee::buffer() { return pool->take(); }
+
+void Tee::write(shared_ptr<const string> bytes)
+{
+    for (const unique_ptr<TeeSink> & sink : sinks)
+        sink->push(bytes);
+}
+
+void Tee::finish()
+{
+    for (const unique_ptr<TeeSink> & sink : sinks)
+        sink->finish();
+}
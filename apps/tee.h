@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "options.h"
+#include "stats.h"
+
+class TeeBufferPool;
+class TeeSink;
+
+// Copies of the output for --tee: files, named pipes, commands ("|cmd")
+// and TCP sockets ("tcp:host:port"), each written by its own thread.
+//
+// The writer renders into buffers from buffer() and passes them to
+// write(), which hands each sink a reference rather than a copy; a buffer
+// returns to the pool once the last sink has written it. Each sink queues
+// up to options.teeBuffer bytes, and past that applies its policy: block
+// waits for the sink, holding up the whole output; drop discards the
+// buffer, so the sink misses whole records; spill appends the buffer to a
+// temporary file in options.spillDir and the sink reads it back in turn.
+class Tee
+{
+public:
+    Tee(const Options & options, RunStats & stats);
+    // Abandons sinks not yet finished.
+    ~Tee();
+    Tee(const Tee &) = delete;
+    Tee & operator=(const Tee &) = delete;
+
+    // An empty buffer with capacity left from earlier use.
+    std::shared_ptr<std::string> buffer();
+
+    // Queues bytes for every sink, in order. Throws the first sink error.
+    void write(std::shared_ptr<const std::string> bytes);
+
+    // Waits for every sink to write its queue and closes them. Throws the
+    // first sink error, including a command's non-zero exit.
+    void finish();
+
+private:
+    std::shared_ptr<TeeBufferPool> pool;
+    std::vector<std::unique_ptr<TeeSink>> sinks;
+};
@@ -0,0 +1,111 @@
+#include "trace.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct TraceEvent
+{
+    const char * name;
+    int64_t start;
+    int64_t end;
+    int64_t arg;
+};
+
+struct ThreadTrace
+{
+    int tid;
+    string name;
+    vector<TraceEvent> events;
+};
+
+const auto traceEpoch = chrono::steady_clock::now();
+
+// Buffers are owned here rather than by the threads so they survive until
+// export. The mutex is only taken when a thread records its first span.
+mutex registryMutex;
+vector<unique_ptr<ThreadTrace>> registry;
+
+ThreadTrace & threadTrace()
+{
+    thread_local ThreadTrace * trace = [] {
+        lock_guard<mutex> lock(registryMutex);
+        auto buffer = make_unique<ThreadTrace>();
+        buffer->tid = static_cast<int>(registry.size()) + 1;
+        buffer->events.reserve(4096);
+        registry.push_back(move(buffer));
+        return registry.back().get();
+    }();
+    return *trace;
+}
+
+void writeJsonString(ostream & out, const string & text)
+{
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) >= 0x20)
+            out << c;
+    }
+    out << '"';
+}
+
+void writeMicros(ostream & out, int64_t nanos)
+{
+    out << nanos / 1000 << '.' << char('0' + nanos % 1000 / 100) << char('0' + nanos % 100 / 10)
+        << char('0' + nanos % 10);
+}
+
+} // namespace
+
+int64_t traceNow()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - traceEpoch).count();
+}
+
+void recordTraceSpan(const char * name, int64_t start, int64_t end, int64_t arg)
+{
+    threadTrace().events.push_back({name, start, end, arg});
+}
+
+void setTraceThreadName(const string & name)
+{
+    if (tracingEnabled()) {
+        ThreadTrace & trace = threadTrace();
+        lock_guard<mutex> lock(registryMutex);
+        trace.name = name;
+    }
+}
+
+void writeChromeTrace(ostream & out)
+{
+    lock_guard<mutex> lock(registryMutex);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    const char * separator = "\n";
+    for (const auto & trace : registry) {
+        if (!trace->name.empty()) {
+            out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << trace->tid
+                << ",\"args\":{\"name\":";
+            writeJsonString(out, trace->name);
+            out << "}}";
+            separator = ",\n";
+        }
+        for (const TraceEvent & event : trace->events) {
+            out << separator << "{\"name\":\"" << event.name << "\",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                << trace->tid << ",\"ts\":";
+            writeMicros(out, event.start);
+            out << ",\"dur\":";
+            writeMicros(out, event.end - event.start);
+            if (event.arg >= 0)
+                out << ",\"args\":{\"chunk\":" << event.arg << '}';
+            out << '}';
+            separator = ",\n";
+        }
+    }
+    out << "\n]}\n";
+}
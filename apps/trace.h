@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Scoped spans recorded into per-thread buffers and exported as Chrome
+// trace-event JSON (chrome://tracing or ui.perfetto.dev). While tracing is
+// disabled a span costs one relaxed load.
+
+inline std::atomic<bool> traceEnabled{false};
+
+inline void enableTracing() { traceEnabled.store(true, std::memory_order_relaxed); }
+inline bool tracingEnabled() { return traceEnabled.load(std::memory_order_relaxed); }
+
+int64_t traceNow();
+void recordTraceSpan(const char * name, int64_t start, int64_t end, int64_t arg);
+
+// Labels the calling thread in the exported trace.
+void setTraceThreadName(const std::string & name);
+
+// Writes every span recorded so far. Call after the traced threads finish.
+void writeChromeTrace(std::ostream & out);
+
+class TraceSpan
+{
+public:
+    // name must outlive the trace (string literals); arg, if not negative,
+    // is exported as args.chunk.
+    explicit TraceSpan(const char * name, int64_t arg = -1)
+    {
+        if (tracingEnabled()) {
+            this->name = name;
+            this->arg = arg;
+            start = traceNow();
+        }
+    }
+    ~TraceSpan()
+    {
+        if (name)
+            recordTraceSpan(name, start, traceNow(), arg);
+    }
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan & operator=(const TraceSpan &) = delete;
+
+private:
+    const char * name = nullptr;
+    int64_t arg = -1;
+    int64_t start = 0;
+};
@@ -0,0 +1,124 @@
+// Skewed, bursty local load: client threads fire bursts of single greetings
+// at the same moment, names drawn from a Zipf distribution so a few names
+// dominate each burst, as when many clients react to the same event. Runs
+// the same load without and with coalescing and reports the process CPU
+// time per greeting, the renders saved and the burst latency.
+//
+// usage: burstload [workers] [clients] [burst] [bursts] [distinct-names]
+
+#include <algorithm>
+#include <barrier>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <future>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "greetingservice.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+namespace {
+
+double cpuSeconds()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    auto seconds = [](const timeval & t) { return double(t.tv_sec) + double(t.tv_usec) / 1e6; };
+    return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+}
+
+// Name ranks drawn with probability proportional to 1 / rank.
+vector<size_t> zipfRanks(size_t count, size_t distinct, unsigned seed)
+{
+    vector<double> cumulative(distinct);
+    double total = 0;
+    for (size_t rank = 0; rank < distinct; ++rank)
+        cumulative[rank] = total += 1.0 / double(rank + 1);
+    mt19937_64 random(seed);
+    uniform_real_distribution<double> uniform(0, total);
+    vector<size_t> ranks(count);
+    for (size_t & rank : ranks)
+        rank = size_t(lower_bound(cumulative.begin(), cumulative.end(), uniform(random)) - cumulative.begin());
+    return ranks;
+}
+
+struct Result
+{
+    double cpuMicrosPerGreeting = 0;
+    double burstMillis = 0;
+    GreetingServiceStats stats;
+};
+
+Result runLoad(bool coalesce, unsigned workers, unsigned clients, size_t burst, size_t bursts, size_t distinct)
+{
+    GreetingServiceConfig config;
+    config.workers = workers;
+    config.coalesce = coalesce;
+    GreetingService service(config);
+    vector<string> names;
+    for (size_t i = 0; i < distinct; ++i)
+        names.push_back("customer " + to_string(i));
+
+    barrier start(clients + 1);
+    vector<thread> threads;
+    for (unsigned c = 0; c < clients; ++c) {
+        threads.emplace_back([&, c] {
+            vector<size_t> ranks = zipfRanks(burst * bursts, distinct, c + 1);
+            vector<future<string>> pending;
+            for (size_t b = 0; b < bursts; ++b) {
+                start.arrive_and_wait();
+                for (size_t i = 0; i < burst; ++i)
+                    pending.push_back(service.greet(names[ranks[b * burst + i]]));
+                for (future<string> & greeting : pending)
+                    greeting.get();
+                pending.clear();
+                start.arrive_and_wait();
+            }
+        });
+    }
+
+    double cpuBefore = cpuSeconds();
+    Clock::duration busy{};
+    for (size_t b = 0; b < bursts; ++b) {
+        start.arrive_and_wait();
+        Clock::time_point burstStart = Clock::now();
+        start.arrive_and_wait();
+        busy += Clock::now() - burstStart;
+    }
+    for (thread & t : threads)
+        t.join();
+    Result result;
+    result.cpuMicrosPerGreeting = (cpuSeconds() - cpuBefore) * 1e6 / double(clients * burst * bursts);
+    result.burstMillis = chrono::duration<double, milli>(busy).count() / double(bursts);
+    result.stats = service.stats();
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    unsigned workers = argc > 1 ? stoul(argv[1]) : 2;
+    unsigned clients = argc > 2 ? stoul(argv[2]) : 8;
+    size_t burst = argc > 3 ? stoul(argv[3]) : 2000;
+    size_t bursts = argc > 4 ? stoul(argv[4]) : 50;
+    size_t distinct = argc > 5 ? stoul(argv[5]) : 10000;
+
+    printf("workers=%u clients=%u burst=%zu bursts=%zu distinct-names=%zu\n", workers, clients, burst, bursts,
+           distinct);
+    printf("%-10s %14s %12s %12s %12s\n", "mode", "cpu us/greet", "renders", "coalesced", "burst ms");
+    for (bool coalesce : {false, true}) {
+        Result result = runLoad(coalesce, workers, clients, burst, bursts, distinct);
+        printf("%-10s %14.2f %12llu %12llu %12.2f\n", coalesce ? "coalesce" : "plain", result.cpuMicrosPerGreeting,
+               (unsigned long long)result.stats.interactiveRequests, (unsigned long long)result.stats.coalesced,
+               result.burstMillis);
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+// Cost per name of greeting through the C interface one name per call versus
+// in batches, next to the C++ API. The per-call rows are the floor an FFI
+// binding pays before its own marshalling; see ffibench.py for the same
+// comparison through Python ctypes.
+//
+// usage: ffibench [names]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "hello.h"
+#include "hello_c.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+namespace {
+
+template <typename Body>
+double nanosPerName(size_t names, Body body)
+{
+    body();  // warm up
+    Clock::time_point start = Clock::now();
+    body();
+    return chrono::duration<double, nano>(Clock::now() - start).count() / names;
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    size_t count = argc > 1 ? stoul(argv[1]) : 1000000;
+    string names;
+    vector<uint64_t> nameOffsets{0};
+    for (size_t i = 0; i < count; ++i) {
+        names += "customer " + to_string(i);
+        nameOffsets.push_back(names.size());
+    }
+    uint64_t required = 0;
+    hello_greetings_size(names.data(), nameOffsets.data(), count, 0, &required);
+    vector<char> out(required);
+    vector<uint64_t> outOffsets(count + 1);
+
+    printf("%-28s %10s\n", "path", "ns/name");
+    printf("%-28s %10.1f\n", "C++ generateHelloString", nanosPerName(count, [&] {
+        for (size_t i = 0; i < count; ++i)
+            generateHelloString(names.substr(nameOffsets[i], nameOffsets[i + 1] - nameOffsets[i]));
+    }));
+    printf("%-28s %10.1f\n", "C hello_greet per name", nanosPerName(count, [&] {
+        size_t length;
+        for (size_t i = 0; i < count; ++i)
+            hello_greet(names.data() + nameOffsets[i], nameOffsets[i + 1] - nameOffsets[i], 0, out.data(),
+                        out.size(), &length);
+    }));
+    for (size_t batch : {16, 256, 4096, 65536}) {
+        string label = "C hello_greet_batch x" + to_string(batch);
+        printf("%-28s %10.1f\n", label.c_str(), nanosPerName(count, [&] {
+            // Each call writes its greetings from the start of out, as a
+            // binding reusing one buffer would.
+            for (size_t first = 0; first < count; first += batch) {
+                size_t n = min(batch, count - first);
+                hello_greet_batch(names.data(), nameOffsets.data() + first, n, 0, out.data(), out.size(),
+                                  outOffsets.data(), nullptr);
+            }
+        }));
+    }
+    return 0;
+}
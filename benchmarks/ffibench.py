@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+"""Greets names through Python ctypes one call per name and in batches, to
+show what crossing the FFI boundary per name costs.
+
+usage: ffibench.py path/to/libhello.so [names]
+"""
+
+import ctypes
+import sys
+import time
+
+
+def main():
+    lib = ctypes.CDLL(sys.argv[1])
+    count = int(sys.argv[2]) if len(sys.argv) > 2 else 200000
+    u64p = ctypes.POINTER(ctypes.c_uint64)
+    lib.hello_greet.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_uint32, ctypes.c_char_p,
+                                ctypes.c_size_t, ctypes.POINTER(ctypes.c_size_t)]
+    lib.hello_greet_batch.argtypes = [ctypes.c_char_p, u64p, ctypes.c_size_t, ctypes.c_uint32, ctypes.c_char_p,
+                                      ctypes.c_uint64, u64p, u64p]
+    lib.hello_greetings_size.argtypes = [ctypes.c_char_p, u64p, ctypes.c_size_t, ctypes.c_uint32, u64p]
+
+    names = [('customer %d' % i).encode() for i in range(count)]
+
+    out = ctypes.create_string_buffer(256)
+    length = ctypes.c_size_t()
+    start = time.perf_counter()
+    greetings = []
+    for name in names:
+        lib.hello_greet(name, len(name), 0, out, len(out), ctypes.byref(length))
+        greetings.append(out.raw[:length.value])
+    per_name = time.perf_counter() - start
+
+    start = time.perf_counter()
+    blob = b''.join(names)
+    offsets = (ctypes.c_uint64 * (count + 1))()
+    position = 0
+    for i, name in enumerate(names):
+        offsets[i] = position
+        position += len(name)
+    offsets[count] = position
+    required = ctypes.c_uint64()
+    lib.hello_greetings_size(blob, offsets, count, 0, ctypes.byref(required))
+    batch_out = ctypes.create_string_buffer(required.value)
+    out_offsets = (ctypes.c_uint64 * (count + 1))()
+    lib.hello_greet_batch(blob, offsets, count, 0, batch_out, required.value, out_offsets, None)
+    raw = batch_out.raw
+    batched = [raw[out_offsets[i]:out_offsets[i + 1]] for i in range(count)]
+    batch = time.perf_counter() - start
+
+    assert batched == greetings
+    print('%-34s %10.1f ns/name' % ('ctypes hello_greet per name', per_name / count * 1e9))
+    print('%-34s %10.1f ns/name' % ('ctypes hello_greet_batch, one call', batch / count * 1e9))
+
+
+if __name__ == '__main__':
+    main()
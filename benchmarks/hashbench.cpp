@@ -0,0 +1,88 @@
+// Throughput of hashing a column of names: std::hash one string at a time
+// (what each caller did before), hashName per name, the hashNames batch
+// kernel, and keyed SipHash-2-4. Names are "customer N", about 14 bytes,
+// unless a length is given.
+//
+// usage: hashbench [names] [length]
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "namehash.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+namespace {
+
+// Best of five, after a warm-up run; also keeps the hashes alive.
+template <typename Body>
+double nanosPerName(size_t names, Body body)
+{
+    uint64_t sink = body();
+    double best = 1e300;
+    for (int run = 0; run < 5; ++run) {
+        Clock::time_point start = Clock::now();
+        sink ^= body();
+        best = min(best, chrono::duration<double, nano>(Clock::now() - start).count() / names);
+    }
+    if (sink == 42)
+        puts("");
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    size_t count = argc > 1 ? stoul(argv[1]) : 1000000;
+    size_t length = argc > 2 ? stoul(argv[2]) : 0;
+    vector<string> storage;
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) {
+        string name = "customer " + to_string(i);
+        if (length)
+            name.resize(length, 'x');
+        bytes += name.size();
+        storage.push_back(move(name));
+    }
+    vector<string_view> names(storage.begin(), storage.end());
+    vector<uint64_t> hashes;
+    SipHashKey key{0x0706050403020100ull, 0x0f0e0d0c0b0a0908ull};
+
+    auto report = [&](const char * label, double nanos) {
+        printf("%-24s %10.2f %10.2f\n", label, nanos, bytes / double(count) / nanos);
+    };
+    printf("%zu names, %.1f bytes each\n", count, bytes / double(count));
+    printf("%-24s %10s %10s\n", "hash", "ns/name", "GB/s");
+    report("std::hash per name", nanosPerName(count, [&] {
+        uint64_t x = 0;
+        for (string_view name : names)
+            x ^= hash<string_view>{}(name);
+        return x;
+    }));
+    report("hashName per name", nanosPerName(count, [&] {
+        uint64_t x = 0;
+        for (string_view name : names)
+            x ^= hashName(name);
+        return x;
+    }));
+    report("hashNames batch", nanosPerName(count, [&] {
+        hashNames(names, hashes);
+        return hashes.back();
+    }));
+    report("sipHash24 per name", nanosPerName(count, [&] {
+        uint64_t x = 0;
+        for (string_view name : names)
+            x ^= sipHash24(name, key);
+        return x;
+    }));
+    report("sipHashNames batch", nanosPerName(count, [&] {
+        sipHashNames(names, key, hashes);
+        return hashes.back();
+    }));
+    return 0;
+}
@@ -0,0 +1,79 @@
+// Cost of logging one request line on the logging threads: the async log's
+// ring write against a synchronous ofstream line under a mutex, the usual
+// way to share a log file between threads. Lines go to a file that is
+// removed afterwards.
+//
+// usage: logbench [threads] [lines-per-thread] [path]
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "asynclog.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+namespace {
+
+const LogFormat requestFormat("conn={} G {} -> {} bytes in {} us");
+
+// Nanoseconds per line on the logging threads.
+template <typename LogLine>
+double timeThreads(unsigned threads, size_t lines, LogLine logLine)
+{
+    vector<thread> workers;
+    Clock::time_point start = Clock::now();
+    for (unsigned t = 0; t < threads; ++t)
+        workers.emplace_back([&, t] {
+            for (size_t i = 0; i < lines; ++i)
+                logLine(t, i);
+        });
+    for (thread & worker : workers)
+        worker.join();
+    return chrono::duration<double, nano>(Clock::now() - start).count() / double(lines);
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    unsigned threads = argc > 1 ? stoul(argv[1]) : 4;
+    size_t lines = argc > 2 ? stoul(argv[2]) : 1'000'000;
+    string path = argc > 3 ? argv[3] : "/tmp/logbench.log";
+    string name = "Jim";
+
+    printf("threads=%u lines/thread=%zu\n", threads, lines);
+    printf("%-16s %14s %12s %12s\n", "logger", "ns/line", "written", "dropped");
+
+    {
+        ofstream out(path, ios::trunc);
+        mutex outMutex;
+        double ns = timeThreads(threads, lines, [&](unsigned t, size_t i) {
+            lock_guard<mutex> lock(outMutex);
+            out << "conn=" << t << " G " << name << " -> " << 9 + name.size() << " bytes in " << i % 100 << " us"
+                << endl;
+        });
+        printf("%-16s %14.1f %12zu %12d\n", "ofstream+endl", ns, threads * lines, 0);
+    }
+    for (LogOverflow overflow : {LogOverflow::Drop, LogOverflow::Block}) {
+        remove(path.c_str());
+        AsyncLogConfig config{path};
+        config.overflow = overflow;
+        config.ringSize = 1 << 20;
+        AsyncLog log(config);
+        double ns = timeThreads(threads, lines, [&](unsigned t, size_t i) {
+            log.write(requestFormat, t, name, 9 + name.size(), i % 100);
+        });
+        log.flush();
+        AsyncLogStats stats = log.stats();
+        printf("%-16s %14.1f %12llu %12llu\n", overflow == LogOverflow::Drop ? "async drop" : "async block", ns,
+               (unsigned long long)stats.written, (unsigned long long)stats.dropped);
+    }
+    remove(path.c_str());
+    return 0;
+}
@@ -0,0 +1,100 @@
+// Mixed local load: closed-loop bulk clients keep the greeting service busy
+// with large batches while one interactive client issues single greetings at
+// a fixed interval. Runs the same load against a FIFO service and a
+// prioritized one and reports interactive latency and bulk throughput.
+//
+// usage: mixedload [workers] [bulk-clients] [bulk-batch] [seconds]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "greetingservice.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+namespace {
+
+struct Result
+{
+    vector<double> interactiveMicros;
+    double bulkGreetingsPerSecond = 0;
+};
+
+double percentile(vector<double> & values, double p)
+{
+    if (values.empty())
+        return 0;
+    size_t rank = min(values.size() - 1, size_t(p / 100 * values.size()));
+    nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank];
+}
+
+Result runLoad(GreetingServiceConfig config, unsigned bulkClients, size_t bulkBatch, chrono::seconds duration)
+{
+    GreetingService service(config);
+    vector<string> names;
+    for (size_t i = 0; i < bulkBatch; ++i)
+        names.push_back("bulk customer " + to_string(i));
+
+    atomic<bool> stop{false};
+    atomic<uint64_t> bulkGreetings{0};
+    vector<thread> clients;
+    for (unsigned c = 0; c < bulkClients; ++c) {
+        clients.emplace_back([&] {
+            while (!stop) {
+                size_t count = service.greetBatch(names, GreetingPriority::Bulk).get().size();
+                bulkGreetings += count;
+            }
+        });
+    }
+
+    Result result;
+    Clock::time_point start = Clock::now();
+    Clock::time_point next = start;
+    while (Clock::now() - start < duration) {
+        next += chrono::microseconds(500);
+        this_thread::sleep_until(next);
+        Clock::time_point sent = Clock::now();
+        service.greet("interactive customer").get();
+        result.interactiveMicros.push_back(chrono::duration<double, micro>(Clock::now() - sent).count());
+    }
+    double elapsed = chrono::duration<double>(Clock::now() - start).count();
+    stop = true;
+    for (thread & client : clients)
+        client.join();
+    result.bulkGreetingsPerSecond = bulkGreetings / elapsed;
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    unsigned workers = argc > 1 ? stoul(argv[1]) : 2;
+    unsigned bulkClients = argc > 2 ? stoul(argv[2]) : 2;
+    size_t bulkBatch = argc > 3 ? stoul(argv[3]) : 50000;
+    chrono::seconds duration(argc > 4 ? stoul(argv[4]) : 3);
+
+    printf("workers=%u bulk-clients=%u bulk-batch=%zu seconds=%lld\n", workers, bulkClients, bulkBatch,
+           static_cast<long long>(duration.count()));
+    printf("%-12s %12s %12s %12s %16s\n", "mode", "p50 us", "p99 us", "max us", "bulk greet/s");
+    for (bool prioritize : {false, true}) {
+        GreetingServiceConfig config;
+        config.workers = workers;
+        config.prioritize = prioritize;
+        Result result = runLoad(config, bulkClients, bulkBatch, duration);
+        double worst = result.interactiveMicros.empty()
+                           ? 0
+                           : *max_element(result.interactiveMicros.begin(), result.interactiveMicros.end());
+        printf("%-12s %12.1f %12.1f %12.1f %16.0f\n", prioritize ? "priority" : "fifo",
+               percentile(result.interactiveMicros, 50), percentile(result.interactiveMicros, 99), worst,
+               result.bulkGreetingsPerSecond);
+    }
+    return 0;
+}
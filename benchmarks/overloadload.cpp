@@ -0,0 +1,134 @@
+// Sustained overload: batches arrive on a fixed schedule faster than the
+// service can render them. Without shedding the queue, and with it every
+// request's latency, grows for as long as the overload lasts; with
+// shedding the backlog is cut and the requests that are served stay near
+// the target delay. Reports goodput, requests shed and the latency of the
+// served requests from their intended arrival, in each mode.
+//
+// usage: overloadload [overload-factor] [seconds] [batch-size] [target-ms] [interval-ms]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "greetingservice.h"
+#include "hdrhistogram.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+namespace {
+
+struct Pending
+{
+    Clock::time_point intended;
+    future<GreetingBatch> result;
+};
+
+struct Result
+{
+    double goodput = 0;
+    HdrHistogram latency;
+    HdrHistogram queueDelay;
+    GreetingServiceStats stats;
+};
+
+GreetingServiceConfig serviceConfig(bool shed, chrono::milliseconds target, chrono::milliseconds interval)
+{
+    GreetingServiceConfig config;
+    config.workers = 1;
+    config.prioritize = false;
+    config.shed = shed;
+    config.shedTarget = target;
+    config.shedInterval = interval;
+    return config;
+}
+
+// Batches per second one worker renders, submission included.
+double capacity(const vector<string> & names)
+{
+    GreetingService service(serviceConfig(false, {}, {}));
+    constexpr int batches = 2000;
+    Clock::time_point start = Clock::now();
+    vector<future<GreetingBatch>> results;
+    for (int i = 0; i < batches; ++i)
+        results.push_back(service.greetBatch(names, GreetingPriority::Bulk));
+    for (future<GreetingBatch> & result : results)
+        result.wait();
+    return batches / chrono::duration<double>(Clock::now() - start).count();
+}
+
+Result runLoad(bool shed, double rate, double seconds, const vector<string> & names, chrono::milliseconds target,
+               chrono::milliseconds interval)
+{
+    GreetingService service(serviceConfig(shed, target, interval));
+    size_t count = size_t(rate * seconds);
+    vector<Pending> pending(count);
+    atomic<size_t> submitted{0};
+    Result result;
+    uint64_t served = 0;
+    // Waits for the results in arrival order, which FIFO is also the
+    // order they complete in, timing each as it comes.
+    thread collector([&] {
+        for (size_t i = 0; i < count; ++i) {
+            submitted.wait(i);
+            try {
+                pending[i].result.get();
+                result.latency.record(
+                    uint64_t(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - pending[i].intended).count()));
+                ++served;
+            } catch (const GreetingOverloaded &) {
+            }
+        }
+    });
+
+    Clock::time_point start = Clock::now();
+    auto gap = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1 / rate));
+    for (size_t i = 0; i < count; ++i) {
+        pending[i].intended = start + gap * i;
+        this_thread::sleep_until(pending[i].intended);
+        pending[i].result = service.greetBatch(names, GreetingPriority::Bulk);
+        submitted.store(i + 1);
+        submitted.notify_one();
+    }
+    collector.join();
+    result.goodput = double(served) / chrono::duration<double>(Clock::now() - start).count();
+    result.queueDelay = service.queueDelays(GreetingPriority::Interactive);
+    result.stats = service.stats();
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    double factor = argc > 1 ? stod(argv[1]) : 2;
+    double seconds = argc > 2 ? stod(argv[2]) : 3;
+    size_t batchSize = argc > 3 ? stoul(argv[3]) : 1000;
+    chrono::milliseconds target(argc > 4 ? stoul(argv[4]) : 5);
+    chrono::milliseconds interval(argc > 5 ? stoul(argv[5]) : 100);
+
+    vector<string> names;
+    for (size_t i = 0; i < batchSize; ++i)
+        names.push_back("customer " + to_string(i));
+    capacity(names);   // warm up
+    double rate = factor * capacity(names);
+
+    printf("batch=%zu capacity=%.0f/s offered=%.0f/s for %.1fs target=%lldms interval=%lldms\n", batchSize,
+           rate / factor, rate, seconds, (long long)target.count(), (long long)interval.count());
+    printf("%-8s %12s %10s %12s %12s %12s %14s\n", "mode", "goodput/s", "shed", "p50 ms", "p99 ms", "max ms",
+           "queue p99 ms");
+    for (bool shed : {false, true}) {
+        Result result = runLoad(shed, rate, seconds, names, target, interval);
+        auto ms = [](uint64_t nanos) { return double(nanos) / 1e6; };
+        printf("%-8s %12.0f %10llu %12.2f %12.2f %12.2f %14.2f\n", shed ? "shed" : "plain", result.goodput,
+               (unsigned long long)result.stats.shed[0], ms(result.latency.valueAtPercentile(50)),
+               ms(result.latency.valueAtPercentile(99)), ms(result.latency.max()),
+               ms(result.queueDelay.valueAtPercentile(99)));
+    }
+    return 0;
+}
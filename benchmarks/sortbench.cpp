@@ -0,0 +1,73 @@
+// Sorting a batch of names: std::sort on the views against sortNames with
+// one thread and with every core, on shuffled "customer N" names, which
+// share a long prefix, and on random lowercase names of the same length.
+//
+// usage: sortbench [names] [threads]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "namesort.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+namespace {
+
+// Best of three, each sorting a fresh copy of the shuffled views.
+template <typename Sort>
+double nanosPerName(const vector<string_view> & names, Sort sort)
+{
+    double best = 1e300;
+    for (int run = 0; run < 3; ++run) {
+        vector<string_view> batch = names;
+        Clock::time_point start = Clock::now();
+        sort(batch);
+        best = min(best, chrono::duration<double, nano>(Clock::now() - start).count() / names.size());
+        if (!is_sorted(batch.begin(), batch.end()))
+            puts("not sorted!");
+    }
+    return best;
+}
+
+void run(const char * label, const vector<string_view> & names, unsigned threads)
+{
+    printf("%s\n", label);
+    printf("  %-22s %8.1f ns/name\n", "std::sort",
+           nanosPerName(names, [](vector<string_view> & batch) { sort(batch.begin(), batch.end()); }));
+    printf("  %-22s %8.1f ns/name\n", "sortNames, 1 thread",
+           nanosPerName(names, [](vector<string_view> & batch) { sortNames(batch, 1); }));
+    char parallel[32];
+    snprintf(parallel, sizeof parallel, "sortNames, %u threads", threads);
+    printf("  %-22s %8.1f ns/name\n", parallel,
+           nanosPerName(names, [&](vector<string_view> & batch) { sortNames(batch, threads); }));
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    size_t count = argc > 1 ? stoul(argv[1]) : 2000000;
+    unsigned threads = argc > 2 ? stoul(argv[2]) : max(1u, thread::hardware_concurrency());
+    mt19937_64 random(42);
+
+    vector<string> customers;
+    vector<string> lowercase;
+    for (size_t i = 0; i < count; ++i) {
+        customers.push_back("customer " + to_string(i));
+        string name(customers.back().size(), 'a');
+        for (char & c : name)
+            c = char('a' + random() % 26);
+        lowercase.push_back(move(name));
+    }
+    shuffle(customers.begin(), customers.end(), random);
+    printf("%zu names\n", count);
+    run("customer N", vector<string_view>(customers.begin(), customers.end()), threads);
+    run("random lowercase", vector<string_view>(lowercase.begin(), lowercase.end()), threads);
+    return 0;
+}
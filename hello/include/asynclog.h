@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Asynchronous logging for hot paths. A thread logs by copying a compact
+// binary record, the id of its format and the raw arguments, into a ring
+// only it writes; no locks, no formatting and no system calls, some tens of
+// nanoseconds. A background thread drains the rings every pollInterval,
+// formats the records and writes them out.
+//
+// When a thread's ring is full its records are dropped and counted, and the
+// log reports how many went missing in place of them, so a stalled disk
+// costs log lines rather than request latency; LogOverflow::Block waits for
+// room instead. Lines from one thread stay in order; lines of different
+// threads may interleave out of order within a poll, their timestamps
+// telling the true order.
+
+// A format string with "{}" for each argument, registered once for the
+// process; records carry its id. Declare as static, as text must outlive
+// every log.
+class LogFormat
+{
+public:
+    explicit LogFormat(const char * text);
+
+    uint32_t id() const { return formatId; }
+    // Null past the last format registered.
+    static const char * text(uint32_t id);
+
+private:
+    uint32_t formatId;
+};
+
+enum class LogOverflow { Drop, Block };
+
+struct AsyncLogConfig
+{
+    std::string path = "-";            // appended to; "-" is stderr
+    size_t ringSize = 1 << 16;         // bytes per logging thread, at least 16k, rounded up to a power of two
+    LogOverflow overflow = LogOverflow::Drop;
+    std::chrono::microseconds pollInterval{1000};
+};
+
+struct AsyncLogStats
+{
+    uint64_t written = 0;              // records formatted and written
+    uint64_t dropped = 0;              // records lost to full rings
+};
+
+// One thread's records, consumed by the log's background thread.
+class alignas(64) LogRing
+{
+public:
+    explicit LogRing(size_t capacity);
+
+    // Room for size contiguous bytes, or null when the record is dropped.
+    char * reserve(size_t size, LogOverflow overflow);
+    void commit() { tail.store(reservedTail, std::memory_order_release); }
+    // Called as its thread exits; the log retires the ring once drained.
+    void markOrphaned() { orphaned.store(true, std::memory_order_release); }
+
+private:
+    friend class AsyncLog;
+
+    std::unique_ptr<char[]> data;
+    uint64_t capacity;
+    // Written by the producer.
+    alignas(64) std::atomic<uint64_t> tail{0};
+    uint64_t reservedTail = 0;
+    uint64_t cachedHead = 0;
+    std::atomic<uint64_t> dropped{0};
+    // Written by the consumer.
+    alignas(64) std::atomic<uint64_t> head{0};
+    uint64_t reportedDropped = 0;
+    std::atomic<bool> orphaned{false};   // its thread has exited
+    unsigned thread = 0;
+};
+
+class AsyncLog
+{
+public:
+    // Throws std::system_error if path cannot be opened.
+    explicit AsyncLog(AsyncLogConfig config = {});
+    // Writes what is logged so far and stops the background thread. Threads
+    // must have stopped logging to it.
+    ~AsyncLog();
+    AsyncLog(const AsyncLog &) = delete;
+    AsyncLog & operator=(const AsyncLog &) = delete;
+
+    // Arguments may be integers, floating point numbers, bools, characters
+    // and strings; strings are copied, up to maxString bytes.
+    template <typename... Args>
+    void write(const LogFormat & format, const Args &... args);
+
+    // Returns once everything logged before the call is written.
+    void flush();
+
+    AsyncLogStats stats() const;
+
+    // On SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT, waits up to a second
+    // for the background thread to write what the rings hold, then lets the
+    // signal take its default action. Only the last log installed is
+    // flushed. Best effort: a crash in the background thread itself loses
+    // the rings.
+    void flushOnCrash();
+
+    static constexpr size_t maxString = 4096;
+
+private:
+    struct Header
+    {
+        uint32_t size;                 // of the record, header and padding included
+        uint32_t format;
+        int64_t time;                  // nanoseconds since the Unix epoch
+    };
+
+    struct ThreadCache
+    {
+        uint64_t log = 0;
+        LogRing * ring = nullptr;
+    };
+    static thread_local ThreadCache threadCache;   // the ring of the log the thread last wrote to
+
+    LogRing & threadRing()
+    {
+        if (threadCache.log != serial)
+            registerThread();
+        return *threadCache.ring;
+    }
+    void registerThread();
+    static void crashHandler(int signal);
+    void run();
+    size_t drain();
+    void format(const char * record, const Header & header, unsigned thread);
+    char * putTime(char * out, int64_t nanos);
+    char * textSpace(size_t size);
+    void writeOut();
+
+    template <typename T>
+    static size_t encodedSize(const T & arg);
+    template <typename T>
+    static char * encode(char * out, const T & arg);
+
+    const AsyncLogConfig config;
+    const uint64_t serial;
+    int fd = -1;
+    std::unique_ptr<char[]> text;      // formatted lines waiting to be written
+    size_t textSize = 0;
+    size_t textCapacity = 0;
+    std::vector<std::string_view> formatTexts;
+    int64_t cachedSecond = -1;
+    char cachedTime[20];
+
+    mutable std::mutex ringsMutex;     // taken by threads logging for the first time
+    std::vector<std::shared_ptr<LogRing>> rings;
+    std::vector<std::shared_ptr<LogRing>> draining;
+    unsigned threads = 0;
+    uint64_t retiredDropped = 0;       // by rings of threads that have exited
+
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> flushRequested{0};
+    std::atomic<uint64_t> flushed{0};
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::condition_variable flushDone;
+    bool stopping = false;
+    std::thread consumer;
+};
+
+inline thread_local AsyncLog::ThreadCache AsyncLog::threadCache;
+
+// The process-wide log for code without one of its own, like main's and the
+// server's, or null. While there is none, logEvent() costs a relaxed load.
+// A log installed here is uninstalled when it is destroyed; threads that may
+// still log must have finished by then.
+inline std::atomic<AsyncLog *> processLog{nullptr};
+
+template <typename... Args>
+void logEvent(const LogFormat & format, const Args &... args)
+{
+    if (AsyncLog * log = processLog.load(std::memory_order_relaxed))
+        log->write(format, args...);
+}
+
+// Records: Header, then per argument a tag byte and its value; integers and
+// floating point as 8 bytes, strings as a 4-byte length and the bytes.
+// Padded with zeros to 8 bytes.
+
+template <typename T>
+size_t AsyncLog::encodedSize(const T & arg)
+{
+    if constexpr (std::is_arithmetic_v<T>)
+        return 1 + 8;
+    else
+        return 1 + 4 + std::min(std::string_view(arg).size(), maxString);
+}
+
+template <typename T>
+char * AsyncLog::encode(char * out, const T & arg)
+{
+    if constexpr (std::is_same_v<T, bool>) {
+        *out = 'b';
+        uint64_t value = arg;
+        std::memcpy(out + 1, &value, 8);
+        return out + 9;
+    } else if constexpr (std::is_same_v<T, char>) {
+        *out = 'c';
+        uint64_t value = static_cast<unsigned char>(arg);
+        std::memcpy(out + 1, &value, 8);
+        return out + 9;
+    } else if constexpr (std::is_floating_point_v<T>) {
+        *out = 'd';
+        double value = arg;
+        std::memcpy(out + 1, &value, 8);
+        return out + 9;
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+        *out = 'i';
+        int64_t value = arg;
+        std::memcpy(out + 1, &value, 8);
+        return out + 9;
+    } else if constexpr (std::is_integral_v<T>) {
+        *out = 'u';
+        uint64_t value = arg;
+        std::memcpy(out + 1, &value, 8);
+        return out + 9;
+    } else {
+        std::string_view value(arg);
+        uint32_t size = static_cast<uint32_t>(std::min(value.size(), maxString));
+        *out = 's';
+        std::memcpy(out + 1, &size, 4);
+        std::memcpy(out + 5, value.data(), size);
+        return out + 5 + size;
+    }
+}
+
+template <typename... Args>
+void AsyncLog::write(const LogFormat & format, const Args &... args)
+{
+    size_t size = (sizeof(Header) + ... + encodedSize(args));
+    size = (size + 7) & ~size_t(7);
+    LogRing & ring = threadRing();
+    char * record = ring.reserve(size, config.overflow);
+    if (!record)
+        return;
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    Header header{static_cast<uint32_t>(size), format.id(),
+                  std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()};
+    std::memcpy(record, &header, sizeof header);
+    char * out = record + sizeof header;
+    ((out = encode(out, args)), ...);
+    std::memset(out, 0, size_t(record + size - out));
+    ring.commit();
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "hello.h"
+
+// A seekable binary file of greetings, for outputs too big to rescan.
+//
+//   header   "HELLOBLK", u32 version, u32 target block size
+//   blocks   greetings, each a LEB128 length and its bytes, in blocks of
+//            about the target size; a greeting never spans two blocks
+//   index    per block: u64 first row, u64 offset, u32 size, u32 rows,
+//            u32 CRC-32C of the block, u32 zero
+//   footer   u64 index offset, u64 blocks, u64 rows, u32 CRC-32C of the
+//            index, u32 version, "HELLOIDX"
+//
+// All integers are little-endian. The footer has a fixed size, so a reader
+// finds the index from the end of the file and fetches any row by reading
+// one block.
+
+// CRC-32C (Castagnoli). Continue a running checksum by passing it as crc.
+uint32_t crc32c(std::string_view data, uint32_t crc = 0);
+
+constexpr uint32_t defaultGreetingBlockSize = 64 << 10;
+
+struct GreetingBlock
+{
+    uint32_t size = 0;
+    uint32_t rows = 0;
+    uint32_t checksum = 0;
+};
+
+// Appends greetings to out as blocks of at most blockSize bytes (a single
+// greeting longer than that gets a block of its own), and their
+// descriptions to blocks. Batches encode independently, so each may be
+// encoded on its own thread and the results written in order.
+void encodeGreetingBlocks(const GreetingBatch & greetings, uint32_t blockSize, std::string & out,
+                          std::vector<GreetingBlock> & blocks);
+
+// Writes the framing around the encoded blocks: header() first, the blocks
+// in order, each batch's also passed to add(), then trailer().
+class BlockFileIndex
+{
+public:
+    explicit BlockFileIndex(uint32_t blockSize = defaultGreetingBlockSize) : blockSize(blockSize) {}
+
+    std::string header() const;
+    void add(const std::vector<GreetingBlock> & blocks);
+    std::string trailer() const;
+
+    uint64_t rows() const { return nextRow; }
+
+private:
+    struct Entry
+    {
+        uint64_t firstRow;
+        uint64_t offset;
+        GreetingBlock block;
+    };
+
+    uint32_t blockSize;
+    std::vector<Entry> entries;
+    uint64_t nextRow = 0;
+    uint64_t nextOffset = 16;   // just past the header
+};
+
+// Random access to the rows of a block file through a read-only mapping.
+// Opening reads only the footer and index; row() touches one block, whose
+// checksum is verified the first time it is read. Safe to share between
+// threads.
+class BlockFileReader
+{
+public:
+    // Throws std::system_error if the file cannot be mapped and
+    // std::runtime_error if it is not a well-formed block file.
+    explicit BlockFileReader(const std::string & path);
+    ~BlockFileReader();
+
+    BlockFileReader(const BlockFileReader &) = delete;
+    BlockFileReader & operator=(const BlockFileReader &) = delete;
+
+    uint64_t rows() const { return rowCount; }
+    size_t blocks() const { return blockCount; }
+
+    // Row n, viewing the mapping. Throws std::out_of_range past the last
+    // row and std::runtime_error if its block is corrupt.
+    std::string_view row(uint64_t n) const;
+
+private:
+    struct Entry
+    {
+        uint64_t firstRow;
+        uint64_t offset;
+        uint32_t size;
+        uint32_t rows;
+        uint32_t checksum;
+    };
+
+    std::string_view block(size_t i) const;
+
+    const char * data = nullptr;
+    size_t size = 0;
+    std::string path;
+    std::vector<Entry> entries;
+    size_t blockCount = 0;
+    uint64_t rowCount = 0;
+    std::unique_ptr<std::atomic<bool>[]> verified;
+#ifdef _WIN32
+    std::string contents;   // no mmap; the file is read whole
+#endif
+};
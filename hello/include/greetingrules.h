@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "hello.h"
+
+// Personalized greetings chosen by rules on the name: an exact name (an
+// organization's override), a prefix ("Dr. ") or a suffix (" Jr."). Rules
+// are compiled once into two byte-class DFAs stored as double-array tries,
+// one over prefixes and exact names and one over reversed suffixes, so
+// matching reads each byte of the name at most twice, with no backtracking
+// and no regex engine, however many rules there are.
+//
+// An exact rule wins over any prefix rule, which wins over any suffix rule;
+// among rules of one kind the longest pattern wins. Names that match no
+// rule get generateHelloString's greeting.
+
+enum class RuleKind { Prefix, Suffix, Exact };
+
+// template is the greeting, with {name} standing for the whole name, {rest}
+// for the name without the matched prefix or suffix (the whole name for an
+// exact rule), and {{ and }} for literal braces.
+struct GreetingRule
+{
+    RuleKind kind = RuleKind::Exact;
+    std::string pattern;
+    std::string greeting;
+};
+
+// Parses rules, one per line as kind<TAB>pattern<TAB>template, kind being
+// prefix, suffix or exact. Blank lines and lines starting with # are
+// ignored; a trailing CR is dropped. Throws std::invalid_argument naming the
+// line on anything else.
+std::vector<GreetingRule> parseGreetingRules(std::string_view text);
+
+class GreetingRules
+{
+public:
+    // Throws std::invalid_argument on an empty prefix or suffix, a pattern
+    // given twice for one kind, or a malformed template.
+    explicit GreetingRules(const std::vector<GreetingRule> & rules);
+
+    std::string greet(std::string_view name) const;
+
+    // Appends one greeting per name to greetings, as generateHelloStrings
+    // does.
+    void greet(const std::vector<std::string_view> & names, GreetingBatch & greetings) const;
+
+    // The rule applying to name, as an index into the rules compiled, or -1.
+    int match(std::string_view name) const;
+
+    size_t states() const { return forward.states + backward.states; }
+    // Memory held by the compiled automata and templates.
+    size_t bytes() const;
+
+private:
+    // A double-array trie: the transition from state s on byte class c goes
+    // to t = base[s] + c when check[t] == s. Class 0 is every byte that no
+    // pattern uses and never has a transition. The arrays are padded so t
+    // is always in bounds.
+    struct Automaton
+    {
+        std::vector<int32_t> base;
+        std::vector<int32_t> check;
+        std::vector<int32_t> accept;   // longest prefix or suffix rule ending here
+        std::vector<int32_t> exact;    // exact rule ending here (forward only)
+        size_t states = 0;
+    };
+
+    struct Piece
+    {
+        enum Kind : uint8_t { Literal, Name, Rest } kind;
+        uint32_t offset;   // into literals, for Literal
+        uint32_t size;
+    };
+
+    struct Match
+    {
+        int rule = -1;
+        size_t restBegin = 0;
+        size_t restEnd = 0;
+    };
+
+    void compile(Automaton & automaton, const std::vector<GreetingRule> & rules, bool reversed);
+    Match find(std::string_view name) const;
+    size_t greetingSize(const Match & match, size_t nameSize) const;
+    char * write(char * out, std::string_view name, const Match & match) const;
+
+    uint16_t byteClass[256] = {};
+    unsigned classes = 1;
+    Automaton forward;
+    Automaton backward;
+    std::string literals;
+    std::vector<Piece> pieces;
+    std::vector<uint32_t> firstPiece;   // rule r's pieces are [firstPiece[r], firstPiece[r + 1])
+    std::vector<uint32_t> fixedSize;    // bytes of rule r's literals
+    std::vector<uint32_t> nameCount;    // {name} placeholders in rule r
+    std::vector<uint32_t> restCount;    // {rest} placeholders in rule r
+};
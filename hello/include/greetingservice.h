@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hdrhistogram.h"
+#include "hello.h"
+
+// Interactive requests are single names or small batches a caller is waiting
+// on; bulk requests are large batches where throughput matters more than
+// latency.
+enum class GreetingPriority { Interactive, Bulk };
+
+struct GreetingServiceConfig
+{
+    unsigned workers = 0;              // 0 = one per core
+    bool prioritize = true;            // false = one FIFO queue, batches run to completion
+    unsigned interactiveWeight = 8;    // share of greetings rendered for each class
+    unsigned bulkWeight = 1;           //   while both have work queued
+    size_t bulkChunkSize = 256;        // names rendered before a bulk batch yields
+    size_t interactiveMaxBatch = 16;   // greetBatch() classifies up to this many names as interactive
+    bool coalesce = false;             // collapse concurrent greet() calls for the same name
+    unsigned coalescingShards = 16;    // independently locked parts of the in-flight table
+    bool shed = false;                 // shed requests when the queue delay stays above shedTarget
+    std::chrono::microseconds shedTarget{5000};      // acceptable standing queue delay
+    std::chrono::microseconds shedInterval{100000};  // window over which the delay is judged
+};
+
+// When a request stops being worth doing. It is checked when a worker takes
+// the request from its queue and between the chunks of a batch, so an
+// expired or cancelled request costs at most one chunk of worker time.
+struct GreetingRequestOptions
+{
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    std::stop_token stopToken;         // request_stop() on its source cancels the request
+};
+
+// Set on the future of a request dropped because its deadline passed or it
+// was cancelled. Greetings already rendered for it are discarded.
+class GreetingDeadlineExceeded : public std::runtime_error
+{
+public:
+    GreetingDeadlineExceeded() : std::runtime_error("greeting deadline exceeded") {}
+};
+
+class GreetingCancelled : public std::runtime_error
+{
+public:
+    GreetingCancelled() : std::runtime_error("greeting cancelled") {}
+};
+
+// Set on the future of a request shed because the service is overloaded.
+class GreetingOverloaded : public std::runtime_error
+{
+public:
+    GreetingOverloaded() : std::runtime_error("greeting service overloaded") {}
+};
+
+struct GreetingServiceStats
+{
+    uint64_t interactiveRequests = 0;
+    uint64_t bulkRequests = 0;
+    uint64_t bulkChunks = 0;
+    uint64_t preemptions = 0;          // bulk chunk boundaries where interactive work went first
+    uint64_t expired = 0;              // requests dropped past their deadline
+    uint64_t cancelled = 0;            // requests dropped on cancellation
+    uint64_t droppedNames = 0;         // names of dropped requests that were never rendered
+    uint64_t coalesced = 0;            // greet() calls answered by another call's render
+    uint64_t shed[2] = {0, 0};         // requests shed for overload, by class as in queueDelays()
+};
+
+// Renders greetings on a pool of worker threads with separate queues per
+// priority class. Workers pick between the queues by deficit round robin,
+// weighted by greetings rendered, so interactive requests never wait behind
+// more than one bulk chunk per worker and bulk still gets every idle cycle.
+// Bulk batches are rendered a chunk at a time and go back to the head of
+// their queue between chunks.
+//
+// With coalescing, greet() for a name that is already queued or rendering
+// joins that request instead of queueing another (singleflight): the one
+// render's greeting fulfils every caller's future. A table of the names in
+// flight, sharded by hashName with a mutex per shard, tracks them from
+// enqueue until the render completes, so later calls render afresh. Calls
+// with a deadline or stop token are never coalesced, as dropping the shared
+// render would fail callers that did not ask for it.
+//
+// Overload is detected by how long requests wait rather than by how many
+// are queued, CoDel-style: each queue tracks the least time any request
+// taken from it in the last shedInterval had waited. Above shedTarget the
+// queue is standing rather than absorbing a burst, and until an interval
+// ends with the minimum back under target, requests that have waited more
+// than shedTarget are shed as workers reach them; otherwise requests may
+// wait up to shedInterval. Unlike packets, dropped requests do not slow
+// their senders, so this sheds the whole standing backlog where RFC 8289
+// would drop one request per step. Shed requests fail with
+// GreetingOverloaded. A bulk batch already started is never shed.
+class GreetingService
+{
+public:
+    explicit GreetingService(GreetingServiceConfig config = {});
+    // Finishes queued work, then joins the workers.
+    ~GreetingService();
+
+    GreetingService(const GreetingService &) = delete;
+    GreetingService & operator=(const GreetingService &) = delete;
+
+    std::future<std::string> greet(std::string personName, GreetingRequestOptions options = {});
+    std::future<GreetingBatch> greetBatch(std::vector<std::string> personNames, GreetingRequestOptions options = {});
+    std::future<GreetingBatch> greetBatch(std::vector<std::string> personNames, GreetingPriority priority,
+                                          GreetingRequestOptions options = {});
+
+    GreetingServiceStats stats() const;
+
+    // How long requests of a class waited in its queue before a worker took
+    // them, in nanoseconds, shed ones included; with prioritize off, every
+    // request counts as interactive.
+    HdrHistogram queueDelays(GreetingPriority priority) const;
+
+private:
+    struct Task;
+    using TaskPtr = std::unique_ptr<Task>;
+    struct FlightShard;
+
+    FlightShard & flightShard(const std::string & name);
+    void settleSingle(Task & task, const std::string * greeting, std::exception_ptr error);
+
+    // Overload detection for one queue.
+    struct Shedder
+    {
+        std::chrono::steady_clock::time_point intervalEnd{};
+        std::chrono::steady_clock::duration minDelay = std::chrono::steady_clock::duration::max();
+        bool overloaded = false;
+    };
+
+    void enqueue(TaskPtr task);
+    TaskPtr next(std::unique_lock<std::mutex> & lock, std::vector<TaskPtr> & shed);
+    bool shouldShed(int queue, std::chrono::steady_clock::duration sojourn,
+                    std::chrono::steady_clock::time_point now);
+    void fail(Task & task, std::exception_ptr error);
+    void run();
+
+    const GreetingServiceConfig config;
+    mutable std::mutex queueMutex;
+    std::condition_variable workAvailable;
+    std::deque<TaskPtr> queues[2];
+    int64_t deficit[2] = {0, 0};
+    int turn = 0;
+    bool stopping = false;
+    GreetingServiceStats counters;
+    Shedder shedders[2];
+    HdrHistogram delays[2] = {HdrHistogram(60'000'000'000), HdrHistogram(60'000'000'000)};
+    std::unique_ptr<FlightShard[]> flightShards;
+    std::atomic<uint64_t> coalescedCount{0};
+    std::vector<std::thread> workers;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// High dynamic range histogram of non-negative integer values (usually
+// latencies in nanoseconds) with a fixed relative precision. Buckets are
+// log-linear as in HdrHistogram: recording is a few shifts and an
+// increment, and memory does not depend on the number of samples.
+// Not thread safe; record per thread and add() the results.
+class HdrHistogram
+{
+public:
+    // Values above highestTrackableValue are recorded as that value.
+    // significantDigits (1 to 4) sets the precision: 3 keeps every value to
+    // within 0.1%.
+    explicit HdrHistogram(uint64_t highestTrackableValue = 3'600'000'000'000, int significantDigits = 3);
+
+    void record(uint64_t value, uint64_t count = 1);
+    void add(const HdrHistogram & other);
+    void reset();
+
+    uint64_t count() const { return totalCount; }
+    uint64_t min() const;
+    uint64_t max() const { return maxValue; }
+    double mean() const;
+
+    // Smallest recorded value such that percentile percent of the samples
+    // are at or below it, to the histogram's precision.
+    uint64_t valueAtPercentile(double percentile) const;
+
+    // Percentile distribution in the HdrHistogram .hgrm text format, values
+    // divided by scale (1000 to print nanoseconds as microseconds).
+    void writePercentileDistribution(std::ostream & out, double scale = 1, int ticksPerHalfDistance = 5) const;
+
+private:
+    size_t indexOf(uint64_t value) const;
+    uint64_t lowestEquivalent(size_t index) const;
+    uint64_t highestEquivalent(size_t index) const;
+
+    uint64_t highestTrackable;
+    int subBucketBits;
+    uint64_t subBucketCount;
+    uint64_t subBucketHalf;
+    std::vector<uint64_t> counts;
+    uint64_t totalCount = 0;
+    uint64_t minValue = UINT64_MAX;
+    uint64_t maxValue = 0;
+    double sum = 0;
+};
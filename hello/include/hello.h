@@ -1,5 +1,36 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
+#include <string_view>
+#include <vector>
 
-const std::string generateHelloString(const std::string & personName);
\ No newline at end of file
+// What every plain greeting starts with: generateHelloString(name) is
+// helloPrefix followed by name. Other renderers share it so they cannot
+// drift from the reference.
+inline constexpr std::string_view helloPrefix = "Hello ";
+
+const std::string generateHelloString(const std::string & personName);
+
+// Greetings for a batch of names, stored back to back in one buffer.
+// Greeting i is text[offsets[i], offsets[i + 1]).
+struct GreetingBatch
+{
+    std::string text;
+    std::vector<size_t> offsets{0};
+
+    size_t size() const { return offsets.size() - 1; }
+    std::string_view operator[](size_t i) const
+    {
+        return std::string_view(text).substr(offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    void clear()
+    {
+        text.clear();
+        offsets.resize(1);
+    }
+};
+
+// Appends one greeting per name to greetings. Byte-identical to calling
+// generateHelloString on each name.
+void generateHelloStrings(const std::vector<std::string_view> & personNames, GreetingBatch & greetings);
@@ -0,0 +1,65 @@
+#ifndef HELLO_C_H
+#define HELLO_C_H
+
+/*
+ * Stable C interface to the hello library for FFI callers (Python ctypes,
+ * cgo, Rust). Only C types cross the boundary and all memory is owned by the
+ * caller, so one call can greet a whole column of names.
+ *
+ * A batch of names is one byte buffer plus count + 1 offsets: name i is
+ * names[name_offsets[i], name_offsets[i + 1]). Greetings come back the same
+ * way in out / out_offsets, with out_offsets[0] == 0. Call
+ * hello_greetings_size first to size out, or just call hello_greet_batch and
+ * retry when it reports HELLO_BUFFER_TOO_SMALL.
+ *
+ * New functionality is added as new functions or flag bits; existing
+ * signatures do not change while HELLO_ABI_VERSION stays the same.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HELLO_ABI_VERSION 1
+
+typedef enum hello_status {
+    HELLO_OK = 0,
+    HELLO_INVALID_ARGUMENT = 1,  /* null pointer or decreasing offsets */
+    HELLO_BUFFER_TOO_SMALL = 2,  /* *required_bytes says how much out needs */
+    HELLO_INTERNAL_ERROR = 3
+} hello_status;
+
+/* Flag bits for the flags arguments. */
+#define HELLO_TRANSLITERATE 1u   /* greet the ASCII transliteration of each name */
+
+/* Returns HELLO_ABI_VERSION of the library actually loaded. */
+uint32_t hello_abi_version(void);
+
+/* Sets *required_bytes to the size of all greetings for the batch. */
+hello_status hello_greetings_size(const char * names, const uint64_t * name_offsets, size_t count,
+                                  uint32_t flags, uint64_t * required_bytes);
+
+/*
+ * Writes the greetings for count names into out and their count + 1 offsets
+ * into out_offsets. *required_bytes, if not null, is always set to the size
+ * the greetings need; out is left untouched when it is too small.
+ */
+hello_status hello_greet_batch(const char * names, const uint64_t * name_offsets, size_t count,
+                               uint32_t flags, char * out, uint64_t out_capacity, uint64_t * out_offsets,
+                               uint64_t * required_bytes);
+
+/* Single-name form: writes one greeting of *out_length bytes, no terminator. */
+hello_status hello_greet(const char * name, size_t name_length, uint32_t flags, char * out,
+                         size_t out_capacity, size_t * out_length);
+
+/* Short English description of a status, for error messages. */
+const char * hello_status_message(hello_status status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HELLO_C_H */
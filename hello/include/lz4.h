@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// LZ4 compression in the standard frame format, readable by lz4 and
+// lz4cat, with no dependency on liblz4.
+//
+// Frames written here have independent blocks of at most lz4MaxBlockSize
+// bytes, each followed by its xxHash32, and no content checksum, so any
+// number of blocks can be compressed at once on different threads and
+// their output concatenated in order between lz4FrameHeader() and
+// lz4FrameEnd().
+//
+// Reading goes the other way: lz4DecompressFrames takes whole frames in
+// memory, while a reader of a stream parses the frame descriptor and block
+// headers itself and decodes blocks with lz4DecompressFrameBlock, on
+// several threads where the frame's blocks are independent.
+
+constexpr size_t lz4MaxBlockSize = 4 << 20;
+
+constexpr uint32_t lz4FrameMagic = 0x184d2204;
+
+// Skippable frames carry other data: a 4-byte size, then that many bytes.
+inline bool lz4IsSkippableMagic(uint32_t magic) { return (magic & 0xfffffff0) == 0x184d2a50; }
+
+// xxHash32, as LZ4 frames use it for their checksums.
+uint32_t xxh32(std::string_view data, uint32_t seed = 0);
+
+// xxHash32 of data that arrives in pieces.
+class Xxh32
+{
+public:
+    explicit Xxh32(uint32_t seed = 0) { reset(seed); }
+
+    void reset(uint32_t seed = 0);
+    void update(std::string_view data);
+    uint32_t digest() const;
+
+private:
+    uint32_t seed;
+    uint32_t lanes[4];
+    uint64_t length;
+    char buffered[16];   // a partial stripe of 16 bytes
+    size_t bufferedSize;
+};
+
+// The raw LZ4 block format: sequences of literals and matches within the
+// block. Appends the compressed form of input to out.
+void lz4CompressBlock(std::string_view input, std::string & out);
+
+// Appends the decompressed block to out. Matches may reach back into the
+// last history bytes already in out, as blocks of a frame with dependent
+// blocks do. Throws std::runtime_error if the block is malformed or would
+// decompress to more than maxSize bytes.
+void lz4DecompressBlock(std::string_view block, std::string & out, size_t maxSize, size_t history = 0);
+
+// Magic number and frame descriptor, to write before the blocks.
+std::string lz4FrameHeader();
+
+// Appends data to out as frame blocks: compressed, or stored as is where
+// compressing would not make it smaller.
+void lz4CompressFrameBlocks(std::string_view data, std::string & out);
+
+// The end mark, to write after the last block.
+std::string lz4FrameEnd();
+
+// What the frame descriptor after the magic number says about the frame.
+struct Lz4FrameDescriptor
+{
+    bool independentBlocks = true;
+    bool blockChecksums = false;
+    bool contentChecksum = false;   // an xxh32 of the content follows the end mark
+    size_t blockMaxSize = lz4MaxBlockSize;
+};
+
+// The size of the descriptor, including its checksum, given its first byte.
+size_t lz4DescriptorSize(char flags);
+
+// Parses and checks a descriptor of lz4DescriptorSize bytes. Throws
+// std::runtime_error if it is malformed or uses features not supported
+// here (dictionaries).
+Lz4FrameDescriptor lz4ParseDescriptor(std::string_view descriptor);
+
+// Verifies and decodes one block of a frame, given the 4-byte size field
+// before it and its bytes after, including the block checksum if the frame
+// has them, and appends its content to out. history is as for
+// lz4DecompressBlock; it is 0 for independent blocks.
+void lz4DecompressFrameBlock(const Lz4FrameDescriptor & frame, uint32_t sizeField, std::string_view block,
+                             std::string & out, size_t history = 0);
+
+// The number of bytes after a block's size field: the block and its
+// checksum. 0 for the end mark.
+size_t lz4FrameBlockSize(const Lz4FrameDescriptor & frame, uint32_t sizeField);
+
+// Appends the content of one or more concatenated frames, such as lz4
+// writes, to out; skippable frames are skipped. Checksums present are
+// verified. Throws std::runtime_error on malformed or truncated input.
+void lz4DecompressFrames(std::string_view frames, std::string & out);
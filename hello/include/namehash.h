@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Hashing of names for caches, dedupe, sharding and sketches.
+//
+// hashName is a fast non-cryptographic 64-bit hash (wyhash-style
+// multiply-fold) for in-process tables; it is not stable across releases
+// and must not be persisted. sipHash24 is SipHash-2-4, a keyed PRF: with a
+// secret key its output can stand in for a name (pseudonymization) without
+// revealing it or being predictable to whoever supplied the names.
+
+uint64_t hashName(std::string_view name, uint64_t seed = 0);
+
+// Batch form: hashes[i] = hashName(names[i], seed). hashes is resized to
+// names.size().
+void hashNames(const std::vector<std::string_view> & names, std::vector<uint64_t> & hashes, uint64_t seed = 0);
+
+struct SipHashKey
+{
+    uint64_t k0 = 0;
+    uint64_t k1 = 0;
+};
+
+// The key from 16 bytes, little-endian halves as in the SipHash paper.
+SipHashKey sipHashKey(const unsigned char bytes[16]);
+
+uint64_t sipHash24(std::string_view message, const SipHashKey & key);
+
+// Batch form: hashes[i] = sipHash24(names[i], key). On x86-64 CPUs with
+// AVX2, names are hashed four at a time, one per 64-bit lane.
+void sipHashNames(const std::vector<std::string_view> & names, const SipHashKey & key, std::vector<uint64_t> & hashes);
+
+// Replaces each name with its pseudonym, the 16 lowercase hex digits of its
+// SipHash-2-4 under key. The pseudonyms are written to storage (cleared
+// first), which must outlive the views.
+void pseudonymizeNames(std::vector<std::string_view> & names, const SipHashKey & key, std::string & storage);
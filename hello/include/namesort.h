@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Sorting of name batches for ordered reports, and merging of sorted runs.
+// Only the views move; the name bytes stay where they are.
+//
+// Both use a most-significant-digit radix sort on the bytes of the names.
+// Each pass counts one byte position into 257 buckets (the end of the name
+// sorts before any byte) and scatters the views through a scratch array,
+// parallelized across threads while a range is large: every thread counts
+// and scatters its own slice. The resulting buckets are then sorted
+// independently, biggest first, one thread each. Ranges whose names all
+// share the next byte skip ahead to where they differ, and small ranges
+// fall back to multikey quicksort.
+//
+// The name bytes are scattered across memory once the views are shuffled,
+// so the sort keeps eight bytes of each name in an array that moves with
+// the views, and reads the names themselves once per eight bytes of depth.
+// Besides the names, a sort needs 32 bytes of scratch per name.
+
+// Sorts names bytewise, as unsigned chars, a prefix before its extensions:
+// the order of std::sort with string_view's operator<.
+void sortNames(std::vector<std::string_view> & names, unsigned threads = 1);
+
+// Groups names by their first character, a UTF-8 sequence or, where that is
+// malformed, a byte. Groups are in byte order, empty names first; within a
+// group names keep their input order.
+void groupNamesByFirstCharacter(std::vector<std::string_view> & names, unsigned threads = 1);
+
+// Merges k sorted sequences of names (ways) in the order of sortNames with
+// a tree of losers: each internal node holds the way that lost the match
+// there, so replacing the winner's name replays one leaf-to-root path,
+// log2(k) comparisons, without looking at the sibling subtrees. Ties go to
+// the lower-numbered way, so the merge is stable.
+class LoserTree
+{
+public:
+    // heads[i] is way i's first name, or nullopt if way i is empty.
+    explicit LoserTree(const std::vector<std::optional<std::string_view>> & heads);
+
+    // Whether every way is exhausted.
+    bool empty() const { return exhausted[tree[0]]; }
+
+    // The way holding the smallest name, and that name. Not when empty().
+    size_t winner() const { return tree[0]; }
+    std::string_view top() const { return names[tree[0]]; }
+
+    // Replaces the winner's name with the next one from its way, which
+    // must not sort before it, or marks the way exhausted.
+    void replace(std::string_view next);
+    void exhaust();
+
+private:
+    bool beats(size_t a, size_t b) const;
+    void replay(size_t way);
+
+    size_t ways;
+    std::vector<std::string_view> names;
+    std::vector<char> exhausted;
+    std::vector<size_t> tree;   // [0] is the winner, [1, ways) the losers
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "hello.h"
+
+// Greetings as an Apache Parquet file, written without Arrow: two required
+// UTF-8 string columns, name and greeting, in row groups of about
+// rowGroupBytes, each column chunk in data pages of about pageBytes.
+//
+// A column chunk is dictionary encoded (a PLAIN dictionary page, then
+// RLE_DICTIONARY data pages) when its distinct values fit dictionaryBytes
+// and that comes out smaller than PLAIN; otherwise its data pages are
+// PLAIN. Pages may be compressed as LZ4_RAW, which Arrow, Spark and DuckDB
+// read. Page headers and the footer are Thrift compact protocol, as the
+// format specifies.
+
+struct ParquetWriterConfig
+{
+    size_t rowGroupBytes = 64 << 20;   // values buffered, both columns, before a row group is written
+    size_t pageBytes = 1 << 20;        // target uncompressed data page size
+    size_t dictionaryBytes = 1 << 20;  // a column whose distinct values outgrow this is written PLAIN
+    bool dictionary = true;
+    bool lz4 = false;                  // LZ4_RAW pages, else uncompressed
+};
+
+class ParquetColumn;
+
+// Writes the file as it is produced: header() first, then what each add()
+// appends, then trailer(). Rows are buffered until a row group is full, so
+// the writer holds up to about rowGroupBytes, and as much again while a row
+// group is encoded.
+class ParquetWriter
+{
+public:
+    explicit ParquetWriter(ParquetWriterConfig config = {});
+    ~ParquetWriter();
+    ParquetWriter(const ParquetWriter &) = delete;
+    ParquetWriter & operator=(const ParquetWriter &) = delete;
+
+    std::string header() const;
+    // Adds the rows names[i], greetings[i], appending the row groups they
+    // complete to out.
+    void add(const std::vector<std::string_view> & names, const GreetingBatch & greetings, std::string & out);
+    // The last row group and the footer.
+    std::string trailer();
+
+    uint64_t rows() const { return rowCount; }
+
+private:
+    friend class ParquetColumn;
+
+    struct ChunkMeta
+    {
+        bool dictionary;
+        uint64_t values;
+        uint64_t uncompressedSize;
+        uint64_t compressedSize;
+        uint64_t dataPageOffset;
+        uint64_t dictionaryPageOffset;
+    };
+
+    struct RowGroupMeta
+    {
+        uint64_t rows;
+        uint64_t offset;
+        ChunkMeta columns[2];
+    };
+
+    void writeRowGroup(std::string & out);
+
+    ParquetWriterConfig config;
+    std::unique_ptr<ParquetColumn> columns[2];
+    std::vector<RowGroupMeta> rowGroups;
+    uint64_t rowCount = 0;
+    uint64_t bufferedRows = 0;
+    uint64_t nextOffset = 4;   // just past the header
+};
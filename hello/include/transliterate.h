@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Transliterates UTF-8 text to ASCII, e.g. "Zoë Ångström" -> "Zoe Angstrom".
+// Characters with no ASCII rendering, and invalid UTF-8, become '?'.
+std::string transliterateToAscii(std::string_view text);
+
+// Appends the transliteration of text to out.
+void transliterateToAscii(std::string_view text, std::string & out);
+
+// Batch form. Names that are not plain ASCII are transliterated into storage
+// and repointed there; ASCII names keep viewing the caller's bytes. storage
+// is cleared first and must outlive the views.
+void transliterateNames(std::vector<std::string_view> & names, std::string & storage);
+
+// Length of the leading run of ASCII bytes in text.
+size_t asciiPrefixLength(std::string_view text);
@@ -0,0 +1,388 @@
+#include "asynclog.h"
+
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr uint32_t paddingFormat = UINT32_MAX;   // fills the end of the ring before a wrap
+constexpr size_t writeBuffer = 1 << 16;          // formatted bytes gathered for a write
+constexpr chrono::milliseconds signalPoll{10};
+
+mutex & formatsMutex()
+{
+    static mutex formatsMutex;
+    return formatsMutex;
+}
+
+deque<const char *> & formats()
+{
+    static deque<const char *> formats;
+    return formats;
+}
+
+atomic<uint64_t> nextSerial{1};
+atomic<AsyncLog *> crashLog{nullptr};
+
+// A thread's rings, one per log it wrote to, released for the logs'
+// background threads to retire when it exits.
+struct ThreadRings
+{
+    vector<pair<uint64_t, shared_ptr<LogRing>>> rings;
+
+    ~ThreadRings()
+    {
+        for (auto & [log, ring] : rings)
+            ring->markOrphaned();
+    }
+};
+
+thread_local ThreadRings threadRings;
+
+template <typename T>
+T read(const char * at)
+{
+    T value;
+    memcpy(&value, at, sizeof value);
+    return value;
+}
+
+char * putNumber(char * out, auto value) { return to_chars(out, out + 24, value).ptr; }
+
+char * putText(char * out, const char * text, size_t size)
+{
+    memcpy(out, text, size);
+    return out + size;
+}
+
+} // namespace
+
+LogFormat::LogFormat(const char * text)
+{
+    lock_guard<mutex> lock(formatsMutex());
+    formatId = uint32_t(formats().size());
+    formats().push_back(text);
+}
+
+const char * LogFormat::text(uint32_t id)
+{
+    lock_guard<mutex> lock(formatsMutex());
+    return id < formats().size() ? formats()[id] : nullptr;
+}
+
+LogRing::LogRing(size_t capacity)
+    : data(make_unique<char[]>(bit_ceil(max<size_t>(capacity, 1 << 14)))),
+      capacity(bit_ceil(max<size_t>(capacity, 1 << 14)))
+{
+}
+
+char * LogRing::reserve(size_t size, LogOverflow overflow)
+{
+    // A record that would not leave room for another is not worth waiting for.
+    if (size > capacity / 2) {
+        dropped.store(dropped.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        return nullptr;
+    }
+    uint64_t at = tail.load(memory_order_relaxed);
+    uint64_t offset = at & (capacity - 1);
+    uint64_t padding = offset + size > capacity ? capacity - offset : 0;
+    while (at + padding + size - cachedHead > capacity) {
+        cachedHead = head.load(memory_order_acquire);
+        if (at + padding + size - cachedHead <= capacity)
+            break;
+        if (overflow == LogOverflow::Drop) {
+            dropped.store(dropped.load(memory_order_relaxed) + 1, memory_order_relaxed);
+            return nullptr;
+        }
+        this_thread::yield();
+    }
+    if (padding) {
+        // Only the size and format of a padding record are read.
+        uint32_t marker[2] = {uint32_t(padding), paddingFormat};
+        memcpy(data.get() + offset, marker, sizeof marker);
+        at += padding;
+    }
+    reservedTail = at + size;
+    return data.get() + (at & (capacity - 1));
+}
+
+AsyncLog::AsyncLog(AsyncLogConfig config)
+    : config(move(config)), serial(nextSerial.fetch_add(1, memory_order_relaxed))
+{
+    if (this->config.path == "-") {
+        fd = STDERR_FILENO;
+    } else {
+        fd = ::open(this->config.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+        if (fd < 0)
+            throw system_error(errno, generic_category(), this->config.path);
+    }
+    consumer = thread([this] { run(); });
+}
+
+AsyncLog::~AsyncLog()
+{
+    AsyncLog * self = this;
+    crashLog.compare_exchange_strong(self, nullptr);
+    self = this;
+    processLog.compare_exchange_strong(self, nullptr);
+    {
+        lock_guard<mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    consumer.join();
+    if (fd != STDERR_FILENO)
+        ::close(fd);
+}
+
+void AsyncLog::flush()
+{
+    uint64_t request = flushRequested.fetch_add(1) + 1;
+    unique_lock<mutex> lock(wakeMutex);
+    wake.notify_all();
+    flushDone.wait(lock, [&] { return flushed.load() >= request; });
+}
+
+AsyncLogStats AsyncLog::stats() const
+{
+    AsyncLogStats stats;
+    stats.written = written.load(memory_order_relaxed);
+    lock_guard<mutex> lock(ringsMutex);
+    stats.dropped = retiredDropped;
+    for (const shared_ptr<LogRing> & ring : rings)
+        stats.dropped += ring->dropped.load(memory_order_relaxed);
+    return stats;
+}
+
+void AsyncLog::flushOnCrash()
+{
+    crashLog.store(this);
+    struct sigaction action{};
+    action.sa_handler = crashHandler;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    for (int signal : {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT})
+        sigaction(signal, &action, nullptr);
+}
+
+void AsyncLog::crashHandler(int signal)
+{
+    // Nothing here may lock or allocate: asks the background thread for a
+    // flush and polls for it, then re-raises the signal, now with its
+    // default action, to take effect on return.
+    if (AsyncLog * log = crashLog.load()) {
+        uint64_t request = log->flushRequested.fetch_add(1) + 1;
+        timespec pause{0, 1'000'000};
+        for (int waited = 0; waited < 1000 && log->flushed.load() < request; ++waited)
+            nanosleep(&pause, nullptr);
+    }
+    raise(signal);
+}
+
+void AsyncLog::registerThread()
+{
+    for (auto & [log, ring] : threadRings.rings) {
+        if (log == serial) {
+            threadCache = {serial, ring.get()};
+            return;
+        }
+    }
+    // Rings only this thread still holds belong to logs that are gone.
+    erase_if(threadRings.rings, [](const auto & entry) { return entry.second.use_count() == 1; });
+    auto ring = make_shared<LogRing>(config.ringSize);
+    {
+        lock_guard<mutex> lock(ringsMutex);
+        ring->thread = ++threads;
+        rings.push_back(ring);
+    }
+    threadRings.rings.emplace_back(serial, ring);
+    threadCache = {serial, ring.get()};
+}
+
+void AsyncLog::run()
+{
+    for (;;) {
+        uint64_t request = flushRequested.load();
+        bool stop;
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            stop = stopping;
+        }
+        drain();
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            flushed.store(request);
+        }
+        flushDone.notify_all();
+        if (stop)
+            return;
+        // A signal handler cannot notify, so its flush requests are polled
+        // for more often than the rings.
+        unique_lock<mutex> lock(wakeMutex);
+        auto due = chrono::steady_clock::now() + config.pollInterval;
+        while (!stopping && flushRequested.load() == request && chrono::steady_clock::now() < due)
+            wake.wait_until(lock, min(due, chrono::steady_clock::now() + signalPoll));
+    }
+}
+
+size_t AsyncLog::drain()
+{
+    {
+        lock_guard<mutex> lock(ringsMutex);
+        draining = rings;
+    }
+    size_t records = 0;
+    bool retire = false;
+    for (const shared_ptr<LogRing> & ring : draining) {
+        // Read before the tail: once its thread has exited, the ring is
+        // complete.
+        bool orphaned = ring->orphaned.load(memory_order_acquire);
+        uint64_t end = ring->tail.load(memory_order_acquire);
+        uint64_t at = ring->head.load(memory_order_relaxed);
+        while (at < end) {
+            const char * record = ring->data.get() + (at & (ring->capacity - 1));
+            Header header{read<uint32_t>(record), read<uint32_t>(record + 4), 0};
+            if (header.format != paddingFormat) {
+                header.time = read<int64_t>(record + 8);
+                format(record, header, ring->thread);
+                ++records;
+            }
+            at += header.size;
+        }
+        ring->head.store(at, memory_order_release);
+
+        uint64_t dropped = ring->dropped.load(memory_order_relaxed);
+        if (dropped != ring->reportedDropped) {
+            auto now = chrono::system_clock::now().time_since_epoch();
+            char * start = textSpace(128);
+            char * out = putTime(start, chrono::duration_cast<chrono::nanoseconds>(now).count());
+            out = putText(out, " [", 2);
+            out = putNumber(out, ring->thread);
+            out = putText(out, "] dropped ", 10);
+            out = putNumber(out, dropped - ring->reportedDropped);
+            out = putText(out, " log records\n", 13);
+            textSize += size_t(out - start);
+            ring->reportedDropped = dropped;
+        }
+        retire = retire || orphaned;
+    }
+    writeOut();
+    written.fetch_add(records, memory_order_relaxed);
+
+    if (retire) {
+        lock_guard<mutex> lock(ringsMutex);
+        erase_if(rings, [&](const shared_ptr<LogRing> & ring) {
+            bool done = ring->orphaned.load(memory_order_acquire) &&
+                        ring->head.load(memory_order_relaxed) == ring->tail.load(memory_order_acquire) &&
+                        ring->reportedDropped == ring->dropped.load(memory_order_relaxed);
+            if (done)
+                retiredDropped += ring->reportedDropped;
+            return done;
+        });
+    }
+    draining.clear();
+    return records;
+}
+
+// Lines are formatted in place, in room reserved for the longest a record
+// can format to: numbers take at most 24 characters for their 9 bytes.
+void AsyncLog::format(const char * record, const Header & header, unsigned thread)
+{
+    // Formats are looked up in a copy of the registry, refreshed on a miss.
+    if (header.format >= formatTexts.size()) {
+        formatTexts.clear();
+        for (uint32_t id = 0; const char * known = LogFormat::text(id); ++id)
+            formatTexts.emplace_back(known);
+    }
+    string_view pattern = header.format < formatTexts.size() ? formatTexts[header.format] : "(unknown log format)";
+
+    char * start = textSpace(64 + pattern.size() + 3 * header.size);
+    char * out = putTime(start, header.time);
+    out = putText(out, " [", 2);
+    out = putNumber(out, thread);
+    out = putText(out, "] ", 2);
+    const char * arg = record + sizeof(Header);
+    const char * end = record + header.size;
+    size_t literal = 0;
+    for (size_t at = 0; at + 1 < pattern.size(); ++at) {
+        // Padding is zeros, which no argument tag is.
+        if (pattern[at] != '{' || pattern[at + 1] != '}' || arg >= end || *arg == 0)
+            continue;
+        out = putText(out, pattern.data() + literal, at - literal);
+        literal = ++at + 1;
+        char tag = *arg++;
+        if (tag == 's') {
+            uint32_t size = read<uint32_t>(arg);
+            out = putText(out, arg + 4, size);
+            arg += 4 + size;
+            continue;
+        }
+        switch (tag) {
+        case 'b': out = read<uint64_t>(arg) ? putText(out, "true", 4) : putText(out, "false", 5); break;
+        case 'c': *out++ = char(read<uint64_t>(arg)); break;
+        case 'i': out = putNumber(out, read<int64_t>(arg)); break;
+        case 'u': out = putNumber(out, read<uint64_t>(arg)); break;
+        case 'd': out += snprintf(out, 24, "%g", read<double>(arg)); break;
+        }
+        arg += 8;
+    }
+    out = putText(out, pattern.data() + literal, pattern.size() - literal);
+    *out++ = '\n';
+    textSize += size_t(out - start);
+}
+
+// "2026-10-18 09:15:02.123456", reusing the date and time while the second
+// stays the same.
+char * AsyncLog::putTime(char * out, int64_t nanos)
+{
+    int64_t second = nanos / 1'000'000'000;
+    if (second != cachedSecond) {
+        time_t time = time_t(second);
+        tm parts{};
+        gmtime_r(&time, &parts);
+        strftime(cachedTime, sizeof cachedTime, "%Y-%m-%d %H:%M:%S", &parts);
+        cachedSecond = second;
+    }
+    out = putText(out, cachedTime, 19);
+    *out = '.';
+    for (int i = 6, micros = int(nanos % 1'000'000'000 / 1000); i > 0; --i, micros /= 10)
+        out[i] = char('0' + micros % 10);
+    return out + 7;
+}
+
+char * AsyncLog::textSpace(size_t size)
+{
+    if (textSize + size > textCapacity) {
+        writeOut();
+        if (size > textCapacity) {
+            textCapacity = max(size, writeBuffer);
+            text = make_unique<char[]>(textCapacity);
+        }
+    }
+    return text.get() + textSize;
+}
+
+void AsyncLog::writeOut()
+{
+    // Write errors are not reported: the log must not fail the service.
+    for (size_t done = 0; done < textSize;) {
+        ssize_t written = ::write(fd, text.get() + done, textSize - done);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            break;
+        done += size_t(written);
+    }
+    textSize = 0;
+}
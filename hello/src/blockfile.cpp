@@ -0,0 +1,308 @@
+#include "blockfile.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+constexpr char headerMagic[8] = {'H', 'E', 'L', 'L', 'O', 'B', 'L', 'K'};
+constexpr char footerMagic[8] = {'H', 'E', 'L', 'L', 'O', 'I', 'D', 'X'};
+constexpr uint32_t version = 1;
+constexpr size_t headerSize = 16;
+constexpr size_t entrySize = 32;
+constexpr size_t footerSize = 40;
+
+void put(char * p, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        p[i] = char(value >> (8 * i));
+}
+
+uint64_t get(const char * p, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+        value |= uint64_t(uint8_t(p[i])) << (8 * i);
+    return value;
+}
+
+// Slicing-by-8 tables: table[k][b] is the CRC of byte b followed by k zero
+// bytes, so eight input bytes are folded with eight lookups.
+constexpr array<array<uint32_t, 256>, 8> makeCrcTables()
+{
+    array<array<uint32_t, 256>, 8> table{};
+    for (uint32_t b = 0; b < 256; ++b) {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0x82f63b78u & (0u - (crc & 1)));
+        table[0][b] = crc;
+    }
+    for (int k = 1; k < 8; ++k)
+        for (uint32_t b = 0; b < 256; ++b)
+            table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xff];
+    return table;
+}
+
+constexpr array<array<uint32_t, 256>, 8> crcTables = makeCrcTables();
+
+size_t varintSize(size_t value)
+{
+    size_t bytes = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++bytes;
+    }
+    return bytes;
+}
+
+[[noreturn]] void malformed(const string & path, const char * why)
+{
+    throw runtime_error(path + ": not a greeting block file (" + why + ")");
+}
+
+} // namespace
+
+uint32_t crc32c(string_view data, uint32_t crc)
+{
+    const unsigned char * p = reinterpret_cast<const unsigned char *>(data.data());
+    size_t n = data.size();
+    crc = ~crc;
+#ifdef __SSE4_2__
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc = uint32_t(_mm_crc32_u64(crc, word));
+    }
+#else
+    for (; n >= 8; p += 8, n -= 8) {
+        uint32_t low = crc ^ (uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24);
+        crc = crcTables[7][low & 0xff] ^ crcTables[6][(low >> 8) & 0xff] ^ crcTables[5][(low >> 16) & 0xff] ^
+              crcTables[4][low >> 24] ^ crcTables[3][p[4]] ^ crcTables[2][p[5]] ^ crcTables[1][p[6]] ^
+              crcTables[0][p[7]];
+    }
+#endif
+    for (; n > 0; ++p, --n)
+        crc = (crc >> 8) ^ crcTables[0][(crc ^ *p) & 0xff];
+    return ~crc;
+}
+
+void encodeGreetingBlocks(const GreetingBatch & greetings, uint32_t blockSize, string & out,
+                          vector<GreetingBlock> & blocks)
+{
+    // Sized for the worst case once, filled through a pointer, trimmed at
+    // the end: the per-greeting work is a varint and a memcpy.
+    size_t start = out.size();
+    out.resize(start + greetings.text.size() + 10 * greetings.size());
+    char * begin = out.data();
+    char * p = begin + start;
+    char * blockStart = p;
+    uint32_t rows = 0;
+    auto finishBlock = [&] {
+        uint32_t size = uint32_t(p - blockStart);
+        blocks.push_back({size, rows, crc32c(string_view(blockStart, size))});
+        blockStart = p;
+        rows = 0;
+    };
+    for (size_t i = 0; i < greetings.size(); ++i) {
+        string_view greeting = greetings[i];
+        size_t length = greeting.size();
+        if (rows > 0 && size_t(p - blockStart) + varintSize(length) + length > blockSize)
+            finishBlock();
+        while (length >= 0x80) {
+            *p++ = char(length | 0x80);
+            length >>= 7;
+        }
+        *p++ = char(length);
+        memcpy(p, greeting.data(), greeting.size());
+        p += greeting.size();
+        ++rows;
+    }
+    if (rows > 0)
+        finishBlock();
+    out.resize(p - begin);
+}
+
+string BlockFileIndex::header() const
+{
+    string header(headerSize, '\0');
+    memcpy(header.data(), headerMagic, 8);
+    put(header.data() + 8, version, 4);
+    put(header.data() + 12, blockSize, 4);
+    return header;
+}
+
+void BlockFileIndex::add(const vector<GreetingBlock> & blocks)
+{
+    for (const GreetingBlock & block : blocks) {
+        entries.push_back({nextRow, nextOffset, block});
+        nextRow += block.rows;
+        nextOffset += block.size;
+    }
+}
+
+string BlockFileIndex::trailer() const
+{
+    string trailer(entries.size() * entrySize + footerSize, '\0');
+    char * p = trailer.data();
+    for (const Entry & entry : entries) {
+        put(p, entry.firstRow, 8);
+        put(p + 8, entry.offset, 8);
+        put(p + 16, entry.block.size, 4);
+        put(p + 20, entry.block.rows, 4);
+        put(p + 24, entry.block.checksum, 4);
+        p += entrySize;
+    }
+    put(p, nextOffset, 8);
+    put(p + 8, entries.size(), 8);
+    put(p + 16, nextRow, 8);
+    put(p + 24, crc32c(string_view(trailer.data(), entries.size() * entrySize)), 4);
+    put(p + 28, version, 4);
+    memcpy(p + 32, footerMagic, 8);
+    return trailer;
+}
+
+BlockFileReader::BlockFileReader(const string & path) : path(path)
+{
+#ifdef _WIN32
+    ifstream in(path, ios::binary);
+    if (!in)
+        throw system_error(errno, generic_category(), path);
+    ostringstream buffer;
+    buffer << in.rdbuf();
+    contents = buffer.str();
+    data = contents.data();
+    size = contents.size();
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw system_error(errno, generic_category(), path);
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        int error = errno;
+        close(fd);
+        throw system_error(error, generic_category(), path);
+    }
+    size = size_t(status.st_size);
+    if (size > 0) {
+        void * mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            int error = errno;
+            close(fd);
+            throw system_error(error, generic_category(), path);
+        }
+        data = static_cast<const char *>(mapping);
+    }
+    close(fd);
+#endif
+
+    try {
+        if (size < headerSize + footerSize || memcmp(data, headerMagic, 8) != 0)
+            malformed(path, "no header");
+        const char * footer = data + size - footerSize;
+        if (memcmp(footer + 32, footerMagic, 8) != 0)
+            malformed(path, "no footer; was the writer interrupted?");
+        if (get(data + 8, 4) != version || get(footer + 28, 4) != version)
+            malformed(path, "unknown version");
+        uint64_t indexOffset = get(footer, 8);
+        uint64_t count = get(footer + 8, 8);
+        rowCount = get(footer + 16, 8);
+        if (indexOffset < headerSize || count > (size - footerSize) / entrySize ||
+            indexOffset != size - footerSize - count * entrySize)
+            malformed(path, "bad index position");
+        blockCount = size_t(count);
+        string_view index(data + indexOffset, blockCount * entrySize);
+        if (crc32c(index) != get(footer + 24, 4))
+            malformed(path, "index checksum mismatch");
+
+        entries.resize(blockCount);
+        uint64_t row = 0;
+        uint64_t offset = headerSize;
+        for (size_t i = 0; i < blockCount; ++i) {
+            const char * p = index.data() + i * entrySize;
+            Entry & entry = entries[i];
+            entry = {get(p, 8), get(p + 8, 8), uint32_t(get(p + 16, 4)), uint32_t(get(p + 20, 4)),
+                     uint32_t(get(p + 24, 4))};
+            if (entry.firstRow != row || entry.offset != offset || entry.rows == 0)
+                malformed(path, "inconsistent index");
+            row += entry.rows;
+            offset += entry.size;
+        }
+        if (row != rowCount || offset != indexOffset)
+            malformed(path, "index does not cover the blocks");
+    } catch (...) {
+#ifndef _WIN32
+        if (data)
+            munmap(const_cast<char *>(data), size);
+#endif
+        throw;
+    }
+    verified = make_unique<atomic<bool>[]>(blockCount);
+}
+
+BlockFileReader::~BlockFileReader()
+{
+#ifndef _WIN32
+    if (data)
+        munmap(const_cast<char *>(data), size);
+#endif
+}
+
+string_view BlockFileReader::block(size_t i) const
+{
+    const Entry & entry = entries[i];
+    string_view bytes(data + entry.offset, entry.size);
+    if (!verified[i].load(memory_order_acquire)) {
+        if (crc32c(bytes) != entry.checksum)
+            throw runtime_error(path + ": block " + to_string(i) + " checksum mismatch");
+        verified[i].store(true, memory_order_release);
+    }
+    return bytes;
+}
+
+string_view BlockFileReader::row(uint64_t n) const
+{
+    if (n >= rowCount)
+        throw out_of_range(path + ": row " + to_string(n) + " of " + to_string(rowCount));
+    size_t i = size_t(upper_bound(entries.begin(), entries.end(), n,
+                                  [](uint64_t row, const Entry & entry) { return row < entry.firstRow; }) -
+                      entries.begin() - 1);
+    string_view bytes = block(i);
+    const char * p = bytes.data();
+    const char * end = p + bytes.size();
+    for (uint64_t skip = n - entries[i].firstRow;; --skip) {
+        uint64_t length = 0;
+        for (int shift = 0;; shift += 7) {
+            if (p == end || shift > 63)
+                throw runtime_error(path + ": block " + to_string(i) + " is malformed");
+            uint8_t byte = uint8_t(*p++);
+            length |= uint64_t(byte & 0x7f) << shift;
+            if (byte < 0x80)
+                break;
+        }
+        if (length > uint64_t(end - p))
+            throw runtime_error(path + ": block " + to_string(i) + " is malformed");
+        if (skip == 0)
+            return string_view(p, size_t(length));
+        p += length;
+    }
+}
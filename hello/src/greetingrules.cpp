@@ -0,0 +1,331 @@
+#include "greetingrules.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+const char * kindName(RuleKind kind)
+{
+    switch (kind) {
+    case RuleKind::Prefix:
+        return "prefix";
+    case RuleKind::Suffix:
+        return "suffix";
+    case RuleKind::Exact:
+        break;
+    }
+    return "exact";
+}
+
+string describe(const GreetingRule & rule) { return string(kindName(rule.kind)) + " '" + rule.pattern + "'"; }
+
+} // namespace
+
+vector<GreetingRule> parseGreetingRules(string_view text)
+{
+    vector<GreetingRule> rules;
+    size_t lineNumber = 0;
+    while (!text.empty()) {
+        size_t end = text.find('\n');
+        string_view line = text.substr(0, end);
+        text.remove_prefix(end == string_view::npos ? text.size() : end + 1);
+        ++lineNumber;
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        if (line.empty() || line.front() == '#')
+            continue;
+
+        auto fail = [&](const string & why) {
+            throw invalid_argument("greeting rules line " + to_string(lineNumber) + ": " + why);
+        };
+        size_t tab1 = line.find('\t');
+        size_t tab2 = tab1 == string_view::npos ? tab1 : line.find('\t', tab1 + 1);
+        if (tab2 == string_view::npos)
+            fail("expected kind<TAB>pattern<TAB>template");
+        GreetingRule rule;
+        string_view kind = line.substr(0, tab1);
+        if (kind == "prefix")
+            rule.kind = RuleKind::Prefix;
+        else if (kind == "suffix")
+            rule.kind = RuleKind::Suffix;
+        else if (kind == "exact")
+            rule.kind = RuleKind::Exact;
+        else
+            fail("unknown rule kind '" + string(kind) + "'");
+        rule.pattern = line.substr(tab1 + 1, tab2 - tab1 - 1);
+        rule.greeting = line.substr(tab2 + 1);
+        rules.push_back(move(rule));
+    }
+    return rules;
+}
+
+GreetingRules::GreetingRules(const vector<GreetingRule> & rules)
+{
+    // Bytes that no pattern uses all share class 0, so the rows of the
+    // automata are as wide as the patterns' alphabet, not 256.
+    for (const GreetingRule & rule : rules) {
+        if (rule.pattern.empty() && rule.kind != RuleKind::Exact)
+            throw invalid_argument("greeting rules: empty " + string(kindName(rule.kind)));
+        for (char c : rule.pattern)
+            if (!byteClass[uint8_t(c)])
+                byteClass[uint8_t(c)] = uint16_t(classes++);
+    }
+    compile(forward, rules, false);
+    compile(backward, rules, true);
+
+    firstPiece.push_back(0);
+    for (const GreetingRule & rule : rules) {
+        const string & text = rule.greeting;
+        uint32_t fixed = 0, names = 0, rests = 0;
+        auto literal = [&](size_t from, size_t size) {
+            if (size == 0)
+                return;
+            // Literals are appended back to back, so text split by {{ or }}
+            // extends the piece before it.
+            if (pieces.size() > firstPiece.back() && pieces.back().kind == Piece::Literal)
+                pieces.back().size += uint32_t(size);
+            else
+                pieces.push_back({Piece::Literal, uint32_t(literals.size()), uint32_t(size)});
+            literals.append(text, from, size);
+            fixed += uint32_t(size);
+        };
+        size_t start = 0;
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] != '{' && text[i] != '}')
+                continue;
+            literal(start, i - start);
+            if (text.compare(i, 2, "{{") == 0 || text.compare(i, 2, "}}") == 0) {
+                literal(i, 1);
+                start = ++i + 1;
+            } else if (text.compare(i, 6, "{name}") == 0) {
+                pieces.push_back({Piece::Name, 0, 0});
+                ++names;
+                start = (i += 5) + 1;
+            } else if (text.compare(i, 6, "{rest}") == 0) {
+                pieces.push_back({Piece::Rest, 0, 0});
+                ++rests;
+                start = (i += 5) + 1;
+            } else {
+                throw invalid_argument("greeting rules: " + describe(rule) +
+                                       ": template may only use {name}, {rest}, {{ and }}");
+            }
+        }
+        literal(start, text.size() - start);
+        firstPiece.push_back(uint32_t(pieces.size()));
+        fixedSize.push_back(fixed);
+        nameCount.push_back(names);
+        restCount.push_back(rests);
+    }
+}
+
+void GreetingRules::compile(Automaton & automaton, const vector<GreetingRule> & rules, bool reversed)
+{
+    // Build an ordinary trie first, then lay it out breadth first, giving
+    // each state the lowest base at which all its children's slots are free.
+    struct Node
+    {
+        vector<pair<uint16_t, uint32_t>> children;
+        int32_t accept = -1;
+        int32_t exact = -1;
+    };
+    vector<Node> nodes(1);
+    for (size_t r = 0; r < rules.size(); ++r) {
+        const GreetingRule & rule = rules[r];
+        if ((rule.kind == RuleKind::Suffix) != reversed)
+            continue;
+        const string & pattern = rule.pattern;
+        uint32_t node = 0;
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            uint16_t c = byteClass[uint8_t(reversed ? pattern[pattern.size() - 1 - i] : pattern[i])];
+            auto & children = nodes[node].children;
+            auto child = find_if(children.begin(), children.end(), [c](const auto & edge) { return edge.first == c; });
+            if (child != children.end()) {
+                node = child->second;
+            } else {
+                uint32_t added = uint32_t(nodes.size());
+                children.emplace_back(c, added);
+                nodes.emplace_back();
+                node = added;
+            }
+        }
+        int32_t & slot = rule.kind == RuleKind::Exact ? nodes[node].exact : nodes[node].accept;
+        if (slot >= 0)
+            throw invalid_argument("greeting rules: " + describe(rule) + " given twice");
+        slot = int32_t(r);
+    }
+
+    // Slot 0 is the root, marked with a check no state has. A state's base
+    // plus any class stays below the array size, so walks need no bounds
+    // test, and class 0 never lands on a child since children are at c >= 1.
+    automaton.base.assign(classes, 0);
+    automaton.check.assign(classes, -1);
+    automaton.check[0] = -2;
+    automaton.accept.assign(classes, -1);
+    automaton.exact.assign(classes, -1);
+    vector<pair<uint32_t, int32_t>> queue{{0, 0}};
+    size_t firstFree = 1;
+    for (size_t q = 0; q < queue.size(); ++q) {
+        auto [node, state] = queue[q];
+        automaton.accept[state] = nodes[node].accept;
+        automaton.exact[state] = nodes[node].exact;
+        const auto & children = nodes[node].children;
+        if (children.empty())
+            continue;
+        while (firstFree < automaton.check.size() && automaton.check[firstFree] != -1)
+            ++firstFree;
+        uint16_t lowest = min_element(children.begin(), children.end())->first;
+        size_t base = firstFree > lowest ? firstFree - lowest : 0;
+        auto fits = [&](size_t b) {
+            for (const auto & [c, child] : children)
+                if (b + c < automaton.check.size() && automaton.check[b + c] != -1)
+                    return false;
+            return true;
+        };
+        while (!fits(base))
+            ++base;
+        if (base + classes > automaton.check.size()) {
+            size_t size = max(base + classes, automaton.check.size() + automaton.check.size() / 2);
+            automaton.base.resize(size, 0);
+            automaton.check.resize(size, -1);
+            automaton.accept.resize(size, -1);
+            automaton.exact.resize(size, -1);
+        }
+        automaton.base[state] = int32_t(base);
+        for (const auto & [c, child] : children) {
+            automaton.check[base + c] = state;
+            queue.emplace_back(child, int32_t(base + c));
+        }
+    }
+    automaton.states = queue.size();
+    size_t used = classes;
+    for (const auto & [node, state] : queue)
+        used = max(used, size_t(automaton.base[state]) + classes);
+    for (vector<int32_t> * array : {&automaton.base, &automaton.check, &automaton.accept, &automaton.exact}) {
+        array->resize(used);
+        array->shrink_to_fit();
+    }
+}
+
+GreetingRules::Match GreetingRules::find(string_view name) const
+{
+    const uint8_t * p = reinterpret_cast<const uint8_t *>(name.data());
+    size_t n = name.size();
+    Match match;
+
+    int32_t state = 0;
+    size_t i = 0;
+    size_t longest = 0;
+    for (; i < n; ++i) {
+        int32_t next = forward.base[state] + byteClass[p[i]];
+        if (forward.check[next] != state)
+            break;
+        state = next;
+        if (forward.accept[state] >= 0) {
+            match.rule = forward.accept[state];
+            longest = i + 1;
+        }
+    }
+    if (i == n && forward.exact[state] >= 0)
+        return {forward.exact[state], 0, n};
+    if (match.rule >= 0)
+        return {match.rule, longest, n};
+
+    state = 0;
+    for (i = n; i > 0; --i) {
+        int32_t next = backward.base[state] + byteClass[p[i - 1]];
+        if (backward.check[next] != state)
+            break;
+        state = next;
+        if (backward.accept[state] >= 0) {
+            match.rule = backward.accept[state];
+            longest = n - i + 1;
+        }
+    }
+    if (match.rule >= 0)
+        return {match.rule, 0, n - longest};
+    return match;
+}
+
+size_t GreetingRules::greetingSize(const Match & match, size_t nameSize) const
+{
+    if (match.rule < 0)
+        return helloPrefix.size() + nameSize;
+    return fixedSize[match.rule] + nameCount[match.rule] * nameSize +
+           restCount[match.rule] * (match.restEnd - match.restBegin);
+}
+
+char * GreetingRules::write(char * out, string_view name, const Match & match) const
+{
+    if (match.rule < 0) {
+        memcpy(out, helloPrefix.data(), helloPrefix.size());
+        memcpy(out + helloPrefix.size(), name.data(), name.size());
+        return out + helloPrefix.size() + name.size();
+    }
+    for (uint32_t i = firstPiece[match.rule]; i < firstPiece[match.rule + 1]; ++i) {
+        const Piece & piece = pieces[i];
+        switch (piece.kind) {
+        case Piece::Literal:
+            memcpy(out, literals.data() + piece.offset, piece.size);
+            out += piece.size;
+            break;
+        case Piece::Name:
+            memcpy(out, name.data(), name.size());
+            out += name.size();
+            break;
+        case Piece::Rest:
+            memcpy(out, name.data() + match.restBegin, match.restEnd - match.restBegin);
+            out += match.restEnd - match.restBegin;
+            break;
+        }
+    }
+    return out;
+}
+
+int GreetingRules::match(string_view name) const { return find(name).rule; }
+
+string GreetingRules::greet(string_view name) const
+{
+    Match match = find(name);
+    string greeting(greetingSize(match, name.size()), '\0');
+    write(greeting.data(), name, match);
+    return greeting;
+}
+
+void GreetingRules::greet(const vector<string_view> & names, GreetingBatch & greetings) const
+{
+    // Match every name first so the text is sized once and filled in place.
+    vector<Match> matches(names.size());
+    size_t bytes = 0;
+    for (size_t i = 0; i < names.size(); ++i) {
+        matches[i] = find(names[i]);
+        bytes += greetingSize(matches[i], names[i].size());
+    }
+
+    size_t pos = greetings.text.size();
+    greetings.text.resize(pos + bytes);
+    size_t offsetsNeeded = greetings.offsets.size() + names.size();
+    if (offsetsNeeded > greetings.offsets.capacity())
+        greetings.offsets.reserve(max(offsetsNeeded, 2 * greetings.offsets.capacity()));
+    char * begin = greetings.text.data();
+    char * out = begin + pos;
+    for (size_t i = 0; i < names.size(); ++i) {
+        out = write(out, names[i], matches[i]);
+        greetings.offsets.push_back(size_t(out - begin));
+    }
+}
+
+size_t GreetingRules::bytes() const
+{
+    auto automatonBytes = [](const Automaton & a) {
+        return (a.base.capacity() + a.check.capacity() + a.accept.capacity() + a.exact.capacity()) * sizeof(int32_t);
+    };
+    return sizeof(*this) + automatonBytes(forward) + automatonBytes(backward) + literals.capacity() +
+           pieces.capacity() * sizeof(Piece) +
+           (firstPiece.capacity() + fixedSize.capacity() + nameCount.capacity() + restCount.capacity()) *
+               sizeof(uint32_t);
+}
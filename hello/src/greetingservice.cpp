@@ -0,0 +1,320 @@
+#include "greetingservice.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "namehash.h"
+
+using namespace std;
+
+struct GreetingService::Task
+{
+    GreetingPriority priority;
+    GreetingRequestOptions options;
+    vector<string> names;
+    size_t next = 0;                  // first name not yet rendered
+    GreetingBatch greetings;
+    bool single = false;
+    bool inFlight = false;            // registered in the in-flight table for coalescing
+    chrono::steady_clock::time_point enqueued;
+    promise<string> singleResult;
+    promise<GreetingBatch> batchResult;
+};
+
+namespace {
+
+struct NameHasher
+{
+    size_t operator()(const string & name) const { return size_t(hashName(name)); }
+};
+
+int classIndex(GreetingPriority priority) { return priority == GreetingPriority::Interactive ? 0 : 1; }
+
+enum class Drop { None, Expired, Cancelled };
+
+Drop dropReason(const GreetingRequestOptions & options)
+{
+    if (options.stopToken.stop_requested())
+        return Drop::Cancelled;
+    if (options.deadline != chrono::steady_clock::time_point::max() && chrono::steady_clock::now() >= options.deadline)
+        return Drop::Expired;
+    return Drop::None;
+}
+
+} // namespace
+
+// Names queued or rendering for a coalesced greet(), each with the callers
+// that joined it.
+struct alignas(64) GreetingService::FlightShard
+{
+    mutex flightMutex;
+    unordered_map<string, vector<promise<string>>, NameHasher> flights;
+};
+
+GreetingService::GreetingService(GreetingServiceConfig config) : config([&] {
+    config.workers = config.workers ? config.workers : max(1u, thread::hardware_concurrency());
+    config.interactiveWeight = max(1u, config.interactiveWeight);
+    config.bulkWeight = max(1u, config.bulkWeight);
+    config.bulkChunkSize = max<size_t>(1, config.bulkChunkSize);
+    config.coalescingShards = max(1u, config.coalescingShards);
+    return config;
+}())
+{
+    if (this->config.coalesce)
+        flightShards = make_unique<FlightShard[]>(this->config.coalescingShards);
+    for (unsigned i = 0; i < this->config.workers; ++i)
+        workers.emplace_back(&GreetingService::run, this);
+}
+
+GreetingService::~GreetingService()
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (thread & worker : workers)
+        worker.join();
+}
+
+future<string> GreetingService::greet(string personName, GreetingRequestOptions options)
+{
+    bool coalescing = config.coalesce && !options.stopToken.stop_possible() &&
+                      options.deadline == chrono::steady_clock::time_point::max();
+    if (coalescing) {
+        FlightShard & shard = flightShard(personName);
+        lock_guard<mutex> lock(shard.flightMutex);
+        auto [flight, inserted] = shard.flights.try_emplace(personName);
+        if (!inserted) {
+            coalescedCount.fetch_add(1, memory_order_relaxed);
+            return flight->second.emplace_back().get_future();
+        }
+    }
+    auto task = make_unique<Task>();
+    task->priority = GreetingPriority::Interactive;
+    task->options = move(options);
+    task->names.push_back(move(personName));
+    task->single = true;
+    task->inFlight = coalescing;
+    future<string> result = task->singleResult.get_future();
+    enqueue(move(task));
+    return result;
+}
+
+future<GreetingBatch> GreetingService::greetBatch(vector<string> personNames, GreetingRequestOptions options)
+{
+    GreetingPriority priority = personNames.size() <= config.interactiveMaxBatch ? GreetingPriority::Interactive
+                                                                                 : GreetingPriority::Bulk;
+    return greetBatch(move(personNames), priority, move(options));
+}
+
+future<GreetingBatch> GreetingService::greetBatch(vector<string> personNames, GreetingPriority priority,
+                                                  GreetingRequestOptions options)
+{
+    auto task = make_unique<Task>();
+    task->priority = priority;
+    task->options = move(options);
+    task->names = move(personNames);
+    future<GreetingBatch> result = task->batchResult.get_future();
+    enqueue(move(task));
+    return result;
+}
+
+GreetingServiceStats GreetingService::stats() const
+{
+    lock_guard<mutex> lock(queueMutex);
+    GreetingServiceStats stats = counters;
+    stats.coalesced = coalescedCount.load(memory_order_relaxed);
+    return stats;
+}
+
+HdrHistogram GreetingService::queueDelays(GreetingPriority priority) const
+{
+    lock_guard<mutex> lock(queueMutex);
+    return delays[classIndex(priority)];
+}
+
+GreetingService::FlightShard & GreetingService::flightShard(const string & name)
+{
+    // The high half, as the shard's map buckets by the low bits.
+    return flightShards[(hashName(name) >> 32) % config.coalescingShards];
+}
+
+void GreetingService::settleSingle(Task & task, const string * greeting, exception_ptr error)
+{
+    // Taken out of the table first: a greet() from now on renders afresh
+    // rather than joining a flight that has landed.
+    vector<promise<string>> joined;
+    if (task.inFlight) {
+        FlightShard & shard = flightShard(task.names[0]);
+        lock_guard<mutex> lock(shard.flightMutex);
+        auto flight = shard.flights.find(task.names[0]);
+        joined = move(flight->second);
+        shard.flights.erase(flight);
+    }
+    joined.push_back(move(task.singleResult));
+    for (promise<string> & waiter : joined) {
+        if (error)
+            waiter.set_exception(error);
+        else
+            waiter.set_value(*greeting);
+    }
+}
+
+void GreetingService::fail(Task & task, exception_ptr error)
+{
+    if (task.single)
+        settleSingle(task, nullptr, error);
+    else
+        task.batchResult.set_exception(error);
+}
+
+void GreetingService::enqueue(TaskPtr task)
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        task->enqueued = chrono::steady_clock::now();
+        if (task->priority == GreetingPriority::Interactive)
+            ++counters.interactiveRequests;
+        else
+            ++counters.bulkRequests;
+        queues[config.prioritize ? classIndex(task->priority) : 0].push_back(move(task));
+    }
+    workAvailable.notify_one();
+}
+
+GreetingService::TaskPtr GreetingService::next(unique_lock<mutex> & lock, vector<TaskPtr> & shed)
+{
+    workAvailable.wait(lock, [this] { return stopping || !queues[0].empty() || !queues[1].empty(); });
+    if (queues[0].empty() && queues[1].empty())
+        return nullptr;
+
+    auto cost = [this](const Task & task) -> int64_t {
+        size_t remaining = task.names.size() - task.next;
+        return task.priority == GreetingPriority::Bulk ? min(remaining, config.bulkChunkSize) : remaining;
+    };
+    auto quantum = [this](int c) -> int64_t {
+        return int64_t(c == 0 ? config.interactiveWeight : config.bulkWeight) * int64_t(config.bulkChunkSize);
+    };
+
+    // Deficit round robin. A class that runs dry forfeits its credit, and a
+    // class with no competition is served without building up debt.
+    for (;;) {
+        int other = 1 - turn;
+        if (queues[turn].empty()) {
+            deficit[turn] = 0;
+            turn = other;
+            continue;
+        }
+        int64_t needed = cost(*queues[turn].front());
+        if (deficit[turn] >= needed || queues[other].empty()) {
+            deficit[turn] = max<int64_t>(deficit[turn] - needed, 0);
+            if (turn == 0 && !queues[1].empty() && queues[1].front()->next > 0)
+                ++counters.preemptions;
+            TaskPtr task = move(queues[turn].front());
+            queues[turn].pop_front();
+            if (task->next > 0)
+                return task;   // a bulk batch resumed, not a fresh request
+
+            // Fresh requests are measured, and may be shed, as they leave
+            // the queue; the caller fails the shed ones outside the lock.
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            chrono::steady_clock::duration sojourn = now - task->enqueued;
+            delays[turn].record(uint64_t(chrono::duration_cast<chrono::nanoseconds>(sojourn).count()));
+            if (!config.shed || !shouldShed(turn, sojourn, now))
+                return task;
+            ++counters.shed[turn];
+            counters.droppedNames += task->names.size();
+            shed.push_back(move(task));
+            if (queues[0].empty() && queues[1].empty())
+                return nullptr;
+            continue;
+        }
+        turn = other;
+        deficit[turn] += quantum(turn);
+    }
+}
+
+bool GreetingService::shouldShed(int queue, chrono::steady_clock::duration sojourn,
+                                 chrono::steady_clock::time_point now)
+{
+    Shedder & shedder = shedders[queue];
+    shedder.minDelay = min(shedder.minDelay, sojourn);
+    if (now >= shedder.intervalEnd) {
+        // The first interval starts with the first request, unjudged.
+        shedder.overloaded = shedder.intervalEnd != chrono::steady_clock::time_point{} &&
+                             shedder.minDelay > config.shedTarget;
+        shedder.minDelay = chrono::steady_clock::duration::max();
+        shedder.intervalEnd = now + config.shedInterval;
+    }
+    return sojourn > (shedder.overloaded ? config.shedTarget : config.shedInterval);
+}
+
+void GreetingService::run()
+{
+    vector<string_view> views;
+    vector<TaskPtr> shed;
+    unique_lock<mutex> lock(queueMutex);
+    for (;;) {
+        TaskPtr task = next(lock, shed);
+        if (!shed.empty()) {
+            lock.unlock();
+            exception_ptr overloaded = make_exception_ptr(GreetingOverloaded());
+            for (TaskPtr & dropped : shed)
+                fail(*dropped, overloaded);
+            shed.clear();
+            lock.lock();
+            if (!task)
+                continue;
+        }
+        if (!task)
+            break;
+        lock.unlock();
+
+        // A chunked bulk batch renders one chunk per turn; anything else
+        // runs to the end, still in chunks so a drop is noticed between them.
+        bool chunked = config.prioritize && task->priority == GreetingPriority::Bulk;
+        size_t end = chunked ? min(task->names.size(), task->next + config.bulkChunkSize) : task->names.size();
+        Drop drop = dropReason(task->options);
+        bool finished = true;
+        try {
+            while (drop == Drop::None && task->next < end) {
+                size_t count = min(end - task->next, config.bulkChunkSize);
+                views.assign(task->names.begin() + task->next, task->names.begin() + task->next + count);
+                generateHelloStrings(views, task->greetings);
+                task->next += count;
+                if (task->next < end)
+                    drop = dropReason(task->options);
+            }
+            if (drop != Drop::None) {
+                // Counted before the future is failed, so a caller that sees
+                // the exception also sees the count.
+                lock_guard<mutex> counted(queueMutex);
+                ++(drop == Drop::Expired ? counters.expired : counters.cancelled);
+                counters.droppedNames += task->names.size() - task->next;
+            }
+            if (drop == Drop::Expired)
+                throw GreetingDeadlineExceeded();
+            if (drop == Drop::Cancelled)
+                throw GreetingCancelled();
+            if (chunked) {
+                // Likewise counted before a last chunk settles the future.
+                lock_guard<mutex> counted(queueMutex);
+                ++counters.bulkChunks;
+            }
+            finished = task->next == task->names.size();
+            if (finished && task->single) {
+                string greeting(task->greetings[0]);
+                settleSingle(*task, &greeting, nullptr);
+            } else if (finished)
+                task->batchResult.set_value(move(task->greetings));
+        } catch (...) {
+            finished = true;
+            fail(*task, current_exception());
+        }
+
+        lock.lock();
+        if (!finished)
+            queues[1].push_front(move(task));
+    }
+}
@@ -0,0 +1,137 @@
+#include "hdrhistogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+
+using namespace std;
+
+HdrHistogram::HdrHistogram(uint64_t highestTrackableValue, int significantDigits)
+    : highestTrackable(std::max<uint64_t>(highestTrackableValue, 2))
+{
+    if (significantDigits < 1 || significantDigits > 4)
+        throw invalid_argument("HdrHistogram: significantDigits must be 1 to 4");
+    // Enough linear sub-buckets that adjacent values differ by less than
+    // one unit in the last significant digit.
+    uint64_t largestExact = 2 * static_cast<uint64_t>(pow(10, significantDigits));
+    subBucketBits = bit_width(largestExact - 1);
+    subBucketCount = uint64_t(1) << subBucketBits;
+    subBucketHalf = subBucketCount / 2;
+    counts.assign(indexOf(highestTrackable) + 1, 0);
+}
+
+// Values below subBucketCount map one to one. Above that each power of two
+// is split into subBucketHalf equal buckets.
+size_t HdrHistogram::indexOf(uint64_t value) const
+{
+    if (value < subBucketCount)
+        return static_cast<size_t>(value);
+    int shift = bit_width(value) - subBucketBits;
+    return static_cast<size_t>(subBucketCount + uint64_t(shift - 1) * subBucketHalf + ((value >> shift) - subBucketHalf));
+}
+
+uint64_t HdrHistogram::lowestEquivalent(size_t index) const
+{
+    if (index < subBucketCount)
+        return index;
+    uint64_t shift = (index - subBucketCount) / subBucketHalf + 1;
+    uint64_t sub = (index - subBucketCount) % subBucketHalf + subBucketHalf;
+    return sub << shift;
+}
+
+uint64_t HdrHistogram::highestEquivalent(size_t index) const
+{
+    if (index < subBucketCount)
+        return index;
+    uint64_t shift = (index - subBucketCount) / subBucketHalf + 1;
+    return lowestEquivalent(index) + (uint64_t(1) << shift) - 1;
+}
+
+void HdrHistogram::record(uint64_t value, uint64_t count)
+{
+    value = std::min(value, highestTrackable);
+    counts[indexOf(value)] += count;
+    totalCount += count;
+    minValue = std::min(minValue, value);
+    maxValue = std::max(maxValue, value);
+    sum += double(value) * double(count);
+}
+
+void HdrHistogram::add(const HdrHistogram & other)
+{
+    if (other.subBucketBits != subBucketBits || other.counts.size() > counts.size())
+        throw invalid_argument("HdrHistogram::add: incompatible histograms");
+    for (size_t i = 0; i < other.counts.size(); ++i)
+        counts[i] += other.counts[i];
+    totalCount += other.totalCount;
+    minValue = std::min(minValue, other.minValue);
+    maxValue = std::max(maxValue, other.maxValue);
+    sum += other.sum;
+}
+
+void HdrHistogram::reset()
+{
+    fill(counts.begin(), counts.end(), 0);
+    totalCount = 0;
+    minValue = UINT64_MAX;
+    maxValue = 0;
+    sum = 0;
+}
+
+uint64_t HdrHistogram::min() const
+{
+    return totalCount ? minValue : 0;
+}
+
+double HdrHistogram::mean() const
+{
+    return totalCount ? sum / double(totalCount) : 0;
+}
+
+uint64_t HdrHistogram::valueAtPercentile(double percentile) const
+{
+    if (totalCount == 0)
+        return 0;
+    percentile = clamp(percentile, 0.0, 100.0);
+    uint64_t wanted = std::max<uint64_t>(1, static_cast<uint64_t>(ceil(percentile / 100 * double(totalCount))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= wanted)
+            return std::min(highestEquivalent(i), maxValue);
+    }
+    return maxValue;
+}
+
+void HdrHistogram::writePercentileDistribution(ostream & out, double scale, int ticksPerHalfDistance) const
+{
+    out << fixed << setw(12) << "Value" << ' ' << setw(14) << "Percentile" << ' ' << setw(10) << "TotalCount"
+        << ' ' << setw(14) << "1/(1-Percentile)" << "\n\n";
+    auto line = [&](double percentile) {
+        uint64_t value = valueAtPercentile(percentile);
+        uint64_t atOrBelow = 0;
+        for (size_t i = 0; i <= indexOf(value); ++i)
+            atOrBelow += counts[i];
+        out << setprecision(3) << setw(12) << value / scale << ' ' << setprecision(12) << setw(14)
+            << percentile / 100 << ' ' << setw(10) << atOrBelow << ' ' << setprecision(2) << setw(14);
+        if (percentile < 100)
+            out << 1 / (1 - percentile / 100) << '\n';
+        else
+            out << "inf" << '\n';
+        return atOrBelow;
+    };
+    if (totalCount > 0) {
+        // ticksPerHalfDistance lines for each halving of the distance to
+        // 100%, as HdrHistogram prints them.
+        double percentile = 0;
+        while (line(percentile) < totalCount) {
+            double halvings = floor(log2(100 / (100 - percentile)));
+            percentile += 100 / (ticksPerHalfDistance * pow(2, halvings + 1));
+        }
+        line(100);
+    }
+    out << setprecision(3) << "#[Mean    = " << setw(12) << mean() / scale << ", Samples = " << setw(12)
+        << totalCount << "]\n#[Max     = " << setw(12) << maxValue / scale << "]\n";
+}
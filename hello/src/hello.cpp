@@ -1,8 +1,32 @@
 #include "hello.h"
 
+#include <algorithm>
+
 using namespace std;
 
-const string generateHelloString(const string & personName) 
+const string generateHelloString(const string & personName)
+{
+    return string(helloPrefix) + personName;
+}
+
+void generateHelloStrings(const vector<string_view> & personNames, GreetingBatch & greetings)
 {
-    return "Hello " + personName;
-}
\ No newline at end of file
+    size_t bytes = 0;
+    for (string_view name : personNames)
+        bytes += helloPrefix.size() + name.size();
+
+    // Size once and fill in place so the loop is just two memcpys per name.
+    size_t pos = greetings.text.size();
+    greetings.text.resize(pos + bytes);
+    size_t offsetsNeeded = greetings.offsets.size() + personNames.size();
+    if (offsetsNeeded > greetings.offsets.capacity())
+        greetings.offsets.reserve(max(offsetsNeeded, 2 * greetings.offsets.capacity()));
+    char * out = greetings.text.data();
+    for (string_view name : personNames) {
+        helloPrefix.copy(out + pos, helloPrefix.size());
+        pos += helloPrefix.size();
+        name.copy(out + pos, name.size());
+        pos += name.size();
+        greetings.offsets.push_back(pos);
+    }
+}
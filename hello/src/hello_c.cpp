@@ -0,0 +1,140 @@
+#include "hello_c.h"
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "hello.h"
+#include "transliterate.h"
+
+using namespace std;
+
+namespace {
+
+// No exception may cross the C boundary.
+template <typename Body>
+hello_status guarded(Body body)
+{
+    try {
+        return body();
+    } catch (...) {
+        return HELLO_INTERNAL_ERROR;
+    }
+}
+
+bool validBatch(const char * names, const uint64_t * nameOffsets, size_t count)
+{
+    if (count == 0)
+        return true;
+    if (!names || !nameOffsets)
+        return false;
+    for (size_t i = 0; i < count; ++i) {
+        if (nameOffsets[i] > nameOffsets[i + 1])
+            return false;
+    }
+    return true;
+}
+
+// The batch's names as views, transliterated if asked; those changed view
+// thread-local storage until the next call. Each name is transliterated
+// once, and the size and the write both use the result.
+const vector<string_view> & batchNames(const char * names, const uint64_t * nameOffsets, size_t count,
+                                       uint32_t flags)
+{
+    thread_local vector<string_view> views;
+    thread_local string storage;
+    views.clear();
+    for (size_t i = 0; i < count; ++i)
+        views.emplace_back(names + nameOffsets[i], nameOffsets[i + 1] - nameOffsets[i]);
+    if (flags & HELLO_TRANSLITERATE)
+        transliterateNames(views, storage);
+    return views;
+}
+
+uint64_t greetingsSize(const vector<string_view> & names)
+{
+    uint64_t bytes = 0;
+    for (string_view name : names)
+        bytes += helloPrefix.size() + name.size();
+    return bytes;
+}
+
+} // namespace
+
+uint32_t hello_abi_version(void)
+{
+    return HELLO_ABI_VERSION;
+}
+
+hello_status hello_greetings_size(const char * names, const uint64_t * name_offsets, size_t count,
+                                  uint32_t flags, uint64_t * required_bytes)
+{
+    if (!required_bytes || !validBatch(names, name_offsets, count))
+        return HELLO_INVALID_ARGUMENT;
+    return guarded([&] {
+        if (flags & HELLO_TRANSLITERATE)
+            *required_bytes = greetingsSize(batchNames(names, name_offsets, count, flags));
+        else
+            *required_bytes = count * helloPrefix.size() + (count ? name_offsets[count] - name_offsets[0] : 0);
+        return HELLO_OK;
+    });
+}
+
+hello_status hello_greet_batch(const char * names, const uint64_t * name_offsets, size_t count,
+                               uint32_t flags, char * out, uint64_t out_capacity, uint64_t * out_offsets,
+                               uint64_t * required_bytes)
+{
+    if (!out_offsets || !validBatch(names, name_offsets, count))
+        return HELLO_INVALID_ARGUMENT;
+    return guarded([&] {
+        const vector<string_view> & batch = batchNames(names, name_offsets, count, flags);
+        uint64_t needed = greetingsSize(batch);
+        if (required_bytes)
+            *required_bytes = needed;
+        if (needed > out_capacity)
+            return HELLO_BUFFER_TOO_SMALL;
+        if (needed > 0 && !out)
+            return HELLO_INVALID_ARGUMENT;
+
+        uint64_t pos = 0;
+        out_offsets[0] = 0;
+        for (size_t i = 0; i < count; ++i) {
+            memcpy(out + pos, helloPrefix.data(), helloPrefix.size());
+            pos += helloPrefix.size();
+            memcpy(out + pos, batch[i].data(), batch[i].size());
+            pos += batch[i].size();
+            out_offsets[i + 1] = pos;
+        }
+        return HELLO_OK;
+    });
+}
+
+hello_status hello_greet(const char * name, size_t name_length, uint32_t flags, char * out, size_t out_capacity,
+                         size_t * out_length)
+{
+    if ((!name && name_length) || !out_length)
+        return HELLO_INVALID_ARGUMENT;
+    uint64_t offsets[2] = {0, name_length};
+    uint64_t outOffsets[2];
+    uint64_t required = 0;
+    hello_status status = hello_greet_batch(name ? name : "", offsets, 1, flags, out, out_capacity, outOffsets,
+                                            &required);
+    *out_length = static_cast<size_t>(required);
+    return status;
+}
+
+const char * hello_status_message(hello_status status)
+{
+    switch (status) {
+    case HELLO_OK:
+        return "ok";
+    case HELLO_INVALID_ARGUMENT:
+        return "invalid argument";
+    case HELLO_BUFFER_TOO_SMALL:
+        return "output buffer too small";
+    case HELLO_INTERNAL_ERROR:
+        return "internal error";
+    }
+    return "unknown status";
+}
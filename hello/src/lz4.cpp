@@ -0,0 +1,419 @@
+#include "lz4.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+constexpr uint32_t storedFlag = 0x80000000;       // on a block size: not compressed
+
+constexpr size_t minMatch = 4;
+constexpr size_t lastLiterals = 5;    // a block ends with at least this many literals
+constexpr size_t matchSafety = 12;    // and its last match starts at least this far from the end
+constexpr size_t maxOffset = 65535;
+constexpr int hashBits = 12;
+
+constexpr uint32_t prime1 = 2654435761u;
+constexpr uint32_t prime2 = 2246822519u;
+constexpr uint32_t prime3 = 3266489917u;
+constexpr uint32_t prime4 = 668265263u;
+constexpr uint32_t prime5 = 374761393u;
+
+inline uint32_t read32(const char * p)
+{
+    const unsigned char * b = reinterpret_cast<const unsigned char *>(p);
+    return uint32_t(b[0]) | uint32_t(b[1]) << 8 | uint32_t(b[2]) << 16 | uint32_t(b[3]) << 24;
+}
+
+inline uint64_t read64(const char * p) { return read32(p) | uint64_t(read32(p + 4)) << 32; }
+
+inline void append32(string & out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        out += char(value >> (8 * i));
+}
+
+inline uint32_t rotl(uint32_t x, int r) { return (x << r) | (x >> (32 - r)); }
+
+inline uint32_t round(uint32_t lane, uint32_t input) { return rotl(lane + input * prime2, 13) * prime1; }
+
+inline uint32_t hashOf(uint32_t sequence) { return (sequence * prime1) >> (32 - hashBits); }
+
+// Length of the common prefix of a and b, stopping at limit.
+inline size_t matchLength(const char * a, const char * b, const char * limit)
+{
+    const char * start = a;
+    while (a + 8 <= limit) {
+        uint64_t difference = read64(a) ^ read64(b);
+        if (difference)
+            return size_t(a - start) + size_t(countr_zero(difference) / 8);
+        a += 8;
+        b += 8;
+    }
+    while (a < limit && *a == *b) {
+        ++a;
+        ++b;
+    }
+    return size_t(a - start);
+}
+
+// Lengths of 15 and up continue in bytes of 255 and a final smaller one.
+inline void appendLength(char *& out, size_t length)
+{
+    for (; length >= 255; length -= 255)
+        *out++ = char(255);
+    *out++ = char(length);
+}
+
+[[noreturn]] void malformed(const char * why) { throw runtime_error(string("malformed LZ4 data: ") + why); }
+
+// Decodes block, appending to out; matches may reach back to historyStart.
+void decodeBlock(string_view block, string & out, size_t historyStart, size_t maxSize)
+{
+    const unsigned char * p = reinterpret_cast<const unsigned char *>(block.data());
+    const unsigned char * end = p + block.size();
+    // Decoded into room for the largest block, then cut to size.
+    size_t start = out.size();
+    out.resize(start + maxSize);
+    char * base = out.data();
+    char * o = base + start;
+    char * limit = o + maxSize;
+    auto readLength = [&](size_t length) {
+        if (length == 15) {
+            unsigned char byte;
+            do {
+                if (p == end)
+                    malformed("truncated length");
+                byte = *p++;
+                length += byte;
+            } while (byte == 255);
+        }
+        return length;
+    };
+    while (p < end) {
+        unsigned token = *p++;
+        size_t literals = readLength(token >> 4);
+        if (literals > size_t(end - p) || literals > size_t(limit - o))
+            malformed("literals overrun");
+        // Short runs are copied 16 bytes at a time, past their end where
+        // there is room: the next sequence overwrites the excess.
+        if (literals <= 16 && end - p >= 16 && limit - o >= 16)
+            memcpy(o, p, 16);
+        else
+            memcpy(o, p, literals);
+        o += literals;
+        p += literals;
+        if (p == end)
+            break;   // the last sequence has no match
+        if (end - p < 2)
+            malformed("truncated offset");
+        size_t offset = p[0] | size_t(p[1]) << 8;
+        p += 2;
+        if (offset == 0 || offset > size_t(o - base) - historyStart)
+            malformed("offset out of range");
+        size_t length = readLength(token & 15) + minMatch;
+        if (length > size_t(limit - o))
+            malformed("match overruns the block size");
+        const char * source = o - offset;
+        if (offset >= 16 && size_t(limit - o) >= length + 16) {
+            for (size_t i = 0; i < length; i += 16)
+                memcpy(o + i, source + i, 16);
+        } else if (offset >= length) {
+            memcpy(o, source, length);
+        } else {
+            // Overlapping: the match repeats its last offset bytes.
+            for (size_t i = 0; i < length; ++i)
+                o[i] = source[i];
+        }
+        o += length;
+    }
+    out.resize(size_t(o - base));
+}
+
+} // namespace
+
+uint32_t xxh32(string_view data, uint32_t seed)
+{
+    Xxh32 hash(seed);
+    hash.update(data);
+    return hash.digest();
+}
+
+void Xxh32::reset(uint32_t seed)
+{
+    this->seed = seed;
+    lanes[0] = seed + prime1 + prime2;
+    lanes[1] = seed + prime2;
+    lanes[2] = seed;
+    lanes[3] = seed - prime1;
+    length = 0;
+    bufferedSize = 0;
+}
+
+void Xxh32::update(string_view data)
+{
+    const char * p = data.data();
+    const char * end = p + data.size();
+    length += data.size();
+    if (bufferedSize > 0) {
+        size_t take = min(sizeof buffered - bufferedSize, data.size());
+        memcpy(buffered + bufferedSize, p, take);
+        bufferedSize += take;
+        p += take;
+        if (bufferedSize < sizeof buffered)
+            return;
+        for (int i = 0; i < 4; ++i)
+            lanes[i] = round(lanes[i], read32(buffered + 4 * i));
+        bufferedSize = 0;
+    }
+    uint32_t v[4] = {lanes[0], lanes[1], lanes[2], lanes[3]};
+    for (; end - p >= 16; p += 16)
+        for (int i = 0; i < 4; ++i)
+            v[i] = round(v[i], read32(p + 4 * i));
+    memcpy(lanes, v, sizeof lanes);
+    memcpy(buffered, p, size_t(end - p));
+    bufferedSize = size_t(end - p);
+}
+
+uint32_t Xxh32::digest() const
+{
+    uint32_t hash;
+    if (length >= 16)
+        hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+    else
+        hash = seed + prime5;
+    hash += uint32_t(length);
+    const char * p = buffered;
+    const char * end = p + bufferedSize;
+    for (; p + 4 <= end; p += 4)
+        hash = rotl(hash + read32(p) * prime3, 17) * prime4;
+    for (; p < end; ++p)
+        hash = rotl(hash + uint8_t(*p) * prime5, 11) * prime1;
+    hash ^= hash >> 15;
+    hash *= prime2;
+    hash ^= hash >> 13;
+    hash *= prime3;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+void lz4CompressBlock(string_view input, string & out)
+{
+    // Greedy parsing with a hash table of the last position of each 4-byte
+    // sequence, as the reference compressor's fast mode does: a miss
+    // advances by more the longer it has been since the last match, so
+    // incompressible data passes quickly.
+    const char * base = input.data();
+    size_t n = input.size();
+    size_t start = out.size();
+    out.resize(start + n + n / 255 + 16);
+    char * o = out.data() + start;
+    size_t anchor = 0;
+
+    auto emit = [&](size_t literalsEnd, size_t offset, size_t length) {
+        size_t literals = literalsEnd - anchor;
+        char * token = o++;
+        *token = char(min<size_t>(literals, 15) << 4);
+        if (literals >= 15)
+            appendLength(o, literals - 15);
+        memcpy(o, base + anchor, literals);
+        o += literals;
+        if (length == 0)
+            return;
+        *o++ = char(offset);
+        *o++ = char(offset >> 8);
+        *token |= char(min<size_t>(length - minMatch, 15));
+        if (length - minMatch >= 15)
+            appendLength(o, length - minMatch - 15);
+    };
+
+    if (n > matchSafety) {
+        uint32_t table[1 << hashBits] = {};
+        size_t matchStartLimit = n - matchSafety;
+        const char * matchEnd = base + n - lastLiterals;
+        size_t ip = 1;
+        table[hashOf(read32(base))] = 0;
+        for (;;) {
+            size_t candidate = 0;
+            bool found = false;
+            for (unsigned misses = 1 << 6; ip < matchStartLimit; ip += misses++ >> 6) {
+                uint32_t sequence = read32(base + ip);
+                uint32_t & slot = table[hashOf(sequence)];
+                candidate = slot;
+                slot = uint32_t(ip);
+                if (ip - candidate <= maxOffset && read32(base + candidate) == sequence) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found)
+                break;
+            // Extend backwards over literals that also match.
+            while (ip > anchor && candidate > 0 && base[ip - 1] == base[candidate - 1]) {
+                --ip;
+                --candidate;
+            }
+            size_t length = minMatch + matchLength(base + ip + minMatch, base + candidate + minMatch, matchEnd);
+            emit(ip, ip - candidate, length);
+            ip += length;
+            anchor = ip;
+            if (ip < matchStartLimit)
+                table[hashOf(read32(base + ip - 2))] = uint32_t(ip - 2);
+        }
+    }
+    emit(n, 0, 0);
+    out.resize(size_t(o - out.data()));
+}
+
+void lz4DecompressBlock(string_view block, string & out, size_t maxSize, size_t history)
+{
+    decodeBlock(block, out, out.size() - min(history, out.size()), maxSize);
+}
+
+string lz4FrameHeader()
+{
+    string header;
+    append32(header, lz4FrameMagic);
+    // Version 01, independent blocks, block checksums; 4 MiB blocks.
+    string descriptor = {char(0x40 | 0x20 | 0x10), char(7 << 4)};
+    header += descriptor;
+    header += char((xxh32(descriptor) >> 8) & 0xff);
+    return header;
+}
+
+void lz4CompressFrameBlocks(string_view data, string & out)
+{
+    for (size_t offset = 0; offset < data.size(); offset += lz4MaxBlockSize) {
+        string_view block = data.substr(offset, lz4MaxBlockSize);
+        size_t sizeAt = out.size();
+        append32(out, 0);
+        lz4CompressBlock(block, out);
+        size_t size = out.size() - sizeAt - 4;
+        uint32_t sizeField = uint32_t(size);
+        if (size >= block.size()) {
+            out.resize(sizeAt + 4);
+            out += block;
+            size = block.size();
+            sizeField = uint32_t(size) | storedFlag;
+        }
+        for (int i = 0; i < 4; ++i)
+            out[sizeAt + i] = char(sizeField >> (8 * i));
+        append32(out, xxh32(string_view(out).substr(sizeAt + 4, size)));
+    }
+}
+
+string lz4FrameEnd()
+{
+    string end;
+    append32(end, 0);
+    return end;
+}
+
+size_t lz4DescriptorSize(char flags)
+{
+    // FLG and BD, the content size if FLG says so, and the header checksum.
+    return (flags & 0x08 ? 11 : 3);
+}
+
+Lz4FrameDescriptor lz4ParseDescriptor(string_view descriptor)
+{
+    if (descriptor.size() != lz4DescriptorSize(descriptor.empty() ? 0 : descriptor[0]))
+        malformed("truncated frame descriptor");
+    unsigned flags = uint8_t(descriptor[0]);
+    unsigned blockMaxCode = (uint8_t(descriptor[1]) >> 4) & 7;
+    if ((flags >> 6) != 1)
+        malformed("unsupported frame version");
+    if (flags & 0x01)
+        throw runtime_error("LZ4 frames with dictionaries are not supported");
+    if (blockMaxCode < 4)
+        malformed("bad block size code");
+    string_view checked = descriptor.substr(0, descriptor.size() - 1);
+    if (uint8_t(descriptor.back()) != ((xxh32(checked) >> 8) & 0xff))
+        malformed("header checksum mismatch");
+    Lz4FrameDescriptor frame;
+    frame.independentBlocks = flags & 0x20;
+    frame.blockChecksums = flags & 0x10;
+    frame.contentChecksum = flags & 0x04;
+    frame.blockMaxSize = size_t(1) << (8 + 2 * blockMaxCode);
+    return frame;
+}
+
+size_t lz4FrameBlockSize(const Lz4FrameDescriptor & frame, uint32_t sizeField)
+{
+    if (sizeField == 0)
+        return 0;
+    size_t size = sizeField & ~storedFlag;
+    if (size > frame.blockMaxSize)
+        malformed("block larger than the frame allows");
+    return size + (frame.blockChecksums ? 4 : 0);
+}
+
+void lz4DecompressFrameBlock(const Lz4FrameDescriptor & frame, uint32_t sizeField, string_view block, string & out,
+                             size_t history)
+{
+    if (frame.blockChecksums) {
+        if (block.size() < 4)
+            malformed("truncated block");
+        uint32_t checksum = read32(block.data() + block.size() - 4);
+        block.remove_suffix(4);
+        if (checksum != xxh32(block))
+            malformed("block checksum mismatch");
+    }
+    if (sizeField & storedFlag)
+        out += block;
+    else
+        lz4DecompressBlock(block, out, frame.blockMaxSize, history);
+}
+
+void lz4DecompressFrames(string_view frames, string & out)
+{
+    const char * p = frames.data();
+    const char * end = p + frames.size();
+    auto need = [&](size_t bytes) {
+        if (size_t(end - p) < bytes)
+            malformed("truncated frame");
+    };
+    while (p < end) {
+        need(4);
+        uint32_t magic = read32(p);
+        p += 4;
+        if (lz4IsSkippableMagic(magic)) {
+            need(4);
+            size_t size = read32(p);
+            need(4 + size);
+            p += 4 + size;
+            continue;
+        }
+        if (magic != lz4FrameMagic)
+            malformed("bad magic number");
+        need(1);
+        size_t descriptorSize = lz4DescriptorSize(*p);
+        need(descriptorSize);
+        Lz4FrameDescriptor frame = lz4ParseDescriptor(string_view(p, descriptorSize));
+        p += descriptorSize;
+
+        size_t frameStart = out.size();
+        for (;;) {
+            need(4);
+            uint32_t sizeField = read32(p);
+            p += 4;
+            size_t size = lz4FrameBlockSize(frame, sizeField);
+            if (size == 0)
+                break;
+            need(size);
+            lz4DecompressFrameBlock(frame, sizeField, string_view(p, size), out,
+                                    frame.independentBlocks ? 0 : out.size() - frameStart);
+            p += size;
+        }
+        if (frame.contentChecksum) {
+            need(4);
+            if (read32(p) != xxh32(string_view(out).substr(frameStart)))
+                malformed("content checksum mismatch");
+            p += 4;
+        }
+    }
+}
@@ -0,0 +1,335 @@
+#include "namehash.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HELLO_SIPHASH_AVX2 1
+#endif
+
+using namespace std;
+
+namespace {
+
+// Little-endian loads, as SipHash specifies and so hashes agree across hosts.
+inline uint64_t read64(const unsigned char * p)
+{
+    uint64_t v = 0;
+    if constexpr (endian::native == endian::little) {
+        memcpy(&v, p, sizeof v);
+    } else {
+        for (int i = 7; i >= 0; --i)
+            v = v << 8 | p[i];
+    }
+    return v;
+}
+
+inline uint64_t read32(const unsigned char * p)
+{
+    uint32_t v = 0;
+    if constexpr (endian::native == endian::little) {
+        memcpy(&v, p, sizeof v);
+    } else {
+        for (int i = 3; i >= 0; --i)
+            v = v << 8 | p[i];
+    }
+    return v;
+}
+
+// 64x64 -> 128-bit multiply; a and b become the low and high halves.
+inline void multiply(uint64_t & a, uint64_t & b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = __uint128_t(a) * b;
+    a = static_cast<uint64_t>(r);
+    b = static_cast<uint64_t>(r >> 64);
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = uint32_t(a), lb = uint32_t(b);
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t carry = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    carry += lo < t;
+    b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+    a = lo;
+#endif
+}
+
+inline uint64_t mix(uint64_t a, uint64_t b)
+{
+    multiply(a, b);
+    return a ^ b;
+}
+
+constexpr uint64_t secret[4] = {0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull,
+                                0x589965cc75374cc3ull};
+
+// wyhash's structure: names up to 16 bytes are two overlapping loads and a
+// single 128-bit multiply, longer ones fold 16 (or 48, in three independent
+// lanes) bytes per multiply.
+inline uint64_t fastHash(const unsigned char * p, size_t length, uint64_t seed)
+{
+    seed ^= mix(seed ^ secret[0], secret[1]);
+    uint64_t a, b;
+    if (length <= 16) {
+        if (length >= 4) {
+            size_t shift = (length >> 3) << 2;
+            a = read32(p) << 32 | read32(p + shift);
+            b = read32(p + length - 4) << 32 | read32(p + length - 4 - shift);
+        } else if (length > 0) {
+            a = uint64_t(p[0]) << 16 | uint64_t(p[length >> 1]) << 8 | p[length - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t left = length;
+        if (left > 48) {
+            uint64_t seed1 = seed, seed2 = seed;
+            do {
+                seed = mix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+                seed1 = mix(read64(p + 16) ^ secret[2], read64(p + 24) ^ seed1);
+                seed2 = mix(read64(p + 32) ^ secret[3], read64(p + 40) ^ seed2);
+                p += 48;
+                left -= 48;
+            } while (left > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (left > 16) {
+            seed = mix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+            p += 16;
+            left -= 16;
+        }
+        a = read64(p + left - 16);
+        b = read64(p + left - 8);
+    }
+    a ^= secret[1];
+    b ^= seed;
+    multiply(a, b);
+    return mix(a ^ secret[0] ^ length, b ^ secret[1]);
+}
+
+struct SipState
+{
+    uint64_t v0, v1, v2, v3;
+};
+
+inline SipState sipInit(const SipHashKey & key)
+{
+    return {key.k0 ^ 0x736f6d6570736575ull, key.k1 ^ 0x646f72616e646f6dull, key.k0 ^ 0x6c7967656e657261ull,
+            key.k1 ^ 0x7465646279746573ull};
+}
+
+inline void sipRound(SipState & s)
+{
+    s.v0 += s.v1;
+    s.v1 = rotl(s.v1, 13);
+    s.v1 ^= s.v0;
+    s.v0 = rotl(s.v0, 32);
+    s.v2 += s.v3;
+    s.v3 = rotl(s.v3, 16);
+    s.v3 ^= s.v2;
+    s.v0 += s.v3;
+    s.v3 = rotl(s.v3, 21);
+    s.v3 ^= s.v0;
+    s.v2 += s.v1;
+    s.v1 = rotl(s.v1, 17);
+    s.v1 ^= s.v2;
+    s.v2 = rotl(s.v2, 32);
+}
+
+inline void sipAbsorb(SipState & s, uint64_t m)
+{
+    s.v3 ^= m;
+    sipRound(s);
+    sipRound(s);
+    s.v0 ^= m;
+}
+
+inline uint64_t sipFinish(SipState & s)
+{
+    s.v2 ^= 0xff;
+    for (int i = 0; i < 4; ++i)
+        sipRound(s);
+    return s.v0 ^ s.v1 ^ s.v2 ^ s.v3;
+}
+
+// A message is length / 8 + 1 words: its whole 8-byte blocks, then the
+// bytes left over with the length in the top byte.
+inline size_t sipWords(size_t length) { return length / 8 + 1; }
+
+inline uint64_t sipWord(const unsigned char * p, size_t length, size_t j)
+{
+    if (j < length / 8)
+        return read64(p + 8 * j);
+    p += length & ~size_t(7);
+    uint64_t last = uint64_t(length) << 56;
+    for (size_t i = 0; i < (length & 7); ++i)
+        last |= uint64_t(p[i]) << (8 * i);
+    return last;
+}
+
+inline uint64_t sipHash(const unsigned char * p, size_t length, const SipHashKey & key)
+{
+    SipState s = sipInit(key);
+    const unsigned char * end = p + (length & ~size_t(7));
+    for (const unsigned char * block = p; block != end; block += 8)
+        sipAbsorb(s, read64(block));
+    sipAbsorb(s, sipWord(p, length, length / 8));
+    return sipFinish(s);
+}
+
+#ifdef HELLO_SIPHASH_AVX2
+
+// SipHash-2-4 on four messages at once, one per 64-bit AVX2 lane. AVX2 has
+// no 64-bit rotate: the 16- and 32-bit ones are byte shuffles, the others
+// two shifts and an or. Compiled for AVX2 whatever the build targets and
+// only called where the CPU has it.
+struct SipLanes
+{
+    __m256i v0, v1, v2, v3;
+};
+
+template <int bits>
+[[gnu::target("avx2")]] inline __m256i rotl4(__m256i x)
+{
+    if constexpr (bits == 32) {
+        return _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1));
+    } else if constexpr (bits == 16) {
+        const __m256i order = _mm256_setr_epi8(6, 7, 0, 1, 2, 3, 4, 5, 14, 15, 8, 9, 10, 11, 12, 13, 6, 7, 0, 1, 2,
+                                               3, 4, 5, 14, 15, 8, 9, 10, 11, 12, 13);
+        return _mm256_shuffle_epi8(x, order);
+    } else {
+        return _mm256_or_si256(_mm256_slli_epi64(x, bits), _mm256_srli_epi64(x, 64 - bits));
+    }
+}
+
+[[gnu::target("avx2")]] inline void sipRound(SipLanes & s)
+{
+    s.v0 = _mm256_add_epi64(s.v0, s.v1);
+    s.v1 = _mm256_xor_si256(rotl4<13>(s.v1), s.v0);
+    s.v0 = rotl4<32>(s.v0);
+    s.v2 = _mm256_add_epi64(s.v2, s.v3);
+    s.v3 = _mm256_xor_si256(rotl4<16>(s.v3), s.v2);
+    s.v0 = _mm256_add_epi64(s.v0, s.v3);
+    s.v3 = _mm256_xor_si256(rotl4<21>(s.v3), s.v0);
+    s.v2 = _mm256_add_epi64(s.v2, s.v1);
+    s.v1 = _mm256_xor_si256(rotl4<17>(s.v1), s.v2);
+    s.v2 = rotl4<32>(s.v2);
+}
+
+// The lanes run together for the words all four messages have. If their
+// word counts differ, the lanes are split and each finishes as scalar code.
+[[gnu::target("avx2")]] void sipHashLanes(const string_view * names, const SipHashKey & key, uint64_t * out)
+{
+    SipState init = sipInit(key);
+    SipLanes s{_mm256_set1_epi64x(int64_t(init.v0)), _mm256_set1_epi64x(int64_t(init.v1)),
+               _mm256_set1_epi64x(int64_t(init.v2)), _mm256_set1_epi64x(int64_t(init.v3))};
+    const unsigned char * p[4];
+    size_t words[4];
+    for (int i = 0; i < 4; ++i) {
+        p[i] = reinterpret_cast<const unsigned char *>(names[i].data());
+        words[i] = sipWords(names[i].size());
+    }
+    size_t common = min(min(words[0], words[1]), min(words[2], words[3]));
+    for (size_t j = 0; j < common; ++j) {
+        __m256i m = _mm256_setr_epi64x(
+            int64_t(sipWord(p[0], names[0].size(), j)), int64_t(sipWord(p[1], names[1].size(), j)),
+            int64_t(sipWord(p[2], names[2].size(), j)), int64_t(sipWord(p[3], names[3].size(), j)));
+        s.v3 = _mm256_xor_si256(s.v3, m);
+        sipRound(s);
+        sipRound(s);
+        s.v0 = _mm256_xor_si256(s.v0, m);
+    }
+    if (words[0] == common && words[1] == common && words[2] == common && words[3] == common) {
+        s.v2 = _mm256_xor_si256(s.v2, _mm256_set1_epi64x(0xff));
+        for (int i = 0; i < 4; ++i)
+            sipRound(s);
+        __m256i hash = _mm256_xor_si256(_mm256_xor_si256(s.v0, s.v1), _mm256_xor_si256(s.v2, s.v3));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), hash);
+        return;
+    }
+    alignas(32) uint64_t v[4][4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(v[0]), s.v0);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(v[1]), s.v1);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(v[2]), s.v2);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(v[3]), s.v3);
+    for (int i = 0; i < 4; ++i) {
+        SipState lane{v[0][i], v[1][i], v[2][i], v[3][i]};
+        for (size_t j = common; j < words[i]; ++j)
+            sipAbsorb(lane, sipWord(p[i], names[i].size(), j));
+        out[i] = sipFinish(lane);
+    }
+}
+
+bool haveAvx2()
+{
+    static const bool have = __builtin_cpu_supports("avx2");
+    return have;
+}
+
+#endif
+
+inline const unsigned char * bytes(string_view text) { return reinterpret_cast<const unsigned char *>(text.data()); }
+
+} // namespace
+
+uint64_t hashName(string_view name, uint64_t seed)
+{
+    return fastHash(bytes(name), name.size(), seed);
+}
+
+void hashNames(const vector<string_view> & names, vector<uint64_t> & hashes, uint64_t seed)
+{
+    // One pass with the kernel inlined: no call per name, and the hashes of
+    // neighbouring names are independent so their multiplies overlap. There
+    // are no SIMD lanes: neither SSE2 nor AVX2 has the 64x64 -> 128-bit
+    // multiply this hash is built on.
+    hashes.resize(names.size());
+    uint64_t * out = hashes.data();
+    for (string_view name : names)
+        *out++ = fastHash(bytes(name), name.size(), seed);
+}
+
+SipHashKey sipHashKey(const unsigned char bytes[16])
+{
+    return {read64(bytes), read64(bytes + 8)};
+}
+
+uint64_t sipHash24(string_view message, const SipHashKey & key)
+{
+    return sipHash(bytes(message), message.size(), key);
+}
+
+void sipHashNames(const vector<string_view> & names, const SipHashKey & key, vector<uint64_t> & hashes)
+{
+    hashes.resize(names.size());
+    uint64_t * out = hashes.data();
+    size_t i = 0;
+#ifdef HELLO_SIPHASH_AVX2
+    // Four names at a time, one per lane; the last few are hashed alone.
+    if (haveAvx2())
+        for (; i + 4 <= names.size(); i += 4)
+            sipHashLanes(names.data() + i, key, out + i);
+#endif
+    for (; i < names.size(); ++i)
+        out[i] = sipHash(bytes(names[i]), names[i].size(), key);
+}
+
+void pseudonymizeNames(vector<string_view> & names, const SipHashKey & key, string & storage)
+{
+    static constexpr char digits[] = "0123456789abcdef";
+    thread_local vector<uint64_t> hashes;
+    sipHashNames(names, key, hashes);
+    storage.resize(names.size() * 16);
+    char * out = storage.data();
+    for (size_t n = 0; n < names.size(); ++n) {
+        uint64_t hash = hashes[n];
+        for (int i = 15; i >= 0; --i, hash >>= 4)
+            out[i] = digits[hash & 15];
+        names[n] = string_view(out, 16);
+        out += 16;
+    }
+}
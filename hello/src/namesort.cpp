@@ -0,0 +1,429 @@
+#include "namesort.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t bucketCount = 257;          // the end of a name, then each byte value
+constexpr size_t quicksortThreshold = 64;    // smaller ranges use multikey quicksort
+constexpr size_t insertionThreshold = 12;    // smaller ranges use insertion sort
+constexpr size_t parallelThreshold = 1 << 16;
+
+using Counts = array<size_t, bucketCount>;
+
+// Bytes in the UTF-8 sequence that lead starts; 1 if lead cannot start one.
+size_t characterLength(uint8_t lead)
+{
+    if (lead < 0xc0)
+        return 1;
+    if (lead < 0xe0)
+        return 2;
+    if (lead < 0xf0)
+        return 3;
+    return lead < 0xf8 ? 4 : 1;
+}
+
+// The depth past the bytes that every name in [a, a + n) shares with
+// first. They are known to share those up to depth + 1.
+size_t sharedPrefixEnd(string_view first, const string_view * a, size_t n, size_t depth)
+{
+    size_t end = first.size();
+    for (size_t i = 0; i < n && end > depth + 1; ++i) {
+        size_t limit = min(end, a[i].size());
+        size_t j = depth + 1;
+        while (j < limit && a[i][j] == first[j])
+            ++j;
+        end = j;
+    }
+    return max(end, depth + 1);
+}
+
+// Runs body(0) .. body(threads - 1) concurrently, body(0) on the caller.
+template <typename Body>
+void runOnThreads(unsigned threads, Body body)
+{
+    vector<thread> workers;
+    try {
+        for (unsigned t = 1; t < threads; ++t)
+            workers.emplace_back(body, t);
+    } catch (...) {
+        for (thread & worker : workers)
+            worker.join();
+        throw;
+    }
+    body(0u);
+    for (thread & worker : workers)
+        worker.join();
+}
+
+class RadixSorter
+{
+public:
+    RadixSorter(vector<string_view> & names, unsigned threads, bool firstCharacter)
+        : names(names.data()), size(names.size()), threads(max(1u, threads)), firstCharacter(firstCharacter)
+    {
+    }
+
+    void sort()
+    {
+        if (size < 2)
+            return;
+        cache.reset(new uint64_t[size]);
+        if (!firstCharacter && size < quicksortThreshold) {
+            multikeyQuicksort(0, size, 0, noCache);
+            return;
+        }
+        scratch.reset(new string_view[size]);
+        cacheScratch.reset(new uint64_t[size]);
+        vector<Range> tasks;
+        if (threads > 1)
+            distributeInParallel({0, size, 0, noCache}, tasks);
+        else
+            tasks.push_back({0, size, 0, noCache});
+
+        // Biggest first, so that the last tasks to start are short ones.
+        std::sort(tasks.begin(), tasks.end(), [](const Range & a, const Range & b) { return a.size > b.size; });
+        atomic<size_t> next{0};
+        runOnThreads(min<size_t>(threads, tasks.size()), [&](unsigned) {
+            for (size_t i; (i = next++) < tasks.size();)
+                sortSequentially(tasks[i]);
+        });
+    }
+
+private:
+    static constexpr size_t noCache = SIZE_MAX;
+
+    // size names from begin sharing their first depth bytes, whose cache
+    // entries hold their bytes from cached on.
+    struct Range
+    {
+        size_t begin;
+        size_t size;
+        size_t depth;
+        size_t cached;
+    };
+
+    bool finished(const Range & range) const
+    {
+        if (range.size < 2)
+            return true;
+        // Past the first byte the names in a range share it.
+        return firstCharacter && range.depth > 0 &&
+               range.depth >= characterLength(uint8_t(names[range.begin][0]));
+    }
+
+    bool cacheCovers(const Range & range) const { return range.cached != noCache && range.depth < range.cached + 8; }
+
+    // Loads the cache of [from, to) of range from range.depth. This is the
+    // pass that reads the name bytes, scattered across memory once sorting
+    // is under way; up to seven distribution passes after it read only the
+    // cache, in order.
+    void loadCache(const Range & range, size_t from, size_t to) const
+    {
+        for (size_t i = range.begin + from; i < range.begin + to; ++i) {
+            string_view name = names[i];
+            uint64_t bytes = 0;
+            size_t count = range.depth < name.size() ? min<size_t>(8, name.size() - range.depth) : 0;
+            for (size_t j = 0; j < count; ++j)
+                bytes |= uint64_t(uint8_t(name[range.depth + j])) << (56 - 8 * j);
+            cache[i] = bytes;
+        }
+    }
+
+    // Name i's key at depth, from the cache if that holds the byte.
+    unsigned keyAt(size_t i, size_t depth, size_t cached) const
+    {
+        if (depth >= names[i].size())
+            return 0;
+        if (cached != noCache && depth < cached + 8)
+            return unsigned(uint8_t(cache[i] >> (56 - 8 * (depth - cached)))) + 1;
+        return unsigned(uint8_t(names[i][depth])) + 1;
+    }
+
+    // Whether name i sorts before name j. They share their first depth
+    // bytes.
+    bool before(size_t i, size_t j, size_t depth, size_t cached) const
+    {
+        string_view x = names[i], y = names[j];
+        if (cached != noCache && depth < cached + 8) {
+            // Past its end a name's cache is zero, so a name that ends
+            // differs from one that goes on with a byte above zero, and a
+            // tie within the cache where one has ended goes to the shorter.
+            unsigned shift = unsigned(8 * (depth - cached));
+            uint64_t cx = cache[i] << shift, cy = cache[j] << shift;
+            if (cx != cy)
+                return cx < cy;
+            depth = cached + 8;
+            if (x.size() < depth || y.size() < depth)
+                return x.size() < y.size();
+        }
+        return x.substr(depth) < y.substr(depth);
+    }
+
+    void swapNames(size_t i, size_t j) const
+    {
+        swap(names[i], names[j]);
+        swap(cache[i], cache[j]);
+    }
+
+    void insertionSort(size_t begin, size_t n, size_t depth, size_t cached) const
+    {
+        for (size_t i = begin + 1; i < begin + n; ++i)
+            for (size_t j = i; j > begin && before(j, j - 1, depth, cached); --j)
+                swapNames(j, j - 1);
+    }
+
+    // Bentley and Sedgewick's three-way radix quicksort, for the small
+    // ranges where counting 257 buckets costs more than it saves.
+    void multikeyQuicksort(size_t begin, size_t n, size_t depth, size_t cached) const
+    {
+        while (n > insertionThreshold) {
+            unsigned x = keyAt(begin, depth, cached), y = keyAt(begin + n / 2, depth, cached),
+                     z = keyAt(begin + n - 1, depth, cached);
+            unsigned pivot = max(min(x, y), min(max(x, y), z));
+            size_t less = begin, i = begin, greater = begin + n;
+            while (i < greater) {
+                unsigned key = keyAt(i, depth, cached);
+                if (key < pivot)
+                    swapNames(less++, i++);
+                else if (key > pivot)
+                    swapNames(i, --greater);
+                else
+                    ++i;
+            }
+            multikeyQuicksort(begin, less - begin, depth, cached);
+            multikeyQuicksort(greater, begin + n - greater, depth, cached);
+            if (pivot == 0)
+                return;   // the names equal to the pivot have all ended
+            begin = less;
+            n = greater - less;
+            ++depth;
+        }
+        insertionSort(begin, n, depth, cached);
+    }
+
+    void count(const Range & range, size_t from, size_t to, Counts & counts) const
+    {
+        counts.fill(0);
+        for (size_t i = range.begin + from; i < range.begin + to; ++i)
+            ++counts[keyAt(i, range.depth, range.cached)];
+    }
+
+    // Moves the names in [from, to) of range, with their cache entries, to
+    // offsets in scratch and advances the offsets.
+    void scatter(const Range & range, size_t from, size_t to, Counts & offsets) const
+    {
+        for (size_t i = range.begin + from; i < range.begin + to; ++i) {
+            size_t target = range.begin + offsets[keyAt(i, range.depth, range.cached)]++;
+            scratch[target] = names[i];
+            cacheScratch[target] = cache[i];
+        }
+    }
+
+    void copyBack(const Range & range, size_t from, size_t to) const
+    {
+        copy(&scratch[range.begin + from], &scratch[range.begin + to], names + range.begin + from);
+        copy(&cacheScratch[range.begin + from], &cacheScratch[range.begin + to], &cache[range.begin + from]);
+    }
+
+    // Pushes the buckets of range that still need sorting, at depth + 1.
+    static void pushBuckets(const Range & range, const Counts & counts, vector<Range> & out)
+    {
+        size_t begin = range.begin + counts[0];
+        for (size_t b = 1; b < bucketCount; ++b) {
+            if (counts[b] > 1)
+                out.push_back({begin, counts[b], range.depth + 1, range.cached});
+            begin += counts[b];
+        }
+    }
+
+    void sortSequentially(Range first)
+    {
+        vector<Range> pending{first};
+        Counts counts;
+        Counts offsets;
+        while (!pending.empty()) {
+            Range range = pending.back();
+            pending.pop_back();
+            if (finished(range))
+                continue;
+            // Not for grouping, which must keep input order.
+            if (!firstCharacter && range.size < quicksortThreshold) {
+                multikeyQuicksort(range.begin, range.size, range.depth, range.cached);
+                continue;
+            }
+            if (!cacheCovers(range)) {
+                loadCache(range, 0, range.size);
+                range.cached = range.depth;
+            }
+            count(range, 0, range.size, counts);
+            if (counts[0] == range.size)
+                continue;   // all ended, so all equal
+            if (counts[keyAt(range.begin, range.depth, range.cached)] == range.size) {
+                const string_view * a = names + range.begin;
+                range.depth = sharedPrefixEnd(a[0], a, range.size, range.depth);
+                pending.push_back(range);
+                continue;
+            }
+            for (size_t b = 0, sum = 0; b < bucketCount; sum += counts[b++])
+                offsets[b] = sum;
+            scatter(range, 0, range.size, offsets);
+            copyBack(range, 0, range.size);
+            pushBuckets(range, counts, pending);
+        }
+    }
+
+    // Distributes range with every thread counting and scattering a slice,
+    // for as long as its buckets are too big for one thread, and leaves the
+    // rest in tasks.
+    void distributeInParallel(Range range, vector<Range> & tasks)
+    {
+        vector<Counts> counts(threads);
+        vector<Counts> offsets(threads);
+        for (;;) {
+            if (finished(range))
+                return;
+            if (range.size < parallelThreshold || range.size * threads <= size) {
+                tasks.push_back(range);
+                return;
+            }
+            size_t slice = (range.size + threads - 1) / threads;
+            auto sliceOf = [&](unsigned t) {
+                return pair(min(range.size, t * slice), min(range.size, (t + 1) * slice));
+            };
+
+            if (!cacheCovers(range)) {
+                runOnThreads(threads, [&](unsigned t) {
+                    auto [from, to] = sliceOf(t);
+                    loadCache(range, from, to);
+                });
+                range.cached = range.depth;
+            }
+            runOnThreads(threads, [&](unsigned t) {
+                auto [from, to] = sliceOf(t);
+                count(range, from, to, counts[t]);
+            });
+            Counts total{};
+            for (const Counts & c : counts)
+                for (size_t b = 0; b < bucketCount; ++b)
+                    total[b] += c[b];
+            if (total[0] == range.size)
+                return;
+            if (total[keyAt(range.begin, range.depth, range.cached)] == range.size) {
+                const string_view * a = names + range.begin;
+                vector<size_t> ends(threads);
+                runOnThreads(threads, [&](unsigned t) {
+                    auto [from, to] = sliceOf(t);
+                    ends[t] = sharedPrefixEnd(a[0], a + from, to - from, range.depth);
+                });
+                range.depth = *min_element(ends.begin(), ends.end());
+                continue;
+            }
+            // Each thread's share of a bucket follows the earlier threads',
+            // so the scatter is stable.
+            for (size_t b = 0, sum = 0; b < bucketCount; ++b) {
+                for (unsigned t = 0; t < threads; ++t) {
+                    offsets[t][b] = sum;
+                    sum += counts[t][b];
+                }
+            }
+            runOnThreads(threads, [&](unsigned t) {
+                auto [from, to] = sliceOf(t);
+                scatter(range, from, to, offsets[t]);
+            });
+            runOnThreads(threads, [&](unsigned t) {
+                auto [from, to] = sliceOf(t);
+                copyBack(range, from, to);
+            });
+
+            vector<Range> buckets;
+            pushBuckets(range, total, buckets);
+            for (const Range & bucket : buckets)
+                distributeInParallel(bucket, tasks);
+            return;
+        }
+    }
+
+    string_view * names;
+    size_t size;
+    unsigned threads;
+    bool firstCharacter;
+    unique_ptr<string_view[]> scratch;
+    // Up to eight bytes of each name, big-endian from some depth, so most
+    // distribution passes need not touch the names' bytes.
+    unique_ptr<uint64_t[]> cache;
+    unique_ptr<uint64_t[]> cacheScratch;
+};
+
+} // namespace
+
+void sortNames(vector<string_view> & names, unsigned threads)
+{
+    RadixSorter(names, threads, false).sort();
+}
+
+void groupNamesByFirstCharacter(vector<string_view> & names, unsigned threads)
+{
+    RadixSorter(names, threads, true).sort();
+}
+
+LoserTree::LoserTree(const vector<optional<string_view>> & heads)
+    : ways(max<size_t>(1, heads.size())), names(ways), exhausted(ways, 1), tree(ways)
+{
+    for (size_t i = 0; i < heads.size(); ++i) {
+        if (heads[i]) {
+            names[i] = *heads[i];
+            exhausted[i] = 0;
+        }
+    }
+    // Leaves are the nodes [ways, 2 ways); play the matches bottom up,
+    // keeping each node's winner aside to pass up.
+    vector<size_t> winners(2 * ways);
+    for (size_t i = 0; i < ways; ++i)
+        winners[ways + i] = i;
+    for (size_t node = ways - 1; node > 0; --node) {
+        size_t a = winners[2 * node], b = winners[2 * node + 1];
+        winners[node] = beats(a, b) ? a : b;
+        tree[node] = beats(a, b) ? b : a;
+    }
+    tree[0] = ways == 1 ? 0 : winners[1];
+}
+
+void LoserTree::replace(string_view next)
+{
+    names[tree[0]] = next;
+    replay(tree[0]);
+}
+
+void LoserTree::exhaust()
+{
+    exhausted[tree[0]] = 1;
+    replay(tree[0]);
+}
+
+bool LoserTree::beats(size_t a, size_t b) const
+{
+    if (exhausted[a] || exhausted[b])
+        return !exhausted[a] || (exhausted[b] && a < b);
+    int order = names[a].compare(names[b]);
+    return order < 0 || (order == 0 && a < b);
+}
+
+void LoserTree::replay(size_t way)
+{
+    size_t winner = way;
+    for (size_t node = (ways + way) / 2; node > 0; node /= 2) {
+        if (beats(tree[node], winner))
+            swap(tree[node], winner);
+    }
+    tree[0] = winner;
+}
@@ -0,0 +1,452 @@
+#include "parquet.h"
+
+#include <algorithm>
+#include <bit>
+
+#include "lz4.h"
+#include "namehash.h"
+
+using namespace std;
+
+namespace {
+
+constexpr string_view magic = "PAR1";
+constexpr const char * columnNames[2] = {"name", "greeting"};
+
+// Thrift enum values from parquet.thrift.
+constexpr int32_t byteArrayType = 6;
+constexpr int32_t requiredRepetition = 0;
+constexpr int32_t utf8ConvertedType = 0;
+constexpr int32_t plainEncoding = 0;
+constexpr int32_t rleEncoding = 3;
+constexpr int32_t rleDictionaryEncoding = 8;
+constexpr int32_t uncompressedCodec = 0;
+constexpr int32_t lz4RawCodec = 7;
+constexpr int32_t dataPage = 0;
+constexpr int32_t dictionaryPage = 2;
+
+void putVarint(string & out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out += char(value | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+void putLength(string & out, size_t length)
+{
+    for (int i = 0; i < 4; ++i)
+        out += char(length >> (8 * i));
+}
+
+// Thrift's compact protocol, as much of it as page headers and the footer
+// need. Fields must be written in increasing id order within a struct.
+class CompactWriter
+{
+public:
+    static constexpr uint8_t i32Type = 5;
+    static constexpr uint8_t binaryType = 8;
+    static constexpr uint8_t structType = 12;
+
+    explicit CompactWriter(string & out) : out(out) {}
+
+    void i32(int16_t id, int32_t value)
+    {
+        field(id, i32Type);
+        i32Value(value);
+    }
+    void i64(int16_t id, int64_t value)
+    {
+        field(id, 6);
+        putVarint(out, zigzag(value));
+    }
+    void binary(int16_t id, string_view value)
+    {
+        field(id, binaryType);
+        binaryValue(value);
+    }
+    void beginStruct(int16_t id)
+    {
+        field(id, structType);
+        lastIds.push_back(0);
+    }
+    // Ends a struct field, a struct list element or, last, the outermost struct.
+    void endStruct()
+    {
+        out += char(0);
+        lastIds.pop_back();
+    }
+    void beginList(int16_t id, uint8_t elementType, size_t size)
+    {
+        field(id, 9);
+        if (size < 15) {
+            out += char(size << 4 | elementType);
+        } else {
+            out += char(0xf0 | elementType);
+            putVarint(out, size);
+        }
+    }
+    // List elements, without field headers.
+    void beginElement() { lastIds.push_back(0); }
+    void i32Value(int32_t value) { putVarint(out, zigzag(value)); }
+    void binaryValue(string_view value)
+    {
+        putVarint(out, value.size());
+        out += value;
+    }
+
+private:
+    static uint64_t zigzag(int64_t value) { return (uint64_t(value) << 1) ^ uint64_t(value >> 63); }
+
+    void field(int16_t id, uint8_t type)
+    {
+        int16_t & last = lastIds.back();
+        if (id > last && id - last <= 15) {
+            out += char((id - last) << 4 | type);
+        } else {
+            out += char(type);
+            putVarint(out, zigzag(id));
+        }
+        last = id;
+    }
+
+    string & out;
+    vector<int16_t> lastIds{0};
+};
+
+// values[0, count) in Parquet's RLE/bit-packed hybrid at bitWidth: eight or
+// more repeats as an RLE run, the rest bit-packed in groups of eight. The
+// last group is padded with zeros, which readers ignore past count.
+void encodeHybrid(const uint32_t * values, size_t count, int bitWidth, string & out)
+{
+    auto repeats = [&](size_t i, size_t limit) {
+        size_t n = 1;
+        while (n < limit && i + n < count && values[i + n] == values[i])
+            ++n;
+        return n;
+    };
+    size_t i = 0;
+    while (i < count) {
+        size_t run = repeats(i, count);
+        if (run >= 8) {
+            putVarint(out, uint64_t(run) << 1);
+            for (int b = 0; b < (bitWidth + 7) / 8; ++b)
+                out += char(values[i] >> (8 * b));
+            i += run;
+            continue;
+        }
+        size_t start = i;
+        size_t groups = 0;
+        do {
+            i = min(count, i + 8);
+            ++groups;
+        } while (i < count && groups < 63 && repeats(i, 8) < 8);
+        putVarint(out, groups << 1 | 1);
+        size_t at = out.size();
+        out.resize(at + groups * size_t(bitWidth));
+        char * p = out.data() + at;
+        uint64_t bits = 0;
+        int pending = 0;
+        for (size_t k = start; k < start + groups * 8; ++k) {
+            bits |= uint64_t(k < count ? values[k] : 0) << pending;
+            for (pending += bitWidth; pending >= 8; pending -= 8) {
+                *p++ = char(bits);
+                bits >>= 8;
+            }
+        }
+    }
+}
+
+} // namespace
+
+// One column of the row group being buffered: its values PLAIN encoded, as
+// they would be written without a dictionary, and while the distinct values
+// fit dictionaryBytes, the dictionary and each value's index into it.
+class ParquetColumn
+{
+public:
+    explicit ParquetColumn(const ParquetWriterConfig & config) : config(config), building(config.dictionary) {}
+
+    void add(string_view value)
+    {
+        putLength(plain, value.size());
+        plain += value;
+        ++rows;
+        if (building)
+            index(value);
+        if (plain.size() - pages.back().plainEnd >= config.pageBytes)
+            pages.push_back({rows, plain.size()});
+    }
+
+    // Bytes held, an estimate of the memory taken.
+    size_t bufferedBytes() const
+    {
+        return plain.size() + dictionary.size() + 4 * (entryOffsets.size() + indices.size()) + 8 * slots.size();
+    }
+
+    // Appends the column chunk's pages to out, at file offset offset, and
+    // starts the next row group's.
+    ParquetWriter::ChunkMeta write(string & out, uint64_t offset)
+    {
+        size_t entries = entryOffsets.size() - 1;
+        int bitWidth = max(1, int(bit_width(entries > 0 ? entries - 1 : 0)));
+        bool useDictionary = building && rows > 0 && dictionary.size() + rows * bitWidth / 8 < plain.size();
+        ParquetWriter::ChunkMeta meta{useDictionary, rows, 0, 0, 0, 0};
+        size_t start = out.size();
+        if (useDictionary) {
+            meta.dictionaryPageOffset = offset;
+            writePage(out, dictionaryPage, dictionary, entries, plainEncoding, meta);
+        }
+        meta.dataPageOffset = offset + (out.size() - start);
+        if (pages.back().rows < rows)
+            pages.push_back({rows, plain.size()});
+        for (size_t p = 1; p < pages.size(); ++p) {
+            uint64_t first = pages[p - 1].rows;
+            uint64_t count = pages[p].rows - first;
+            if (useDictionary) {
+                body.assign(1, char(bitWidth));
+                encodeHybrid(indices.data() + first, count, bitWidth, body);
+                writePage(out, dataPage, body, count, rleDictionaryEncoding, meta);
+            } else {
+                string_view values(plain.data() + pages[p - 1].plainEnd, pages[p].plainEnd - pages[p - 1].plainEnd);
+                writePage(out, dataPage, values, count, plainEncoding, meta);
+            }
+        }
+        meta.compressedSize = out.size() - start;
+        reset();
+        return meta;
+    }
+
+private:
+    struct Page
+    {
+        uint64_t rows;       // rows before the page ends
+        size_t plainEnd;
+    };
+
+    struct Slot
+    {
+        uint32_t entry;      // index + 1, 0 for an empty slot
+        uint32_t tag;        // high half of the value's hash
+    };
+
+    void index(string_view value)
+    {
+        if (slots.empty())
+            slots.assign(1024, Slot{0, 0});
+        uint64_t hash = hashName(value);
+        size_t mask = slots.size() - 1;
+        for (size_t s = size_t(hash) & mask;; s = (s + 1) & mask) {
+            Slot & slot = slots[s];
+            if (slot.entry == 0) {
+                uint32_t entry = uint32_t(entryOffsets.size() - 1);
+                slot = {entry + 1, uint32_t(hash >> 32)};
+                indices.push_back(entry);
+                putLength(dictionary, value.size());
+                dictionary += value;
+                entryOffsets.push_back(uint32_t(dictionary.size()));
+                if (dictionary.size() > config.dictionaryBytes)
+                    abandonDictionary();
+                else if (2 * entryOffsets.size() > slots.size())
+                    grow();
+                return;
+            }
+            if (slot.tag == uint32_t(hash >> 32) && entryValue(slot.entry - 1) == value) {
+                indices.push_back(slot.entry - 1);
+                return;
+            }
+        }
+    }
+
+    string_view entryValue(uint32_t entry) const
+    {
+        size_t begin = entryOffsets[entry] + 4;
+        return string_view(dictionary).substr(begin, entryOffsets[entry + 1] - begin);
+    }
+
+    void grow()
+    {
+        vector<Slot> old(slots.size() * 2, Slot{0, 0});
+        old.swap(slots);
+        size_t mask = slots.size() - 1;
+        for (uint32_t entry = 0; entry + 1 < entryOffsets.size(); ++entry) {
+            uint64_t hash = hashName(entryValue(entry));
+            size_t s = size_t(hash) & mask;
+            while (slots[s].entry != 0)
+                s = (s + 1) & mask;
+            slots[s] = {entry + 1, uint32_t(hash >> 32)};
+        }
+    }
+
+    // Too many distinct values: this row group's chunk is written PLAIN.
+    void abandonDictionary()
+    {
+        building = false;
+        string().swap(dictionary);
+        vector<uint32_t>(1, 0).swap(entryOffsets);
+        vector<Slot>().swap(slots);
+        vector<uint32_t>().swap(indices);
+    }
+
+    void writePage(string & out, int32_t type, string_view data, uint64_t values, int32_t encoding,
+                   ParquetWriter::ChunkMeta & meta)
+    {
+        string_view stored = data;
+        if (config.lz4) {
+            compressed.clear();
+            lz4CompressBlock(data, compressed);
+            stored = compressed;
+        }
+        size_t headerStart = out.size();
+        CompactWriter header(out);
+        header.i32(1, type);
+        header.i32(2, int32_t(data.size()));
+        header.i32(3, int32_t(stored.size()));
+        if (type == dataPage) {
+            header.beginStruct(5);
+            header.i32(1, int32_t(values));
+            header.i32(2, encoding);
+            header.i32(3, rleEncoding);
+            header.i32(4, rleEncoding);
+            header.endStruct();
+        } else {
+            header.beginStruct(7);
+            header.i32(1, int32_t(values));
+            header.i32(2, encoding);
+            header.endStruct();
+        }
+        header.endStruct();
+        meta.uncompressedSize += out.size() - headerStart + data.size();
+        out += stored;
+    }
+
+    void reset()
+    {
+        plain.clear();
+        rows = 0;
+        pages.assign(1, Page{0, 0});
+        building = config.dictionary;
+        dictionary.clear();
+        entryOffsets.assign(1, 0);
+        slots.clear();
+        indices.clear();
+    }
+
+    const ParquetWriterConfig & config;
+    string plain;
+    uint64_t rows = 0;
+    vector<Page> pages{Page{0, 0}};   // where each page ends, the first entry where the first begins
+    bool building;                    // keeping a dictionary
+    string dictionary;                // distinct values, PLAIN encoded
+    vector<uint32_t> entryOffsets{0}; // where each dictionary entry begins, and the end
+    vector<Slot> slots;               // open addressing over the entries, power-of-two sized
+    vector<uint32_t> indices;         // per value
+    string body;
+    string compressed;
+};
+
+ParquetWriter::ParquetWriter(ParquetWriterConfig config) : config(config)
+{
+    for (unique_ptr<ParquetColumn> & column : columns)
+        column = make_unique<ParquetColumn>(this->config);
+}
+
+ParquetWriter::~ParquetWriter() = default;
+
+string ParquetWriter::header() const { return string(magic); }
+
+void ParquetWriter::add(const vector<string_view> & names, const GreetingBatch & greetings, string & out)
+{
+    for (size_t i = 0; i < names.size(); ++i) {
+        columns[0]->add(names[i]);
+        columns[1]->add(greetings[i]);
+        ++bufferedRows;
+        ++rowCount;
+        if (columns[0]->bufferedBytes() + columns[1]->bufferedBytes() >= config.rowGroupBytes)
+            writeRowGroup(out);
+    }
+}
+
+void ParquetWriter::writeRowGroup(string & out)
+{
+    RowGroupMeta group{bufferedRows, nextOffset, {}};
+    size_t start = out.size();
+    for (int c = 0; c < 2; ++c)
+        group.columns[c] = columns[c]->write(out, nextOffset + (out.size() - start));
+    nextOffset += out.size() - start;
+    rowGroups.push_back(group);
+    bufferedRows = 0;
+}
+
+string ParquetWriter::trailer()
+{
+    string out;
+    if (bufferedRows > 0)
+        writeRowGroup(out);
+
+    string footer;
+    CompactWriter meta(footer);
+    meta.i32(1, 1);
+    meta.beginList(2, CompactWriter::structType, 3);
+    meta.beginElement();
+    meta.binary(4, "schema");
+    meta.i32(5, 2);
+    meta.endStruct();
+    for (const char * name : columnNames) {
+        meta.beginElement();
+        meta.i32(1, byteArrayType);
+        meta.i32(3, requiredRepetition);
+        meta.binary(4, name);
+        meta.i32(6, utf8ConvertedType);
+        meta.beginStruct(10);   // LogicalType, the STRING member
+        meta.beginStruct(1);
+        meta.endStruct();
+        meta.endStruct();
+        meta.endStruct();
+    }
+    meta.i64(3, int64_t(rowCount));
+    meta.beginList(4, CompactWriter::structType, rowGroups.size());
+    for (const RowGroupMeta & group : rowGroups) {
+        uint64_t uncompressed = 0;
+        uint64_t compressed = 0;
+        meta.beginElement();
+        meta.beginList(1, CompactWriter::structType, 2);
+        for (int c = 0; c < 2; ++c) {
+            const ChunkMeta & chunk = group.columns[c];
+            uncompressed += chunk.uncompressedSize;
+            compressed += chunk.compressedSize;
+            meta.beginElement();
+            meta.i64(2, int64_t(chunk.dictionary ? chunk.dictionaryPageOffset : chunk.dataPageOffset));
+            meta.beginStruct(3);
+            meta.i32(1, byteArrayType);
+            meta.beginList(2, CompactWriter::i32Type, chunk.dictionary ? 2 : 1);
+            meta.i32Value(plainEncoding);
+            if (chunk.dictionary)
+                meta.i32Value(rleDictionaryEncoding);
+            meta.beginList(3, CompactWriter::binaryType, 1);
+            meta.binaryValue(columnNames[c]);
+            meta.i32(4, config.lz4 ? lz4RawCodec : uncompressedCodec);
+            meta.i64(5, int64_t(chunk.values));
+            meta.i64(6, int64_t(chunk.uncompressedSize));
+            meta.i64(7, int64_t(chunk.compressedSize));
+            meta.i64(9, int64_t(chunk.dataPageOffset));
+            if (chunk.dictionary)
+                meta.i64(11, int64_t(chunk.dictionaryPageOffset));
+            meta.endStruct();
+            meta.endStruct();
+        }
+        meta.i64(2, int64_t(uncompressed));
+        meta.i64(3, int64_t(group.rows));
+        meta.i64(5, int64_t(group.offset));
+        meta.i64(6, int64_t(compressed));
+        meta.endStruct();
+    }
+    meta.binary(6, "hello greeting writer");
+    meta.endStruct();
+
+    out += footer;
+    putLength(out, footer.size());
+    out += magic;
+    return out;
+}
@@ -0,0 +1,141 @@
+#include "transliterate.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HELLO_HAVE_SSE2 1
+#endif
+
+using namespace std;
+
+namespace {
+
+#include "translittables.inc"
+
+// Decodes one UTF-8 sequence at text[i]. Returns the code point, or -1 for
+// an invalid sequence, and sets length to the bytes consumed (at least 1).
+int32_t decodeUtf8(string_view text, size_t i, size_t & length)
+{
+    unsigned char lead = text[i];
+    int32_t cp;
+    size_t needed;
+    int32_t minimum;
+    if (lead >= 0xc2 && lead <= 0xdf) {
+        cp = lead & 0x1f;
+        needed = 1;
+        minimum = 0x80;
+    } else if (lead >= 0xe0 && lead <= 0xef) {
+        cp = lead & 0x0f;
+        needed = 2;
+        minimum = 0x800;
+    } else if (lead >= 0xf0 && lead <= 0xf4) {
+        cp = lead & 0x07;
+        needed = 3;
+        minimum = 0x10000;
+    } else {
+        length = 1;
+        return -1;
+    }
+    if (text.size() - i <= needed) {
+        length = 1;
+        return -1;
+    }
+    for (size_t k = 1; k <= needed; ++k) {
+        unsigned char c = text[i + k];
+        if ((c & 0xc0) != 0x80) {
+            length = 1;
+            return -1;
+        }
+        cp = cp << 6 | (c & 0x3f);
+    }
+    if (cp < minimum || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) {
+        length = 1;
+        return -1;
+    }
+    length = needed + 1;
+    return cp;
+}
+
+void appendCodePoint(int32_t cp, string & out)
+{
+    if (cp < 0 || cp > 0xffff) {
+        out += '?';
+        return;
+    }
+    unsigned short entry = translitPages[translitPageIndex[cp >> translitPageBits]][cp & ((1 << translitPageBits) - 1)];
+    if (entry == 0xffff)
+        out += '?';
+    else
+        out.append(translitPool + (entry >> 3), entry & 7);
+}
+
+} // namespace
+
+size_t asciiPrefixLength(string_view text)
+{
+    const char * data = text.data();
+    size_t size = text.size();
+    size_t i = 0;
+#ifdef HELLO_HAVE_SSE2
+    for (; i + 16 <= size; i += 16) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+        if (mask != 0)
+            return i + countr_zero(static_cast<unsigned>(mask));
+    }
+#endif
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof word);
+        if (word & 0x8080808080808080ull)
+            break;
+    }
+    while (i < size && static_cast<unsigned char>(data[i]) < 0x80)
+        ++i;
+    return i;
+}
+
+void transliterateToAscii(string_view text, string & out)
+{
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t run = asciiPrefixLength(text.substr(i));
+        out.append(text.data() + i, run);
+        i += run;
+        // Non-ASCII runs tend to be short, so only go back to the vector
+        // scan after the next ASCII byte.
+        while (i < text.size() && static_cast<unsigned char>(text[i]) >= 0x80) {
+            size_t length;
+            appendCodePoint(decodeUtf8(text, i, length), out);
+            i += length;
+        }
+    }
+}
+
+string transliterateToAscii(string_view text)
+{
+    string out;
+    out.reserve(text.size());
+    transliterateToAscii(text, out);
+    return out;
+}
+
+void transliterateNames(vector<string_view> & names, string & storage)
+{
+    storage.clear();
+    // Views into storage are only taken once it has stopped growing.
+    vector<pair<size_t, size_t>> converted;
+    for (size_t n = 0; n < names.size(); ++n) {
+        if (asciiPrefixLength(names[n]) == names[n].size())
+            continue;
+        transliterateToAscii(names[n], storage);
+        converted.emplace_back(n, storage.size());
+    }
+    size_t start = 0;
+    for (auto [n, end] : converted) {
+        names[n] = string_view(storage).substr(start, end - start);
+        start = end;
+    }
+}
@@ -0,0 +1,156 @@
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "asynclog.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+std::string tempPath(const char * name) { return ::testing::TempDir() + name; }
+
+std::vector<std::string> readLines(const std::string & path)
+{
+    std::ifstream in(path);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(in, line);)
+        lines.push_back(line);
+    return lines;
+}
+
+// The message, after the timestamp and thread.
+std::string message(const std::string & line) { return line.substr(line.find("] ") + 2); }
+
+const LogFormat greetFormat("G {} -> {} in {} us");
+const LogFormat allTypesFormat("{} {} {} {} {} {} {}");
+const LogFormat sequenceFormat("thread {} record {}");
+
+}
+
+TEST(AsyncLogTests, testFormatsArguments) {
+    std::string path = tempPath("asynclog_format.log");
+    std::remove(path.c_str());
+    {
+        AsyncLog log({path});
+        log.write(greetFormat, std::string("Jim"), "Hello Jim", 42u);
+        log.write(allTypesFormat, -7, uint64_t(1) << 63, 2.5, true, 'x', std::string_view("view"), "extra {}");
+        log.write(greetFormat, "too few");
+        log.flush();
+        EXPECT_EQ(3u, log.stats().written);
+    }
+    std::vector<std::string> lines = readLines(path);
+    ASSERT_EQ(3u, lines.size());
+    EXPECT_EQ("G Jim -> Hello Jim in 42 us", message(lines[0]));
+    EXPECT_EQ("-7 9223372036854775808 2.5 true x view extra {}", message(lines[1]));
+    EXPECT_EQ("G too few -> {} in {} us", message(lines[2]));
+    // 2026-10-18 09:15:02.123456 [1]
+    EXPECT_EQ(' ', lines[0][10]);
+    EXPECT_EQ('.', lines[0][19]);
+    EXPECT_EQ(" [1] ", lines[0].substr(26, 5));
+    std::remove(path.c_str());
+}
+
+TEST(AsyncLogTests, testThreadsKeepTheirOrder) {
+    std::string path = tempPath("asynclog_threads.log");
+    std::remove(path.c_str());
+    constexpr int threads = 4, records = 20000;
+    AsyncLogConfig config{path};
+    config.overflow = LogOverflow::Block;
+    {
+        AsyncLog log(config);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < threads; ++t)
+            writers.emplace_back([&, t] {
+                for (int i = 0; i < records; ++i)
+                    log.write(sequenceFormat, t, i);
+            });
+        for (std::thread & writer : writers)
+            writer.join();
+        log.flush();
+        EXPECT_EQ(uint64_t(threads * records), log.stats().written);
+        EXPECT_EQ(0u, log.stats().dropped);
+    }
+    std::vector<int> next(threads, 0);
+    for (const std::string & line : readLines(path)) {
+        int t = -1, i = -1;
+        ASSERT_EQ(2, std::sscanf(message(line).c_str(), "thread %d record %d", &t, &i));
+        ASSERT_EQ(next[t]++, i);
+    }
+    EXPECT_EQ(std::vector<int>(threads, records), next);
+    std::remove(path.c_str());
+}
+
+TEST(AsyncLogTests, testFullRingDropsAndReports) {
+    std::string path = tempPath("asynclog_drop.log");
+    std::remove(path.c_str());
+    AsyncLogConfig config{path};
+    config.ringSize = 1 << 14;
+    config.pollInterval = std::chrono::hours(1);   // drained only by flush()
+    AsyncLogStats stats;
+    {
+        AsyncLog log(config);
+        log.flush();
+        for (int i = 0; i < 10000; ++i)
+            log.write(sequenceFormat, 0, i);
+        log.flush();
+        stats = log.stats();
+    }
+    EXPECT_GT(stats.dropped, 0u);
+    EXPECT_EQ(10000u, stats.written + stats.dropped);
+    std::vector<std::string> lines = readLines(path);
+    ASSERT_EQ(stats.written + 1, lines.size());
+    EXPECT_EQ("dropped " + std::to_string(stats.dropped) + " log records", message(lines.back()));
+    std::remove(path.c_str());
+}
+
+TEST(AsyncLogTests, testRecordsOfExitedThreadsAreWritten) {
+    std::string path = tempPath("asynclog_exited.log");
+    std::remove(path.c_str());
+    {
+        AsyncLog log({path});
+        for (int t = 0; t < 50; ++t)
+            std::thread([&] { log.write(sequenceFormat, t, 0); }).join();
+        log.flush();
+        log.flush();   // retires the rings the first one drained
+        EXPECT_EQ(50u, log.stats().written);
+    }
+    EXPECT_EQ(50u, readLines(path).size());
+    std::remove(path.c_str());
+}
+
+TEST(AsyncLogTests, testDestroyedLogIsUninstalled) {
+    std::string path = tempPath("asynclog_uninstalled.log");
+    std::remove(path.c_str());
+    {
+        AsyncLog log({path});
+        processLog = &log;
+        logEvent(sequenceFormat, 1, 2);
+    }
+    EXPECT_EQ(nullptr, processLog.load());
+    logEvent(sequenceFormat, 3, 4);
+    EXPECT_EQ(1u, readLines(path).size());
+    std::remove(path.c_str());
+}
+
+TEST(AsyncLogTests, testFlushesOnCrash) {
+    std::string path = tempPath("asynclog_crash.log");
+    std::remove(path.c_str());
+    auto crash = [&] {
+        AsyncLogConfig config{path};
+        config.pollInterval = std::chrono::hours(1);
+        static AsyncLog * log = new AsyncLog(config);
+        log->flushOnCrash();
+        log->write(greetFormat, "Jim", "Hello Jim", 1);
+        std::abort();
+    };
+    EXPECT_EXIT(crash(), ::testing::KilledBySignal(SIGABRT), "");
+    std::vector<std::string> lines = readLines(path);
+    ASSERT_EQ(1u, lines.size());
+    EXPECT_EQ("G Jim -> Hello Jim in 1 us", message(lines[0]));
+    std::remove(path.c_str());
+}
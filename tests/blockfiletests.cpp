@@ -0,0 +1,127 @@
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "blockfile.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+std::string tempPath(const char * name) { return ::testing::TempDir() + name; }
+
+// Writes greetings for names in batches of batchSize through the same calls
+// main uses, as if each batch came from a different worker.
+void writeBlockFile(const std::string & path, const std::vector<std::string> & names, size_t batchSize,
+                    uint32_t blockSize)
+{
+    std::ofstream out(path, std::ios::binary);
+    BlockFileIndex index(blockSize);
+    out << index.header();
+    for (size_t begin = 0; begin < names.size(); begin += batchSize) {
+        std::vector<std::string_view> batch(names.begin() + begin,
+                                            names.begin() + std::min(names.size(), begin + batchSize));
+        GreetingBatch greetings;
+        generateHelloStrings(batch, greetings);
+        std::string encoded;
+        std::vector<GreetingBlock> blocks;
+        encodeGreetingBlocks(greetings, blockSize, encoded, blocks);
+        index.add(blocks);
+        out << encoded;
+    }
+    out << index.trailer();
+}
+
+std::vector<std::string> makeNames(size_t count)
+{
+    std::vector<std::string> names;
+    for (size_t i = 0; i < count; ++i)
+        names.push_back("name " + std::to_string(i) + std::string(i % 300, 'x'));
+    return names;
+}
+
+} // namespace
+
+TEST(BlockFileTests, testCrc32cCheckValues) {
+    EXPECT_EQ(0u, crc32c(""));
+    EXPECT_EQ(0xe3069283u, crc32c("123456789"));
+    EXPECT_EQ(0x8a9136aau, crc32c(std::string(32, '\0')));
+    EXPECT_EQ(crc32c("123456789"), crc32c("6789", crc32c("12345")));
+}
+
+TEST(BlockFileTests, testEveryRowReadsBack) {
+    std::string path = tempPath("blockfile_rows.hgb");
+    std::vector<std::string> names = makeNames(5000);
+    writeBlockFile(path, names, 777, 4096);
+
+    BlockFileReader reader(path);
+    ASSERT_EQ(names.size(), reader.rows());
+    EXPECT_GT(reader.blocks(), names.size() / 777);
+    for (size_t i = 0; i < names.size(); i += 7)
+        ASSERT_EQ(generateHelloString(names[i]), reader.row(i)) << i;
+    EXPECT_EQ(generateHelloString(names.back()), reader.row(names.size() - 1));
+    EXPECT_THROW(reader.row(names.size()), std::out_of_range);
+    std::remove(path.c_str());
+}
+
+TEST(BlockFileTests, testGreetingLongerThanABlock) {
+    std::string path = tempPath("blockfile_long.hgb");
+    std::vector<std::string> names = {"a", std::string(10000, 'b'), "c"};
+    writeBlockFile(path, names, 3, 256);
+    BlockFileReader reader(path);
+    EXPECT_EQ(3u, reader.blocks());
+    EXPECT_EQ("Hello " + names[1], reader.row(1));
+    EXPECT_EQ("Hello c", reader.row(2));
+    std::remove(path.c_str());
+}
+
+TEST(BlockFileTests, testEmptyFile) {
+    std::string path = tempPath("blockfile_empty.hgb");
+    writeBlockFile(path, {}, 1, 4096);
+    BlockFileReader reader(path);
+    EXPECT_EQ(0u, reader.rows());
+    EXPECT_EQ(0u, reader.blocks());
+    EXPECT_THROW(reader.row(0), std::out_of_range);
+    std::remove(path.c_str());
+}
+
+TEST(BlockFileTests, testCorruptionIsDetected) {
+    std::string path = tempPath("blockfile_corrupt.hgb");
+    std::vector<std::string> names = makeNames(2000);
+    writeBlockFile(path, names, 2000, 4096);
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), {});
+    }
+    auto rewrite = [&](const std::string & contents) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << contents;
+    };
+
+    // A flipped byte in the first block fails reads from that block only.
+    std::string flipped = bytes;
+    flipped[100] ^= 1;
+    rewrite(flipped);
+    {
+        BlockFileReader reader(path);
+        EXPECT_THROW(reader.row(0), std::runtime_error);
+        EXPECT_EQ(generateHelloString(names.back()), reader.row(names.size() - 1));
+    }
+
+    // A file cut short, as by an interrupted writer, has no footer.
+    rewrite(bytes.substr(0, bytes.size() - 1));
+    EXPECT_THROW(BlockFileReader reader(path), std::runtime_error);
+
+    // A damaged index is caught on open.
+    std::string badIndex = bytes;
+    badIndex[badIndex.size() - 60] ^= 1;
+    rewrite(badIndex);
+    EXPECT_THROW(BlockFileReader reader(path), std::runtime_error);
+
+    rewrite("not a block file at all, but long enough to have a footer");
+    EXPECT_THROW(BlockFileReader reader(path), std::runtime_error);
+    std::remove(path.c_str());
+    EXPECT_THROW(BlockFileReader reader(path), std::system_error);
+}
@@ -0,0 +1,244 @@
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "chunkreader.h"
+#include "csv.h"
+#include "inputstream.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Byte at a time: what the 64-byte block scanner must agree with.
+size_t referenceRecordsEnd(std::string_view data, size_t from, bool & inQuotes)
+{
+    size_t end = 0;
+    for (size_t i = from; i < data.size(); ++i) {
+        if (data[i] == '"')
+            inQuotes = !inQuotes;
+        else if (data[i] == '\n' && !inQuotes)
+            end = i + 1;
+    }
+    return end;
+}
+
+// A well-formed CSV text and, for the column chosen, the names split()
+// must return and how many records it must skip.
+struct GeneratedCsv
+{
+    std::string text;
+    std::vector<std::string> names;
+    size_t skipped = 0;
+};
+
+std::string randomValue(std::mt19937 & random, char delimiter, bool quoted)
+{
+    static const char plain[] = "abcXYZ 019";
+    std::string value;
+    size_t length = random() % 12;
+    for (size_t i = 0; i < length; ++i) {
+        unsigned pick = random() % 16;
+        if (quoted && pick == 0)
+            value += '"';
+        else if (quoted && pick == 1)
+            value += '\n';
+        else if (quoted && pick == 2)
+            value += delimiter;
+        else if (quoted && pick == 3)
+            value += "\r\n";
+        else
+            value += plain[random() % (sizeof plain - 1)];
+    }
+    return value;
+}
+
+std::string quote(const std::string & value)
+{
+    std::string field = "\"";
+    for (char c : value) {
+        field += c;
+        if (c == '"')
+            field += '"';
+    }
+    return field + '"';
+}
+
+GeneratedCsv generateCsv(std::mt19937 & random, size_t records, size_t columns, size_t column, char delimiter)
+{
+    GeneratedCsv csv;
+    for (size_t r = 0; r < records; ++r) {
+        unsigned kind = random() % 10;
+        if (kind == 0) {
+            csv.text += random() % 2 ? "\r\n" : "\n";
+            ++csv.skipped;
+            continue;
+        }
+        size_t fields = kind == 1 ? 1 + random() % columns : columns;
+        std::string record;
+        std::string name;
+        for (size_t f = 0; f < fields; ++f) {
+            bool quoted = random() % 3 == 0;
+            std::string value = randomValue(random, delimiter, quoted);
+            if (f)
+                record += delimiter;
+            record += quoted ? quote(value) : value;
+            if (f == column)
+                name = value;
+        }
+        bool newline = r + 1 < records || random() % 2;
+        csv.text += record;
+        if (newline)
+            csv.text += random() % 2 ? "\r\n" : "\n";
+        // An empty record is a blank line, or nothing at all at the end.
+        if (record.empty())
+            csv.skipped += newline;
+        else if (fields <= column)
+            ++csv.skipped;
+        else
+            csv.names.push_back(name);
+    }
+    return csv;
+}
+
+std::vector<std::string> split(const CsvColumn & column, std::string_view records, size_t & skipped)
+{
+    std::vector<std::string_view> views;
+    std::string storage;
+    skipped = column.split(records, views, storage);
+    return std::vector<std::string>(views.begin(), views.end());
+}
+
+// The chunks a ChunkReader cuts text into.
+std::vector<std::string> readChunks(const std::string & text, size_t chunkSize)
+{
+    FILE * file = std::tmpfile();
+    std::fwrite(text.data(), 1, text.size(), file);
+    std::rewind(file);
+    std::vector<std::string> chunks;
+    {
+        InputStream in(file, "csv", 1);
+        ChunkReader reader(in, chunkSize, true);
+        std::string chunk;
+        while (reader.next(chunk))
+            chunks.push_back(chunk);
+    }
+    std::fclose(file);
+    return chunks;
+}
+
+}
+
+TEST(CsvTests, testRecordsEndMatchesReferenceAcrossBlocks) {
+    std::mt19937 random(1);
+    const char alphabet[] = "\"\"\n,ab\r";
+    for (int run = 0; run < 2000; ++run) {
+        std::string data(random() % 300, 'x');
+        for (char & c : data)
+            c = alphabet[random() % (sizeof alphabet - 1)];
+        size_t from = data.empty() ? 0 : random() % (data.size() + 1);
+        bool startQuoted = random() % 2;
+        bool expectedQuotes = startQuoted;
+        bool inQuotes = startQuoted;
+        size_t expected = referenceRecordsEnd(data, from, expectedQuotes);
+        ASSERT_EQ(expected, findCsvRecordsEnd(data, from, inQuotes)) << "run " << run;
+        ASSERT_EQ(expectedQuotes, inQuotes) << "run " << run;
+    }
+}
+
+TEST(CsvTests, testQuotedFieldStraddlingEveryBlockEdge) {
+    CsvColumn column("2", ',', false);
+    for (size_t pad = 0; pad < 140; ++pad) {
+        std::string text = std::string(pad, 'p') + ",\"a,\"\"b\"\"\nc\r\nd\",tail\n" + "x,\"\"\"\"\r\n";
+        size_t skipped = 0;
+        std::vector<std::string> names = split(column, text, skipped);
+        ASSERT_EQ(2u, names.size()) << "pad " << pad;
+        EXPECT_EQ("a,\"b\"\nc\r\nd", names[0]) << "pad " << pad;
+        EXPECT_EQ("\"", names[1]) << "pad " << pad;
+        EXPECT_EQ(0u, skipped);
+        bool inQuotes = false;
+        EXPECT_EQ(text.size(), findCsvRecordsEnd(text, 0, inQuotes));
+        EXPECT_FALSE(inQuotes);
+    }
+}
+
+TEST(CsvTests, testSplitMatchesGeneratedRecords) {
+    std::mt19937 random(2);
+    for (char delimiter : {',', ';', '\t', '|'}) {
+        for (int run = 0; run < 200; ++run) {
+            size_t columns = 1 + random() % 4;
+            size_t index = random() % columns;
+            GeneratedCsv csv = generateCsv(random, random() % 40, columns, index, delimiter);
+            CsvColumn column(std::to_string(index + 1), delimiter, false);
+            size_t skipped = 0;
+            std::vector<std::string> names = split(column, csv.text, skipped);
+            ASSERT_EQ(csv.names, names) << "delimiter " << delimiter << ", run " << run;
+            EXPECT_EQ(csv.skipped, skipped);
+        }
+    }
+}
+
+TEST(CsvTests, testBlankAndShortRecordsAreSkipped) {
+    CsvColumn column("2", ',', false);
+    size_t skipped = 0;
+    std::vector<std::string> names = split(column, "a,b\n\nc\r\n\r\nd,e,f\ng", skipped);
+    EXPECT_EQ((std::vector<std::string>{"b", "e"}), names);
+    EXPECT_EQ(4u, skipped);
+
+    CsvColumn first("1", ',', false);
+    names = split(first, "\n\r\n,x\n\"\"\n", skipped);
+    EXPECT_EQ((std::vector<std::string>{"", ""}), names);
+    EXPECT_EQ(2u, skipped);
+}
+
+TEST(CsvTests, testHeaderSelectsTheColumn) {
+    CsvColumn column("name", ';', true);
+    std::string chunk = "id;\"na\nme\";name\r\n1;x;Jim\n";
+    column.takeHeader(chunk);
+    EXPECT_EQ("1;x;Jim\n", chunk);
+    size_t skipped = 0;
+    EXPECT_EQ((std::vector<std::string>{"Jim"}), split(column, chunk, skipped));
+
+    CsvColumn missing("name", ',', true);
+    std::string other = "id,age\n1,2\n";
+    EXPECT_THROW(missing.takeHeader(other), std::runtime_error);
+}
+
+TEST(CsvTests, testBadDelimitersAndColumns) {
+    for (char delimiter : {'\0', '"', '\n', '\r'})
+        EXPECT_THROW(CsvColumn("1", delimiter, false), std::invalid_argument) << int(delimiter);
+    EXPECT_THROW(CsvColumn("0", ',', false), std::invalid_argument);
+    EXPECT_THROW(CsvColumn("name", ',', false), std::invalid_argument);
+    EXPECT_NO_THROW(CsvColumn("name", ',', true));
+}
+
+TEST(CsvTests, testChunkReaderResumesInsideQuotes) {
+    std::mt19937 random(3);
+    for (int run = 0; run < 60; ++run) {
+        GeneratedCsv csv = generateCsv(random, 50 + random() % 100, 3, 1, ',');
+        CsvColumn column("2", ',', false);
+        for (size_t chunkSize : {1, 7, 63, 64, 65, 200, 1 << 16}) {
+            std::vector<std::string> chunks = readChunks(csv.text, chunkSize);
+            std::string joined;
+            std::vector<std::string> names;
+            size_t skipped = 0;
+            for (const std::string & chunk : chunks) {
+                // Every chunk but the last ends on a newline outside quotes.
+                bool inQuotes = false;
+                if (&chunk != &chunks.back()) {
+                    ASSERT_EQ(chunk.size(), referenceRecordsEnd(chunk, 0, inQuotes)) << "chunk size " << chunkSize;
+                }
+                joined += chunk;
+                size_t chunkSkipped = 0;
+                for (std::string & name : split(column, chunk, chunkSkipped))
+                    names.push_back(std::move(name));
+                skipped += chunkSkipped;
+            }
+            ASSERT_EQ(csv.text, joined) << "chunk size " << chunkSize;
+            ASSERT_EQ(csv.names, names) << "chunk size " << chunkSize;
+            EXPECT_EQ(csv.skipped, skipped);
+        }
+    }
+}
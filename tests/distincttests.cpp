@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "distinct.h"
+#include "hello.h"
+#include "lz4.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+std::string tempPath(const char * name) { return ::testing::TempDir() + name; }
+
+// count distinct names, each given once in order and then repeated at
+// random among the others.
+std::vector<std::string> makeNames(size_t count, std::vector<std::string> & distinct)
+{
+    std::mt19937_64 random(8);
+    distinct.clear();
+    for (size_t i = 0; i < count; ++i)
+        distinct.push_back("n" + std::to_string(random() >> 24));
+    std::sort(distinct.begin(), distinct.end());
+    distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+    std::vector<std::string> names;
+    for (size_t i = 0; i < distinct.size(); ++i) {
+        names.push_back(distinct[i]);
+        names.push_back(distinct[random() % (i + 1)]);
+    }
+    return names;
+}
+
+std::string joinLines(const std::vector<std::string> & names)
+{
+    std::string text;
+    for (const std::string & name : names)
+        text += name + "\n";
+    return text;
+}
+
+void writeFile(const std::string & path, const std::string & data)
+{
+    std::ofstream(path, std::ios::binary) << data;
+}
+
+std::vector<std::string> readLines(const std::string & path)
+{
+    std::ifstream in(path);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(in, line);)
+        lines.push_back(line);
+    return lines;
+}
+
+size_t openFiles()
+{
+    return std::distance(std::filesystem::directory_iterator("/proc/self/fd"), std::filesystem::directory_iterator());
+}
+
+Options spillingOptions(const std::string & spillDir)
+{
+    std::filesystem::remove_all(spillDir);
+    std::filesystem::create_directories(spillDir);
+    Options options;
+    options.distinct = true;
+    options.chunkSize = 16 << 10;
+    options.memoryBudget = 512 << 10;
+    options.spillDir = spillDir;
+    return options;
+}
+
+}
+
+TEST(DistinctTests, testSpillingOverSeveralLevelsGreetsEachNameOnce) {
+    std::vector<std::string> distinct;
+    std::vector<std::string> names = makeNames(200000, distinct);
+    std::string input = tempPath("distinct_input.txt");
+    writeFile(input, joinLines(names));
+    std::string spillDir = tempPath("distinct_spill");
+
+    for (unsigned threads : {1u, 2u}) {
+        Options options = spillingOptions(spillDir);
+        options.inputPath = input;
+        options.outputPath = tempPath("distinct_output.txt");
+        options.threads = threads;
+        options.memoryBudget *= threads;
+        RunStats stats;
+        size_t filesBefore = openFiles();
+        runDistinct(options, stats);
+
+        // The first overflow spills into 16 partitions at this budget; more
+        // files mean partitions overflowed and were partitioned again.
+        EXPECT_GT(stats.spillFiles.load(), 16u) << threads << " threads";
+        EXPECT_EQ(distinct.size(), stats.distinctNames.load());
+        std::vector<std::string> lines = readLines(options.outputPath);
+        std::sort(lines.begin(), lines.end());
+        std::vector<std::string> expected;
+        for (const std::string & name : distinct)
+            expected.push_back(generateHelloString(name));
+        std::sort(expected.begin(), expected.end());
+        ASSERT_EQ(expected.size(), lines.size()) << threads << " threads";
+        EXPECT_TRUE(expected == lines) << threads << " threads";
+
+        EXPECT_EQ(filesBefore, openFiles());
+        EXPECT_TRUE(std::filesystem::is_empty(spillDir));
+        std::remove(options.outputPath.c_str());
+    }
+    std::remove(input.c_str());
+    std::filesystem::remove_all(spillDir);
+}
+
+TEST(DistinctTests, testSpillFilesAreReleasedOnError) {
+    std::vector<std::string> distinct;
+    std::string text = joinLines(makeNames(100000, distinct));
+    // Independent blocks of 16K, the last one cut short: the input fails
+    // only after everything before it has been read and spilled.
+    std::string frame = lz4FrameHeader();
+    for (size_t at = 0; at < text.size(); at += 16 << 10)
+        lz4CompressFrameBlocks(std::string_view(text).substr(at, 16 << 10), frame);
+    frame.resize(frame.size() - 100);
+    std::string input = tempPath("distinct_truncated.lz4");
+    writeFile(input, frame);
+    std::string spillDir = tempPath("distinct_spill_error");
+
+    Options options = spillingOptions(spillDir);
+    options.inputPath = input;
+    options.outputPath = tempPath("distinct_error_output.txt");
+    options.threads = 1;
+    RunStats stats;
+    size_t filesBefore = openFiles();
+    EXPECT_THROW(runDistinct(options, stats), std::runtime_error);
+    EXPECT_GT(stats.spillFiles.load(), 0u);
+    EXPECT_EQ(filesBefore, openFiles());
+    EXPECT_TRUE(std::filesystem::is_empty(spillDir));
+
+    std::remove(input.c_str());
+    std::remove(options.outputPath.c_str());
+    std::filesystem::remove_all(spillDir);
+}
+
+TEST(DistinctTests, testBudgetTooSmallIsRejected) {
+    Options options = spillingOptions(tempPath("distinct_spill_small"));
+    std::string input = tempPath("distinct_small.txt");
+    writeFile(input, "Jim\n");
+    options.inputPath = input;
+    options.outputPath = tempPath("distinct_small_output.txt");
+    options.memoryBudget = 64 << 10;
+    RunStats stats;
+    EXPECT_THROW(runDistinct(options, stats), std::invalid_argument);
+    std::remove(input.c_str());
+    std::remove(options.outputPath.c_str());
+    std::filesystem::remove_all(options.spillDir);
+}
@@ -0,0 +1,149 @@
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+
+#include <signal.h>
+
+#include "follow.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+std::string tempPath(const char * name) { return ::testing::TempDir() + name; }
+
+std::string readFile(const std::string & path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string & path, const std::string & data, std::ios::openmode mode = std::ios::trunc)
+{
+    std::ofstream(path, std::ios::binary | std::ios::out | mode) << data;
+}
+
+// Waits up to ten seconds for path to hold expected.
+bool waitForContents(const std::string & path, const std::string & expected)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (readFile(path) != expected) {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+// runFollow on a thread of its own until stop(), which sends SIGTERM the
+// way a shell would. SIGTERM is blocked here first, so that it can only
+// arrive through runFollow's signalfd.
+class FollowRun
+{
+public:
+    explicit FollowRun(const Options & options)
+    {
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, &savedMask);
+        follower = std::thread([this, options] {
+            try {
+                runFollow(options, stats);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        });
+    }
+
+    ~FollowRun()
+    {
+        if (follower.joinable())
+            stop();
+        pthread_sigmask(SIG_SETMASK, &savedMask, nullptr);
+    }
+
+    void stop()
+    {
+        kill(getpid(), SIGTERM);
+        follower.join();
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    RunStats stats;
+
+private:
+    sigset_t savedMask;
+    std::thread follower;
+    std::exception_ptr error;
+};
+
+}
+
+TEST(FollowTests, testAppendTruncateReplaceAndResume) {
+    std::string input = tempPath("follow_input.txt");
+    std::string output = tempPath("follow_output.txt");
+    std::string state = tempPath("follow_state");
+    std::remove(state.c_str());
+    writeFile(input, "a\nb\n");
+
+    Options options;
+    options.inputPath = input;
+    options.outputPath = output;
+    options.follow = true;
+    options.followState = state;
+    options.threads = 1;
+    {
+        FollowRun run(options);
+        ASSERT_TRUE(waitForContents(output, "Hello a\nHello b\n"));
+
+        // A record is greeted once its newline arrives.
+        writeFile(input, "c\npart", std::ios::app);
+        ASSERT_TRUE(waitForContents(output, "Hello a\nHello b\nHello c\n"));
+        writeFile(input, "ial\n", std::ios::app);
+        ASSERT_TRUE(waitForContents(output, "Hello a\nHello b\nHello c\nHello partial\n"));
+
+        // Truncated in place and rewritten shorter: reread from the start.
+        writeFile(input, "d\n");
+        ASSERT_TRUE(waitForContents(output, "Hello a\nHello b\nHello c\nHello partial\nHello d\n"));
+
+        // Replaced by a rename: the old file's unterminated record is
+        // complete, and the new file is read from its start.
+        writeFile(input, "old", std::ios::app);
+        std::string replacement = input + ".new";
+        writeFile(replacement, "e\n");
+        std::filesystem::rename(replacement, input);
+        ASSERT_TRUE(waitForContents(output, "Hello a\nHello b\nHello c\nHello partial\nHello d\nHello old\nHello e\n"));
+        run.stop();
+        EXPECT_EQ(7u, run.stats.records.load());
+    }
+
+    // Appended to while stopped: a new run picks up after the last record
+    // greeted.
+    writeFile(input, "f\n", std::ios::app);
+    {
+        FollowRun run(options);
+        ASSERT_TRUE(waitForContents(output, "Hello f\n"));
+        run.stop();
+    }
+
+    // Replaced while stopped: the saved position is for another file, so
+    // the new one is read from its start.
+    std::string replacement = input + ".new";
+    writeFile(replacement, "g\nh\n");
+    std::filesystem::rename(replacement, input);
+    {
+        FollowRun run(options);
+        ASSERT_TRUE(waitForContents(output, "Hello g\nHello h\n"));
+        run.stop();
+    }
+
+    std::remove(input.c_str());
+    std::remove(output.c_str());
+    std::remove(state.c_str());
+}
@@ -0,0 +1,983 @@
+// Differential fuzzing of every way the library renders a greeting against
+// the reference, generateHelloString: the batch renderer, greeting rules
+// that reproduce the plain greeting, the C interface with and without
+// transliteration, GreetingService single, batch, coalesced and bulk
+// requests, and the batch forms of transliteration and name hashing
+// against their single-name forms. The other fast paths the greetings pass
+// through are checked on the same input: the CSV and JSON Lines block
+// scanners against byte-at-a-time references, and LZ4 and block file
+// encoding against their decoders. Any difference aborts with the name and
+// both outputs.
+//
+// Names are read and greetings written against inaccessible guard pages
+// (mmap with PROT_NONE), ending exactly at the page edge or starting right
+// after one, so a vectorized path that reads or writes a byte out of bounds
+// faults even without a sanitizer.
+//
+// An input is two control bytes, then names separated by newlines; the
+// whole rest after the control bytes is also greeted as one name, newlines
+// and all, and scanned as CSV and JSON Lines records. Built with -DHELLO_LIBFUZZER=ON this is a libFuzzer target;
+// otherwise it is a program that replays the files and directories given,
+// such as a corpus or a crash reproducer, or without files runs names of
+// boundary lengths in several byte mixes and then random inputs.
+//
+// usage: GreetingFuzzer [FILE|DIR]...
+//        GreetingFuzzer [--runs N] [--seed S]
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "blockfile.h"
+#include "csv.h"
+#include "greetingrules.h"
+#include "greetingservice.h"
+#include "hello.h"
+#include "hello_c.h"
+#include "jsonl.h"
+#include "lz4.h"
+#include "namehash.h"
+#include "transliterate.h"
+
+using namespace std;
+
+namespace {
+
+constexpr size_t maxServiceNames = 64;   // greet() calls per input, to keep inputs fast
+
+string printable(string_view bytes)
+{
+    string out = "\"";
+    for (unsigned char c : bytes) {
+        if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\') {
+            out += char(c);
+        } else {
+            char escaped[8];
+            snprintf(escaped, sizeof escaped, "\\x%02x", c);
+            out += escaped;
+        }
+    }
+    return out + "\"";
+}
+
+void expectSame(const char * path, string_view name, string_view expected, string_view got)
+{
+    if (expected == got)
+        return;
+    fprintf(stderr, "GreetingFuzzer: %s differs for name %s (%zu bytes)\n  expected %s\n  got      %s\n", path,
+            printable(name).c_str(), name.size(), printable(expected).c_str(), printable(got).c_str());
+    abort();
+}
+
+void expectTrue(const char * path, bool condition, const char * what)
+{
+    if (condition)
+        return;
+    fprintf(stderr, "GreetingFuzzer: %s: %s\n", path, what);
+    abort();
+}
+
+// Memory with an inaccessible page on either side, reused across inputs.
+// Bytes placed at the end of it fault on the first read past them; bytes
+// placed at the start fault on the first read before them.
+class GuardedBuffer
+{
+public:
+    GuardedBuffer() = default;
+    GuardedBuffer(const GuardedBuffer &) = delete;
+    GuardedBuffer & operator=(const GuardedBuffer &) = delete;
+    ~GuardedBuffer()
+    {
+#ifndef _WIN32
+        if (base)
+            munmap(base, mapped);
+#endif
+    }
+
+    char * atEnd(size_t size) { return room(size) + usable - size; }
+    char * atStart(size_t size) { return room(size); }
+
+    string_view copyAtEnd(string_view bytes) { return copy(atEnd(bytes.size()), bytes); }
+    string_view copyAtStart(string_view bytes) { return copy(atStart(bytes.size()), bytes); }
+
+private:
+    static string_view copy(char * at, string_view bytes)
+    {
+        if (!bytes.empty())
+            memcpy(at, bytes.data(), bytes.size());
+        return string_view(at, bytes.size());
+    }
+
+#ifndef _WIN32
+    char * room(size_t size)
+    {
+        size_t page = size_t(sysconf(_SC_PAGESIZE));
+        if (!base || size > usable) {
+            if (base)
+                munmap(base, mapped);
+            usable = max(page, (size + page - 1) / page * page);
+            mapped = usable + 2 * page;
+            void * mapping = mmap(nullptr, mapped, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            expectTrue("GuardedBuffer", mapping != MAP_FAILED, "mmap failed");
+            base = static_cast<char *>(mapping);
+            expectTrue("GuardedBuffer", mprotect(base + page, usable, PROT_READ | PROT_WRITE) == 0,
+                       "mprotect failed");
+        }
+        return base + page;
+    }
+
+    char * base = nullptr;
+    size_t mapped = 0;
+#else
+    // No guard pages; out of bounds accesses go unnoticed.
+    char * room(size_t size)
+    {
+        if (size > usable) {
+            usable = size;
+            memory.assign(usable, '\0');
+        }
+        return memory.data();
+    }
+
+    string memory;
+#endif
+    size_t usable = 0;
+};
+
+struct Input
+{
+    size_t batchSplit = 1;           // generateHelloStrings is called on runs of this many names
+    size_t offsetBase = 0;           // leading bytes before the names in the C API buffer
+    unsigned mode = 0;               // the first control byte, which also picks scanner settings
+    string_view text;                // everything after the control bytes
+    vector<string_view> names;       // views into the input
+};
+
+Input parseInput(const uint8_t * data, size_t size)
+{
+    Input input;
+    if (size > 0) {
+        input.batchSplit = 1 + data[0] % 17;
+        input.mode = data[0];
+    }
+    if (size > 1)
+        input.offsetBase = data[1];
+    string_view rest(reinterpret_cast<const char *>(data) + min<size_t>(size, 2), size - min<size_t>(size, 2));
+    input.text = rest;
+    for (size_t begin = 0;;) {
+        size_t end = rest.find('\n', begin);
+        input.names.push_back(rest.substr(begin, end == string_view::npos ? string_view::npos : end - begin));
+        if (end == string_view::npos)
+            break;
+        begin = end + 1;
+    }
+    if (input.names.size() > 1)
+        input.names.push_back(rest);
+    return input;
+}
+
+// The names back to back in one guarded buffer, the last ending at the
+// guard page (or the first starting at it), viewed in place.
+vector<string_view> guardedNames(const vector<string_view> & names, GuardedBuffer & buffer, bool atEnd)
+{
+    size_t total = 0;
+    for (string_view name : names)
+        total += name.size();
+    char * p = atEnd ? buffer.atEnd(total) : buffer.atStart(total);
+    vector<string_view> views;
+    for (string_view name : names) {
+        if (!name.empty())
+            memcpy(p, name.data(), name.size());
+        views.emplace_back(p, name.size());
+        p += name.size();
+    }
+    return views;
+}
+
+void checkBatchRenderer(const Input & input, const vector<string> & expected, GuardedBuffer & names)
+{
+    for (bool atEnd : {true, false}) {
+        vector<string_view> views = guardedNames(input.names, names, atEnd);
+        GreetingBatch whole;
+        generateHelloStrings(views, whole);
+        expectTrue("generateHelloStrings", whole.size() == views.size(), "wrong number of greetings");
+        for (size_t i = 0; i < views.size(); ++i)
+            expectSame("generateHelloStrings", views[i], expected[i], whole[i]);
+    }
+
+    // Runs of batchSplit names appended to a batch that already holds one.
+    GreetingBatch appended;
+    generateHelloStrings({"earlier"}, appended);
+    for (size_t begin = 0; begin < input.names.size(); begin += input.batchSplit) {
+        vector<string_view> run(input.names.begin() + begin,
+                                input.names.begin() + min(input.names.size(), begin + input.batchSplit));
+        generateHelloStrings(run, appended);
+    }
+    expectSame("generateHelloStrings appending", "earlier", "Hello earlier", appended[0]);
+    for (size_t i = 0; i < input.names.size(); ++i)
+        expectSame("generateHelloStrings appending", input.names[i], expected[i], appended[i + 1]);
+}
+
+string escapeTemplate(string_view text)
+{
+    string out;
+    for (char c : text) {
+        out += c;
+        if (c == '{' || c == '}')
+            out += c;
+    }
+    return out;
+}
+
+// Rules taken from the input's own names, with templates that give back the
+// plain greeting, so matching names still have a reference: a prefix of
+// one name, a suffix of another and a third name exactly.
+void checkRules(const Input & input, const vector<string> & expected, GuardedBuffer & names)
+{
+    vector<string_view> candidates;
+    for (string_view name : input.names)
+        if (!name.empty() && candidates.size() < 3)
+            candidates.push_back(name);
+    if (candidates.empty())
+        return;
+    vector<GreetingRule> rules;
+    string prefix(candidates[0].substr(0, 3));
+    rules.push_back({RuleKind::Prefix, prefix, "Hello " + escapeTemplate(prefix) + "{rest}"});
+    if (candidates.size() > 1) {
+        string suffix(candidates[1].substr(candidates[1].size() - min<size_t>(2, candidates[1].size())));
+        rules.push_back({RuleKind::Suffix, suffix, "Hello {rest}" + escapeTemplate(suffix)});
+    }
+    if (candidates.size() > 2)
+        rules.push_back({RuleKind::Exact, string(candidates[2]), "Hello {name}"});
+    GreetingRules compiled(rules);
+
+    for (size_t i = 0; i < input.names.size(); ++i) {
+        string_view name = names.copyAtEnd(input.names[i]);
+        expectSame("GreetingRules::greet", name, expected[i], compiled.greet(name));
+        name = names.copyAtStart(input.names[i]);
+        expectSame("GreetingRules::greet", name, expected[i], compiled.greet(name));
+    }
+    vector<string_view> views = guardedNames(input.names, names, true);
+    GreetingBatch batch;
+    compiled.greet(views, batch);
+    for (size_t i = 0; i < views.size(); ++i)
+        expectSame("GreetingRules::greet batch", views[i], expected[i], batch[i]);
+}
+
+void checkCApi(const Input & input, uint32_t flags, const vector<string> & expected, GuardedBuffer & names,
+               GuardedBuffer & out)
+{
+    const char * path = flags & HELLO_TRANSLITERATE ? "hello_greet_batch transliterating" : "hello_greet_batch";
+    size_t total = input.offsetBase;
+    for (string_view name : input.names)
+        total += name.size();
+    char * buffer = names.atEnd(total);
+    vector<uint64_t> offsets{input.offsetBase};
+    for (string_view name : input.names) {
+        if (!name.empty())
+            memcpy(buffer + offsets.back(), name.data(), name.size());
+        offsets.push_back(offsets.back() + name.size());
+    }
+    size_t count = input.names.size();
+    uint64_t required = 0;
+    expectTrue(path, hello_greetings_size(buffer, offsets.data(), count, flags, &required) == HELLO_OK,
+               "hello_greetings_size failed");
+    size_t expectedBytes = 0;
+    for (const string & greeting : expected)
+        expectedBytes += greeting.size();
+    expectTrue(path, required == expectedBytes, "hello_greetings_size disagrees with the greetings");
+
+    // The size pass again with the buffer starting at a guard page, for a
+    // transliteration that reads before a name.
+    char * early = names.atStart(total);
+    memmove(early, buffer, total);
+    uint64_t earlyRequired = 0;
+    expectTrue(path,
+               hello_greetings_size(early, offsets.data(), count, flags, &earlyRequired) == HELLO_OK &&
+                   earlyRequired == expectedBytes,
+               "hello_greetings_size disagrees with the greetings");
+    buffer = names.atEnd(total);
+    for (size_t i = 0; i < count; ++i)
+        if (!input.names[i].empty())
+            memcpy(buffer + offsets[i], input.names[i].data(), input.names[i].size());
+
+    vector<uint64_t> outOffsets(count + 1);
+    if (required > 0) {
+        uint64_t reported = 0;
+        hello_status status = hello_greet_batch(buffer, offsets.data(), count, flags, out.atEnd(size_t(required) - 1),
+                                                required - 1, outOffsets.data(), &reported);
+        expectTrue(path, status == HELLO_BUFFER_TOO_SMALL && reported == required, "a short buffer was accepted");
+    }
+    char * greetings = out.atEnd(size_t(required));
+    expectTrue(path,
+               hello_greet_batch(buffer, offsets.data(), count, flags, greetings, required, outOffsets.data(),
+                                 nullptr) == HELLO_OK,
+               "hello_greet_batch failed");
+    expectTrue(path, outOffsets[0] == 0 && outOffsets[count] == required, "bad greeting offsets");
+    for (size_t i = 0; i < count; ++i)
+        expectSame(path, input.names[i], expected[i],
+                   string_view(greetings + outOffsets[i], size_t(outOffsets[i + 1] - outOffsets[i])));
+
+    for (size_t i = 0; i < count; ++i) {
+        string_view name = names.copyAtEnd(input.names[i]);
+        size_t length = 0;
+        char * single = out.atEnd(expected[i].size());
+        expectTrue("hello_greet",
+                   hello_greet(name.data(), name.size(), flags, single, expected[i].size(), &length) == HELLO_OK,
+                   "hello_greet failed");
+        expectSame("hello_greet", name, expected[i], string_view(single, length));
+    }
+}
+
+void checkTransliteration(const Input & input, GuardedBuffer & names)
+{
+    vector<string> reference;
+    for (size_t i = 0; i < input.names.size(); ++i) {
+        string_view name = names.copyAtEnd(input.names[i]);
+        reference.push_back(transliterateToAscii(name));
+        size_t ascii = 0;
+        while (ascii < name.size() && static_cast<unsigned char>(name[ascii]) < 0x80)
+            ++ascii;
+        expectTrue("asciiPrefixLength", asciiPrefixLength(name) == ascii, "wrong length");
+        name = names.copyAtStart(input.names[i]);
+        expectTrue("asciiPrefixLength", asciiPrefixLength(name) == ascii, "wrong length");
+        expectSame("transliterateToAscii", name, reference.back(), transliterateToAscii(name));
+    }
+    vector<string_view> views = guardedNames(input.names, names, true);
+    string storage = "stale";
+    transliterateNames(views, storage);
+    for (size_t i = 0; i < views.size(); ++i)
+        expectSame("transliterateNames", input.names[i], reference[i], views[i]);
+}
+
+void checkHashes(const Input & input, GuardedBuffer & names)
+{
+    vector<string_view> views = guardedNames(input.names, names, true);
+    vector<uint64_t> hashes;
+    hashNames(views, hashes, 7);
+    SipHashKey key{0x0706050403020100ull, 0x0f0e0d0c0b0a0908ull};
+    vector<uint64_t> sipHashes;
+    sipHashNames(views, key, sipHashes);
+    for (size_t i = 0; i < views.size(); ++i) {
+        expectTrue("hashNames", hashes[i] == hashName(views[i], 7), "batch and single hashes differ");
+        expectTrue("sipHashNames", sipHashes[i] == sipHash24(views[i], key), "batch and single hashes differ");
+    }
+}
+
+// CSV byte at a time, for the block scanners to agree with: a quote flips
+// the quoted state, and delimiters and newlines outside quotes end fields.
+size_t referenceCsvRecordsEnd(string_view data, size_t from, bool & inQuotes)
+{
+    size_t end = 0;
+    for (size_t i = from; i < data.size(); ++i) {
+        if (data[i] == '"')
+            inQuotes = !inQuotes;
+        else if (data[i] == '\n' && !inQuotes)
+            end = i + 1;
+    }
+    return end;
+}
+
+string referenceCsvValue(string_view field, bool endsRecord)
+{
+    if (endsRecord && !field.empty() && field.back() == '\r')
+        field.remove_suffix(1);
+    if (field.empty() || field.front() != '"')
+        return string(field);
+    field.remove_prefix(1);
+    if (!field.empty() && field.back() == '"')
+        field.remove_suffix(1);
+    string value;
+    for (size_t i = 0; i < field.size(); ++i) {
+        value += field[i];
+        if (field[i] == '"' && i + 1 < field.size() && field[i + 1] == '"')
+            ++i;
+    }
+    return value;
+}
+
+size_t referenceCsvSplit(string_view records, char delimiter, size_t index, vector<string> & names)
+{
+    size_t field = 0;
+    size_t start = 0;
+    size_t skipped = 0;
+    auto endField = [&](size_t end, bool endsRecord) {
+        string_view text = records.substr(start, end - start);
+        if (endsRecord && field == 0 && (text.empty() || text == "\r"))
+            ++skipped;
+        else if (field == index)
+            names.push_back(referenceCsvValue(text, endsRecord));
+        else if (endsRecord && field < index)
+            ++skipped;
+        field = endsRecord ? 0 : field + 1;
+        start = end + 1;
+    };
+    bool inQuotes = false;
+    for (size_t i = 0; i < records.size(); ++i) {
+        if (records[i] == '"')
+            inQuotes = !inQuotes;
+        else if (!inQuotes && (records[i] == delimiter || records[i] == '\n'))
+            endField(i, records[i] == '\n');
+    }
+    if (start < records.size() || field > 0)
+        endField(records.size(), true);
+    return skipped;
+}
+
+void checkCsv(const Input & input, GuardedBuffer & text)
+{
+    static const char delimiters[] = ",;\t|";
+    char delimiter = delimiters[input.offsetBase % 4];
+    size_t index = input.mode % 4;
+    vector<string> expected;
+    size_t expectedSkipped = referenceCsvSplit(input.text, delimiter, index, expected);
+    CsvColumn column(to_string(index + 1), delimiter, false);
+    for (bool atEnd : {true, false}) {
+        string_view records = atEnd ? text.copyAtEnd(input.text) : text.copyAtStart(input.text);
+        size_t from = input.offsetBase % (records.size() + 1);
+        bool inQuotes = input.mode & 0x80;
+        bool expectedQuotes = inQuotes;
+        size_t expectedEnd = referenceCsvRecordsEnd(records, from, expectedQuotes);
+        expectTrue("findCsvRecordsEnd", findCsvRecordsEnd(records, from, inQuotes) == expectedEnd,
+                   "differs from the byte-at-a-time scan");
+        expectTrue("findCsvRecordsEnd", inQuotes == expectedQuotes, "wrong quote state at the end");
+
+        vector<string_view> names;
+        string storage;
+        expectTrue("CsvColumn::split", column.split(records, names, storage) == expectedSkipped,
+                   "wrong number of records skipped");
+        expectTrue("CsvColumn::split", names.size() == expected.size(), "wrong number of names");
+        for (size_t i = 0; i < names.size(); ++i)
+            expectSame("CsvColumn::split", input.text, expected[i], names[i]);
+    }
+}
+
+// splitJsonl byte at a time: the same record checks as its parser, driven
+// by a walk that tracks strings and escapes one byte after another rather
+// than with bitmasks over 64-byte blocks.
+class JsonlReference
+{
+public:
+    // As splitJsonl with records, which skips those with a reserved member.
+    JsonlReference(string_view text, string_view field, string_view reserved)
+        : text(text), field(field), reserved(reserved)
+    {
+    }
+
+    size_t split(vector<string> & names, vector<string> & records)
+    {
+        size_t skipped = 0;
+        auto finish = [&](size_t end) {
+            if (!closed && depth == 0 && !bad && blank(begin, end))
+                return;
+            if (bad || !found || !closed || !blank(closedAt + 1, end)) {
+                ++skipped;
+                return;
+            }
+            names.push_back(value);
+            records.push_back(string(text.substr(begin, closedAt + 1 - begin)));
+        };
+        start(0);
+        bool inString = false;
+        bool escaped = false;
+        for (size_t i = 0; i < text.size(); ++i) {
+            unsigned char c = text[i];
+            bool isEscaped = escaped;
+            escaped = c == '\\' && !isEscaped;
+            if (c == '"' && !isEscaped) {
+                inString = !inString;
+            } else if (c == '\n') {
+                bad |= inString;
+                inString = false;
+                finish(i);
+                start(i + 1);
+            } else if (c < 0x20) {
+                bad |= inString;
+            } else if (!inString && (c == '{' || c == '}' || c == '[' || c == ']' || c == ':')) {
+                token(i, char(c));
+            }
+        }
+        bad |= inString;
+        finish(text.size());
+        return skipped;
+    }
+
+private:
+    void start(size_t at)
+    {
+        begin = at;
+        kinds.clear();
+        depth = 0;
+        closed = false;
+        found = false;
+        bad = false;
+    }
+
+    void token(size_t at, char c)
+    {
+        if (bad)
+            return;
+        if (closed) {
+            bad = true;
+        } else if (c == ':') {
+            if (depth == 1 && (!found || !reserved.empty()))
+                member(at);
+        } else if (c == '{' || c == '[') {
+            if ((depth == 0 && (c != '{' || !blank(begin, at))) || depth == 256) {
+                bad = true;
+            } else {
+                kinds.resize(++depth + 1);
+                kinds[depth] = c;
+            }
+        } else if (depth == 0 || (kinds[depth] == '{') != (c == '}')) {
+            bad = true;
+        } else if (--depth == 0) {
+            closed = true;
+            closedAt = at;
+        }
+    }
+
+    bool blank(size_t from, size_t to) const
+    {
+        for (size_t i = from; i < to; ++i)
+            if (text[i] != ' ' && text[i] != '\t' && text[i] != '\r')
+                return false;
+        return true;
+    }
+
+    // A JSON string's contents unescaped, or false if an escape is bad.
+    static bool unescape(string_view raw, string & out)
+    {
+        auto hex4 = [&](size_t at, uint32_t & value) {
+            if (at + 4 > raw.size())
+                return false;
+            value = 0;
+            for (size_t i = at; i < at + 4; ++i) {
+                char c = raw[i];
+                int digit = c >= '0' && c <= '9' ? c - '0'
+                            : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                            : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                                   : -1;
+                if (digit < 0)
+                    return false;
+                value = value << 4 | digit;
+            }
+            return true;
+        };
+        static const string_view simple = "\"\"\\\\//b\bf\fn\nr\rt\t";
+        for (size_t i = 0; i < raw.size(); ++i) {
+            if (raw[i] != '\\') {
+                out += raw[i];
+                continue;
+            }
+            if (++i == raw.size())
+                return false;
+            if (raw[i] != 'u') {
+                size_t at = simple.find(raw[i]);
+                if (at == string_view::npos || at % 2)
+                    return false;
+                out += simple[at + 1];
+                continue;
+            }
+            uint32_t c;
+            if (!hex4(i + 1, c) || (c >= 0xdc00 && c <= 0xdfff))
+                return false;
+            i += 4;
+            if (c >= 0xd800 && c <= 0xdbff) {
+                uint32_t low;
+                if (i + 2 >= raw.size() || raw[i + 1] != '\\' || raw[i + 2] != 'u' || !hex4(i + 3, low) ||
+                    low < 0xdc00 || low > 0xdfff)
+                    return false;
+                i += 6;
+                c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+            }
+            int extra = c < 0x80 ? 0 : c < 0x800 ? 1 : c < 0x10000 ? 2 : 3;
+            static const unsigned char lead[] = {0x00, 0xc0, 0xe0, 0xf0};
+            out += char(lead[extra] | c >> (6 * extra));
+            for (int shift = 6 * (extra - 1); shift >= 0; shift -= 6)
+                out += char(0x80 | (c >> shift & 0x3f));
+        }
+        return true;
+    }
+
+    // A colon at depth 1: its key, looked for backwards, and if that is the
+    // field, its value, which must be a string.
+    void member(size_t colon)
+    {
+        size_t close = colon;
+        while (close > begin && blank(close - 1, close))
+            --close;
+        if (close == begin || text[--close] != '"') {
+            bad |= !found;
+            return;
+        }
+        size_t open = close;
+        for (;;) {
+            if (open == begin) {
+                bad |= !found;
+                return;
+            }
+            if (text[--open] != '"')
+                continue;
+            size_t backslashes = 0;
+            while (open - backslashes > begin && text[open - backslashes - 1] == '\\')
+                ++backslashes;
+            if (backslashes % 2 == 0)
+                break;
+        }
+        string key;
+        bool validKey = unescape(text.substr(open + 1, close - open - 1), key);
+        if (validKey && !reserved.empty() && key == reserved) {
+            bad = true;
+            return;
+        }
+        if (found || !validKey || key != field)
+            return;   // another member, or a key with a bad escape, which is no match
+
+        size_t start = colon + 1;
+        while (start < text.size() && blank(start, start + 1))
+            ++start;
+        if (start == text.size() || text[start] != '"') {
+            bad = true;
+            return;
+        }
+        size_t end = ++start;
+        for (; end < text.size() && text[end] != '"' && text[end] != '\n'; ++end)
+            if (text[end] == '\\')
+                ++end;
+        if (end >= text.size() || text[end] != '"') {
+            bad = true;
+            return;
+        }
+        found = true;
+        value.clear();
+        bad = !unescape(text.substr(start, end - start), value);
+    }
+
+    string_view text;
+    string_view field;
+    string_view reserved;
+    size_t begin = 0;
+    string kinds;   // the open bracket at each depth
+    size_t depth = 0;
+    bool closed = false;
+    size_t closedAt = 0;
+    bool found = false;
+    string value;
+    bool bad = false;
+};
+
+void checkJsonl(const Input & input, GuardedBuffer & text)
+{
+    vector<string> expected;
+    vector<string> expectedRecords;
+    size_t expectedSkipped = JsonlReference(input.text, "name", greetingMember).split(expected, expectedRecords);
+    for (bool atEnd : {true, false}) {
+        string_view chunk = atEnd ? text.copyAtEnd(input.text) : text.copyAtStart(input.text);
+        vector<string_view> names;
+        vector<string_view> records;
+        string storage = "stale";
+        expectTrue("splitJsonl", splitJsonl(chunk, "name", names, &records, storage) == expectedSkipped,
+                   "wrong number of records skipped");
+        expectTrue("splitJsonl", names.size() == expected.size() && records.size() == expected.size(),
+                   "wrong number of names");
+        for (size_t i = 0; i < names.size(); ++i) {
+            expectSame("splitJsonl", input.text, expected[i], names[i]);
+            expectSame("splitJsonl record", input.text, expectedRecords[i], records[i]);
+        }
+    }
+}
+
+// The input compressed as an LZ4 block and frame and decoded again, each
+// read from against a guard page; and the input itself decoded as a block
+// and as frames, which must fail cleanly if it does not decode.
+void checkLz4(const Input & input, GuardedBuffer & buffer)
+{
+    for (bool atEnd : {true, false}) {
+        string_view data = atEnd ? buffer.copyAtEnd(input.text) : buffer.copyAtStart(input.text);
+        string block;
+        lz4CompressBlock(data, block);
+        string frame = lz4FrameHeader();
+        lz4CompressFrameBlocks(data, frame);
+        frame += lz4FrameEnd();
+
+        string decoded = "before";
+        lz4DecompressBlock(atEnd ? buffer.copyAtEnd(block) : buffer.copyAtStart(block), decoded, input.text.size());
+        expectSame("lz4DecompressBlock", input.text, "before" + string(input.text), decoded);
+        decoded.clear();
+        lz4DecompressFrames(atEnd ? buffer.copyAtEnd(frame) : buffer.copyAtStart(frame), decoded);
+        expectSame("lz4DecompressFrames", input.text, input.text, decoded);
+    }
+
+    string_view raw = buffer.copyAtEnd(input.text);
+    try {
+        string decoded;
+        lz4DecompressBlock(raw, decoded, 1 << 16);
+        expectTrue("lz4DecompressBlock", decoded.size() <= 1 << 16, "decoded past its size limit");
+    } catch (const runtime_error &) {
+    }
+    try {
+        string decoded;
+        lz4DecompressFrames(raw, decoded);
+    } catch (const runtime_error &) {
+    }
+}
+
+// A file for the block file checks, removed at exit.
+struct ScratchFile
+{
+    string path = (filesystem::temp_directory_path() / ("greetingfuzzer-" + to_string(random_device()()) + ".blk"))
+                      .string();
+    ~ScratchFile() { remove(path.c_str()); }
+};
+
+// The greetings written as a block file in two independently encoded
+// batches, with blocks small enough that some greetings need their own,
+// and read back row by row.
+void checkBlockFile(const Input & input, const vector<string> & expected)
+{
+    static ScratchFile scratch;
+    uint32_t blockSize = 1 + input.mode * 3;
+    BlockFileIndex index(blockSize);
+    string file = index.header();
+    size_t half = input.names.size() / 2;
+    for (auto [begin, end] : {pair<size_t, size_t>(0, half), pair<size_t, size_t>(half, input.names.size())}) {
+        GreetingBatch greetings;
+        generateHelloStrings(vector<string_view>(input.names.begin() + begin, input.names.begin() + end), greetings);
+        vector<GreetingBlock> blocks;
+        encodeGreetingBlocks(greetings, blockSize, file, blocks);
+        index.add(blocks);
+    }
+    file += index.trailer();
+    FILE * out = fopen(scratch.path.c_str(), "wb");
+    expectTrue("BlockFileReader", out && fwrite(file.data(), 1, file.size(), out) == file.size() && fclose(out) == 0,
+               "cannot write the scratch file");
+
+    BlockFileReader reader(scratch.path);
+    expectTrue("BlockFileReader", reader.rows() == expected.size(), "wrong number of rows");
+    for (size_t i = 0; i < expected.size(); ++i)
+        expectSame("BlockFileReader::row", input.names[i], expected[i], reader.row(i));
+    bool threw = false;
+    try {
+        reader.row(expected.size());
+    } catch (const out_of_range &) {
+        threw = true;
+    }
+    expectTrue("BlockFileReader::row", threw, "a row past the end was returned");
+}
+
+GreetingServiceConfig serviceConfig(bool prioritize, bool coalesce)
+{
+    GreetingServiceConfig config;
+    config.workers = 2;
+    config.prioritize = prioritize;
+    config.coalesce = coalesce;
+    config.bulkChunkSize = 3;   // bulk batches yield between many chunks
+    return config;
+}
+
+// Started once and reused across inputs.
+const vector<GreetingService *> & services()
+{
+    static GreetingService plain(serviceConfig(true, false));
+    static GreetingService coalescing(serviceConfig(true, true));
+    static GreetingService fifo(serviceConfig(false, false));
+    static const vector<GreetingService *> all{&plain, &coalescing, &fifo};
+    return all;
+}
+
+void checkService(const Input & input, const vector<string> & expected)
+{
+    size_t count = min(input.names.size(), maxServiceNames);
+    vector<string> names(input.names.begin(), input.names.begin() + count);
+    for (GreetingService * service : services()) {
+        vector<future<string>> singles;
+        for (const string & name : names)
+            singles.push_back(service->greet(name));
+        future<GreetingBatch> interactive = service->greetBatch(names, GreetingPriority::Interactive);
+        future<GreetingBatch> bulk = service->greetBatch(names, GreetingPriority::Bulk);
+        for (size_t i = 0; i < count; ++i)
+            expectSame("GreetingService::greet", names[i], expected[i], singles[i].get());
+        for (future<GreetingBatch> * batch : {&interactive, &bulk}) {
+            GreetingBatch greetings = batch->get();
+            expectTrue("GreetingService::greetBatch", greetings.size() == count, "wrong number of greetings");
+            for (size_t i = 0; i < count; ++i)
+                expectSame("GreetingService::greetBatch", names[i], expected[i], greetings[i]);
+        }
+    }
+}
+
+int checkInput(const uint8_t * data, size_t size)
+{
+    static GuardedBuffer names;
+    static GuardedBuffer out;
+    Input input = parseInput(data, size);
+    vector<string> expected;
+    vector<string> transliterated;
+    for (string_view name : input.names) {
+        expected.push_back(generateHelloString(string(name)));
+        transliterated.push_back(generateHelloString(transliterateToAscii(name)));
+    }
+    checkBatchRenderer(input, expected, names);
+    checkRules(input, expected, names);
+    checkCApi(input, 0, expected, names, out);
+    checkCApi(input, HELLO_TRANSLITERATE, transliterated, names, out);
+    checkTransliteration(input, names);
+    checkHashes(input, names);
+    checkCsv(input, names);
+    checkJsonl(input, names);
+    checkLz4(input, names);
+    checkBlockFile(input, expected);
+    checkService(input, expected);
+    return 0;
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) { return checkInput(data, size); }
+
+#ifndef HELLO_LIBFUZZER
+
+namespace {
+
+int checkString(const string & input)
+{
+    return checkInput(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+}
+
+// Names of every length through the widths vector code works in and
+// around a page, filled with bytes of each kind a fast path may treat
+// differently. The guard pages already put every name against a page edge.
+size_t checkBoundaries()
+{
+    const vector<string> fills = {"a", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x91\x8b", "\xff", "\xc3",
+                                  "{}",  string(1, '\0')};
+    size_t page = 4096;
+    vector<size_t> lengths;
+    for (size_t length = 0; length <= 130; ++length)
+        lengths.push_back(length);
+    for (size_t length = page - 17; length <= page + 17; ++length)
+        lengths.push_back(length);
+    size_t inputs = 0;
+    for (const string & fill : fills) {
+        for (size_t length : lengths) {
+            string name;
+            while (name.size() < length)
+                name += fill;
+            name.resize(length);
+            // Alone, then after an ASCII run so multi-byte characters straddle
+            // every alignment.
+            checkString(string("\x03\x05", 2) + name);
+            string shifted = "abcdefghijklmnopq" + name;
+            checkString(string("\x01\x00", 2) + shifted.substr(0, length) + "\n" + name);
+            inputs += 2;
+        }
+    }
+    return inputs;
+}
+
+size_t checkRandom(size_t runs, uint64_t seed)
+{
+    mt19937_64 random(seed);
+    // Name fragments, and structure for the CSV and JSON Lines scanners.
+    const vector<string> pieces = {"a", "Z", " ", "-", "'", "{", "}", "\n", "\t", string(1, '\0'), "\xc3\xa9",
+                                   "\xc3\x85", "\xe2\x82\xac", "\xf0\x9f\x91\x8b", "\xc3", "\x80", "\xff",
+                                   "Dr. ", " Jr.", "\"", "\\", ",", ";", ":", "[", "]", "\r\n"};
+    // Every third input is JSON Lines records instead, mostly well formed,
+    // so that names get past the scanner's checks.
+    const vector<string> jsonPieces = {"a", "Z", " ", "'", "\xc3\xa9", "\xf0\x9f\x91\x8b", "\xff", "Dr. ",
+                                       "\\\"", "\\\\", "\\n", "\\u00e9", "\\ud83d\\ude00", "\\ud83d"};
+    const vector<string> separators = {"\"}\n{\"name\":\"", "\"} \r\n\n{ \"id\": [1, {\"name\": 2}], \"name\" : \"",
+                                       "\",\"name\":\"", "\"}\n[\"", "\"\n{\"name\":\"", "\",\"greeting\":\""};
+    for (size_t run = 0; run < runs; ++run) {
+        string input(2, '\0');
+        input[0] = char(random());
+        input[1] = char(random());
+        size_t pieceCount = random() % 16 == 0 ? random() % 2000 : random() % 80;
+        if (run % 3 == 2) {
+            input += "{\"name\":\"";
+            for (size_t i = 0; i < pieceCount; ++i) {
+                if (random() % 6 == 0)
+                    input += random() % 4 ? separators[0] : separators[random() % separators.size()];
+                else
+                    input += jsonPieces[random() % jsonPieces.size()];
+            }
+            input += "\"}";
+        } else {
+            for (size_t i = 0; i < pieceCount; ++i)
+                input += pieces[random() % pieces.size()];
+        }
+        checkString(input);
+    }
+    return runs;
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    size_t runs = 500;
+    uint64_t seed = 1;
+    vector<filesystem::path> paths;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc)
+            runs = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg[0] == '-')
+            fprintf(stderr, "GreetingFuzzer: ignoring fuzzer option '%s'\n", arg.c_str());
+        else
+            paths.push_back(arg);
+    }
+
+    if (!paths.empty()) {
+        size_t replayed = 0;
+        for (const filesystem::path & path : paths) {
+            vector<filesystem::path> files;
+            if (filesystem::is_directory(path)) {
+                for (const filesystem::directory_entry & entry : filesystem::directory_iterator(path))
+                    if (entry.is_regular_file())
+                        files.push_back(entry.path());
+                sort(files.begin(), files.end());
+            } else {
+                files.push_back(path);
+            }
+            for (const filesystem::path & file : files) {
+                ifstream in(file, ios::binary);
+                if (!in) {
+                    fprintf(stderr, "GreetingFuzzer: cannot read %s\n", file.string().c_str());
+                    return 2;
+                }
+                checkString(string(istreambuf_iterator<char>(in), istreambuf_iterator<char>()));
+                ++replayed;
+            }
+        }
+        printf("replayed %zu inputs, no differences\n", replayed);
+        return 0;
+    }
+
+    size_t boundaries = checkBoundaries();
+    size_t random = checkRandom(runs, seed);
+    printf("%zu boundary and %zu random inputs (seed %llu), no differences\n", boundaries, random,
+           (unsigned long long)seed);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "greetingrules.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+std::vector<GreetingRule> sampleRules()
+{
+    return parseGreetingRules("# honorifics\n"
+                              "prefix\tDr. \tGood day, Doctor {rest}\n"
+                              "prefix\tDr. Who\tHello, time traveller\n"
+                              "prefix\tProf. \tGood day, Professor {rest}\n"
+                              "suffix\t Jr.\tHello {rest}, junior\n"
+                              "\n"
+                              "exact\tAcme Corp\tWelcome back, {name} team\r\n"
+                              "exact\tDr. Acme\tHi {{{name}}}\n");
+}
+
+// The rule a straightforward scan over every rule picks.
+int naiveMatch(const std::vector<GreetingRule> & rules, const std::string & name)
+{
+    int best[3] = {-1, -1, -1};
+    for (size_t r = 0; r < rules.size(); ++r) {
+        const GreetingRule & rule = rules[r];
+        const std::string & p = rule.pattern;
+        bool matches = false;
+        if (rule.kind == RuleKind::Exact)
+            matches = name == p;
+        else if (rule.kind == RuleKind::Prefix)
+            matches = name.compare(0, p.size(), p) == 0;
+        else
+            matches = name.size() >= p.size() && name.compare(name.size() - p.size(), p.size(), p) == 0;
+        int & slot = best[int(rule.kind)];
+        if (matches && (slot < 0 || rules[slot].pattern.size() < p.size()))
+            slot = int(r);
+    }
+    if (best[int(RuleKind::Exact)] >= 0)
+        return best[int(RuleKind::Exact)];
+    return best[int(RuleKind::Prefix)] >= 0 ? best[int(RuleKind::Prefix)] : best[int(RuleKind::Suffix)];
+}
+
+} // namespace
+
+TEST(GreetingRulesTests, testParse) {
+    std::vector<GreetingRule> rules = sampleRules();
+    ASSERT_EQ(6u, rules.size());
+    EXPECT_EQ(RuleKind::Prefix, rules[0].kind);
+    EXPECT_EQ("Dr. ", rules[0].pattern);
+    EXPECT_EQ("Good day, Doctor {rest}", rules[0].greeting);
+    EXPECT_EQ(RuleKind::Suffix, rules[3].kind);
+    EXPECT_EQ(RuleKind::Exact, rules[4].kind);
+    EXPECT_EQ("Welcome back, {name} team", rules[4].greeting);
+
+    EXPECT_THROW(parseGreetingRules("prefix\tDr."), std::invalid_argument);
+    EXPECT_THROW(parseGreetingRules("infix\tx\ty"), std::invalid_argument);
+}
+
+TEST(GreetingRulesTests, testPrecedence) {
+    GreetingRules rules(sampleRules());
+    EXPECT_EQ("Good day, Doctor Jane Smith", rules.greet("Dr. Jane Smith"));
+    EXPECT_EQ("Hello, time traveller", rules.greet("Dr. Whovian"));
+    EXPECT_EQ("Good day, Professor Ada", rules.greet("Prof. Ada"));
+    EXPECT_EQ("Hello John Smith, junior", rules.greet("John Smith Jr."));
+    EXPECT_EQ("Good day, Doctor John Jr.", rules.greet("Dr. John Jr."));
+    EXPECT_EQ("Welcome back, Acme Corp team", rules.greet("Acme Corp"));
+    EXPECT_EQ("Hi {Dr. Acme}", rules.greet("Dr. Acme"));
+    EXPECT_EQ("Good day, Doctor Acme Corp", rules.greet("Dr. Acme Corp"));
+}
+
+TEST(GreetingRulesTests, testUnmatchedNamesGetTheDefaultGreeting) {
+    GreetingRules rules(sampleRules());
+    std::vector<std::string> names = {"", "Jim", "Dr.", "Dr", "Acme Corp.", "Jr.", "dr. jane", std::string("\0\xff", 2)};
+    for (const std::string & name : names) {
+        EXPECT_EQ(-1, rules.match(name));
+        EXPECT_EQ(generateHelloString(name), rules.greet(name));
+    }
+    GreetingRules none({});
+    EXPECT_EQ("Hello Jim", none.greet("Jim"));
+}
+
+TEST(GreetingRulesTests, testBatchMatchesSingle) {
+    GreetingRules rules(sampleRules());
+    std::vector<std::string_view> names = {"Dr. Jane", "Jim", "Acme Corp", "Bob Jr.", "", "Prof. X"};
+    GreetingBatch greetings;
+    greetings.text = "kept";
+    greetings.offsets = {0, 4};
+    rules.greet(names, greetings);
+    ASSERT_EQ(names.size() + 1, greetings.size());
+    EXPECT_EQ("kept", greetings[0]);
+    for (size_t i = 0; i < names.size(); ++i)
+        EXPECT_EQ(rules.greet(names[i]), greetings[i + 1]);
+}
+
+TEST(GreetingRulesTests, testUnmatchedBatchMatchesGenerateHelloStrings) {
+    GreetingRules rules(sampleRules());
+    std::vector<std::string_view> names = {"", "Jim", "Dr.", "Jr.", "dr. jane", "Acme Corp."};
+    GreetingBatch expected;
+    generateHelloStrings(names, expected);
+    GreetingBatch greetings;
+    rules.greet(names, greetings);
+    EXPECT_EQ(expected.text, greetings.text);
+    EXPECT_EQ(expected.offsets, greetings.offsets);
+}
+
+TEST(GreetingRulesTests, testInvalidRules) {
+    EXPECT_THROW(GreetingRules({{RuleKind::Prefix, "", "x"}}), std::invalid_argument);
+    EXPECT_THROW(GreetingRules({{RuleKind::Suffix, "", "x"}}), std::invalid_argument);
+    EXPECT_THROW(GreetingRules({{RuleKind::Exact, "a", "x"}, {RuleKind::Exact, "a", "y"}}), std::invalid_argument);
+    EXPECT_THROW(GreetingRules({{RuleKind::Prefix, "a", "{nam}"}}), std::invalid_argument);
+    EXPECT_THROW(GreetingRules({{RuleKind::Prefix, "a", "unbalanced }"}}), std::invalid_argument);
+    // The same pattern may be a prefix, a suffix and an exact name at once.
+    GreetingRules rules({{RuleKind::Prefix, "ab", "p"}, {RuleKind::Suffix, "ab", "s"}, {RuleKind::Exact, "ab", "e"}});
+    EXPECT_EQ("e", rules.greet("ab"));
+    EXPECT_EQ("p", rules.greet("abab"));
+    EXPECT_EQ("s", rules.greet("cab"));
+}
+
+TEST(GreetingRulesTests, testManyRulesMatchNaiveScan) {
+    // Patterns over a small alphabet share long prefixes and suffixes, so
+    // the tries branch and overlap heavily.
+    std::mt19937 random(7);
+    auto randomText = [&](size_t maxLength) {
+        std::string text(random() % (maxLength + 1), ' ');
+        for (char & c : text)
+            c = "abc. "[random() % 5];
+        return text;
+    };
+    std::vector<GreetingRule> list;
+    std::vector<std::string> seen[3];
+    while (list.size() < 3000) {
+        RuleKind kind = RuleKind(random() % 3);
+        std::string pattern = randomText(10);
+        std::vector<std::string> & patterns = seen[int(kind)];
+        if (pattern.empty() || std::find(patterns.begin(), patterns.end(), pattern) != patterns.end())
+            continue;
+        patterns.push_back(pattern);
+        list.push_back({kind, pattern, "r" + std::to_string(list.size()) + " {rest}"});
+    }
+    GreetingRules rules(list);
+    EXPECT_GT(rules.states(), 1000u);
+    for (int i = 0; i < 3000; ++i) {
+        std::string name = randomText(14);
+        ASSERT_EQ(naiveMatch(list, name), rules.match(name)) << '"' << name << '"';
+    }
+}
@@ -0,0 +1,225 @@
+#include <chrono>
+#include <stop_token>
+#include "gtest/gtest.h"
+#include "greetingservice.h"
+
+namespace {
+
+std::vector<std::string> makeNames(size_t count) {
+    std::vector<std::string> names;
+    for (size_t i = 0; i < count; ++i)
+        names.push_back("name" + std::to_string(i));
+    return names;
+}
+
+}
+
+TEST(GreetingServiceTests, testGreet) {
+    GreetingService service({2});
+    ASSERT_EQ("Hello Jim", service.greet("Jim").get());
+}
+
+TEST(GreetingServiceTests, testBulkBatchIsRenderedInOrder) {
+    GreetingServiceConfig config;
+    config.workers = 3;
+    config.bulkChunkSize = 7;
+    GreetingService service(config);
+    std::vector<std::string> names = makeNames(1000);
+    GreetingBatch greetings = service.greetBatch(names).get();
+    ASSERT_EQ(names.size(), greetings.size());
+    for (size_t i = 0; i < names.size(); ++i)
+        EXPECT_EQ(generateHelloString(names[i]), greetings[i]);
+    EXPECT_EQ(1u, service.stats().bulkRequests);
+    EXPECT_EQ((names.size() + 6) / 7, service.stats().bulkChunks);
+}
+
+TEST(GreetingServiceTests, testSmallBatchIsInteractive) {
+    GreetingService service({1});
+    EXPECT_EQ("Hello a", service.greetBatch({"a", "b"}).get()[0]);
+    EXPECT_EQ(1u, service.stats().interactiveRequests);
+    EXPECT_EQ(0u, service.stats().bulkRequests);
+}
+
+TEST(GreetingServiceTests, testInteractivePreemptsBulkAtChunkBoundary) {
+    GreetingServiceConfig config;
+    config.workers = 1;
+    config.bulkChunkSize = 64;
+    GreetingService service(config);
+    auto bulk = service.greetBatch(makeNames(400000), GreetingPriority::Bulk);
+    while (service.stats().bulkChunks == 0)
+        std::this_thread::yield();
+
+    ASSERT_EQ("Hello Jim", service.greet("Jim").get());
+    EXPECT_EQ(std::future_status::timeout, bulk.wait_for(std::chrono::seconds(0)));
+    EXPECT_EQ(400000u, bulk.get().size());
+    EXPECT_EQ(1u, service.stats().preemptions);
+}
+
+TEST(GreetingServiceTests, testFifoRunsBatchesToCompletion) {
+    GreetingServiceConfig config;
+    config.workers = 1;
+    config.prioritize = false;
+    GreetingService service(config);
+    auto bulk = service.greetBatch(makeNames(100000), GreetingPriority::Bulk);
+    auto single = service.greet("Jim");
+    ASSERT_EQ("Hello Jim", single.get());
+    EXPECT_EQ(std::future_status::ready, bulk.wait_for(std::chrono::seconds(0)));
+    EXPECT_EQ(0u, service.stats().bulkChunks);
+}
+
+TEST(GreetingServiceTests, testDestructorDrainsQueuedWork) {
+    std::future<std::string> pending;
+    {
+        GreetingService service({1});
+        service.greetBatch(makeNames(10000), GreetingPriority::Bulk);
+        pending = service.greet("Jim");
+    }
+    EXPECT_EQ("Hello Jim", pending.get());
+}
+
+TEST(GreetingServiceTests, testExpiredRequestIsDroppedAtDequeue) {
+    GreetingServiceConfig config;
+    config.workers = 1;
+    GreetingService service(config);
+    GreetingRequestOptions options;
+    options.deadline = std::chrono::steady_clock::now();
+    auto expired = service.greet("Jim", options);
+    EXPECT_THROW(expired.get(), GreetingDeadlineExceeded);
+    EXPECT_EQ(1u, service.stats().expired);
+    EXPECT_EQ(1u, service.stats().droppedNames);
+
+    options.deadline = std::chrono::steady_clock::now() + std::chrono::hours(1);
+    EXPECT_EQ("Hello Jim", service.greet("Jim", options).get());
+}
+
+TEST(GreetingServiceTests, testCancelStopsBatchBetweenChunks) {
+    GreetingServiceConfig config;
+    config.workers = 1;
+    config.bulkChunkSize = 64;
+    GreetingService service(config);
+    std::stop_source stop;
+    GreetingRequestOptions options;
+    options.stopToken = stop.get_token();
+    auto bulk = service.greetBatch(makeNames(400000), GreetingPriority::Bulk, options);
+    while (service.stats().bulkChunks == 0)
+        std::this_thread::yield();
+    stop.request_stop();
+    EXPECT_THROW(bulk.get(), GreetingCancelled);
+    GreetingServiceStats stats = service.stats();
+    EXPECT_EQ(1u, stats.cancelled);
+    EXPECT_GT(stats.droppedNames, 0u);
+    EXPECT_LT(stats.bulkChunks, 400000u / 64);
+}
+
+TEST(GreetingServiceTests, testExpiredBatchesAreDroppedUnrendered) {
+    // One FIFO worker and batches whose deadline has already passed: each is
+    // dropped when the worker reaches it, without rendering a name, and the
+    // request behind them is still served. Counters rather than timings, so
+    // a loaded machine cannot change the outcome.
+    GreetingServiceConfig config;
+    config.workers = 1;
+    config.prioritize = false;
+    GreetingService service(config);
+    GreetingRequestOptions expired;
+    expired.deadline = std::chrono::steady_clock::now() - std::chrono::milliseconds(1);
+    std::vector<std::future<GreetingBatch>> batches;
+    for (int i = 0; i < 100; ++i)
+        batches.push_back(service.greetBatch(makeNames(2000), GreetingPriority::Bulk, expired));
+    auto live = service.greetBatch(makeNames(10), GreetingPriority::Bulk);
+    EXPECT_EQ("Hello Jim", service.greet("Jim").get());
+    for (auto & batch : batches)
+        EXPECT_THROW(batch.get(), GreetingDeadlineExceeded);
+    EXPECT_EQ(10u, live.get().size());
+    GreetingServiceStats stats = service.stats();
+    EXPECT_EQ(100u, stats.expired);
+    EXPECT_EQ(100u * 2000, stats.droppedNames);
+    EXPECT_EQ(0u, stats.cancelled);
+}
+
+TEST(GreetingServiceTests, testCoalescesConcurrentGreetsForOneName) {
+    // The FIFO worker is busy with the batch while the greets arrive, so
+    // every "Jim" after the first joins its flight.
+    GreetingServiceConfig config;
+    config.workers = 1;
+    config.prioritize = false;
+    config.coalesce = true;
+    GreetingService service(config);
+    auto bulk = service.greetBatch(makeNames(400000), GreetingPriority::Bulk);
+    std::vector<std::future<std::string>> jims;
+    for (int i = 0; i < 10; ++i)
+        jims.push_back(service.greet("Jim"));
+    auto ann = service.greet("Ann");
+    for (auto & jim : jims)
+        EXPECT_EQ("Hello Jim", jim.get());
+    EXPECT_EQ("Hello Ann", ann.get());
+    EXPECT_EQ(9u, service.stats().coalesced);
+    EXPECT_EQ(2u, service.stats().interactiveRequests);
+
+    // Landed flights are gone: the next greet renders again.
+    EXPECT_EQ("Hello Jim", service.greet("Jim").get());
+    EXPECT_EQ(9u, service.stats().coalesced);
+    EXPECT_EQ(3u, service.stats().interactiveRequests);
+    bulk.wait();
+}
+
+TEST(GreetingServiceTests, testRequestsWithDeadlinesAreNotCoalesced) {
+    GreetingServiceConfig config;
+    config.workers = 1;
+    config.prioritize = false;
+    config.coalesce = true;
+    GreetingService service(config);
+    auto bulk = service.greetBatch(makeNames(400000), GreetingPriority::Bulk);
+    auto plain = service.greet("Jim");
+    GreetingRequestOptions options;
+    options.deadline = std::chrono::steady_clock::now() + std::chrono::hours(1);
+    auto withDeadline = service.greet("Jim", options);
+    EXPECT_EQ("Hello Jim", plain.get());
+    EXPECT_EQ("Hello Jim", withDeadline.get());
+    EXPECT_EQ(0u, service.stats().coalesced);
+    bulk.wait();
+}
+
+TEST(GreetingServiceTests, testShedsWhenQueueDelayStands) {
+    // Far more work queued at once than one FIFO worker gets through within
+    // the target, so the delay stands and CoDel sheds until it drains.
+    GreetingServiceConfig config;
+    config.workers = 1;
+    config.prioritize = false;
+    config.shed = true;
+    config.shedTarget = std::chrono::milliseconds(1);
+    config.shedInterval = std::chrono::milliseconds(5);
+    std::vector<std::vector<std::string>> work(200, makeNames(20000));
+    GreetingService service(config);
+    std::vector<std::future<GreetingBatch>> batches;
+    for (std::vector<std::string> & names : work)
+        batches.push_back(service.greetBatch(std::move(names), GreetingPriority::Bulk));
+    uint64_t served = 0, shed = 0;
+    for (auto & batch : batches) {
+        try {
+            EXPECT_EQ("Hello name19999", batch.get()[19999]);
+            ++served;
+        } catch (const GreetingOverloaded &) {
+            ++shed;
+        }
+    }
+    GreetingServiceStats stats = service.stats();
+    EXPECT_GT(shed, 0u);
+    EXPECT_GT(served, 0u);
+    EXPECT_EQ(shed, stats.shed[0]);
+    EXPECT_EQ(shed * 20000, stats.droppedNames);
+    EXPECT_EQ(200u, service.queueDelays(GreetingPriority::Interactive).count());
+}
+
+TEST(GreetingServiceTests, testLightLoadIsNotShed) {
+    GreetingServiceConfig config;
+    config.workers = 1;
+    config.shed = true;
+    GreetingService service(config);
+    for (int i = 0; i < 100; ++i)
+        EXPECT_EQ("Hello Jim", service.greet("Jim").get());
+    EXPECT_EQ(10u, service.greetBatch(makeNames(10), GreetingPriority::Bulk).get().size());
+    GreetingServiceStats stats = service.stats();
+    EXPECT_EQ(0u, stats.shed[0] + stats.shed[1]);
+    EXPECT_EQ(100u, service.queueDelays(GreetingPriority::Interactive).count());
+    EXPECT_EQ(1u, service.queueDelays(GreetingPriority::Bulk).count());
+}
@@ -0,0 +1,66 @@
+#include <random>
+#include <sstream>
+#include "gtest/gtest.h"
+#include "hdrhistogram.h"
+
+TEST(HdrHistogramTests, testSmallValuesAreExact) {
+    HdrHistogram histogram;
+    for (uint64_t v = 0; v < 1000; ++v)
+        histogram.record(v);
+    EXPECT_EQ(1000u, histogram.count());
+    EXPECT_EQ(0u, histogram.min());
+    EXPECT_EQ(999u, histogram.max());
+    EXPECT_EQ(499u, histogram.valueAtPercentile(50));
+    EXPECT_EQ(989u, histogram.valueAtPercentile(99));
+    EXPECT_DOUBLE_EQ(499.5, histogram.mean());
+}
+
+TEST(HdrHistogramTests, testPrecisionHoldsAcrossMagnitudes) {
+    HdrHistogram histogram(uint64_t(1) << 40, 3);
+    std::mt19937_64 random(7);
+    std::vector<uint64_t> values;
+    for (int i = 0; i < 20000; ++i) {
+        uint64_t v = random() >> (random() % 40 + 24);
+        values.push_back(v);
+        histogram.record(v);
+    }
+    std::sort(values.begin(), values.end());
+    for (double p : {10.0, 50.0, 90.0, 99.0, 99.9}) {
+        uint64_t exact = values[size_t(std::ceil(p / 100 * values.size())) - 1];
+        uint64_t reported = histogram.valueAtPercentile(p);
+        EXPECT_GE(reported, exact) << p;
+        EXPECT_LE(double(reported), exact * 1.001 + 1) << p;
+    }
+    EXPECT_EQ(values.back(), histogram.valueAtPercentile(100));
+}
+
+TEST(HdrHistogramTests, testValuesAboveRangeAreClamped) {
+    HdrHistogram histogram(1000000, 2);
+    histogram.record(5000000);
+    EXPECT_EQ(1000000u, histogram.max());
+    EXPECT_EQ(1000000u, histogram.valueAtPercentile(100));
+}
+
+TEST(HdrHistogramTests, testAddAndReset) {
+    HdrHistogram a, b;
+    a.record(10, 3);
+    b.record(1000000);
+    a.add(b);
+    EXPECT_EQ(4u, a.count());
+    EXPECT_EQ(10u, a.valueAtPercentile(75));
+    EXPECT_NEAR(1000000.0, double(a.valueAtPercentile(100)), 1000.0);
+    a.reset();
+    EXPECT_EQ(0u, a.count());
+    EXPECT_EQ(0u, a.valueAtPercentile(99));
+}
+
+TEST(HdrHistogramTests, testPercentileDistributionEndsAtMax) {
+    HdrHistogram histogram;
+    for (uint64_t v = 1; v <= 100; ++v)
+        histogram.record(v * 1000);
+    std::ostringstream out;
+    histogram.writePercentileDistribution(out, 1000);
+    std::string text = out.str();
+    EXPECT_NE(std::string::npos, text.find("100.000 1.000000000000        100            inf"));
+    EXPECT_NE(std::string::npos, text.find("#[Mean    =       50.500, Samples =          100]"));
+}
@@ -0,0 +1,93 @@
+/* Exercises hello_c.h from plain C, the way an FFI binding would. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "hello_c.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                \
+    do {                                                                \
+        if (!(condition)) {                                             \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++failures;                                                 \
+        }                                                               \
+    } while (0)
+
+static void testVersion(void)
+{
+    CHECK(hello_abi_version() == HELLO_ABI_VERSION);
+}
+
+static void testSingle(void)
+{
+    char out[32];
+    size_t length = 0;
+    CHECK(hello_greet("Jim", 3, 0, out, sizeof out, &length) == HELLO_OK);
+    CHECK(length == 9 && memcmp(out, "Hello Jim", 9) == 0);
+
+    CHECK(hello_greet("Jim", 3, 0, out, 4, &length) == HELLO_BUFFER_TOO_SMALL);
+    CHECK(length == 9);
+
+    CHECK(hello_greet("Zo\xc3\xab", 4, HELLO_TRANSLITERATE, out, sizeof out, &length) == HELLO_OK);
+    CHECK(length == 9 && memcmp(out, "Hello Zoe", 9) == 0);
+
+    CHECK(hello_greet(NULL, 0, 0, out, sizeof out, &length) == HELLO_OK);
+    CHECK(length == 6 && memcmp(out, "Hello ", 6) == 0);
+}
+
+static void testBatch(void)
+{
+    const char names[] = "JimAnnBob";
+    const uint64_t nameOffsets[] = {0, 3, 3, 6, 9};
+    uint64_t required = 0;
+    char out[64];
+    uint64_t outOffsets[5];
+
+    CHECK(hello_greetings_size(names, nameOffsets, 4, 0, &required) == HELLO_OK);
+    CHECK(required == 4 * 6 + 9);
+
+    CHECK(hello_greet_batch(names, nameOffsets, 4, 0, out, 10, outOffsets, &required) == HELLO_BUFFER_TOO_SMALL);
+    CHECK(required == 33);
+
+    CHECK(hello_greet_batch(names, nameOffsets, 4, 0, out, sizeof out, outOffsets, &required) == HELLO_OK);
+    CHECK(outOffsets[0] == 0 && outOffsets[1] == 9 && outOffsets[2] == 15 && outOffsets[4] == 33);
+    CHECK(memcmp(out, "Hello JimHello Hello AnnHello Bob", 33) == 0);
+}
+
+static void testOffsetsNeedNotStartAtZero(void)
+{
+    const char names[] = "xxJim";
+    const uint64_t nameOffsets[] = {2, 5};
+    char out[16];
+    uint64_t outOffsets[2];
+    CHECK(hello_greet_batch(names, nameOffsets, 1, 0, out, sizeof out, outOffsets, NULL) == HELLO_OK);
+    CHECK(outOffsets[1] == 9 && memcmp(out, "Hello Jim", 9) == 0);
+}
+
+static void testInvalidArguments(void)
+{
+    const uint64_t decreasing[] = {3, 1};
+    uint64_t required;
+    uint64_t outOffsets[2];
+    char out[16];
+    CHECK(hello_greetings_size("abc", decreasing, 1, 0, &required) == HELLO_INVALID_ARGUMENT);
+    CHECK(hello_greetings_size(NULL, NULL, 1, 0, &required) == HELLO_INVALID_ARGUMENT);
+    CHECK(hello_greet_batch("abc", decreasing, 1, 0, out, sizeof out, NULL, NULL) == HELLO_INVALID_ARGUMENT);
+    CHECK(hello_greetings_size(NULL, NULL, 0, 0, &required) == HELLO_OK && required == 0);
+    CHECK(hello_greet_batch(NULL, NULL, 0, 0, NULL, 0, outOffsets, NULL) == HELLO_OK && outOffsets[0] == 0);
+    CHECK(strcmp(hello_status_message(HELLO_BUFFER_TOO_SMALL), "output buffer too small") == 0);
+}
+
+int main(void)
+{
+    testVersion();
+    testSingle();
+    testBatch();
+    testOffsetsNeedNotStartAtZero();
+    testInvalidArguments();
+    if (failures)
+        fprintf(stderr, "%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -3,4 +3,24 @@
 
 TEST(HelloTests, testHello) {
     ASSERT_STREQ("Hello Jim", generateHelloString("Jim").c_str());
-}
\ No newline at end of file
+}
+
+TEST(HelloTests, testHelloBatchMatchesSingle) {
+    std::vector<std::string_view> names = {"Jim", "", "Zoë Ångström", "A"};
+    GreetingBatch greetings;
+    generateHelloStrings(names, greetings);
+    ASSERT_EQ(names.size(), greetings.size());
+    for (size_t i = 0; i < names.size(); ++i)
+        EXPECT_EQ(generateHelloString(std::string(names[i])), greetings[i]);
+}
+
+TEST(HelloTests, testHelloBatchAppends) {
+    GreetingBatch greetings;
+    generateHelloStrings({"Jim"}, greetings);
+    generateHelloStrings({"Bob", "Ann"}, greetings);
+    ASSERT_EQ(3u, greetings.size());
+    EXPECT_EQ("Hello JimHello BobHello Ann", greetings.text);
+    EXPECT_EQ("Hello Ann", greetings[2]);
+    greetings.clear();
+    EXPECT_EQ(0u, greetings.size());
+}
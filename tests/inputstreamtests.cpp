@@ -0,0 +1,251 @@
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#ifdef HELLO_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "inputstream.h"
+#include "lz4.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Reads data back through an InputStream, a few hundred bytes at a time.
+std::string readThrough(const std::string & data, unsigned threads = 2, size_t memoryLimit = SIZE_MAX,
+                        std::string * format = nullptr)
+{
+    std::unique_ptr<FILE, int (*)(FILE *)> file(std::tmpfile(), std::fclose);
+    std::fwrite(data.data(), 1, data.size(), file.get());
+    std::rewind(file.get());
+    InputStream in(file.get(), "input", threads, memoryLimit);
+    if (format)
+        *format = in.format();
+    std::string read;
+    char buffer[777];
+    while (size_t got = in.read(buffer, sizeof buffer))
+        read.append(buffer, got);
+    return read;
+}
+
+std::string names(size_t count, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::string text;
+    for (size_t i = 0; i < count; ++i)
+        text += "name " + std::to_string(random() % 5000) + "\n";
+    return text;
+}
+
+std::string le32(uint32_t value)
+{
+    std::string bytes;
+    for (int i = 0; i < 4; ++i)
+        bytes += char(value >> (8 * i));
+    return bytes;
+}
+
+std::string skippableFrame(const std::string & contents)
+{
+    return le32(0x184d2a5b) + le32(uint32_t(contents.size())) + contents;
+}
+
+// Magic number and descriptor, with FLG flags and block size code.
+std::string frameHeader(unsigned char flags, unsigned char blockCode)
+{
+    std::string descriptor = {char(flags), char(blockCode << 4)};
+    descriptor += char((xxh32(descriptor) >> 8) & 0xff);
+    return le32(lz4FrameMagic) + descriptor;
+}
+
+constexpr unsigned char independent = 0x60;   // version 01, independent blocks
+constexpr unsigned char dependent = 0x40;
+constexpr unsigned char blockChecksums = 0x10;
+constexpr unsigned char contentChecksum = 0x04;
+
+// A frame of 64K blocks, each compressed on its own, which suits frames
+// with dependent blocks as well.
+std::string frame(const std::string & data, unsigned char flags)
+{
+    std::string out = frameHeader(flags, 4);
+    for (size_t at = 0; at < data.size(); at += 64 << 10) {
+        std::string block;
+        lz4CompressBlock(std::string_view(data).substr(at, 64 << 10), block);
+        out += le32(uint32_t(block.size())) + block;
+        if (flags & blockChecksums)
+            out += le32(xxh32(block));
+    }
+    out += le32(0);
+    if (flags & contentChecksum)
+        out += le32(xxh32(data));
+    return out;
+}
+
+// Every cut of input short of its end, but for those at its frame
+// boundaries, must fail as truncated rather than pass for shorter input.
+void expectEveryCutFails(const std::string & input, const std::set<size_t> & boundaries, size_t from)
+{
+    for (size_t size = from; size < input.size(); ++size) {
+        if (boundaries.count(size))
+            continue;
+        EXPECT_THROW(readThrough(input.substr(0, size)), std::runtime_error) << "cut at " << size;
+    }
+}
+
+#ifdef HELLO_HAVE_ZLIB
+std::string gzip(const std::string & data)
+{
+    z_stream stream{};
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&stream, uLong(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream.avail_in = uInt(data.size());
+    stream.next_out = reinterpret_cast<Bytef *>(out.data());
+    stream.avail_out = uInt(out.size());
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+#endif
+
+}
+
+TEST(InputStreamTests, testPlainInputPassesThrough) {
+    std::string format;
+    for (const std::string & text : {std::string(), std::string("a"), std::string("\x1f"), names(1000, 1)}) {
+        EXPECT_EQ(text, readThrough(text, 2, SIZE_MAX, &format));
+        EXPECT_EQ("plain", format);
+    }
+}
+
+#ifdef HELLO_HAVE_ZLIB
+
+TEST(InputStreamTests, testConcatenatedGzipMembersReadAsOne) {
+    // Several pieces' worth, and an empty member between the others.
+    std::string first = names(300000, 2);
+    std::string second = names(1000, 3);
+    std::string input = gzip(first) + gzip("") + gzip(second);
+    std::string format;
+    EXPECT_EQ(first + second, readThrough(input, 2, SIZE_MAX, &format));
+    EXPECT_EQ("gzip", format);
+    // A tight limit means smaller pieces, not different content.
+    EXPECT_EQ(first + second, readThrough(input, 2, 48 << 10));
+}
+
+TEST(InputStreamTests, testTruncatedGzipFails) {
+    std::string member = gzip(names(20, 4));
+    std::string input = member + gzip(names(20, 5));
+    expectEveryCutFails(input, {member.size()}, 2);
+}
+
+TEST(InputStreamTests, testCorruptGzipFails) {
+    std::string text = names(100, 6);
+    std::string input = gzip(text);
+    std::string badChecksum = input;
+    badChecksum[badChecksum.size() - 6] ^= 1;
+    EXPECT_THROW(readThrough(badChecksum), std::runtime_error);
+    std::string badData = input;
+    badData[badData.size() / 2] ^= 0x55;
+    EXPECT_THROW(readThrough(badData), std::runtime_error);
+    EXPECT_THROW(readThrough(input + "trailing"), std::runtime_error);
+}
+
+#else
+
+TEST(InputStreamTests, testGzipNeedsZlib) {
+    EXPECT_THROW(readThrough(std::string("\x1f\x8b\x08\x00", 4)), std::runtime_error);
+}
+
+#endif
+
+TEST(InputStreamTests, testConcatenatedAndSkippableLz4Frames) {
+    std::string first = names(50000, 7);
+    std::string second = names(3000, 8);
+    std::string third = names(10, 9);
+    std::string input = skippableFrame("leading") + frame(first, independent | blockChecksums) +
+                        skippableFrame("") + frame(second, independent | contentChecksum) +
+                        frame("", independent) + frame(third, dependent | blockChecksums | contentChecksum) +
+                        skippableFrame(std::string(100000, 's'));
+    std::string format;
+    for (unsigned threads : {1u, 4u}) {
+        EXPECT_EQ(first + second + third, readThrough(input, threads, SIZE_MAX, &format)) << threads << " threads";
+        EXPECT_EQ("lz4", format);
+    }
+}
+
+TEST(InputStreamTests, testDependentBlocksReachIntoTheBlockBefore) {
+    // Each block after the first copies the last 1000 bytes decoded, all
+    // of them in the block before, and adds five literals.
+    std::string expected = names(200, 10).substr(0, 1000);
+    std::string input = frameHeader(dependent | blockChecksums, 4);
+    input += le32(uint32_t(expected.size()) | 0x80000000) + expected + le32(xxh32(expected));
+    for (int block = 1; block < 200; ++block) {
+        std::string literals = std::to_string(10000 + block);
+        std::string data = {char(0x0f), char(1000 & 0xff), char(1000 >> 8)};
+        size_t length = 1000 - 4 - 15;
+        for (; length >= 255; length -= 255)
+            data += char(255);
+        data += char(length);
+        data += char(literals.size() << 4) + literals;
+        expected += expected.substr(expected.size() - 1000) + literals;
+        input += le32(uint32_t(data.size())) + data + le32(xxh32(data));
+    }
+    input += le32(0);
+    // One piece in circulation or many, the history travels with the
+    // parsing stage.
+    for (size_t memoryLimit : {size_t(1), size_t(SIZE_MAX)})
+        EXPECT_EQ(expected, readThrough(input, 2, memoryLimit)) << memoryLimit;
+
+    // Without the block before, the same match reaches out of the frame.
+    std::string orphan = frameHeader(dependent, 4);
+    std::string data = {char(0x10), 'x', char(2), char(0), char(0x50)};
+    data += "tail!";
+    orphan += le32(uint32_t(data.size())) + data + le32(0);
+    EXPECT_THROW(readThrough(orphan), std::runtime_error);
+}
+
+TEST(InputStreamTests, testTightMemoryLimitKeepsIndependentBlocksInOrder) {
+    std::string text = names(200000, 11);
+    std::string input = frame(text, independent | blockChecksums | contentChecksum);
+    for (size_t memoryLimit : {size_t(1), size_t(300) << 10, size_t(SIZE_MAX)})
+        EXPECT_EQ(text, readThrough(input, 4, memoryLimit)) << memoryLimit;
+}
+
+TEST(InputStreamTests, testTruncatedLz4Fails) {
+    std::string skippable = skippableFrame("skip");
+    std::string first = frame(names(20, 12), independent | blockChecksums | contentChecksum);
+    std::string input = skippable + first + frame(names(20, 13), dependent);
+    expectEveryCutFails(input, {skippable.size(), skippable.size() + first.size()}, 4);
+}
+
+TEST(InputStreamTests, testCorruptLz4Fails) {
+    std::string text = names(2000, 14);
+    std::string input = frame(text, independent | blockChecksums | contentChecksum);
+
+    std::string badBlock = input;
+    badBlock[20] ^= 1;
+    EXPECT_THROW(readThrough(badBlock), std::runtime_error);
+    std::string badContent = input;
+    badContent[badContent.size() - 1] ^= 1;
+    EXPECT_THROW(readThrough(badContent), std::runtime_error);
+    std::string badHeader = input;
+    badHeader[6] ^= 1;
+    EXPECT_THROW(readThrough(badHeader), std::runtime_error);
+    // A block larger than the frame's block size allows.
+    std::string oversized = frameHeader(independent, 4) + le32((64 << 10) + 1);
+    EXPECT_THROW(readThrough(oversized + std::string((64 << 10) + 1, 'x') + le32(0)), std::runtime_error);
+    EXPECT_THROW(readThrough(input + "trailing"), std::runtime_error);
+
+    // Without block checksums, a corrupt block is still caught when it
+    // does not decode.
+    std::string unchecked = frame(text, independent);
+    unchecked[7 + 4] = 0;   // no literals, and a match before the start
+    EXPECT_THROW(readThrough(unchecked), std::runtime_error);
+}
@@ -0,0 +1,252 @@
+#include <cctype>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "hello.h"
+#include "jsonl.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+std::vector<std::string> split(std::string_view chunk, std::string_view field, size_t & skipped,
+                               std::vector<std::string> * records = nullptr)
+{
+    std::vector<std::string_view> names;
+    std::vector<std::string_view> recordViews;
+    std::string storage;
+    skipped = splitJsonl(chunk, field, names, records ? &recordViews : nullptr, storage);
+    if (records)
+        records->assign(recordViews.begin(), recordViews.end());
+    return std::vector<std::string>(names.begin(), names.end());
+}
+
+// JSON string literal for value, escaping with whichever valid form random
+// picks, so the scanner meets every kind of escape.
+std::string encode(const std::string & value, std::mt19937 & random)
+{
+    static const char hex[] = "0123456789abcdef";
+    std::string out = "\"";
+    for (unsigned char c : value) {
+        bool mustEscape = c < 0x20 || c == '"' || c == '\\';
+        if (!mustEscape && c < 0x80 && random() % 8) {
+            out += char(c);
+        } else if (c == '"' || c == '\\' || (c == '/' && random() % 2)) {
+            out += '\\';
+            out += char(c);
+        } else if (c == '\n' && random() % 2) {
+            out += "\\n";
+        } else if (c < 0x80) {
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += random() % 2 ? hex[c & 15] : char(std::toupper(hex[c & 15]));
+        } else {
+            out += char(c);
+        }
+    }
+    return out + '"';
+}
+
+std::string randomValue(std::mt19937 & random)
+{
+    static const char bytes[] = "ab \"\\/\n\t\x01{}[]:,";
+    std::string value;
+    size_t length = random() % 10;
+    for (size_t i = 0; i < length; ++i)
+        value += random() % 6 ? bytes[random() % (sizeof bytes - 1)] : 'z';
+    if (random() % 4 == 0)
+        value += "\xc3\xa9";   // é, left raw
+    return value;
+}
+
+// A value that is not the field: a string, number, or an object or array
+// that itself holds a member named like the field.
+std::string randomOther(std::mt19937 & random, const std::string & field, int depth)
+{
+    switch (depth < 3 ? random() % 4 : 0) {
+    case 1:
+        return "{" + encode(field, random) + ":" + encode(randomValue(random), random) + ",\"k\":" +
+               randomOther(random, field, depth + 1) + "}";
+    case 2:
+        return "[" + randomOther(random, field, depth + 1) + "," + encode(field, random) + "]";
+    case 3:
+        return "-12.5e3";
+    }
+    return encode(randomValue(random), random);
+}
+
+}
+
+TEST(JsonlTests, testBackslashRunsAcrossBlockBoundaries) {
+    for (size_t pad = 0; pad < 140; ++pad) {
+        for (size_t run = 0; run < 6; ++run) {
+            // run escaped backslashes, then an escaped quote, and a value
+            // that ends right after an even run.
+            std::string raw = std::string(2 * run, '\\') + "\\\"x" + std::string(2 * run, '\\');
+            std::string expected = std::string(run, '\\') + "\"x" + std::string(run, '\\');
+            std::string record = "{\"pad\":\"" + std::string(pad, 'p') + "\",\"name\":\"" + raw + "\"}";
+            size_t skipped = 0;
+            std::vector<std::string> names = split(record + "\n" + record, "name", skipped);
+            ASSERT_EQ(2u, names.size()) << "pad " << pad << ", run " << run;
+            EXPECT_EQ(expected, names[0]);
+            EXPECT_EQ(expected, names[1]);
+            EXPECT_EQ(0u, skipped);
+        }
+    }
+}
+
+TEST(JsonlTests, testGeneratedRecordsMatchTheirField) {
+    std::mt19937 random(4);
+    for (int run = 0; run < 300; ++run) {
+        std::string chunk;
+        std::vector<std::string> expected;
+        size_t records = random() % 20;
+        for (size_t r = 0; r < records; ++r) {
+            std::string name = randomValue(random);
+            size_t members = random() % 4;
+            size_t position = random() % (members + 1);
+            std::string record = random() % 2 ? "{" : " { ";
+            for (size_t m = 0; m <= members; ++m) {
+                if (m)
+                    record += random() % 2 ? "," : " ,\t";
+                if (m == position)
+                    record += encode("name", random) + (random() % 2 ? ":" : " : ") + encode(name, random);
+                else
+                    record += encode("other" + std::to_string(m), random) + ":" + randomOther(random, "name", 0);
+            }
+            chunk += record + (random() % 2 ? "}" : "} \r") + "\n";
+            expected.push_back(name);
+            if (random() % 5 == 0)
+                chunk += random() % 2 ? "\n" : " \t\r\n";
+        }
+        size_t skipped = 0;
+        ASSERT_EQ(expected, split(chunk, "name", skipped)) << "run " << run << ":\n" << chunk;
+        EXPECT_EQ(0u, skipped);
+    }
+}
+
+TEST(JsonlTests, testNestedMemberWithTheSameName) {
+    size_t skipped = 0;
+    std::vector<std::string> names =
+        split("{\"a\":{\"name\":\"inner\"},\"list\":[{\"name\":\"x\"}],\"name\":\"outer\"}\n"
+              "{\"name\":\"first\",\"nested\":{\"name\":{\"name\":\"deep\"}}}\n"
+              "{\"nested\":{\"name\":\"only inside\"}}\n",
+              "name", skipped);
+    EXPECT_EQ((std::vector<std::string>{"outer", "first"}), names);
+    EXPECT_EQ(1u, skipped);
+}
+
+TEST(JsonlTests, testSurrogatePairs) {
+    size_t skipped = 0;
+    std::vector<std::string> names = split("{\"name\":\"\\uD83D\\uDE00\"}\n"
+                                           "{\"name\":\"a\\ud83d\\ude00b\"}\n"
+                                           "{\"name\":\"\\uD83D\"}\n"
+                                           "{\"name\":\"\\uDE00\"}\n"
+                                           "{\"name\":\"\\uD83D\\u0041\"}\n"
+                                           "{\"name\":\"\\uD83Dx\"}\n"
+                                           "{\"name\":\"\\u00e9\\u4e2d\"}\n",
+                                           "name", skipped);
+    EXPECT_EQ((std::vector<std::string>{"\xf0\x9f\x98\x80", "a\xf0\x9f\x98\x80" "b", "\xc3\xa9\xe4\xb8\xad"}), names);
+    EXPECT_EQ(4u, skipped);
+}
+
+TEST(JsonlTests, testMalformedRecordsAreCountedAsSkipped) {
+    const std::vector<std::string> malformed = {
+        "{\"name\":\"Jim\"",                 // unclosed object
+        "{\"name\":\"Jim\"}}",               // closed twice
+        "{\"name\":\"Jim}",                  // unterminated string
+        "{\"name\":\"J\x01im\"}",            // raw control byte in a string
+        "{\"name\":42}",                     // not a string
+        "{\"other\":\"Jim\"}",               // no such field
+        "{\"name\":\"Jim\"} x",              // trailing garbage
+        "[\"name\",\"Jim\"]",                // not an object
+        "{\"name\":\"Jim\\q\"}",             // bad escape
+        "{\"name\":\"Jim\\u12\"}",           // short \u escape
+        "{\"name\":[\"Jim\"}]",              // mismatched brackets
+    };
+    for (const std::string & record : malformed) {
+        size_t skipped = 0;
+        std::string chunk = "{\"name\":\"a\"}\n" + record + "\n\n{\"name\":\"b\"}";
+        EXPECT_EQ((std::vector<std::string>{"a", "b"}), split(chunk, "name", skipped)) << record;
+        EXPECT_EQ(1u, skipped) << record;
+    }
+
+    // A raw newline inside a string ends the record there: both halves are
+    // malformed, and the record after them is read as usual.
+    size_t skipped = 0;
+    EXPECT_EQ((std::vector<std::string>{"b"}), split("{\"name\":\"J\nim\"}\n{\"name\":\"b\"}\n", "name", skipped));
+    EXPECT_EQ(2u, skipped);
+}
+
+TEST(JsonlTests, testExtractJsonField) {
+    std::string storage;
+    storage.reserve(64);
+    std::string_view value;
+    EXPECT_TRUE(extractJsonField("{\"id\":1,\"name\":\"J\\tim\"}", "name", value, storage));
+    EXPECT_EQ("J\tim", value);
+    EXPECT_FALSE(extractJsonField("{\"id\":1}", "name", value, storage));
+    EXPECT_FALSE(extractJsonField("{\"name\":\"a\"}\n{\"name\":\"b\"}", "name", value, storage));
+}
+
+TEST(JsonlTests, testGreetingsRoundTripThroughEscaping) {
+    std::mt19937 random(5);
+    std::string chunk;
+    std::vector<std::string> expected;
+    for (int r = 0; r < 200; ++r) {
+        std::string name = randomValue(random);
+        name += char(random() % 0x20);
+        expected.push_back(name);
+        if (r % 3 == 0)
+            chunk += "{\"name\":" + encode(name, random) + "}\n";
+        else
+            chunk += "{ \"id\" : " + std::to_string(r) + " , \"name\":" + encode(name, random) + " } \n";
+    }
+    size_t skipped = 0;
+    std::vector<std::string> records;
+    std::vector<std::string> names = split(chunk, "name", skipped, &records);
+    ASSERT_EQ(expected, names);
+
+    std::vector<std::string_view> nameViews(names.begin(), names.end());
+    std::vector<std::string_view> recordViews(records.begin(), records.end());
+    GreetingBatch greetings;
+    generateHelloStrings(nameViews, greetings);
+    std::string output;
+    writeJsonlGreetings(recordViews, greetings, output);
+
+    EXPECT_EQ(names, split(output, "name", skipped));
+    EXPECT_EQ(0u, skipped);
+    std::vector<std::string> written = split(output, "greeting", skipped);
+    EXPECT_EQ(0u, skipped);
+    ASSERT_EQ(names.size(), written.size());
+    for (size_t i = 0; i < names.size(); ++i)
+        EXPECT_EQ(generateHelloString(names[i]), written[i]);
+}
+
+TEST(JsonlTests, testRecordsWithAGreetingAreSkippedForOutput) {
+    std::string chunk = "{\"name\":\"Ann\",\"greeting\":\"old\"}\n"
+                        "{\"greeting\":1,\"name\":\"Bob\"}\n"
+                        "{\"name\":\"Cy\",\"nested\":{\"greeting\":\"inner\"}}\n"
+                        "{\"name\":\"Di\",\"gr\\u0065eting\":\"escaped\"}\n"
+                        "{\"name\":\"Ed\",\"other\":\"greeting\"}\n";
+    size_t skipped = 0;
+    std::vector<std::string> records;
+    std::vector<std::string> names = split(chunk, "name", skipped, &records);
+    EXPECT_EQ((std::vector<std::string>{"Cy", "Ed"}), names);
+    EXPECT_EQ(3u, skipped);
+
+    // Only the greeting added is left in the output.
+    std::vector<std::string_view> nameViews(names.begin(), names.end());
+    std::vector<std::string_view> recordViews(records.begin(), records.end());
+    GreetingBatch greetings;
+    generateHelloStrings(nameViews, greetings);
+    std::string output;
+    writeJsonlGreetings(recordViews, greetings, output);
+    EXPECT_EQ("{\"name\":\"Cy\",\"nested\":{\"greeting\":\"inner\"},\"greeting\":\"Hello Cy\"}\n"
+              "{\"name\":\"Ed\",\"other\":\"greeting\",\"greeting\":\"Hello Ed\"}\n",
+              output);
+
+    // Names alone are not written back, so nothing is skipped for it.
+    EXPECT_EQ((std::vector<std::string>{"Ann", "Bob", "Cy", "Di", "Ed"}), split(chunk, "name", skipped));
+    EXPECT_EQ(0u, skipped);
+}
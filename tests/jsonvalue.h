@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A small strict JSON reader for checking what the apps write, so the tests
+// need no JSON library. Numbers are doubles and object members keep the last
+// of duplicate keys.
+struct JsonValue
+{
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::map<std::string, JsonValue> object;
+
+    bool has(const std::string & key) const { return type == Type::Object && object.count(key) > 0; }
+
+    const JsonValue & operator[](const std::string & key) const
+    {
+        if (!has(key))
+            throw std::runtime_error("json: no member '" + key + "'");
+        return object.at(key);
+    }
+};
+
+namespace jsonvalue_detail {
+
+class Parser
+{
+public:
+    explicit Parser(std::string_view text) : text(text) {}
+
+    JsonValue document()
+    {
+        JsonValue value = parseValue(0);
+        skipSpace();
+        if (at != text.size())
+            fail("trailing characters");
+        return value;
+    }
+
+private:
+    std::string_view text;
+    size_t at = 0;
+
+    [[noreturn]] void fail(const std::string & what) const
+    {
+        throw std::runtime_error("json: " + what + " at offset " + std::to_string(at));
+    }
+
+    void skipSpace()
+    {
+        while (at < text.size() && (text[at] == ' ' || text[at] == '\t' || text[at] == '\n' || text[at] == '\r'))
+            ++at;
+    }
+
+    void expect(char c)
+    {
+        skipSpace();
+        if (at >= text.size() || text[at] != c)
+            fail(std::string("expected '") + c + "'");
+        ++at;
+    }
+
+    bool literal(std::string_view word)
+    {
+        if (text.substr(at, word.size()) != word)
+            return false;
+        at += word.size();
+        return true;
+    }
+
+    size_t digits()
+    {
+        size_t from = at;
+        while (at < text.size() && text[at] >= '0' && text[at] <= '9')
+            ++at;
+        return at - from;
+    }
+
+    JsonValue parseValue(int depth)
+    {
+        if (depth > 64)
+            fail("nesting too deep");
+        skipSpace();
+        if (at >= text.size())
+            fail("unexpected end");
+        JsonValue value;
+        char c = text[at];
+        if (c == '{') {
+            value.type = JsonValue::Type::Object;
+            ++at;
+            skipSpace();
+            if (at < text.size() && text[at] == '}') {
+                ++at;
+                return value;
+            }
+            do {
+                skipSpace();
+                std::string key = parseString();
+                expect(':');
+                value.object[key] = parseValue(depth + 1);
+                skipSpace();
+            } while (at < text.size() && text[at] == ',' && ++at);
+            expect('}');
+        } else if (c == '[') {
+            value.type = JsonValue::Type::Array;
+            ++at;
+            skipSpace();
+            if (at < text.size() && text[at] == ']') {
+                ++at;
+                return value;
+            }
+            do {
+                value.array.push_back(parseValue(depth + 1));
+                skipSpace();
+            } while (at < text.size() && text[at] == ',' && ++at);
+            expect(']');
+        } else if (c == '"') {
+            value.type = JsonValue::Type::String;
+            value.string = parseString();
+        } else if (literal("true") || literal("false")) {
+            value.type = JsonValue::Type::Bool;
+            value.boolean = c == 't';
+        } else if (literal("null")) {
+            value.type = JsonValue::Type::Null;
+        } else {
+            value.type = JsonValue::Type::Number;
+            value.number = parseNumber();
+        }
+        return value;
+    }
+
+    double parseNumber()
+    {
+        size_t from = at;
+        if (at < text.size() && text[at] == '-')
+            ++at;
+        size_t whole = at;
+        if (!digits() || (text[whole] == '0' && at - whole > 1))
+            fail("bad number");
+        if (at < text.size() && text[at] == '.') {
+            ++at;
+            if (!digits())
+                fail("bad fraction");
+        }
+        if (at < text.size() && (text[at] == 'e' || text[at] == 'E')) {
+            ++at;
+            if (at < text.size() && (text[at] == '+' || text[at] == '-'))
+                ++at;
+            if (!digits())
+                fail("bad exponent");
+        }
+        return std::strtod(std::string(text.substr(from, at - from)).c_str(), nullptr);
+    }
+
+    void appendUtf8(std::string & out, unsigned long code)
+    {
+        if (code < 0x80) {
+            out += char(code);
+        } else if (code < 0x800) {
+            out += char(0xc0 | code >> 6);
+            out += char(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            out += char(0xe0 | code >> 12);
+            out += char(0x80 | (code >> 6 & 0x3f));
+            out += char(0x80 | (code & 0x3f));
+        } else {
+            out += char(0xf0 | code >> 18);
+            out += char(0x80 | (code >> 12 & 0x3f));
+            out += char(0x80 | (code >> 6 & 0x3f));
+            out += char(0x80 | (code & 0x3f));
+        }
+    }
+
+    unsigned long hex4()
+    {
+        if (at + 4 > text.size())
+            fail("short \\u escape");
+        std::string hex(text.substr(at, 4));
+        if (hex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+            fail("bad \\u escape");
+        at += 4;
+        return std::strtoul(hex.c_str(), nullptr, 16);
+    }
+
+    std::string parseString()
+    {
+        if (at >= text.size() || text[at] != '"')
+            fail("expected a string");
+        ++at;
+        std::string out;
+        while (true) {
+            if (at >= text.size())
+                fail("unterminated string");
+            char c = text[at++];
+            if (c == '"')
+                return out;
+            if (static_cast<unsigned char>(c) < 0x20)
+                fail("control character in string");
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (at >= text.size())
+                fail("unterminated escape");
+            switch (char e = text[at++]) {
+            case '"': case '\\': case '/': out += e; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned long code = hex4();
+                if (code >= 0xd800 && code < 0xdc00 && literal("\\u")) {
+                    unsigned long low = hex4();
+                    if (low < 0xdc00 || low >= 0xe000)
+                        fail("bad surrogate pair");
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                }
+                appendUtf8(out, code);
+                break;
+            }
+            default: fail("bad escape");
+            }
+        }
+    }
+};
+
+}
+
+// Parses text as exactly one JSON value; throws std::runtime_error otherwise.
+inline JsonValue parseJson(std::string_view text)
+{
+    return jsonvalue_detail::Parser(text).document();
+}
@@ -0,0 +1,132 @@
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "lz4.h"
+
+namespace {
+
+// "Hello customer 0\n" .. "Hello customer 39\n" as written by lz4 1.9
+// (lz4 -BD small.txt): 64 KiB blocks and a content checksum.
+const unsigned char referenceFrame[] = {
+    0x04, 0x22, 0x4d, 0x18, 0x64, 0x40, 0xa7, 0xb2, 0x00, 0x00, 0x00, 0xfb,
+    0x02, 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x20, 0x63, 0x75, 0x73, 0x74, 0x6f,
+    0x6d, 0x65, 0x72, 0x20, 0x30, 0x0a, 0x11, 0x00, 0x1c, 0x31, 0x11, 0x00,
+    0x1c, 0x32, 0x11, 0x00, 0x1c, 0x33, 0x11, 0x00, 0x1c, 0x34, 0x11, 0x00,
+    0x1c, 0x35, 0x11, 0x00, 0x1c, 0x36, 0x11, 0x00, 0x1c, 0x37, 0x11, 0x00,
+    0x1c, 0x38, 0x11, 0x00, 0x1c, 0x39, 0x11, 0x00, 0x1e, 0x31, 0xab, 0x00,
+    0x0d, 0xac, 0x00, 0x1d, 0x31, 0xad, 0x00, 0x1d, 0x31, 0xae, 0x00, 0x1d,
+    0x31, 0xaf, 0x00, 0x1d, 0x31, 0xb0, 0x00, 0x1d, 0x31, 0xb1, 0x00, 0x1d,
+    0x31, 0xb2, 0x00, 0x1d, 0x31, 0xb3, 0x00, 0x1d, 0x31, 0xb4, 0x00, 0x1d,
+    0x32, 0xb4, 0x00, 0x1d, 0x32, 0xb4, 0x00, 0x1d, 0x32, 0xb4, 0x00, 0x1d,
+    0x32, 0xb4, 0x00, 0x1d, 0x32, 0xb4, 0x00, 0x1d, 0x32, 0xb4, 0x00, 0x1d,
+    0x32, 0xb4, 0x00, 0x1d, 0x32, 0xb4, 0x00, 0x1d, 0x32, 0xb4, 0x00, 0x1d,
+    0x32, 0xb4, 0x00, 0x1d, 0x33, 0xb4, 0x00, 0x1d, 0x33, 0xb4, 0x00, 0x1d,
+    0x33, 0xb4, 0x00, 0x1d, 0x33, 0xb4, 0x00, 0x1d, 0x33, 0xb4, 0x00, 0x1d,
+    0x33, 0xb4, 0x00, 0x1d, 0x33, 0xb4, 0x00, 0x1d, 0x33, 0xb4, 0x00, 0x1b,
+    0x33, 0xb4, 0x00, 0x50, 0x72, 0x20, 0x33, 0x39, 0x0a, 0x00, 0x00, 0x00,
+    0x00, 0xc9, 0x6d, 0xf6, 0x8d,
+};
+
+std::string greetings(size_t count)
+{
+    std::string text;
+    for (size_t i = 0; i < count; ++i)
+        text += "Hello customer " + std::to_string(i) + "\n";
+    return text;
+}
+
+std::string randomBytes(size_t count, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::string bytes(count, '\0');
+    for (char & c : bytes)
+        c = char(random());
+    return bytes;
+}
+
+std::string roundTripBlock(const std::string & input)
+{
+    std::string compressed;
+    lz4CompressBlock(input, compressed);
+    std::string output;
+    lz4DecompressBlock(compressed, output, input.size());
+    return output;
+}
+
+std::string compressFrame(const std::string & input)
+{
+    std::string frame = lz4FrameHeader();
+    lz4CompressFrameBlocks(input, frame);
+    return frame + lz4FrameEnd();
+}
+
+} // namespace
+
+TEST(Lz4Tests, testXxh32ReferenceValues) {
+    EXPECT_EQ(xxh32(""), 0x02cc5d05u);
+    EXPECT_EQ(xxh32("abc"), 0x32d153ffu);
+    EXPECT_EQ(xxh32("", 1), 0x0b2cb792u);
+}
+
+TEST(Lz4Tests, testXxh32InPieces) {
+    std::string data = randomBytes(1000, 5);
+    for (size_t step : {1, 3, 15, 16, 17, 100}) {
+        Xxh32 hash(7);
+        for (size_t i = 0; i < data.size(); i += step)
+            hash.update(std::string_view(data).substr(i, step));
+        EXPECT_EQ(hash.digest(), xxh32(data, 7)) << step;
+    }
+}
+
+TEST(Lz4Tests, testBlockRoundTrips) {
+    std::string text = greetings(5000);
+    for (size_t size : {0, 1, 12, 13, 17, 100, 4096, 65536, 100000}) {
+        std::string input = text.substr(0, size);
+        EXPECT_EQ(roundTripBlock(input), input) << size;
+        std::string noise = randomBytes(size, unsigned(size));
+        EXPECT_EQ(roundTripBlock(noise), noise) << size;
+    }
+    // Long runs make overlapping matches and multi-byte lengths.
+    std::string runs = std::string(1000, 'a') + "b" + std::string(70000, 'c') + text.substr(0, 300);
+    EXPECT_EQ(roundTripBlock(runs), runs);
+}
+
+TEST(Lz4Tests, testGreetingsCompressWell) {
+    std::string text = greetings(100000);
+    std::string compressed;
+    lz4CompressBlock(text, compressed);
+    EXPECT_LT(compressed.size() * 4, text.size());
+}
+
+TEST(Lz4Tests, testFrameRoundTripsAcrossBlocks) {
+    std::string input = greetings(300000) + randomBytes(100000, 3);
+    ASSERT_GT(input.size(), lz4MaxBlockSize);
+    std::string frame = compressFrame(input);
+    std::string output;
+    lz4DecompressFrames(frame, output);
+    EXPECT_EQ(output, input);
+
+    // Frames concatenate, and empty frames are valid.
+    output.clear();
+    lz4DecompressFrames(compressFrame("") + compressFrame("one\n") + compressFrame("two\n"), output);
+    EXPECT_EQ(output, "one\ntwo\n");
+}
+
+TEST(Lz4Tests, testReadsTheReferenceEncoder) {
+    std::string output;
+    lz4DecompressFrames(std::string(reinterpret_cast<const char *>(referenceFrame), sizeof referenceFrame), output);
+    EXPECT_EQ(output, greetings(40));
+}
+
+TEST(Lz4Tests, testRejectsDamage) {
+    std::string frame = compressFrame(greetings(1000));
+    std::string output;
+    EXPECT_THROW(lz4DecompressFrames(frame.substr(0, frame.size() - 3), output), std::runtime_error);
+    std::string flipped = frame;
+    flipped[frame.size() / 2] ^= 1;
+    EXPECT_THROW(lz4DecompressFrames(flipped, output), std::runtime_error);
+    // A match reaching before the start of the block.
+    EXPECT_THROW(lz4DecompressBlock(std::string("\x10" "a" "\x05\x00", 4), output, 100), std::runtime_error);
+}
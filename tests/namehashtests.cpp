@@ -0,0 +1,139 @@
+#include <cmath>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "namehash.h"
+
+namespace {
+
+SipHashKey referenceKey()
+{
+    unsigned char bytes[16];
+    for (int i = 0; i < 16; ++i)
+        bytes[i] = static_cast<unsigned char>(i);
+    return sipHashKey(bytes);
+}
+
+std::string referenceMessage(size_t length)
+{
+    std::string message;
+    for (size_t i = 0; i < length; ++i)
+        message += static_cast<char>(i);
+    return message;
+}
+
+} // namespace
+
+TEST(NameHashTests, testSipHashReferenceVectors) {
+    // From the SipHash paper and reference implementation: key 00..0f,
+    // message 00..(n-1).
+    SipHashKey key = referenceKey();
+    EXPECT_EQ(0x726fdb47dd0e0e31ull, sipHash24(referenceMessage(0), key));
+    EXPECT_EQ(0x74f839c593dc67fdull, sipHash24(referenceMessage(1), key));
+    EXPECT_EQ(0x0d6c8009d9a94f5aull, sipHash24(referenceMessage(2), key));
+    EXPECT_EQ(0x85676696d7fb7e2dull, sipHash24(referenceMessage(3), key));
+    EXPECT_EQ(0xa129ca6149be45e5ull, sipHash24(referenceMessage(15), key));
+}
+
+TEST(NameHashTests, testBatchMatchesSingle) {
+    std::vector<std::string> storage;
+    for (size_t length = 0; length < 200; ++length)
+        storage.push_back(referenceMessage(length) + "name");
+    // Runs of names with as many 8-byte words, which batch kernels may hash
+    // side by side, and an odd count left over.
+    for (size_t length = 0; length < 40; ++length)
+        for (char c = 'a'; c < 'a' + 5; ++c)
+            storage.push_back(std::string(length, c));
+    std::vector<std::string_view> names(storage.begin(), storage.end());
+
+    std::vector<uint64_t> hashes;
+    hashNames(names, hashes, 42);
+    ASSERT_EQ(names.size(), hashes.size());
+    for (size_t i = 0; i < names.size(); ++i)
+        EXPECT_EQ(hashName(names[i], 42), hashes[i]);
+
+    SipHashKey key = referenceKey();
+    sipHashNames(names, key, hashes);
+    for (size_t i = 0; i < names.size(); ++i)
+        EXPECT_EQ(sipHash24(names[i], key), hashes[i]);
+}
+
+TEST(NameHashTests, testSeedAndLengthChangeTheHash) {
+    EXPECT_NE(hashName("Jim", 0), hashName("Jim", 1));
+    EXPECT_NE(hashName("a"), hashName(std::string_view("a\0", 2)));
+    EXPECT_NE(hashName(""), hashName(std::string_view("\0", 1)));
+    EXPECT_EQ(hashName("Jim"), hashName(std::string("Jim")));
+}
+
+TEST(NameHashTests, testNoCollisionsOnSequentialNames) {
+    std::set<uint64_t> seen;
+    std::set<uint32_t> low;
+    for (int i = 0; i < 200000; ++i) {
+        std::string name = "customer " + std::to_string(i);
+        uint64_t hash = hashName(name);
+        EXPECT_TRUE(seen.insert(hash).second) << name;
+        low.insert(static_cast<uint32_t>(hash));
+    }
+    // 200k draws from 2^32 collide about 4.7 times on average.
+    EXPECT_GT(low.size(), 200000u - 30);
+}
+
+TEST(NameHashTests, testBucketsAreUniform) {
+    // Low bits pick the slot in open-addressing tables, so they must spread
+    // well; chi-square over 1024 buckets has 1023 degrees of freedom.
+    constexpr int buckets = 1024;
+    constexpr int keys = 1 << 20;
+    std::vector<int> counts(buckets);
+    for (int i = 0; i < keys; ++i)
+        ++counts[hashName("n" + std::to_string(i)) & (buckets - 1)];
+    double expected = double(keys) / buckets;
+    double chiSquare = 0;
+    for (int count : counts)
+        chiSquare += (count - expected) * (count - expected) / expected;
+    EXPECT_LT(chiSquare, 1023 + 6 * std::sqrt(2 * 1023.0));
+}
+
+TEST(NameHashTests, testAvalanche) {
+    // Flipping any input bit should flip each output bit with probability
+    // close to one half.
+    for (size_t length : {3u, 8u, 13u, 16u, 31u, 64u, 100u}) {
+        std::vector<int> flips(64);
+        int trials = 0;
+        for (int sample = 0; sample < 64; ++sample) {
+            std::string name = referenceMessage(length);
+            for (size_t i = 0; i < length; ++i)
+                name[i] = static_cast<char>(name[i] * 31 + sample * 7 + 1);
+            uint64_t base = hashName(name);
+            for (size_t bit = 0; bit < 8 * length; ++bit) {
+                std::string flipped = name;
+                flipped[bit / 8] ^= static_cast<char>(1 << (bit % 8));
+                uint64_t diff = base ^ hashName(flipped);
+                for (int out = 0; out < 64; ++out)
+                    flips[out] += (diff >> out) & 1;
+                ++trials;
+            }
+        }
+        for (int out = 0; out < 64; ++out) {
+            double p = double(flips[out]) / trials;
+            EXPECT_NEAR(0.5, p, 0.05) << "length " << length << " output bit " << out;
+        }
+    }
+}
+
+TEST(NameHashTests, testPseudonymsAreKeyedHex) {
+    std::vector<std::string_view> names{"Jim", "Zoë", "Jim"};
+    std::string storage;
+    pseudonymizeNames(names, referenceKey(), storage);
+    ASSERT_EQ(3u, names.size());
+    EXPECT_EQ(16u, names[0].size());
+    EXPECT_EQ(names[0], names[2]);
+    EXPECT_NE(names[0], names[1]);
+    EXPECT_EQ(std::string_view::npos, names[1].find_first_not_of("0123456789abcdef"));
+
+    std::vector<std::string_view> other{"Jim"};
+    std::string otherStorage;
+    pseudonymizeNames(other, SipHashKey{1, 2}, otherStorage);
+    EXPECT_NE(names[0], other[0]);
+}
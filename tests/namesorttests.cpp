@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "namesort.h"
+
+namespace {
+
+// Names over a small alphabet with long shared prefixes, embedded zero
+// bytes, high bytes and duplicates, the cases a radix sort gets wrong.
+std::vector<std::string> makeNames(size_t count, unsigned seed)
+{
+    std::mt19937 random(seed);
+    const std::string alphabet("ab\0\xff\xc3\xa9", 6);
+    std::vector<std::string> names;
+    for (size_t i = 0; i < count; ++i) {
+        std::string name = random() % 2 ? "customer " : "";
+        size_t length = random() % 12;
+        for (size_t j = 0; j < length; ++j)
+            name += alphabet[random() % alphabet.size()];
+        names.push_back(name);
+    }
+    return names;
+}
+
+std::vector<std::string> sorted(const std::vector<std::string> & names, unsigned threads)
+{
+    std::vector<std::string_view> views(names.begin(), names.end());
+    sortNames(views, threads);
+    return std::vector<std::string>(views.begin(), views.end());
+}
+
+} // namespace
+
+TEST(NameSortTests, testSmallBatches) {
+    EXPECT_TRUE(sorted({}, 1).empty());
+    EXPECT_EQ(sorted({"b", "", "a", "ab", "a"}, 1), (std::vector<std::string>{"", "a", "a", "ab", "b"}));
+    // Bytes compare unsigned: UTF-8 sorts after ASCII.
+    EXPECT_EQ(sorted({"\xc3\xa9", "z", std::string("\0", 1)}, 1),
+              (std::vector<std::string>{std::string("\0", 1), "z", "\xc3\xa9"}));
+}
+
+TEST(NameSortTests, testMatchesStdSort) {
+    for (size_t count : {50, 1000, 100000}) {
+        std::vector<std::string> names = makeNames(count, unsigned(count));
+        std::vector<std::string> expected = names;
+        std::sort(expected.begin(), expected.end());
+        EXPECT_EQ(sorted(names, 1), expected) << count;
+        EXPECT_EQ(sorted(names, 4), expected) << count;
+    }
+}
+
+TEST(NameSortTests, testParallelSortOfIdenticalPrefixes) {
+    // Every name shares "customer ", so the parallel passes must walk down
+    // the prefix before they split.
+    std::vector<std::string> names;
+    for (int i = 0; i < 100000; ++i)
+        names.push_back("customer " + std::to_string((i * 7919) % 100000));
+    std::vector<std::string> expected = names;
+    std::sort(expected.begin(), expected.end());
+    EXPECT_EQ(sorted(names, 3), expected);
+}
+
+TEST(NameSortTests, testGroupingKeepsInputOrder) {
+    std::vector<std::string> names = {"bob", "\xc3\xa9mile", "alice", "", "ann",
+                                      "\xc3\xa8ve", "bea", "\xc3\xa9lise", "a"};
+    std::vector<std::string_view> views(names.begin(), names.end());
+    groupNamesByFirstCharacter(views);
+    EXPECT_EQ(std::vector<std::string>(views.begin(), views.end()),
+              (std::vector<std::string>{"", "alice", "ann", "a", "bob", "bea", "\xc3\xa8ve", "\xc3\xa9mile",
+                                        "\xc3\xa9lise"}));
+}
+
+TEST(NameSortTests, testGroupingMatchesStableSortByFirstCharacter) {
+    auto firstCharacter = [](std::string_view name) {
+        if (name.empty())
+            return name;
+        unsigned char lead = name[0];
+        size_t length = 1;
+        if (lead >= 0xc0 && lead < 0xf8)
+            length = lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : 2;
+        return name.substr(0, length);
+    };
+    std::vector<std::string> names = makeNames(100000, 7);
+    for (size_t i = 0; i < names.size(); i += 3)
+        names[i] = names[i].substr(names[i].find(' ') + 1);
+    std::vector<std::string_view> expected(names.begin(), names.end());
+    std::stable_sort(expected.begin(), expected.end(), [&](std::string_view a, std::string_view b) {
+        return firstCharacter(a) < firstCharacter(b);
+    });
+    for (unsigned threads : {1u, 4u}) {
+        std::vector<std::string_view> views(names.begin(), names.end());
+        groupNamesByFirstCharacter(views, threads);
+        // Identity, not just equal text: input order within a group.
+        ASSERT_EQ(views.size(), expected.size());
+        for (size_t i = 0; i < views.size(); ++i)
+            ASSERT_EQ(views[i].data(), expected[i].data()) << i;
+    }
+}
+
+TEST(NameSortTests, testLoserTreeMergesStably) {
+    for (size_t ways : {0, 1, 2, 3, 7, 16, 33}) {
+        std::vector<std::vector<std::string>> runs(ways);
+        std::vector<std::pair<std::string, size_t>> expected;
+        for (size_t w = 0; w < ways; ++w) {
+            // Some ways are empty; the rest share names with each other.
+            runs[w] = makeNames(w % 4 == 1 ? 0 : 50 + w * 13, unsigned(w % 5));
+            std::sort(runs[w].begin(), runs[w].end());
+            for (const std::string & name : runs[w])
+                expected.emplace_back(name, w);
+        }
+        std::stable_sort(expected.begin(), expected.end(),
+                         [](const auto & a, const auto & b) { return a.first < b.first; });
+
+        std::vector<std::optional<std::string_view>> heads(ways);
+        std::vector<size_t> positions(ways, 0);
+        for (size_t w = 0; w < ways; ++w)
+            if (!runs[w].empty())
+                heads[w] = runs[w][0];
+        LoserTree tree(heads);
+        std::vector<std::pair<std::string, size_t>> merged;
+        while (!tree.empty()) {
+            size_t w = tree.winner();
+            merged.emplace_back(std::string(tree.top()), w);
+            if (++positions[w] < runs[w].size())
+                tree.replace(runs[w][positions[w]]);
+            else
+                tree.exhaust();
+        }
+        EXPECT_EQ(merged, expected) << ways << " ways";
+    }
+}
@@ -0,0 +1,32 @@
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "options.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+Options parse(std::vector<std::string> args)
+{
+    args.insert(args.begin(), "main");
+    std::vector<char *> argv;
+    for (std::string & arg : args)
+        argv.push_back(arg.data());
+    return parseOptions(int(argv.size()), argv.data());
+}
+
+}
+
+TEST(OptionsTests, testThreadsArePlainNumbers) {
+    EXPECT_EQ(4u, parse({"-j", "4"}).threads);
+    EXPECT_EQ(1024u, parse({"--threads=1024"}).threads);
+    EXPECT_GE(parse({"-j", "0"}).threads, 1u);
+    for (const char * bad : {"2k", "1M", "-1", "", " 2", "1.5", "1025", "99999999999"})
+        EXPECT_THROW(parse({"-j", bad}), std::invalid_argument) << bad;
+}
+
+TEST(OptionsTests, testJsonlOutputCannotReadTheGreetingItWrites) {
+    EXPECT_NO_THROW(parse({"--jsonl", "name", "--jsonl-output"}));
+    EXPECT_THROW(parse({"--jsonl", "greeting", "--jsonl-output"}), std::invalid_argument);
+}
@@ -0,0 +1,385 @@
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lz4.h"
+#include "parquet.h"
+
+namespace {
+
+// A minimal Parquet reader, enough to check the writer against the format
+// rather than against itself: Thrift compact structs parsed generically by
+// field id, and the pages of BYTE_ARRAY columns decoded.
+
+struct ThriftValue
+{
+    int64_t number = 0;                      // integers and bools
+    std::string binary;
+    std::vector<ThriftValue> list;
+    std::map<int16_t, ThriftValue> fields;   // of a struct
+
+    bool has(int16_t id) const { return fields.count(id) > 0; }
+    const ThriftValue & operator[](int16_t id) const
+    {
+        auto field = fields.find(id);
+        if (field == fields.end())
+            throw std::runtime_error("missing field " + std::to_string(id));
+        return field->second;
+    }
+};
+
+class ThriftReader
+{
+public:
+    explicit ThriftReader(std::string_view data) : data(data) {}
+
+    ThriftValue readStruct()
+    {
+        ThriftValue value;
+        int16_t last = 0;
+        for (;;) {
+            uint8_t header = byte();
+            if (header == 0)
+                return value;
+            int16_t id = (header >> 4) ? int16_t(last + (header >> 4)) : int16_t(zigzag(varint()));
+            value.fields[id] = read(header & 0x0f);
+            last = id;
+        }
+    }
+
+    size_t position() const { return at; }
+
+private:
+    ThriftValue read(uint8_t type)
+    {
+        ThriftValue value;
+        switch (type) {
+        case 1:   // booleans are their field header's type
+        case 2:
+            value.number = type == 1;
+            break;
+        case 3:
+            value.number = int8_t(byte());
+            break;
+        case 4:
+        case 5:
+        case 6:
+            value.number = zigzag(varint());
+            break;
+        case 8: {
+            size_t size = size_t(varint());
+            if (size > data.size() - at)
+                throw std::runtime_error("binary past the end");
+            value.binary = std::string(data.substr(at, size));
+            at += size;
+            break;
+        }
+        case 9: {
+            uint8_t header = byte();
+            size_t size = header >> 4;
+            if (size == 15)
+                size = size_t(varint());
+            for (size_t i = 0; i < size; ++i)
+                value.list.push_back(read(header & 0x0f));
+            break;
+        }
+        case 12:
+            value = readStruct();
+            break;
+        default:
+            throw std::runtime_error("unexpected Thrift type " + std::to_string(type));
+        }
+        return value;
+    }
+
+    uint8_t byte()
+    {
+        if (at >= data.size())
+            throw std::runtime_error("Thrift struct past the end");
+        return uint8_t(data[at++]);
+    }
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t b = byte();
+            value |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return value;
+        }
+    }
+
+    static int64_t zigzag(uint64_t value) { return int64_t(value >> 1) ^ -int64_t(value & 1); }
+
+    std::string_view data;
+    size_t at = 0;
+};
+
+uint32_t getLength(std::string_view data, size_t at)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+        value |= uint32_t(uint8_t(data.at(at + i))) << (8 * i);
+    return value;
+}
+
+void decodePlain(std::string_view data, size_t count, std::vector<std::string> & values)
+{
+    size_t at = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t size = getLength(data, at);
+        values.emplace_back(data.substr(at + 4, size));
+        at += 4 + size;
+    }
+    EXPECT_EQ(data.size(), at);
+}
+
+std::vector<uint32_t> decodeHybrid(std::string_view data, size_t count, int bitWidth)
+{
+    std::vector<uint32_t> values;
+    size_t at = 0;
+    auto varint = [&] {
+        uint64_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t b = uint8_t(data.at(at++));
+            value |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return value;
+        }
+    };
+    while (values.size() < count) {
+        uint64_t header = varint();
+        if (header & 1) {
+            size_t packed = size_t(header >> 1) * 8;
+            uint64_t bits = 0;
+            int available = 0;
+            for (size_t i = 0; i < packed; ++i) {
+                while (available < bitWidth) {
+                    bits |= uint64_t(uint8_t(data.at(at++))) << available;
+                    available += 8;
+                }
+                if (values.size() < count)
+                    values.push_back(uint32_t(bits & ((uint64_t(1) << bitWidth) - 1)));
+                bits >>= bitWidth;
+                available -= bitWidth;
+            }
+        } else {
+            uint32_t value = 0;
+            for (int b = 0; b < (bitWidth + 7) / 8; ++b)
+                value |= uint32_t(uint8_t(data.at(at++))) << (8 * b);
+            values.insert(values.end(), size_t(header >> 1), value);
+        }
+    }
+    EXPECT_EQ(data.size(), at);
+    EXPECT_EQ(count, values.size());
+    return values;
+}
+
+struct ParquetContents
+{
+    ThriftValue meta;
+    std::vector<std::string> columns[2];
+    size_t dictionaryChunks = 0;
+    size_t dataPages = 0;
+};
+
+ParquetContents readParquet(std::string_view file)
+{
+    ParquetContents contents;
+    if (file.size() < 12 || file.substr(0, 4) != "PAR1" || file.substr(file.size() - 4) != "PAR1")
+        throw std::runtime_error("not a Parquet file");
+    uint32_t footerSize = getLength(file, file.size() - 8);
+    contents.meta = ThriftReader(file.substr(file.size() - 8 - footerSize, footerSize)).readStruct();
+
+    const ThriftValue & schema = contents.meta[2];
+    EXPECT_EQ(3u, schema.list.size());
+    EXPECT_EQ(2, schema.list.at(0)[5].number);
+    const char * names[2] = {"name", "greeting"};
+    for (int c = 0; c < 2; ++c) {
+        const ThriftValue & column = schema.list.at(c + 1);
+        EXPECT_EQ(names[c], column[4].binary);
+        EXPECT_EQ(6, column[1].number);   // BYTE_ARRAY
+        EXPECT_EQ(0, column[3].number);   // REQUIRED
+        EXPECT_EQ(0, column[6].number);   // UTF8
+        EXPECT_TRUE(column[10].has(1));   // STRING
+    }
+
+    int64_t rows = 0;
+    for (const ThriftValue & group : contents.meta[4].list) {
+        int64_t groupRows = group[3].number;
+        rows += groupRows;
+        EXPECT_EQ(2u, group[1].list.size());
+        for (int c = 0; c < 2; ++c) {
+            const ThriftValue & column = group[1].list.at(c)[3];
+            EXPECT_EQ(names[c], column[3].list.at(0).binary);
+            EXPECT_EQ(groupRows, column[5].number);
+            int64_t codec = column[4].number;
+            int64_t start = column.has(11) ? column[11].number : column[9].number;
+            std::string_view pages = file.substr(size_t(start), size_t(column[7].number));
+            if (c == 0) {
+                EXPECT_EQ(group[5].number, start);
+            }
+            std::vector<std::string> dictionary;
+            size_t values = 0;
+            while (!pages.empty()) {
+                ThriftReader reader(pages);
+                ThriftValue header = reader.readStruct();
+                pages.remove_prefix(reader.position());
+                std::string_view stored = pages.substr(0, size_t(header[3].number));
+                pages.remove_prefix(stored.size());
+                std::string body;
+                if (codec == 7)
+                    lz4DecompressBlock(stored, body, size_t(header[2].number));
+                else
+                    body = std::string(stored);
+                EXPECT_TRUE(codec == 0 || codec == 7);
+                EXPECT_EQ(size_t(header[2].number), body.size());
+                if (header[1].number == 2) {
+                    EXPECT_EQ(0u, values);
+                    decodePlain(body, size_t(header[7][1].number), dictionary);
+                    ++contents.dictionaryChunks;
+                    continue;
+                }
+                ++contents.dataPages;
+                size_t count = size_t(header[5][1].number);
+                values += count;
+                if (header[5][2].number == 0) {
+                    decodePlain(body, count, contents.columns[c]);
+                } else {
+                    EXPECT_EQ(8, header[5][2].number);   // RLE_DICTIONARY
+                    for (uint32_t index : decodeHybrid(std::string_view(body).substr(1), count, body.at(0)))
+                        contents.columns[c].push_back(dictionary.at(index));
+                }
+            }
+            EXPECT_EQ(size_t(groupRows), values);
+        }
+    }
+    EXPECT_EQ(rows, contents.meta[3].number);
+    return contents;
+}
+
+// Writes names and their greetings in batches of batchSize, the way main's
+// writer stage does.
+std::string writeParquet(const std::vector<std::string> & names, const ParquetWriterConfig & config,
+                         size_t batchSize = 1000)
+{
+    ParquetWriter writer(config);
+    std::string file = writer.header();
+    for (size_t begin = 0; begin < names.size(); begin += batchSize) {
+        std::vector<std::string_view> batch(names.begin() + begin,
+                                            names.begin() + std::min(names.size(), begin + batchSize));
+        GreetingBatch greetings;
+        generateHelloStrings(batch, greetings);
+        writer.add(batch, greetings, file);
+    }
+    EXPECT_EQ(names.size(), writer.rows());
+    file += writer.trailer();
+    return file;
+}
+
+void expectRows(const ParquetContents & contents, const std::vector<std::string> & names)
+{
+    ASSERT_EQ(names.size(), contents.columns[0].size());
+    ASSERT_EQ(names.size(), contents.columns[1].size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        EXPECT_EQ(names[i], contents.columns[0][i]);
+        EXPECT_EQ(generateHelloString(names[i]), contents.columns[1][i]);
+    }
+}
+
+std::vector<std::string> distinctNames(size_t count)
+{
+    std::vector<std::string> names;
+    for (size_t i = 0; i < count; ++i)
+        names.push_back("name " + std::to_string(i) + std::string(i % 50, 'x'));
+    return names;
+}
+
+} // namespace
+
+TEST(ParquetTests, testPlainPagesReadBack) {
+    ParquetWriterConfig config;
+    config.dictionary = false;
+    std::vector<std::string> names = distinctNames(5000);
+    names.push_back("");
+    names.push_back("Zoë");
+    ParquetContents contents = readParquet(writeParquet(names, config));
+    expectRows(contents, names);
+    EXPECT_EQ(0u, contents.dictionaryChunks);
+    EXPECT_EQ(1u, contents.meta[4].list.size());
+}
+
+TEST(ParquetTests, testRepeatedNamesAreDictionaryEncoded) {
+    std::vector<std::string> names;
+    for (size_t i = 0; i < 20000; ++i)
+        names.push_back("customer " + std::to_string(i * 7 % 40));
+    ParquetWriterConfig plain;
+    plain.dictionary = false;
+    std::string file = writeParquet(names, {});
+    ParquetContents contents = readParquet(file);
+    expectRows(contents, names);
+    EXPECT_EQ(2u, contents.dictionaryChunks);
+    EXPECT_LT(file.size() * 10, writeParquet(names, plain).size());
+}
+
+TEST(ParquetTests, testRunsAndWideIndices) {
+    // Runs of 20 repeats for RLE runs, 600 distinct values for 10-bit
+    // indices, and a column of one value throughout.
+    std::vector<std::string> names;
+    for (size_t i = 0; i < 30000; ++i)
+        names.push_back("customer " + std::to_string(i / 20 % 600));
+    expectRows(readParquet(writeParquet(names, {})), names);
+
+    std::vector<std::string> same(1001, "Ada");
+    ParquetContents contents = readParquet(writeParquet(same, {}));
+    expectRows(contents, same);
+    EXPECT_EQ(2u, contents.dictionaryChunks);
+}
+
+TEST(ParquetTests, testTooManyDistinctValuesFallBackToPlain) {
+    ParquetWriterConfig config;
+    config.dictionaryBytes = 4096;
+    std::vector<std::string> names = distinctNames(3000);
+    ParquetContents contents = readParquet(writeParquet(names, config));
+    expectRows(contents, names);
+    EXPECT_EQ(0u, contents.dictionaryChunks);
+}
+
+TEST(ParquetTests, testLz4Pages) {
+    ParquetWriterConfig config;
+    config.lz4 = true;
+    config.dictionary = false;
+    std::vector<std::string> names = distinctNames(5000);
+    std::string file = writeParquet(names, config);
+    ParquetContents contents = readParquet(file);
+    expectRows(contents, names);
+    EXPECT_EQ(7, contents.meta[4].list.at(0)[1].list.at(1)[3][4].number);   // LZ4_RAW
+    config.lz4 = false;
+    EXPECT_LT(file.size() * 2, writeParquet(names, config).size());
+}
+
+TEST(ParquetTests, testRowGroupsAndPagesSpanBatches) {
+    ParquetWriterConfig config;
+    config.rowGroupBytes = 64 << 10;
+    config.pageBytes = 4 << 10;
+    std::vector<std::string> names = distinctNames(20000);
+    for (bool lz4 : {false, true}) {
+        config.lz4 = lz4;
+        ParquetContents contents = readParquet(writeParquet(names, config, 777));
+        expectRows(contents, names);
+        EXPECT_GT(contents.meta[4].list.size(), 10u);
+        EXPECT_GT(contents.dataPages, 4 * contents.meta[4].list.size());
+    }
+}
+
+TEST(ParquetTests, testEmptyOutput) {
+    std::string file = writeParquet({}, {});
+    ParquetContents contents = readParquet(file);
+    EXPECT_EQ(0, contents.meta[3].number);
+    EXPECT_TRUE(contents.meta[4].list.empty());
+}
@@ -0,0 +1,291 @@
+// Performance regression checks for the hello library, registered in CTest
+// with the label "perf" (ctest -L perf runs only these, ctest -LE perf
+// skips them).
+//
+// Each benchmark runs a fixed amount of work several times. Its median time
+// is divided by the median of a calibration loop that exercises no library
+// code, so the ratio tracks the code rather than the machine it runs on,
+// and compared with the ratio checked in to perf_baseline.txt for the same
+// build configuration. A benchmark fails only when it is slower than the
+// baseline by more than the tolerance plus four times its own relative
+// median absolute deviation, so noisy runs widen the band instead of
+// failing. Benchmarks with no baseline for the configuration are reported,
+// and the run exits with skippedExit, which CTest counts as skipped rather
+// than passed.
+//
+// usage: PerfTests BASELINE [--only NAME] [--update] [--tolerance X]
+//   --update     rewrites BASELINE's lines for this configuration
+//   --tolerance  allowed slowdown as a fraction, default 0.2
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "greetingrules.h"
+#include "hdrhistogram.h"
+#include "hello.h"
+#include "namehash.h"
+#include "transliterate.h"
+
+#ifndef HELLO_PERF_CONFIG
+#define HELLO_PERF_CONFIG "default"
+#endif
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+namespace {
+
+constexpr int runs = 9;
+constexpr int skippedExit = 77;   // SKIP_RETURN_CODE in tests/CMakeLists.txt
+
+struct Benchmark
+{
+    const char * name;
+    function<uint64_t()> body;   // one run's fixed work; returns something to keep it alive
+};
+
+struct Timing
+{
+    double median = 0;
+    double mad = 0;   // median absolute deviation
+};
+
+double median(vector<double> values)
+{
+    sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+uint64_t sink = 0;
+
+Timing measure(const function<uint64_t()> & body)
+{
+    sink ^= body();   // warm-up
+    vector<double> seconds;
+    for (int run = 0; run < runs; ++run) {
+        Clock::time_point start = Clock::now();
+        sink ^= body();
+        seconds.push_back(chrono::duration<double>(Clock::now() - start).count());
+    }
+    Timing timing;
+    timing.median = median(seconds);
+    for (double & s : seconds)
+        s = abs(s - timing.median);
+    timing.mad = median(seconds);
+    return timing;
+}
+
+// Integer arithmetic and L1-resident loads, nothing from the library.
+uint64_t calibrate()
+{
+    static uint64_t table[4096];
+    uint64_t x = 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < 2'000'000; ++i) {
+        x += 0x9e3779b97f4a7c15ull;
+        uint64_t z = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        table[z & 4095] += z ^ (z >> 31);
+        x ^= table[(z >> 20) & 4095];
+    }
+    return x;
+}
+
+vector<string> makeNames(size_t count)
+{
+    vector<string> names;
+    for (size_t i = 0; i < count; ++i)
+        names.push_back((i % 3 ? "customer " : "Zoë Ångström ") + to_string(i));
+    return names;
+}
+
+vector<Benchmark> benchmarks()
+{
+    static vector<string> storage = makeNames(100'000);
+    static vector<string_view> names(storage.begin(), storage.end());
+    static vector<string_view> ascii = [] {
+        vector<string_view> v;
+        for (size_t i = 1; i < names.size(); i += 3)
+            v.push_back(names[i]);
+        return v;
+    }();
+    static vector<GreetingRule> ruleList = [] {
+        vector<GreetingRule> rules{{RuleKind::Prefix, "Dr. ", "Good day, Doctor {rest}"},
+                                   {RuleKind::Suffix, " Jr.", "Hello {rest}, junior"}};
+        for (int i = 0; i < 2000; ++i)
+            rules.push_back({RuleKind::Exact, "customer " + to_string(i * 37), "Welcome back, {name}"});
+        return rules;
+    }();
+    static GreetingRules rules(ruleList);
+
+    return {
+        {"greet",
+         [] {
+             GreetingBatch greetings;
+             for (int i = 0; i < 10; ++i) {
+                 greetings.clear();
+                 generateHelloStrings(ascii, greetings);
+             }
+             return uint64_t(greetings.text.size());
+         }},
+        {"transliterate",
+         [] {
+             vector<string_view> batch = names;
+             string transliterated;
+             transliterateNames(batch, transliterated);
+             return uint64_t(transliterated.size());
+         }},
+        {"hash",
+         [] {
+             vector<uint64_t> hashes;
+             uint64_t x = 0;
+             for (int i = 0; i < 10; ++i) {
+                 hashNames(names, hashes, i);
+                 x ^= hashes.back();
+             }
+             return x;
+         }},
+        {"siphash",
+         [] {
+             vector<uint64_t> hashes;
+             sipHashNames(names, SipHashKey{1, 2}, hashes);
+             return hashes.back();
+         }},
+        {"rules",
+         [] {
+             GreetingBatch greetings;
+             for (int i = 0; i < 3; ++i) {
+                 greetings.clear();
+                 rules.greet(ascii, greetings);
+             }
+             return uint64_t(greetings.text.size());
+         }},
+        {"histogram",
+         [] {
+             HdrHistogram histogram;
+             uint64_t x = 1;
+             for (int i = 0; i < 1'000'000; ++i) {
+                 x = x * 6364136223846793005ull + 1442695040888963407ull;
+                 histogram.record((x >> 40) + 1);
+             }
+             return histogram.valueAtPercentile(99);
+         }},
+    };
+}
+
+// Baseline lines are "config name ratio"; # starts a comment.
+map<string, double> loadBaseline(const string & path, vector<string> & otherLines)
+{
+    map<string, double> ratios;
+    ifstream in(path);
+    string line;
+    while (getline(in, line)) {
+        istringstream fields(line);
+        string config, name;
+        double ratio;
+        if (line.empty() || line[0] == '#' || !(fields >> config >> name >> ratio) || config != HELLO_PERF_CONFIG)
+            otherLines.push_back(line);
+        else
+            ratios[name] = ratio;
+    }
+    return ratios;
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: PerfTests BASELINE [--only NAME] [--update] [--tolerance X]\n");
+        return 2;
+    }
+    string baselinePath = argv[1];
+    string only;
+    bool update = false;
+    double tolerance = 0.2;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--only" && i + 1 < argc)
+            only = argv[++i];
+        else if (arg == "--update")
+            update = true;
+        else if (arg == "--tolerance" && i + 1 < argc)
+            tolerance = atof(argv[++i]);
+        else {
+            fprintf(stderr, "PerfTests: unknown argument '%s'\n", arg.c_str());
+            return 2;
+        }
+    }
+
+    vector<string> otherLines;
+    map<string, double> baseline = loadBaseline(baselinePath, otherLines);
+    Timing calibration = measure(calibrate);
+    printf("config %s, calibration %.3f ms (MAD %.3f ms)\n", HELLO_PERF_CONFIG, calibration.median * 1e3,
+           calibration.mad * 1e3);
+
+    int failures = 0;
+    int unmeasured = 0;
+    bool found = false;
+    map<string, double> measured;
+    for (const Benchmark & benchmark : benchmarks()) {
+        if (!only.empty() && only != benchmark.name)
+            continue;
+        found = true;
+        Timing timing = measure(benchmark.body);
+        double ratio = timing.median / calibration.median;
+        double noise = timing.mad / timing.median + calibration.mad / calibration.median;
+        measured[benchmark.name] = ratio;
+        printf("%-14s %9.3f ms  ratio %.4f  noise %4.1f%%", benchmark.name, timing.median * 1e3, ratio, noise * 100);
+        auto expected = baseline.find(benchmark.name);
+        if (expected == baseline.end()) {
+            printf("  no baseline\n");
+            ++unmeasured;
+            continue;
+        }
+        double limit = expected->second * (1 + tolerance + 4 * noise);
+        bool regressed = ratio > limit;
+        printf("  baseline %.4f  limit %.4f  %s\n", expected->second, limit, regressed ? "REGRESSED" : "ok");
+        failures += regressed;
+    }
+    if (!found) {
+        fprintf(stderr, "PerfTests: no benchmark named '%s'\n", only.c_str());
+        return 2;
+    }
+
+    if (update) {
+        for (const auto & [name, ratio] : measured)
+            baseline[name] = ratio;
+        ofstream out(baselinePath);
+        for (const string & line : otherLines)
+            out << line << '\n';
+        for (const auto & [name, ratio] : baseline) {
+            char line[128];
+            snprintf(line, sizeof line, "%s %s %.4f\n", HELLO_PERF_CONFIG, name.c_str(), ratio);
+            out << line;
+        }
+        if (!out) {
+            fprintf(stderr, "PerfTests: cannot write %s\n", baselinePath.c_str());
+            return 1;
+        }
+        printf("updated %s\n", baselinePath.c_str());
+        return 0;
+    }
+    if (sink == 42)
+        puts("");
+    if (failures)
+        return 1;
+    // Nothing to compare against is not a pass: ctest reports it as skipped.
+    if (unmeasured) {
+        printf("no %s baseline; record one with --update\n", HELLO_PERF_CONFIG);
+        return skippedExit;
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include <cstdint>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "jsonvalue.h"
+#include "options.h"
+#include "stats.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+std::string report(const RunStats & stats, bool json)
+{
+    std::ostringstream out;
+    writeStatsReport(out, stats, 1.5, json);
+    return out.str();
+}
+
+JsonValue jsonReport(const RunStats & stats)
+{
+    std::string text = report(stats, true);
+    EXPECT_EQ(text.size() - 1, text.find('\n')) << "not one line: " << text;
+    return parseJson(text);
+}
+
+}
+
+TEST(StatsTests, testAllocationsAreChargedToTheirStage) {
+    enableStats();
+    RunStats stats;
+    JsonValue before = jsonReport(stats);
+
+    constexpr size_t blocks = 16;
+    constexpr size_t blockBytes = 1000;
+    std::vector<void *> allocated;
+    allocated.reserve(blocks);
+    {
+        StageScope stage(Stage::Sort);
+        for (size_t i = 0; i < blocks; ++i)
+            allocated.push_back(::operator new(blockBytes));
+    }
+    JsonValue during = jsonReport(stats);
+    for (void * p : allocated)
+        ::operator delete(p);
+    JsonValue after = jsonReport(stats);
+
+    // Nothing else in this binary sorts, so the stage's counts are exact.
+    auto sortCount = [](const JsonValue & report, const char * key) {
+        return report["stages"]["sort"][key].number;
+    };
+    EXPECT_EQ(double(blocks), sortCount(during, "allocations") - sortCount(before, "allocations"));
+    EXPECT_EQ(double(blocks * blockBytes), sortCount(during, "allocated_bytes") - sortCount(before, "allocated_bytes"));
+    EXPECT_EQ(sortCount(during, "allocations"), sortCount(after, "allocations"));
+    EXPECT_GE(during["heap"]["allocations"].number - before["heap"]["allocations"].number, double(blocks));
+    EXPECT_GE(after["heap"]["frees"].number - during["heap"]["frees"].number, double(blocks));
+
+    // All the blocks were live at once, and the high-water mark does not
+    // fall when they are freed.
+    const JsonValue & peak = during["heap"]["peak_live_bytes"];
+    if (peak.type != JsonValue::Type::Null) {
+        EXPECT_GE(peak.number, double(blocks * blockBytes));
+        EXPECT_GE(after["heap"]["peak_live_bytes"].number, peak.number);
+    }
+}
+
+TEST(StatsTests, testBufferHighWaterMarks) {
+    RunStats stats;
+    stats.noteBuffer(Stage::Read, 4000);
+    stats.noteBuffer(Stage::Read, 9000);
+    stats.noteBuffer(Stage::Read, 2000);
+    stats.noteBuffer(Stage::Write, 100);
+    JsonValue json = jsonReport(stats);
+    EXPECT_EQ(9000, json["stages"]["read"]["largest_buffer_bytes"].number);
+    EXPECT_EQ(15000, json["stages"]["read"]["buffer_high_water_bytes"].number);
+    EXPECT_EQ(100, json["stages"]["write"]["buffer_high_water_bytes"].number);
+    EXPECT_EQ(0, json["stages"]["merge"]["buffer_high_water_bytes"].number);
+}
+
+TEST(StatsTests, testJsonReportIsOneLineWithTheDocumentedKeys) {
+    std::vector<std::string> argv = {"main", "--stats=json"};
+    std::vector<char *> args;
+    for (std::string & arg : argv)
+        args.push_back(arg.data());
+    EXPECT_EQ("json", parseOptions(int(args.size()), args.data()).stats);
+
+    RunStats stats;
+    stats.records = 7;
+    stats.skippedRecords = 2;
+    stats.teeDroppedBytes = 5;
+    JsonValue json = jsonReport(stats);
+    ASSERT_EQ(JsonValue::Type::Object, json.type);
+    for (const char * key : {"wall_seconds", "user_cpu_seconds", "system_cpu_seconds", "peak_rss_bytes",
+                             "minor_faults", "major_faults", "records", "input_bytes", "output_bytes",
+                             "skipped_records", "distinct_names", "spill_files", "spill_bytes",
+                             "tee_dropped_bytes", "tee_spilled_bytes"})
+        EXPECT_EQ(JsonValue::Type::Number, json[key].type) << key;
+    for (const char * key : {"allocations", "allocated_bytes", "frees"})
+        EXPECT_EQ(JsonValue::Type::Number, json["heap"][key].type) << key;
+    EXPECT_TRUE(json["heap"].has("peak_live_bytes"));
+    EXPECT_EQ(1.5, json["wall_seconds"].number);
+    EXPECT_EQ(7, json["records"].number);
+    EXPECT_EQ(2, json["skipped_records"].number);
+    EXPECT_EQ(5, json["tee_dropped_bytes"].number);
+
+    EXPECT_EQ(size_t(Stage::Count), json["stages"].object.size());
+    for (size_t s = 0; s < size_t(Stage::Count); ++s) {
+        const JsonValue & stage = json["stages"][stageName(Stage(s))];
+        for (const char * key : {"allocations", "allocated_bytes", "minor_faults", "major_faults",
+                                 "largest_buffer_bytes", "buffer_high_water_bytes"})
+            EXPECT_EQ(JsonValue::Type::Number, stage[key].type) << stageName(Stage(s)) << "." << key;
+    }
+}
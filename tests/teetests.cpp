@@ -0,0 +1,173 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "tee.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+std::string tempPath(const char * name) { return ::testing::TempDir() + name; }
+
+std::string readFile(const std::string & path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// Buffer i: whole records, each naming its buffer, about 1K in all.
+std::string bufferContents(size_t i)
+{
+    std::string text;
+    for (int line = 0; text.size() < 1000; ++line)
+        text += "buffer " + std::to_string(i) + " line " + std::to_string(line) + "\n";
+    return text;
+}
+
+Options teeOptions(const std::string & target, const std::string & policy, const std::string & spillDir)
+{
+    std::filesystem::remove_all(spillDir);
+    std::filesystem::create_directories(spillDir);
+    Options options;
+    options.tee = {{target, policy}};
+    options.teeBuffer = 4 << 10;
+    options.spillDir = spillDir;
+    return options;
+}
+
+// Writes count buffers through a Tee and finishes it; returns what was
+// written, concatenated.
+std::string writeBuffers(const Options & options, RunStats & stats, size_t count)
+{
+    std::string written;
+    Tee tee(options, stats);
+    for (size_t i = 0; i < count; ++i) {
+        std::shared_ptr<std::string> buffer = tee.buffer();
+        *buffer = bufferContents(i);
+        written += *buffer;
+        tee.write(buffer);
+    }
+    tee.finish();
+    return written;
+}
+
+// A sink that reads nothing for a while, so the pipe and then the queue
+// fill up, and then copies everything to path.
+std::string slowSink(const std::string & path) { return "|sleep 0.3; cat > '" + path + "'"; }
+
+}
+
+TEST(TeeTests, testFileSinkGetsEveryBuffer) {
+    std::string path = tempPath("tee_file.txt");
+    Options options = teeOptions(path, "block", tempPath("tee_spill_file"));
+    RunStats stats;
+    std::string written = writeBuffers(options, stats, 100);
+    EXPECT_EQ(written, readFile(path));
+    std::remove(path.c_str());
+    std::filesystem::remove_all(options.spillDir);
+}
+
+TEST(TeeTests, testBlockPolicyWaitsForASlowSink) {
+    std::string path = tempPath("tee_block.txt");
+    Options options = teeOptions(slowSink(path), "block", tempPath("tee_spill_block"));
+    RunStats stats;
+    std::string written = writeBuffers(options, stats, 300);
+    EXPECT_EQ(written, readFile(path));
+    EXPECT_EQ(0u, stats.teeDroppedBytes.load());
+    EXPECT_EQ(0u, stats.teeSpilledBytes.load());
+    std::remove(path.c_str());
+    std::filesystem::remove_all(options.spillDir);
+}
+
+TEST(TeeTests, testDropPolicyLosesWholeBuffersOnly) {
+    std::string path = tempPath("tee_drop.txt");
+    Options options = teeOptions(slowSink(path), "drop", tempPath("tee_spill_drop"));
+    RunStats stats;
+    const size_t count = 300;
+    std::string written = writeBuffers(options, stats, count);
+    std::string received = readFile(path);
+    EXPECT_GT(stats.teeDroppedBytes.load(), 0u);
+    EXPECT_EQ(written.size(), received.size() + stats.teeDroppedBytes.load());
+
+    // What arrived is some of the buffers, each whole, in their order.
+    size_t at = 0;
+    for (size_t i = 0; i < count && at < received.size(); ++i) {
+        std::string buffer = bufferContents(i);
+        if (received.compare(at, buffer.size(), buffer) == 0)
+            at += buffer.size();
+    }
+    EXPECT_EQ(received.size(), at);
+    std::remove(path.c_str());
+    std::filesystem::remove_all(options.spillDir);
+}
+
+TEST(TeeTests, testSpillPolicyKeepsEverythingInOrder) {
+    std::string path = tempPath("tee_spill.txt");
+    std::string spillDir = tempPath("tee_spill_spill");
+    Options options = teeOptions(slowSink(path), "spill", spillDir);
+    RunStats stats;
+    std::string written = writeBuffers(options, stats, 300);
+    EXPECT_GT(stats.teeSpilledBytes.load(), 0u);
+    EXPECT_EQ(0u, stats.teeDroppedBytes.load());
+    EXPECT_EQ(written, readFile(path));
+    // The spill file was never visible, and is gone with the sink.
+    EXPECT_TRUE(std::filesystem::is_empty(spillDir));
+    std::remove(path.c_str());
+    std::filesystem::remove_all(spillDir);
+}
+
+TEST(TeeTests, testSpillingAgainAfterADrainKeepsOrder) {
+    std::string path = tempPath("tee_spill_again.txt");
+    Options options = teeOptions(slowSink(path), "spill", tempPath("tee_spill_again"));
+    RunStats stats;
+    std::string written;
+    {
+        Tee tee(options, stats);
+        // Two bursts with a pause between them, so the sink drains the
+        // first burst's spill before the second one spills.
+        for (int burst = 0; burst < 2; ++burst) {
+            for (size_t i = 0; i < 150; ++i) {
+                std::shared_ptr<std::string> buffer = tee.buffer();
+                *buffer = bufferContents(burst * 150 + i);
+                written += *buffer;
+                tee.write(buffer);
+            }
+            if (burst == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(600));
+        }
+        tee.finish();
+    }
+    EXPECT_EQ(written, readFile(path));
+    std::remove(path.c_str());
+    std::filesystem::remove_all(options.spillDir);
+}
+
+TEST(TeeTests, testSinkThatClosesEarlyFailsTheRun) {
+    for (const char * policy : {"block", "drop", "spill"}) {
+        std::string path = tempPath("tee_early.txt");
+        Options options = teeOptions("|head -c 10 > '" + path + "'", policy, tempPath("tee_spill_early"));
+        RunStats stats;
+        EXPECT_THROW(writeBuffers(options, stats, 2000), std::system_error) << policy;
+        EXPECT_EQ(bufferContents(0).substr(0, 10), readFile(path)) << policy;
+        std::remove(path.c_str());
+        std::filesystem::remove_all(options.spillDir);
+    }
+}
+
+TEST(TeeTests, testFailingCommandIsReported) {
+    Options options = teeOptions("|cat > /dev/null; exit 3", "block", tempPath("tee_spill_exit"));
+    RunStats stats;
+    try {
+        writeBuffers(options, stats, 10);
+        FAIL() << "no error";
+    } catch (const std::runtime_error & e) {
+        EXPECT_NE(std::string::npos, std::string(e.what()).find("status 3")) << e.what();
+    }
+    std::filesystem::remove_all(options.spillDir);
+}
@@ -0,0 +1,83 @@
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "jsonvalue.h"
+#include "pipeline.h"
+#include "trace.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+std::string tempPath(const char * name) { return ::testing::TempDir() + name; }
+
+}
+
+TEST(TraceTests, testPipelineTraceNamesThreadsAndOrdersWrites) {
+    std::string input = tempPath("trace-input.txt");
+    {
+        std::ofstream out(input, std::ios::binary);
+        for (int i = 0; i < 20000; ++i)
+            out << "name " << i << "\n";
+    }
+    Options options;
+    options.inputPath = input;
+    options.outputPath = tempPath("trace-output.txt");
+    options.threads = 2;
+    options.chunkSize = 4 << 10;   // a few dozen chunks
+
+    enableTracing();
+    RunStats stats;
+    runPipeline(options, stats);
+    std::ostringstream trace;
+    writeChromeTrace(trace);
+
+    JsonValue document = parseJson(trace.str());
+    EXPECT_EQ("ms", document["displayTimeUnit"].string);
+    std::map<int64_t, std::string> threadNames;
+    std::map<int64_t, std::vector<const JsonValue *>> spans;
+    for (const JsonValue & event : document["traceEvents"].array) {
+        int64_t tid = int64_t(event["tid"].number);
+        if (event["ph"].string == "M") {
+            ASSERT_EQ("thread_name", event["name"].string);
+            EXPECT_TRUE(threadNames.emplace(tid, event["args"]["name"].string).second) << "tid " << tid;
+        } else {
+            ASSERT_EQ("X", event["ph"].string);
+            EXPECT_GE(event["dur"].number, 0);
+            spans[tid].push_back(&event);
+        }
+    }
+
+    // Every thread that recorded spans is named, and the pipeline's all are there.
+    for (const auto & [tid, events] : spans)
+        EXPECT_TRUE(threadNames.count(tid)) << "tid " << tid << " has spans but no thread_name";
+    std::map<std::string, int64_t> tids;
+    for (const auto & [tid, name] : threadNames)
+        tids[name] = tid;
+    for (const char * name : {"reader", "worker-1", "worker-2", "writer"})
+        EXPECT_TRUE(tids.count(name)) << name;
+
+    std::set<std::string> spanNames;
+    for (const auto & [tid, events] : spans)
+        for (const JsonValue * event : events)
+            spanNames.insert((*event)["name"].string);
+    for (const char * name : {"read", "greet", "write"})
+        EXPECT_TRUE(spanNames.count(name)) << name;
+
+    // The writer puts chunks back in input order, each once.
+    int64_t last = -1;
+    size_t writes = 0;
+    for (const JsonValue * event : spans[tids["writer"]]) {
+        if (!event->has("args"))
+            continue;
+        int64_t chunk = int64_t((*event)["args"]["chunk"].number);
+        EXPECT_EQ(last + 1, chunk);
+        last = chunk;
+        ++writes;
+    }
+    EXPECT_GT(writes, 10u);
+}
@@ -0,0 +1,61 @@
+#include "gtest/gtest.h"
+#include "hello.h"
+#include "transliterate.h"
+
+TEST(TransliterateTests, testLatinDiacritics) {
+    EXPECT_EQ("Zoe Angstrom", transliterateToAscii("Zoë Ångström"));
+    EXPECT_EQ("Francois Muller-Ludenscheidt", transliterateToAscii("François Müller-Lüdenscheidt"));
+    EXPECT_EQ("Dvorak", transliterateToAscii("Dvořák"));
+    EXPECT_EQ("Nguyen Van Duc", transliterateToAscii("Nguyễn Văn Đức"));
+}
+
+TEST(TransliterateTests, testLettersWithoutDecomposition) {
+    EXPECT_EQ("Strasse", transliterateToAscii("Straße"));
+    EXPECT_EQ("Soren Kierkegaard", transliterateToAscii("Søren Kierkegaard"));
+    EXPECT_EQ("Lodz", transliterateToAscii("Łódź"));
+    EXPECT_EQ("AEsir", transliterateToAscii("Æsir"));
+}
+
+TEST(TransliterateTests, testGreekAndCyrillic) {
+    EXPECT_EQ("Sokratis", transliterateToAscii("Σωκράτης"));
+    EXPECT_EQ("Shchukin", transliterateToAscii("Щукин"));
+    EXPECT_EQ("Yuliya", transliterateToAscii("Юлия"));
+}
+
+TEST(TransliterateTests, testPunctuationAndDecomposedInput) {
+    EXPECT_EQ("O'Neil - \"Jr.\"", transliterateToAscii("O’Neil — “Jr.”"));
+    EXPECT_EQ("Zoe", transliterateToAscii("Zoe\xcc\x88"));
+}
+
+TEST(TransliterateTests, testUnmappedAndInvalidBecomeQuestionMarks) {
+    EXPECT_EQ("? ?", transliterateToAscii("李 😀"));
+    EXPECT_EQ("a?b", transliterateToAscii("a\xff" "b"));
+    EXPECT_EQ("a?", transliterateToAscii("a\xc3"));
+    EXPECT_EQ("??", transliterateToAscii("\xc0\xaf"));
+    EXPECT_EQ("???", transliterateToAscii("\xed\xa0\x80"));
+}
+
+TEST(TransliterateTests, testAsciiPassesThroughAtEveryLength) {
+    std::string text;
+    for (size_t length = 0; length < 80; ++length) {
+        EXPECT_EQ(text, transliterateToAscii(text));
+        EXPECT_EQ(length, asciiPrefixLength(text));
+        EXPECT_EQ(length, asciiPrefixLength(text + "é"));
+        text += char('a' + length % 26);
+    }
+}
+
+TEST(TransliterateTests, testBatchRepointsOnlyNonAscii) {
+    std::string jim = "Jim";
+    std::vector<std::string_view> names = {jim, "Zoë", "", "Åsa"};
+    std::string storage;
+    transliterateNames(names, storage);
+    EXPECT_EQ(jim.data(), names[0].data());
+    EXPECT_EQ("Zoe", names[1]);
+    EXPECT_EQ("", names[2]);
+    EXPECT_EQ("Asa", names[3]);
+
+    GreetingBatch greetings;
+    generateHelloStrings(names, greetings);
+    EXPECT_EQ("Hello Zoe", greetings[1]);
+}
@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""Generates hello/src/translittables.inc, the code point to ASCII tables
+used by transliterateToAscii.
+
+usage: tools/gentranslit.py > hello/src/translittables.inc
+
+Mappings come from the NFKD decomposition with combining marks removed,
+plus the explicit tables below for letters that do not decompose and for
+Greek and Cyrillic. The output depends on the Python unicodedata version,
+which is recorded in the generated file.
+"""
+
+import unicodedata
+
+RANGES = [
+    (0x0080, 0x024F),  # Latin-1 Supplement, Latin Extended-A and -B
+    (0x0300, 0x036F),  # combining diacritical marks (dropped)
+    (0x0370, 0x03FF),  # Greek
+    (0x0400, 0x04FF),  # Cyrillic
+    (0x1E00, 0x1EFF),  # Latin Extended Additional
+    (0x2000, 0x206F),  # General Punctuation
+    (0x2070, 0x209F),  # superscripts and subscripts
+    (0x20A0, 0x20CF),  # currency symbols
+    (0x2100, 0x218F),  # letterlike symbols, number forms
+    (0xFF00, 0xFF5E),  # fullwidth ASCII
+]
+
+EXPLICIT = {
+    'ß': 'ss', 'ẞ': 'SS', 'Æ': 'AE', 'æ': 'ae', 'Ø': 'O', 'ø': 'o', 'Œ': 'OE', 'œ': 'oe',
+    'Đ': 'D', 'đ': 'd', 'Ð': 'D', 'ð': 'd', 'Þ': 'Th', 'þ': 'th', 'Ł': 'L', 'ł': 'l',
+    'Ħ': 'H', 'ħ': 'h', 'ı': 'i', 'Ŋ': 'NG', 'ŋ': 'ng', 'ſ': 's', 'Ŧ': 'T', 'ŧ': 't',
+    'Ƒ': 'F', 'ƒ': 'f', 'ĸ': 'q', '×': 'x', '÷': '/', '«': '<<', '»': '>>', '©': '(C)',
+    '®': '(R)', '°': 'o', '±': '+/-', '·': '.', '¡': '!', '¿': '?', '¢': 'c', '£': 'GBP',
+    '¥': 'JPY', '€': 'EUR', '§': 'S', '¶': 'P', '¬': '!', '¦': '|', '­': '',
+    '‐': '-', '‑': '-', '‒': '-', '–': '-', '—': '-', '―': '-', '‘': "'", '’': "'",
+    '‚': ',', '‛': "'", '“': '"', '”': '"', '„': '"', '‟': '"', '†': '+', '•': '*',
+    '′': "'", '″': '"', '‹': '<', '›': '>', '⁄': '/', '​': '', '‌': '',
+    '‍': '', '⁠': '', '№': 'No', '™': 'TM', '℠': 'SM',
+}
+
+GREEK = dict(zip('ΑΒΓΔΕΖΗΘΙΚΛΜΝΞΟΠΡΣΤΥΦΧΨΩ',
+                 'A B G D E Z I Th I K L M N X O P R S T Y F Ch Ps O'.split()))
+CYRILLIC = dict(zip('АБВГДЕЁЖЗИЙКЛМНОПРСТУФХЦЧШЩЪЫЬЭЮЯЄІЇҐЎЈЉЊЋЏ',
+                    ('A B V G D E Yo Zh Z I Y K L M N O P R S T U F Kh Ts Ch Sh Shch - Y - E Yu Ya '
+                     'Ye I Yi G U J Lj Nj C Dz').split()))
+
+for table in (GREEK, CYRILLIC):
+    for upper, ascii_ in list(table.items()):
+        ascii_ = '' if ascii_ == '-' else ascii_
+        table[upper] = ascii_
+        table[upper.lower()] = ascii_.lower()
+GREEK['ς'] = 's'
+EXPLICIT.update(GREEK)
+EXPLICIT.update(CYRILLIC)
+
+MAX_LENGTH = 7
+PAGE_BITS = 6
+
+
+def transliterate(ch, depth=0):
+    if ord(ch) < 0x80:
+        return ch
+    if ch in EXPLICIT:
+        return EXPLICIT[ch]
+    if unicodedata.combining(ch):
+        return ''
+    decomposed = unicodedata.normalize('NFKD', ch)
+    if decomposed == ch or depth > 2:
+        return None
+    parts = [transliterate(c, depth + 1) for c in decomposed]
+    if any(p is None for p in parts):
+        return None
+    return ''.join(parts)
+
+
+def c_string(text):
+    return '"' + ''.join('\\"' if c == '"' else '\\\\' if c == '\\' else c for c in text) + '"'
+
+
+def main():
+    mapping = {}
+    for first, last in RANGES:
+        for cp in range(first, last + 1):
+            ascii_ = transliterate(chr(cp))
+            if ascii_ is not None and len(ascii_) <= MAX_LENGTH and ascii_.isascii():
+                mapping[cp] = ascii_
+
+    pool = ''
+    offsets = {}
+    for text in sorted(set(mapping.values()), key=lambda t: (-len(t), t)):
+        where = pool.find(text)
+        if where < 0:
+            where = len(pool)
+            pool += text
+        offsets[text] = where
+    assert len(pool) < 1 << 13
+
+    pages = {}
+    for cp, text in mapping.items():
+        pages.setdefault(cp >> PAGE_BITS, [0xFFFF] * (1 << PAGE_BITS))[cp & ((1 << PAGE_BITS) - 1)] = \
+            offsets[text] << 3 | len(text)
+    page_ids = {page: i + 1 for i, page in enumerate(sorted(pages))}
+    assert len(page_ids) < 256
+
+    print('// Generated by tools/gentranslit.py from Unicode %s data. Do not edit.' % unicodedata.unidata_version)
+    print('// Entry = pool offset << 3 | length; 0xffff = no ASCII rendering.')
+    print()
+    print('static constexpr int translitPageBits = %d;' % PAGE_BITS)
+    print()
+    print('static const char translitPool[] =')
+    for i in range(0, len(pool), 64):
+        print('    ' + c_string(pool[i:i + 64]))
+    print('    ;')
+    print()
+    print('// Page of each BMP code point >> translitPageBits; 0 = unmapped.')
+    print('static const unsigned char translitPageIndex[%d] = {' % (0x10000 >> PAGE_BITS))
+    index = [page_ids.get(page, 0) for page in range(0x10000 >> PAGE_BITS)]
+    for i in range(0, len(index), 32):
+        print('    ' + ', '.join(str(v) for v in index[i:i + 32]) + ',')
+    print('};')
+    print()
+    print('static const unsigned short translitPages[%d][%d] = {' % (len(pages) + 1, 1 << PAGE_BITS))
+    print('    {  // unmapped')
+    for i in range(0, 1 << PAGE_BITS, 8):
+        print('        ' + ', '.join(['0xffff'] * 8) + ',')
+    print('    },')
+    for page in sorted(pages):
+        entries = pages[page]
+        print('    {  // U+%04X' % (page << PAGE_BITS))
+        for i in range(0, len(entries), 8):
+            print('        ' + ', '.join('0x%04x' % e for e in entries[i:i + 8]) + ',')
+        print('    },')
+    print('};')
+
+
+if __name__ == '__main__':
+    main()